@@ -0,0 +1,133 @@
+#include "cartridge.h"
+#include "controller.h"
+#include "cpu.h"
+#include "memory.h"
+#include "pool.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * @brief Instructions run per input, unimplemented opcodes take no cycles
+ * so the run is bounded in steps rather than cycles
+ */
+#define _FUZZ_STEPS 16384U
+
+/*
+ * @brief Steps each button pair of the input is held for
+ */
+#define _FUZZ_INPUT_STEPS 1024U
+
+/*
+ * @brief Coverage counters, a power of two
+ */
+#define _FUZZ_EDGES 65536U
+
+/*
+ * @brief Template image: an NROM-256 PRG of zeros whose vectors all point
+ * at CARTRIDGE_NROM_ROM_START, where the input's code is patched in
+ */
+#define _FUZZ_PRG_SIZE CARTRIDGE_NROM_ROM_SIZE
+#define _FUZZ_CODE_SIZE (_FUZZ_PRG_SIZE - 6U)
+
+static uint8_t _fuzz_rom[CARTRIDGE_INES_HEADER_SIZE + _FUZZ_PRG_SIZE + CARTRIDGE_INES_CHR_BANK_SIZE];
+
+/*
+ * @brief Consoles reset from the post-boot state of the template
+ */
+static pool_t *_fuzz_pool;
+
+/*
+ * @brief Edges between consecutive opcode and PC pairs, read by libFuzzer
+ * as extra coverage on top of the compiler's own
+ */
+__attribute__((used, section("__libfuzzer_extra_counters")))
+static uint8_t _fuzz_edges[_FUZZ_EDGES];
+
+static pool_t *_fuzz_init() {
+    static const pool_config_t config = { .boot_frames = 0, .warm = 1, .capacity = 1 };
+    uint8_t *prg = _fuzz_rom + CARTRIDGE_INES_HEADER_SIZE;
+
+    memcpy(_fuzz_rom, CARTRIDGE_INES_MAGIC, 4);
+    _fuzz_rom[4] = _FUZZ_PRG_SIZE / CARTRIDGE_INES_PRG_BANK_SIZE;
+    _fuzz_rom[5] = 1;
+
+    for (uint32_t vector = NMI_ADDR_LO; vector <= 0xFFFF; vector += 2) {
+        prg[vector - CARTRIDGE_NROM_ROM_START] = CARTRIDGE_NROM_ROM_START & 0xFF;
+        prg[vector + 1 - CARTRIDGE_NROM_ROM_START] = CARTRIDGE_NROM_ROM_START >> 8;
+    }
+
+    return pool_create(_fuzz_rom, sizeof(_fuzz_rom), &config);
+}
+
+/*
+ * @brief Opcode at an address, read without side effects
+ */
+static uint8_t _fuzz_opcode(uint16_t address) {
+    if (address >= CARTRIDGE_START) {
+        return cartridge_read(address);
+    }
+    if (address < MEMORY_PPU_REG_BASE) {
+        return memory_get_ram()[address & (MEMORY_RAM_SIZE - 1)];
+    }
+    return 0;
+}
+
+/*
+ * @brief Run one input
+ *
+ * The first byte is the number of button pairs that follow, each pair
+ * (port 1, port 2) held for _FUZZ_INPUT_STEPS steps. The rest is code
+ * patched in at CARTRIDGE_NROM_ROM_START, where the CPU starts.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    const uint8_t *buttons = data + 1, *code;
+    size_t pairs, code_size;
+    uint32_t previous = 0;
+    nes_t *nes;
+    cpu_t cpu;
+
+    if (!size || (!_fuzz_pool && !(_fuzz_pool = _fuzz_init()))) {
+        return 0;
+    }
+
+    pairs = data[0];
+    if (pairs * CONTROLLER_PORTS > size - 1) {
+        pairs = (size - 1) / CONTROLLER_PORTS;
+    }
+    code = buttons + pairs * CONTROLLER_PORTS;
+    code_size = data + size - code;
+    if (code_size > _FUZZ_CODE_SIZE) {
+        code_size = _FUZZ_CODE_SIZE;
+    }
+
+    if (!(nes = pool_acquire(_fuzz_pool))) {
+        return 0;
+    }
+    nes_bind(nes);
+    cartridge_patch_rom(CARTRIDGE_NROM_ROM_START, code, code_size);
+
+    for (uint32_t step = 0; step < _FUZZ_STEPS; step++) {
+        uint32_t location;
+
+        if (step % _FUZZ_INPUT_STEPS == 0 && step / _FUZZ_INPUT_STEPS < pairs) {
+            for (uint8_t port = 0; port < CONTROLLER_PORTS; port++) {
+                controller_set_buttons(port, *buttons++);
+            }
+        }
+
+        cpu_get_state(&cpu);
+        location = (cpu.pc ^ (_fuzz_opcode(cpu.pc) << 8) ^ (cpu.pc >> 5)) & (_FUZZ_EDGES - 1);
+        _fuzz_edges[location ^ previous]++;
+        previous = location >> 1;
+
+        cpu_step();
+    }
+
+    /* Put the template back for the next input */
+    cartridge_patch_rom(CARTRIDGE_NROM_ROM_START,
+        _fuzz_rom + CARTRIDGE_INES_HEADER_SIZE, code_size);
+    pool_release(_fuzz_pool, nes);
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static uint8_t *_driver_read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    uint8_t *data = NULL;
+    long length;
+
+    if (!file) {
+        return NULL;
+    }
+
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) >= 0 &&
+            fseek(file, 0, SEEK_SET) == 0 && (data = malloc(length ? length : 1))) {
+        if (fread(data, 1, length, file) == (size_t)length) {
+            *size = length;
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    fclose(file);
+    return data;
+}
+
+/*
+ * @brief Replay inputs through a harness built without libFuzzer, e.g.
+ * crashes or a corpus under gcc's sanitizers. -r repeats every input and
+ * reports the rate.
+ */
+int main(int argc, char **argv) {
+    struct timespec start, end;
+    unsigned long repeat = 1, runs = 0;
+    int first = 1;
+
+    if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+        repeat = strtoul(argv[2], NULL, 10);
+        first = 3;
+    }
+    if (first >= argc) {
+        fprintf(stderr, "usage: %s [-r repeat] <input>...\n", argv[0]);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = first; i < argc; i++) {
+        size_t size;
+        uint8_t *data = _driver_read_file(argv[i], &size);
+
+        if (!data) {
+            fprintf(stderr, "%s: cannot read\n", argv[i]);
+            return 1;
+        }
+        for (unsigned long r = 0; r < repeat; r++) {
+            LLVMFuzzerTestOneInput(data, size);
+            runs++;
+        }
+        free(data);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+    fprintf(stderr, "%lu runs, %.0f runs/s\n", runs, runs / seconds);
+    return 0;
+}
@@ -0,0 +1,134 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nes_conf.h"
+
+/*
+ * @brief Slots are cache line aligned, the arena is reserved in whole huge
+ * pages
+ */
+#define ARENA_ALIGN 64U
+#define ARENA_HUGE_PAGE_SIZE (2U << 20)
+
+/*
+ * @brief Pages backing an arena
+ *
+ * @value ARENA_PAGES_NORMAL Base pages, huge pages are not available
+ * @value ARENA_PAGES_TRANSPARENT Transparent huge pages, advised with
+ * madvise(MADV_HUGEPAGE)
+ * @value ARENA_PAGES_HUGETLB Reserved huge pages, mapped with MAP_HUGETLB
+ */
+typedef enum {
+    ARENA_PAGES_NORMAL = 0x00,
+    ARENA_PAGES_TRANSPARENT = 0x01,
+    ARENA_PAGES_HUGETLB = 0x02,
+} arena_pages_e;
+
+/*
+ * @brief Arena counters
+ *
+ * @attribute slots Number of slots
+ * @attribute used Slots allocated
+ * @attribute slot_size Size of a slot
+ * @attribute size Size of the mapping
+ * @attribute pages Pages backing the mapping
+ */
+typedef struct {
+    uint64_t slots;
+    uint64_t used;
+    uint64_t slot_size;
+    uint64_t size;
+    arena_pages_e pages;
+} arena_stats_t;
+
+/*
+ * @brief Fixed size slots carved from one mapping
+ *
+ * Slots never used are handed out in address order, freed ones are kept
+ * on a list threaded through the slots themselves.
+ *
+ * @warning The fields should not be used outside of the arena module
+ *
+ * @attribute base The mapping
+ * @attribute size Size of the mapping
+ * @attribute slot_size Size of a slot, a multiple of ARENA_ALIGN
+ * @attribute slots Number of slots
+ * @attribute next First slot never used
+ * @attribute free Freed slots
+ * @attribute used Slots allocated
+ * @attribute pages Pages backing the mapping
+ * @attribute lock Guards next, free and used
+ */
+typedef struct {
+    uint8_t *base;
+    size_t size;
+    size_t slot_size;
+    size_t slots;
+    size_t next;
+    void *free;
+    size_t used;
+    arena_pages_e pages;
+    pthread_mutex_t lock;
+} arena_t;
+
+#ifdef NES_CONF_ARENA_ENABLE
+
+/*
+ * @brief Map an arena, on huge pages when the system has them
+ *
+ * Memory is only touched as slots are first used.
+ *
+ * @param slot_size Size of a slot, rounded up to ARENA_ALIGN
+ * @param slots Number of slots
+ *
+ * @return The arena, NULL on failure
+ */
+arena_t *arena_create(size_t slot_size, size_t slots);
+
+/*
+ * @brief Unmap an arena, with every slot it handed out
+ *
+ * @param arena The arena, NULL is ignored
+ */
+void arena_destroy(arena_t *arena);
+
+/*
+ * @brief Allocate a zeroed slot, thread safe
+ *
+ * @param arena The arena
+ *
+ * @return The slot, ARENA_ALIGN aligned, NULL if the arena is full
+ */
+void *arena_alloc(arena_t *arena);
+
+/*
+ * @brief Free a slot, thread safe
+ *
+ * @param arena The arena the slot was allocated from
+ * @param slot The slot
+ */
+void arena_free(arena_t *arena, void *slot);
+
+/*
+ * @brief Get the arena counters
+ *
+ * @param arena The arena
+ * @param stats Destination counters
+ */
+void arena_get_stats(arena_t *arena, arena_stats_t *stats);
+
+#else
+
+#define arena_create(slot_size, slots) (NULL)
+#define arena_destroy(arena)
+#define arena_alloc(arena) (NULL)
+#define arena_free(arena, slot)
+#define arena_get_stats(arena, stats)
+
+#endif // NES_CONF_ARENA_ENABLE
+
+#endif // __ARENA_H__
@@ -0,0 +1,186 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nes_conf.h"
+#include "nes.h"
+#include "stream.h"
+
+/*
+ * @brief Output buffers are aligned and sized for O_DIRECT writes
+ */
+#define CAPTURE_ALIGN 4096U
+#define CAPTURE_DEFAULT_BUFFER_SIZE (4U << 20)
+#define CAPTURE_DEFAULT_SLOTS 16U
+
+/*
+ * @brief Y4M stream header: 4:4:4 planes at the NTSC frame rate, with the
+ * 8:7 NTSC pixel aspect ratio
+ */
+#define CAPTURE_Y4M_HEADER "YUV4MPEG2 W256 H240 F39375000:655171 Ip A8:7 C444\n"
+#define CAPTURE_Y4M_FRAME "FRAME\n"
+
+#define CAPTURE_WAV_HEADER_SIZE 44U
+
+/*
+ * @brief Video file formats
+ *
+ * @value CAPTURE_VIDEO_Y4M YUV4MPEG2, 4:4:4
+ * @value CAPTURE_VIDEO_RAW Headerless planar YUV 4:4:4 frames
+ */
+typedef enum {
+    CAPTURE_VIDEO_Y4M = 0x00,
+    CAPTURE_VIDEO_RAW = 0x01,
+} capture_video_e;
+
+/*
+ * @brief Capture settings
+ *
+ * @attribute video_path Video file, NULL for no video
+ * @attribute video_format Video file format
+ * @attribute audio_path WAV file, NULL for no audio
+ * @attribute slots Frames queued for the writer before the oldest is
+ * dropped, bounds the memory used together with buffer_size
+ * @attribute buffer_size Output buffer per file, a multiple of
+ * CAPTURE_ALIGN
+ */
+typedef struct {
+    const char *video_path;
+    capture_video_e video_format;
+    const char *audio_path;
+    size_t slots;
+    size_t buffer_size;
+} capture_config_t;
+
+/*
+ * @brief Capture counters
+ *
+ * @attribute frames Video frames written
+ * @attribute blocks Audio blocks written
+ * @attribute dropped Frames and blocks dropped because the writer fell
+ * behind
+ * @attribute bytes Bytes written
+ * @attribute direct Files written with O_DIRECT
+ */
+typedef struct {
+    uint64_t frames;
+    uint64_t blocks;
+    uint64_t dropped;
+    uint64_t bytes;
+    uint32_t direct;
+} capture_stats_t;
+
+/*
+ * @brief An output file written through an aligned buffer
+ *
+ * @warning The fields should not be used outside of the capture module
+ *
+ * @attribute fd File descriptor, -1 when unused
+ * @attribute direct The file is open with O_DIRECT
+ * @attribute buffer Aligned output buffer
+ * @attribute size Size of buffer
+ * @attribute used Bytes pending in buffer
+ * @attribute written Bytes written to the file
+ * @attribute failed A write failed
+ */
+typedef struct {
+    int fd;
+    int direct;
+    uint8_t *buffer;
+    size_t size;
+    size_t used;
+    _Atomic uint64_t written;
+    int failed;
+} capture_file_t;
+
+/*
+ * @brief Capture stage
+ *
+ * @warning The fields should not be used outside of the capture module
+ *
+ * @attribute video Video file
+ * @attribute audio Audio file
+ * @attribute video_format Video file format
+ * @attribute video_ring Frames queued for the writer
+ * @attribute audio_ring Audio blocks queued for the writer
+ * @attribute frame Frame being encoded
+ * @attribute block Audio block being encoded
+ * @attribute planes Encoded frame
+ * @attribute running The writer keeps waiting for frames
+ * @attribute frames Video frames written
+ * @attribute blocks Audio blocks written
+ * @attribute thread Writer thread
+ */
+typedef struct {
+    capture_file_t video;
+    capture_file_t audio;
+    capture_video_e video_format;
+
+    stream_ring_t *video_ring;
+    stream_ring_t *audio_ring;
+
+    stream_frame_t frame;
+    stream_audio_t block;
+    uint8_t planes[3 * NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT];
+
+    _Atomic int running;
+    _Atomic uint64_t frames;
+    _Atomic uint64_t blocks;
+
+    pthread_t thread;
+} capture_t;
+
+#ifdef NES_CONF_CAPTURE_ENABLE
+
+/*
+ * @brief Open the output files and start the writer thread
+ *
+ * @param config Capture settings
+ *
+ * @return The capture stage, NULL on failure, when the files it opened
+ * are removed again
+ */
+NES_API capture_t *capture_open(const capture_config_t *config);
+
+/*
+ * @brief Queue the video and audio of the frame a console just ran
+ *
+ * Only copies into a ring slot, it never waits for the writer. When the
+ * writer falls behind the oldest queued frame is dropped.
+ *
+ * @param capture The capture stage
+ * @param nes The console
+ */
+NES_API void capture_frame(capture_t *capture, nes_t *nes);
+
+/*
+ * @brief Write everything queued, finish the file headers and close
+ *
+ * @param capture The capture stage
+ *
+ * @return 0 on success, -1 if a write failed
+ */
+NES_API int capture_close(capture_t *capture);
+
+/*
+ * @brief Get the capture counters
+ *
+ * @param capture The capture stage
+ * @param stats Destination counters
+ */
+NES_API void capture_get_stats(capture_t *capture, capture_stats_t *stats);
+
+#else
+
+#define capture_open(config) (NULL)
+#define capture_frame(capture, nes)
+#define capture_close(capture) (-1)
+#define capture_get_stats(capture, stats)
+
+#endif // NES_CONF_CAPTURE_ENABLE
+
+#endif // __CAPTURE_H__
@@ -2,12 +2,19 @@
 #define __CARTRIDGE_H__
 
 #include "nes_conf.h"
+#include "chr.h"
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define CARTRIDGE_START 0x6000U
 #define CARTRIDGE_SIZE 0xA000U
 
+/*
+ * @brief Largest cartridge RAM of any supported mapper
+ */
+#define CARTRIDGE_RAM_MAX_SIZE 0x2000U
+
 /*
  * @brief NROM cartridge memory map
  */
@@ -16,9 +23,26 @@
 #define CARTRIDGE_NROM_ROM_START 0x8000U
 #define CARTRIDGE_NROM_ROM_SIZE 0x8000U
 
+/*
+ * @brief iNES file format
+ */
+#define CARTRIDGE_INES_MAGIC "NES\x1A"
+#define CARTRIDGE_INES_HEADER_SIZE 16U
+#define CARTRIDGE_INES_TRAINER_SIZE 512U
+#define CARTRIDGE_INES_PRG_BANK_SIZE 0x4000U
+#define CARTRIDGE_INES_CHR_BANK_SIZE 0x2000U
+#define CARTRIDGE_INES_FLAGS6_VERTICAL 0x01U
+#define CARTRIDGE_INES_FLAGS6_BATTERY 0x02U
+#define CARTRIDGE_INES_FLAGS6_TRAINER 0x04U
+#define CARTRIDGE_INES_FLAGS6_FOUR_SCREEN 0x08U
+
+/*
+ * @brief Pattern tables window of the PPU address space
+ */
+#define CARTRIDGE_CHR_SIZE 0x2000U
 
 /*
- * @brief Cartridge types
+ * @brief Cartridge types, valued by their iNES mapper number
  *
  * @value CARTRIDGE_TYPE_NROM  
  */
@@ -26,6 +50,22 @@ typedef enum {
     CARTRIDGE_TYPE_NROM = 0x00,
 } cartridge_type_e;
 
+/*
+ * @brief Nametable mirroring
+ *
+ * @value CARTRIDGE_MIRRORING_HORIZONTAL $2000 and $2400 share a nametable,
+ * as do $2800 and $2C00
+ * @value CARTRIDGE_MIRRORING_VERTICAL $2000 and $2800 share a nametable,
+ * as do $2400 and $2C00
+ * @value CARTRIDGE_MIRRORING_FOUR_SCREEN Four nametables, the cartridge
+ * provides the other two
+ */
+typedef enum {
+    CARTRIDGE_MIRRORING_HORIZONTAL = 0x00,
+    CARTRIDGE_MIRRORING_VERTICAL = 0x01,
+    CARTRIDGE_MIRRORING_FOUR_SCREEN = 0x02,
+} cartridge_mirroring_e;
+
 /*
  * @brief Cartridge write handler function
  *
@@ -62,6 +102,16 @@ typedef struct {
  * @attribute type Cartridge type
  * @attribute write Write handler
  * @attribute read Read handler
+ * @attribute ram Cartridge RAM, NULL if the cartridge has none
+ * @attribute ram_size Size of ram
+ * @attribute ram_hash Zobrist hash of ram, updated on every write
+ * @attribute battery The image declares battery-backed RAM
+ * @attribute mapped ram is a shared mapping of a save file, see
+ * cartridge_map_ram()
+ * @attribute chr Pattern data with its decoded tiles, NULL before a ROM is
+ * loaded
+ * @attribute chr_ram chr is CHR RAM rather than a shared CHR ROM
+ * @attribute mirroring Nametable mirroring
  * @attribute data Cartridge data
  */
 typedef struct {
@@ -71,6 +121,16 @@ typedef struct {
     cartridge_write_handler_t write;
     cartridge_read_handler_t read;
 
+    uint8_t *ram;
+    size_t ram_size;
+    uint64_t ram_hash;
+    uint8_t battery;
+    uint8_t mapped;
+
+    chr_cache_t *chr;
+    uint8_t chr_ram;
+    cartridge_mirroring_e mirroring;
+
     union {
         _cartridge_nrom_t nrom;
     } data;
@@ -79,11 +139,26 @@ typedef struct {
 
 #ifdef NES_CONF_CARTRIDGE_ENABLE
 
+/*
+ * @brief Make a cartridge the one the calling thread operates on
+ *
+ * @param cartridge The cartridge
+ */
+void cartridge_bind(cartridge_t *cartridge);
+
 /*
  * @brief Initialize the cartridge
+ *
+ * @param type Cartridge type, ignored when NES_CONF_MAPPER fixes it
  */
 void cartridge_init(cartridge_type_e type);
 
+/*
+ * @brief Release what the cartridge holds, the save file mapping and the
+ * pattern data, e.g. before the console is freed
+ */
+void cartridge_release();
+
 /*
  * @brief Write to the cartridge
  *
@@ -101,11 +176,135 @@ void cartridge_write(uint16_t address, uint8_t data);
  */
 uint8_t cartridge_read(uint16_t address);
 
+/*
+ * @brief Initialize the cartridge from an iNES image
+ *
+ * @param data The iNES image
+ * @param size The size of the image
+ *
+ * @return 0 on success, -1 if the image is invalid or its mapper unsupported,
+ * or not the one NES_CONF_MAPPER fixes, the cartridge is left as it was on
+ * failure
+ */
+int cartridge_load(const uint8_t *data, size_t size);
+
+/*
+ * @brief Get the cartridge RAM
+ *
+ * @param size Set to the size of the RAM
+ *
+ * @return The RAM, NULL if the cartridge has none
+ */
+const uint8_t *cartridge_get_ram(size_t *size);
+
+/*
+ * @brief Get the Zobrist hash of the cartridge RAM
+ *
+ * @return The hash, 0 if the cartridge has no RAM
+ */
+uint64_t cartridge_get_ram_hash();
+
+/*
+ * @brief Replace the cartridge RAM contents
+ *
+ * @param data The new contents, the size of the RAM
+ * @param hash Hash of data, as returned by cartridge_get_ram_hash() when
+ * it was saved
+ */
+void cartridge_set_ram(const uint8_t *data, uint64_t hash);
+
+/*
+ * @brief Map a save file as the cartridge RAM
+ *
+ * The file is mapped shared, so every write to the RAM goes to the file
+ * with no copy. A new file is created zeroed. Anything restoring the RAM
+ * (cartridge_set_ram(), loading a state) writes to the file as well.
+ *
+ * @param path The save file
+ *
+ * @return 0 on success, -1 if the cartridge has no RAM, a file is already
+ * mapped or the file cannot be mapped
+ */
+int cartridge_map_ram(const char *path);
+
+/*
+ * @brief Write the mapped RAM to the save file and wait for it, as a
+ * checkpoint the file is known to be complete at
+ *
+ * @return 0 on success or if no file is mapped, -1 on failure
+ */
+int cartridge_sync_ram();
+
+/*
+ * @brief Unmap the save file, the kernel writes back what is not synced
+ * yet. The cartridge goes back to its own RAM, cleared.
+ */
+void cartridge_unmap_ram();
+
+/*
+ * @brief Whether the loaded image declares battery-backed RAM
+ *
+ * @return 1 if it does, 0 otherwise
+ */
+uint8_t cartridge_has_battery();
+
+/*
+ * @brief Get the memory behind a CPU address, to read it with no side
+ * effects and without going through the read handler one byte at a time
+ *
+ * @param address CPU address
+ * @param size Set to the number of bytes from address on that are plain
+ * memory, when found
+ *
+ * @return The byte at address, NULL if it is not plain memory
+ */
+const uint8_t *cartridge_peek(uint16_t address, size_t *size);
+
+/*
+ * @brief Overwrite the ROM seen by the CPU in place, e.g. to run generated
+ * code without loading a new image. Bytes outside the ROM are ignored.
+ *
+ * @param address CPU address of the first byte
+ * @param data Bytes to write
+ * @param size Size of data
+ */
+void cartridge_patch_rom(uint16_t address, const uint8_t *data, size_t size);
+
+/*
+ * @brief Get the CHR RAM, to save it in a state
+ *
+ * @param size Set to the size of the RAM
+ *
+ * @return The RAM, NULL if the cartridge has CHR ROM
+ */
+const uint8_t *cartridge_get_chr_ram(size_t *size);
+
+/*
+ * @brief Replace the CHR RAM contents, ignored with CHR ROM
+ *
+ * @param data The new contents, the size of the RAM
+ */
+void cartridge_set_chr_ram(const uint8_t *data);
+
 #else
 
+#define cartridge_bind(cartridge)
 #define cartridge_init() (NULL)
 #define cartridge_write(address, data) (NULL)
 #define cartridge_read(address) (0U)
+#define cartridge_load(data, size) (-1)
+#define cartridge_get_ram(size) (*(size) = 0, NULL)
+#define cartridge_get_ram_hash() (0U)
+#define cartridge_set_ram(data, hash)
+#define cartridge_map_ram(path) (-1)
+#define cartridge_sync_ram() (0)
+#define cartridge_unmap_ram()
+#define cartridge_has_battery() (0U)
+#define cartridge_peek(address, size) (NULL)
+#define cartridge_patch_rom(address, data, size)
+#define cartridge_release()
+#define cartridge_get_chr_ram(size) (*(size) = 0, NULL)
+#define cartridge_set_chr_ram(data)
 
 #endif //NES_CONF_CARTRIDGE_ENABLE
 
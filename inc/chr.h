@@ -0,0 +1,137 @@
+#ifndef __CHR_H__
+#define __CHR_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nes_conf.h"
+
+/*
+ * @brief Pattern table layout: 16 byte tiles of two 8 byte bitplanes, 8
+ * rows of 8 pixels
+ */
+#define CHR_TILE_SIZE 16U
+#define CHR_TILE_ROWS 8U
+
+/*
+ * @brief CHR RAM of boards without CHR ROM
+ */
+#define CHR_RAM_SIZE 0x2000U
+
+/*
+ * @brief Pattern data with its tiles decoded
+ *
+ * A decoded row holds the 8 pixels of a tile row, one 2-bit palette index
+ * per byte with the leftmost pixel in the least significant byte. Stored
+ * to memory on a little-endian host it reads as the pixels left to right,
+ * a horizontal flip is a byte swap and a palette is selected by ORing its
+ * number into every non-zero byte.
+ *
+ * CHR ROM caches are decoded once and shared by every cartridge with the
+ * same ROM. CHR RAM caches belong to their cartridge, a write marks its
+ * tile dirty and the tile is decoded again when next looked up.
+ *
+ * @warning The fields should not be used outside of the chr module
+ *
+ * @attribute data The pattern data
+ * @attribute size Size of data
+ * @attribute tiles Number of tiles
+ * @attribute rows Decoded rows, CHR_TILE_ROWS per tile
+ * @attribute dirty Bitmap of tiles to decode again, NULL for ROM
+ * @attribute generation Bumped whenever the pattern data changes
+ * @attribute hash Hash of a ROM, to find it when shared
+ * @attribute references Cartridges holding a ROM
+ * @attribute next Next shared ROM
+ */
+typedef struct chr_cache {
+    uint8_t *data;
+    size_t size;
+    size_t tiles;
+    uint64_t *rows;
+    uint64_t *dirty;
+    uint64_t generation;
+
+    uint64_t hash;
+    size_t references;
+    struct chr_cache *next;
+} chr_cache_t;
+
+#ifdef NES_CONF_CHR_ENABLE
+
+/*
+ * @brief Get the shared cache of a CHR ROM, decoding it on first use
+ *
+ * @param rom The CHR ROM, copied
+ * @param size Size of rom, a multiple of CHR_TILE_SIZE
+ *
+ * @return The cache, NULL on failure
+ */
+chr_cache_t *chr_acquire(const uint8_t *rom, size_t size);
+
+/*
+ * @brief Create a cache of zeroed CHR RAM
+ *
+ * @param size Size of the RAM, a multiple of CHR_TILE_SIZE
+ *
+ * @return The cache, NULL on failure
+ */
+chr_cache_t *chr_create(size_t size);
+
+/*
+ * @brief Release a CHR ROM cache or free a CHR RAM one
+ *
+ * @param cache The cache, NULL is ignored
+ */
+void chr_release(chr_cache_t *cache);
+
+/*
+ * @brief Write to CHR RAM, marking the tile dirty if the byte changes
+ *
+ * @param cache A CHR RAM cache
+ * @param address Offset in the pattern data
+ * @param data The byte
+ */
+void chr_write(chr_cache_t *cache, uint32_t address, uint8_t data);
+
+/*
+ * @brief Replace the contents of CHR RAM, e.g. when loading a state. Only
+ * the tiles that change are marked dirty.
+ *
+ * @param cache A CHR RAM cache
+ * @param data The new contents, the size of the RAM
+ */
+void chr_set(chr_cache_t *cache, const uint8_t *data);
+
+/*
+ * @brief Get the decoded rows of a tile, decoding it if it is dirty
+ *
+ * @param cache The cache
+ * @param tile Index of the tile in the pattern data
+ *
+ * @return CHR_TILE_ROWS decoded rows, top to bottom
+ */
+const uint64_t *chr_tile(chr_cache_t *cache, uint32_t tile);
+
+/*
+ * @brief Get the generation of the pattern data, to tell whether it
+ * changed since it was last looked at
+ *
+ * @param cache The cache
+ *
+ * @return The generation, constant for ROM
+ */
+uint64_t chr_get_generation(const chr_cache_t *cache);
+
+#else
+
+#define chr_acquire(rom, size) (NULL)
+#define chr_create(size) (NULL)
+#define chr_release(cache)
+#define chr_write(cache, address, data)
+#define chr_set(cache, data)
+#define chr_tile(cache, tile) (NULL)
+#define chr_get_generation(cache) (0U)
+
+#endif // NES_CONF_CHR_ENABLE
+
+#endif // __CHR_H__
@@ -0,0 +1,148 @@
+#ifndef __CODEMAP_H__
+#define __CODEMAP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nes_conf.h"
+#include "cpu.h"
+#include "nes.h"
+
+/*
+ * @brief Code map file layout
+ *
+ * A CODEMAP_HEADER_SIZE header (magic, version, and the FNV-1a hash of
+ * the ROM window the map was made from, little-endian) is followed by runs
+ * covering the CPU_DECODED_SIZE bytes of the window in order: a varint run
+ * length, then the codemap_flag_e flags of every byte of the run.
+ */
+#define CODEMAP_MAGIC "NESC"
+#define CODEMAP_VERSION 1U
+#define CODEMAP_HEADER_SIZE 16U
+
+/*
+ * @brief Most entries read from a jump table
+ */
+#define CODEMAP_MAX_TABLE 128U
+
+/*
+ * @brief What a ROM byte is known to be
+ *
+ * @value CODEMAP_CODE First byte of a reachable instruction
+ * @value CODEMAP_OPERAND Operand byte of a reachable instruction
+ * @value CODEMAP_ENTRY An instruction reached from a vector, jump, call or
+ * jump table
+ * @value CODEMAP_JUMP_TABLE An indirect jump, or the RTS of a pushed
+ * address jump
+ * @value CODEMAP_TABLE Entry of a jump table
+ * @value CODEMAP_BANK_SWITCH An instruction writing to the mapper
+ * registers at CPU_DECODED_BASE and above
+ */
+typedef enum {
+    CODEMAP_CODE = 0x01,
+    CODEMAP_OPERAND = 0x02,
+    CODEMAP_ENTRY = 0x04,
+    CODEMAP_JUMP_TABLE = 0x08,
+    CODEMAP_TABLE = 0x10,
+    CODEMAP_BANK_SWITCH = 0x20,
+} codemap_flag_e;
+
+/*
+ * @brief Code map counters
+ *
+ * @attribute code Bytes of reachable instructions, operands included
+ * @attribute instructions Reachable instructions
+ * @attribute entries Entry points
+ * @attribute jump_tables Indirect jump sites
+ * @attribute table_entries Jump table entries followed
+ * @attribute bank_switches Mapper register write sites
+ */
+typedef struct {
+    uint32_t code;
+    uint32_t instructions;
+    uint32_t entries;
+    uint32_t jump_tables;
+    uint32_t table_entries;
+    uint32_t bank_switches;
+} codemap_stats_t;
+
+/*
+ * @brief Code and data map of the ROM window, and its pre-decoded
+ * instructions
+ *
+ * A map is only read once made, consoles running the same ROM may share
+ * it. Its size is large, allocate it rather than putting it on the stack.
+ *
+ * @attribute flags codemap_flag_e flags of every byte from CPU_DECODED_BASE
+ * @attribute decoded Instruction of every CODEMAP_CODE byte, NULL elsewhere
+ * @attribute hash FNV-1a hash of the ROM window
+ * @attribute stats Counters
+ */
+typedef struct {
+    uint8_t flags[CPU_DECODED_SIZE];
+    const cpu_instruction_t *decoded[CPU_DECODED_SIZE];
+    uint64_t hash;
+    codemap_stats_t stats;
+} codemap_t;
+
+#ifdef NES_CONF_CODEMAP_ENABLE
+
+/*
+ * @brief Map the code reachable from the NMI, reset and IRQ vectors of
+ * the ROM a console has loaded
+ *
+ * Code is walked recursively through jumps, calls and branches, and
+ * through jump tables read by indexed loads just before an indirect jump
+ * or a pushed address RTS.
+ *
+ * @param map Destination map
+ * @param nes The console
+ */
+NES_API void codemap_analyze(codemap_t *map, nes_t *nes);
+
+/*
+ * @brief Write a map to a sidecar file
+ *
+ * @param map The map
+ * @param path The file
+ *
+ * @return 0 on success, -1 on failure
+ */
+NES_API int codemap_save(const codemap_t *map, const char *path);
+
+/*
+ * @brief Read a map from a sidecar file's contents, and pre-decode the
+ * instructions it marks as code
+ *
+ * @param map Destination map
+ * @param nes A console with the ROM the map was made from loaded
+ * @param data The file contents
+ * @param size Size of data
+ *
+ * @return 0 on success, -1 if the file is invalid or made from another ROM
+ */
+NES_API int codemap_load(codemap_t *map, nes_t *nes, const uint8_t *data, size_t size);
+
+/*
+ * @brief Run a console from a map's pre-decoded instructions
+ *
+ * Only valid while the ROM window does not change, so for mappers without
+ * PRG bank switching. The map must outlive its use by the console.
+ *
+ * @param map The map
+ * @param nes A console with the ROM the map was made from loaded
+ *
+ * @return 0 on success, -1 if another ROM is loaded
+ */
+NES_API int codemap_attach(const codemap_t *map, nes_t *nes);
+
+#else
+
+#define codemap_analyze(map, nes)
+#define codemap_save(map, path) (-1)
+#define codemap_load(map, nes, data, size) (-1)
+#define codemap_attach(map, nes) (-1)
+
+#endif // NES_CONF_CODEMAP_ENABLE
+
+#endif // __CODEMAP_H__
@@ -0,0 +1,205 @@
+#ifndef __CONTROL_H__
+#define __CONTROL_H__
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "nes_conf.h"
+#include "nes.h"
+
+/*
+ * @brief Wire format
+ *
+ * A request is a control_header_t followed by its commands, each a
+ * control_command_t followed by size bytes of payload. The reply is a
+ * control_header_t followed by one control_reply_t and its payload per
+ * command, in order. Fields are in host byte order, client and server
+ * share the machine.
+ */
+#define CONTROL_MAGIC 0x4243454eU /* "NECB" */
+
+/*
+ * @brief Largest request accepted, a client sending more is dropped
+ */
+#define CONTROL_MAX_REQUEST (64U << 20)
+
+/*
+ * @brief Clients served at the same time
+ */
+#define CONTROL_MAX_CLIENTS 16U
+
+/*
+ * @brief Commands
+ *
+ * @value CONTROL_STEP Set the buttons of consoles [first, first + count)
+ * from a payload of CONTROLLER_PORTS bytes per console, or leave them with an
+ * empty payload, and run arg0 frames. The reply value is the number of
+ * consoles a hit stopped.
+ * @value CONTROL_SAVE Save the state of the consoles, the reply payload is
+ * nes_state_size() bytes per console, with the host side of the PPU state
+ * (pointers and drawing bookkeeping) zeroed
+ * @value CONTROL_LOAD Load the state of the consoles from a payload of
+ * nes_state_size() bytes per console. The RAM hashes of the payload are
+ * ignored, they are computed from the RAM it holds.
+ * @value CONTROL_READ Read arg1 bytes of internal RAM from address arg0 of
+ * the consoles, the reply payload is arg1 bytes per console
+ */
+typedef enum {
+    CONTROL_STEP = 0x01,
+    CONTROL_SAVE = 0x02,
+    CONTROL_LOAD = 0x03,
+    CONTROL_READ = 0x04,
+} control_op_e;
+
+/*
+ * @brief Header of a request or a reply
+ *
+ * @attribute magic CONTROL_MAGIC
+ * @attribute commands Number of commands, or of replies
+ * @attribute size Bytes following the header
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t commands;
+    uint32_t size;
+} control_header_t;
+
+/*
+ * @brief A command of a request
+ *
+ * @attribute op control_op_e
+ * @attribute first Index of the first console
+ * @attribute count Number of consoles
+ * @attribute arg0 First argument, see control_op_e
+ * @attribute arg1 Second argument, see control_op_e
+ * @attribute size Bytes of payload following the command
+ */
+typedef struct {
+    uint32_t op;
+    uint32_t first;
+    uint32_t count;
+    uint32_t arg0;
+    uint32_t arg1;
+    uint32_t size;
+} control_command_t;
+
+/*
+ * @brief Reply to a command
+ *
+ * @attribute status 0 on success, -1 if the command was invalid, in which
+ * case nothing was done
+ * @attribute value Result, see control_op_e
+ * @attribute size Bytes of payload following the reply
+ */
+typedef struct {
+    int32_t status;
+    uint32_t value;
+    uint32_t size;
+} control_reply_t;
+
+/*
+ * @brief Control server
+ *
+ * @warning The fields should not be used outside of the control module
+ *
+ * @attribute consoles Consoles served
+ * @attribute count Number of consoles
+ * @attribute states State of every console as last saved, sent from in
+ * place
+ * @attribute pending sendmsg() that last sent each state, counted from 1,
+ * 0 for none
+ * @attribute sent sendmsg() calls made so far
+ * @attribute request Request being run, and its capacity
+ * @attribute replies Replies to its commands, and their capacity
+ * @attribute iov Reply being gathered, and its number of iovecs
+ * @attribute ram Whether it points at console RAM
+ * @attribute path Socket path, unlinked on destroy
+ * @attribute listener Listening socket
+ * @attribute wake Read end of the pipe destroy writes to, and its write
+ * end
+ * @attribute clients Connected sockets, -1 for free entries
+ * @attribute thread Server thread
+ */
+typedef struct {
+    nes_t **consoles;
+    size_t count;
+    nes_state_t *states;
+    uint64_t *pending;
+    uint64_t sent;
+
+    uint8_t *request;
+    size_t request_capacity;
+    control_reply_t *replies;
+    size_t replies_capacity;
+    struct iovec *iov;
+    size_t iov_count;
+    uint8_t ram;
+
+    char *path;
+    int listener;
+    int wake[2];
+    int clients[CONTROL_MAX_CLIENTS];
+    pthread_t thread;
+} control_t;
+
+#ifdef NES_CONF_CONTROL_ENABLE
+
+/*
+ * @brief Serve consoles on a Unix domain socket, from a thread of its own
+ *
+ * Each request is run in order and answered with a single sendmsg(),
+ * whose payload iovecs point at the console RAM and saved states in
+ * place. Only when a later command of the batch would change what an
+ * earlier one points at is the reply flushed early. The consoles must not
+ * be used by anything else while they are served.
+ *
+ * @param path Socket path, replaced if it exists
+ * @param consoles Consoles to serve
+ * @param count Number of consoles
+ *
+ * @return The server, NULL on failure
+ */
+NES_API control_t *control_create(const char *path, nes_t **consoles, size_t count);
+
+/*
+ * @brief Stop the server and disconnect its clients
+ *
+ * @param control The server, NULL is ignored
+ */
+NES_API void control_destroy(control_t *control);
+
+/*
+ * @brief Connect to a server
+ *
+ * @param path Socket path
+ *
+ * @return The socket, -1 on failure
+ */
+NES_API int control_connect(const char *path);
+
+/*
+ * @brief Send a request and wait for its reply
+ *
+ * @param fd Socket from control_connect()
+ * @param request The request, header included
+ * @param size Size of the request
+ * @param reply Destination of the reply, header included
+ * @param capacity Size of reply
+ *
+ * @return Size of the reply, -1 on failure or if it does not fit, the
+ * connection is then out of step and has to be closed
+ */
+NES_API long control_call(int fd, const void *request, size_t size, void *reply, size_t capacity);
+
+#else
+
+#define control_create(path, consoles, count) (NULL)
+#define control_destroy(control)
+#define control_connect(path) (-1)
+#define control_call(fd, request, size, reply, capacity) (-1)
+
+#endif // NES_CONF_CONTROL_ENABLE
+
+#endif // __CONTROL_H__
@@ -0,0 +1,114 @@
+#ifndef __CONTROLLER_H__
+#define __CONTROLLER_H__
+
+#include <stdint.h>
+
+#include "nes_conf.h"
+
+#define CONTROLLER_PORTS 2U
+
+/*
+ * @brief Controller registers, relative to MEMORY_APU_IO_REG_BASE
+ */
+#define CONTROLLER_REG_STROBE 0x16U
+#define CONTROLLER_REG_PORT_1 0x16U
+#define CONTROLLER_REG_PORT_2 0x17U
+
+/*
+ * @brief Upper bits of a port read, left over from the bus
+ */
+#define CONTROLLER_OPEN_BUS 0x40U
+
+/*
+ * @brief Standard controller buttons, in shift register order
+ */
+typedef enum {
+    CONTROLLER_BUTTON_A = 1 << 0,
+    CONTROLLER_BUTTON_B = 1 << 1,
+    CONTROLLER_BUTTON_SELECT = 1 << 2,
+    CONTROLLER_BUTTON_START = 1 << 3,
+    CONTROLLER_BUTTON_UP = 1 << 4,
+    CONTROLLER_BUTTON_DOWN = 1 << 5,
+    CONTROLLER_BUTTON_LEFT = 1 << 6,
+    CONTROLLER_BUTTON_RIGHT = 1 << 7
+} controller_button_e;
+
+/*
+ * @brief Controller ports state
+ *
+ * @attribute buttons Buttons currently held on each port
+ * @attribute shift Shift register of each port
+ * @attribute strobe Strobe latch, shift registers reload while it is set
+ */
+typedef struct {
+    uint8_t buttons[CONTROLLER_PORTS];
+    uint8_t shift[CONTROLLER_PORTS];
+    uint8_t strobe;
+} controller_t;
+
+#ifdef NES_CONF_CONTROLLER_ENABLE
+
+/*
+ * @brief Make a controller ports state the one the calling thread operates
+ * on
+ *
+ * @param controller The controller ports state
+ */
+void controller_bind(controller_t *controller);
+
+/*
+ * @brief Initialize the controller ports
+ */
+void controller_init();
+
+/*
+ * @brief Set the buttons held on a port
+ *
+ * @param port The port, 0 or 1
+ * @param buttons Mask of controller_button_e
+ */
+void controller_set_buttons(uint8_t port, uint8_t buttons);
+
+/*
+ * @brief Write the strobe register
+ *
+ * @param data The data written to $4016
+ */
+void controller_write(uint8_t data);
+
+/*
+ * @brief Read the next button state of a port
+ *
+ * @param port The port, 0 for $4016 and 1 for $4017
+ *
+ * @return The button bit with the open bus bits
+ */
+uint8_t controller_read(uint8_t port);
+
+/*
+ * @brief Copy the controller ports state out
+ *
+ * @param state Destination state
+ */
+void controller_get_state(controller_t *state);
+
+/*
+ * @brief Replace the controller ports state
+ *
+ * @param state Source state
+ */
+void controller_set_state(const controller_t *state);
+
+#else
+
+#define controller_bind(controller)
+#define controller_init()
+#define controller_set_buttons(port, buttons)
+#define controller_write(data)
+#define controller_read(port) (0U)
+#define controller_get_state(state)
+#define controller_set_state(state)
+
+#endif // NES_CONF_CONTROLLER_ENABLE
+
+#endif // __CONTROLLER_H__
@@ -9,22 +9,28 @@
 #define NMI_ADDR_HI 0xFFFB
 
 #define RES_ADDR_LO 0xFFFC
-#define RES_ADDR_HI 0xFFDD
+#define RES_ADDR_HI 0xFFFD
 
 #define IRQ_ADDR_LO 0xFFFE
 #define IRQ_ADDR_HI 0xFFFF
 
+/*
+ * @brief ROM window covered by pre-decoded instructions
+ */
+#define CPU_DECODED_BASE 0x8000U
+#define CPU_DECODED_SIZE 0x8000U
+
 #define PUSH_8(value) \
-    memory_write((_cpu.sp--)|0x100, value)
+    memory_write((_cpu->sp--)|0x100, value)
 #define PUSH_16(value) \
-    memory_write((_cpu.sp--)|0x100, (value) & 0xff); \
-    memory_write((_cpu.sp--)|0x100, (value)>>8)
+    memory_write((_cpu->sp--)|0x100, (value)>>8); \
+    memory_write((_cpu->sp--)|0x100, (value) & 0xff)
 
 #define PULL_8() \
-    memory_read((++_cpu.sp)|0x100)
+    memory_read((++_cpu->sp)|0x100)
 #define PULL_16() \
-    (_cpu.sp -= 2, (memory_read((_cpu.sp + 1)|0x100) << 8) | \
-    memory_read((_cpu.sp)|0x100))
+    (_cpu->sp += 2, memory_read((uint8_t)(_cpu->sp - 1)|0x100) | \
+    (memory_read((_cpu->sp)|0x100) << 8))
 
 /*
  * @brief CPU instruction handler
@@ -45,15 +51,38 @@ typedef enum {
     CPU_FLAG_NEGATIVE = 1 << 7
 } cpu_flag_t;
 
+/*
+ * @brief An enum containing the CPU addressing modes
+ */
+typedef enum {
+    CPU_MODE_IMP = 0,
+    CPU_MODE_ACC,
+    CPU_MODE_IMM,
+    CPU_MODE_ZP,
+    CPU_MODE_ZPX,
+    CPU_MODE_ZPY,
+    CPU_MODE_ABS,
+    CPU_MODE_ABSX,
+    CPU_MODE_ABSY,
+    CPU_MODE_IND,
+    CPU_MODE_INDX,
+    CPU_MODE_INDY,
+    CPU_MODE_REL
+} cpu_mode_t;
+
 /*
  * @brief CPU instruction
  *
  * @param handler The instruction handler
  * @param cycles The number of cycles the instruction takes to execute
+ * @param mode The addressing mode, used to size and disassemble operands
+ * @param mnemonic The instruction mnemonic
  */
 typedef struct {
     cpu_instruction_handler_t handler;
     uint8_t cycles;
+    uint8_t mode;
+    char mnemonic[4];
 } cpu_instruction_t;
 
 /*
@@ -65,6 +94,7 @@ typedef struct {
  * @param x The x register
  * @param y The y register
  * @param flags The CPU flags
+ * @param cycles The number of cycles executed since init
  */
 typedef struct {
     uint16_t pc;
@@ -73,10 +103,29 @@ typedef struct {
     uint8_t x;
     uint8_t y;
     uint8_t flags;
+    uint64_t cycles;
 } cpu_t;
 
 #ifdef NES_CONF_CPU_ENABLE
 
+/*
+ * @brief Make a CPU state the one the calling thread operates on
+ *
+ * Every other cpu_* function works on the bound state. Each thread starts
+ * bound to a shared default state.
+ *
+ * @param cpu The CPU state
+ */
+void cpu_bind(cpu_t *cpu);
+
+/*
+ * @brief Get the CPU state the calling thread operates on, to tell
+ * consoles apart
+ *
+ * @return The bound state
+ */
+const cpu_t *cpu_get_bound();
+
 /*
  * @brief Initialize the CPU
  */
@@ -92,6 +141,82 @@ void cpu_reset();
  */
 void cpu_step();
 
+/*
+ * @brief Take a non-maskable interrupt, between two instructions
+ */
+void cpu_nmi();
+
+/*
+ * @brief Halt the CPU for a number of cycles, while DMA has the bus
+ *
+ * @param cycles Cycles added to the cycle counter
+ */
+void cpu_stall(uint32_t cycles);
+
+/*
+ * @brief Step the CPU until the cycle counter reaches a target
+ *
+ * @param cycles The cycle counter value to stop at or after
+ *
+ * @return 0 when the target was reached, 1 if cpu_stop() was called
+ */
+int cpu_run_until(uint64_t cycles);
+
+/*
+ * @brief Make the running cpu_run_until return after the current
+ * instruction
+ */
+void cpu_stop();
+
+/*
+ * @brief Set the breakpoint bitmap cpu_step tests the program counter in
+ *
+ * @param bitmap One bit per address, WATCH_BITMAP_SIZE bytes
+ */
+void cpu_set_breakpoints(const uint8_t *bitmap);
+
+/*
+ * @brief Set the pre-decoded instructions cpu_step takes instead of
+ * fetching and looking up the opcode, see codemap.h
+ *
+ * @param decoded CPU_DECODED_SIZE entries from CPU_DECODED_BASE, each an
+ * entry of cpu_get_instruction() or NULL where the byte is not known to be
+ * an opcode. NULL for none.
+ */
+void cpu_set_decoded(const cpu_instruction_t *const *decoded);
+
+/*
+ * @brief Copy the CPU state out
+ *
+ * @param state Destination state
+ */
+void cpu_get_state(cpu_t *state);
+
+/*
+ * @brief Replace the CPU state
+ *
+ * @param state Source state
+ */
+void cpu_set_state(const cpu_t *state);
+
+/*
+ * @brief Get the instruction table entry of an opcode
+ *
+ * @param opcode The opcode
+ *
+ * @return The instruction, with a NULL handler for unimplemented opcodes
+ */
+const cpu_instruction_t *cpu_get_instruction(uint8_t opcode);
+
+/*
+ * @brief Get the size of an instruction in bytes, opcode included
+ *
+ * @param opcode The opcode
+ *
+ * @return The instruction size
+ */
+uint8_t cpu_get_instruction_size(uint8_t opcode);
+
 /*
  * @brief Fetch an immediate value
  *
@@ -180,9 +305,13 @@ uint8_t cpu_get_flag(cpu_flag_t mask);
 
 #else
 
+#define cpu_bind(cpu)
+#define cpu_get_bound() (NULL)
 #define cpu_init(cpu) (NULL)
 #define cpu_reset(cpu) (NULL)
 #define cpu_step(cpu) (NULL)
+#define cpu_nmi()
+#define cpu_stall(cycles)
 
 #endif // MODULE_CPU_ENABLE
 #endif // __CPU_H__
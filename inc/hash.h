@@ -0,0 +1,64 @@
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include <stdint.h>
+
+/*
+ * @brief Key domains, so equal addresses in different memories hash
+ * differently
+ */
+#define HASH_DOMAIN_RAM 0x01U
+#define HASH_DOMAIN_CARTRIDGE_RAM 0x02U
+#define HASH_DOMAIN_CPU 0x03U
+
+/*
+ * @brief splitmix64 finalizer, a bijection on 64-bit values
+ *
+ * @param z The value to mix
+ *
+ * @return The mixed value
+ */
+static inline uint64_t hash_mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * @brief Zobrist key of a byte value at an address
+ *
+ * A memory hash is the XOR of hash_byte(domain, address, value) ^
+ * hash_byte(domain, address, 0) over its bytes, so zeroed memory hashes to
+ * 0 and a write only XORs out the old value's key and XORs in the new one.
+ *
+ * @param domain HASH_DOMAIN_* of the memory
+ * @param address Offset of the byte in the memory
+ * @param value The byte value
+ *
+ * @return The key
+ */
+static inline uint64_t hash_byte(uint32_t domain, uint32_t address, uint8_t value) {
+    return hash_mix(((uint64_t)domain << 32) | ((uint64_t)address << 8) | value);
+}
+
+/*
+ * @brief Hash a whole memory from scratch
+ *
+ * @param domain HASH_DOMAIN_* of the memory
+ * @param data The memory
+ * @param size The size of the memory
+ *
+ * @return The hash an incrementally maintained one must equal
+ */
+static inline uint64_t hash_memory(uint32_t domain, const uint8_t *data, uint32_t size) {
+    uint64_t hash = 0;
+
+    for (uint32_t i = 0; i < size; i++) {
+        if (data[i]) {
+            hash ^= hash_byte(domain, i, data[i]) ^ hash_byte(domain, i, 0);
+        }
+    }
+    return hash;
+}
+
+#endif // __HASH_H__
@@ -19,12 +19,33 @@
 #define MEMORY_CARTRIDGE_BASE 0x4020
 #define MEMORY_CARTRIDGE_SIZE 0xBFE0
 
+/*
+ * @brief Internal memory
+ *
+ * @attribute ram Internal RAM
+ * @attribute hash Zobrist hash of ram, updated on every write, see hash.h
+ */
 typedef struct {
     uint8_t ram[MEMORY_RAM_SIZE];
+    uint64_t hash;
 } memory_t;
 
 #ifdef NES_CONF_MEMORY_ENABLE
 
+/*
+ * @brief Make a memory state the one the calling thread operates on
+ *
+ * @param memory The memory state
+ */
+void memory_bind(memory_t *memory);
+
+/*
+ * @brief Set the page table of pages whose writes are trapped
+ *
+ * @param pages One byte per 256 byte page, non-zero to call watch_write
+ */
+void memory_set_traps(const uint8_t *pages);
+
 /*
  * @brief Initialize the memory
  */
@@ -52,6 +73,27 @@ void memory_write(uint16_t address, uint8_t data);
  */
 uint8_t memory_read(uint16_t address);
 
+/*
+ * @brief Get the internal RAM
+ *
+ * @return The MEMORY_RAM_SIZE bytes of RAM
+ */
+const uint8_t *memory_get_ram();
+
+/*
+ * @brief Copy the memory state out
+ *
+ * @param state Destination state
+ */
+void memory_get_state(memory_t *state);
+
+/*
+ * @brief Replace the memory state
+ *
+ * @param state Source state
+ */
+void memory_set_state(const memory_t *state);
+
 #else
 
 #endif // MODULE_MEMORY_ENABLE
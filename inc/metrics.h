@@ -0,0 +1,208 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "nes_conf.h"
+
+/*
+ * @brief Shards are written by different threads, each sits on its own
+ * cache lines
+ */
+#define METRICS_CACHE_LINE 64U
+
+/*
+ * @brief Bus accesses are counted per 8 KB page of the CPU address space
+ */
+#define METRICS_BUS_PAGES 8U
+#define METRICS_BUS_PAGE_SHIFT 13U
+
+/*
+ * @brief Buckets of a histogram, the last one is +Inf
+ */
+#define METRICS_BUCKETS 11U
+
+/*
+ * @brief Histograms kept by every shard
+ *
+ * @value METRICS_FRAME_TIME Time to emulate one frame of one console
+ * @value METRICS_SNAPSHOT_TIME Time to save or load a state
+ */
+typedef enum {
+    METRICS_FRAME_TIME = 0x00,
+    METRICS_SNAPSHOT_TIME = 0x01,
+    METRICS_HISTOGRAMS
+} metrics_histogram_e;
+
+/*
+ * @brief Latency histogram
+ *
+ * @attribute buckets Observations per bucket, not cumulative
+ * @attribute sum_ns Sum of the observations
+ */
+typedef struct {
+    _Atomic uint64_t buckets[METRICS_BUCKETS];
+    _Atomic uint64_t sum_ns;
+} metrics_histogram_t;
+
+/*
+ * @brief Counters of one thread
+ *
+ * Only the owning thread writes a shard, with plain relaxed loads and
+ * stores rather than locked read-modify-writes. Readers sum the shards.
+ * A shard outlives its thread and is handed to the next thread that
+ * registers, so totals never go back.
+ *
+ * @warning The fields should not be used outside of the metrics module
+ * but through METRICS_ADD() and METRICS_SET()
+ *
+ * @attribute instructions CPU instructions run
+ * @attribute decoded Instructions dispatched from pre-decoded code
+ * @attribute frames Frames completed
+ * @attribute bus Bus reads and writes per METRICS_BUS_PAGES page
+ * @attribute queue_depth Slots filled in the last stream ring published to,
+ * 0 once the thread exits
+ * @attribute histograms Latency histograms
+ * @attribute next Next shard
+ * @attribute live A thread owns the shard
+ */
+typedef struct metrics_shard {
+    _Alignas(METRICS_CACHE_LINE) _Atomic uint64_t instructions;
+    _Atomic uint64_t decoded;
+    _Atomic uint64_t frames;
+    _Atomic uint64_t bus[METRICS_BUS_PAGES];
+    _Atomic uint64_t queue_depth;
+    metrics_histogram_t histograms[METRICS_HISTOGRAMS];
+
+    struct metrics_shard *next;
+    uint8_t live;
+} metrics_shard_t;
+
+/*
+ * @brief Writes extra samples into an export, e.g. per console ones
+ *
+ * @param file Destination
+ * @param user User data given to metrics_export_start()
+ */
+typedef void (*metrics_writer_t)(FILE *file, void *user);
+
+/*
+ * @brief Thread rewriting a metrics file periodically
+ *
+ * @warning The fields should not be used outside of the metrics module
+ *
+ * @attribute path The file, replaced atomically by renaming a temporary
+ * @attribute interval_ms Time between writes
+ * @attribute writer Extra samples, NULL for none
+ * @attribute user Passed to writer
+ * @attribute quit The thread exits
+ * @attribute lock Guards quit
+ * @attribute wake Signalled to stop
+ * @attribute thread The thread
+ */
+typedef struct {
+    char *path;
+    uint32_t interval_ms;
+    metrics_writer_t writer;
+    void *user;
+    int quit;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+} metrics_exporter_t;
+
+#ifdef NES_CONF_METRICS_ENABLE
+
+/*
+ * @brief Shard of the calling thread, NULL until it registers
+ */
+extern _Thread_local metrics_shard_t *metrics_local;
+
+/*
+ * @brief Add to a counter of the calling thread's shard
+ */
+#define METRICS_ADD(field, n) do { \
+    metrics_shard_t *shard_ = metrics_local ? metrics_local : metrics_register(); \
+    atomic_store_explicit(&shard_->field, \
+        atomic_load_explicit(&shard_->field, memory_order_relaxed) + (n), \
+        memory_order_relaxed); \
+} while (0)
+
+/*
+ * @brief Count a bus access, only with NES_CONF_METRICS_BUS_ENABLE as it
+ * costs a counter update on every memory access
+ */
+#ifdef NES_CONF_METRICS_BUS_ENABLE
+#define METRICS_BUS(address) METRICS_ADD(bus[(address) >> METRICS_BUS_PAGE_SHIFT], 1)
+#else
+#define METRICS_BUS(address)
+#endif
+
+/*
+ * @brief Set a gauge of the calling thread's shard
+ */
+#define METRICS_SET(field, value) do { \
+    metrics_shard_t *shard_ = metrics_local ? metrics_local : metrics_register(); \
+    atomic_store_explicit(&shard_->field, (value), memory_order_relaxed); \
+} while (0)
+
+/*
+ * @brief Give the calling thread a shard
+ *
+ * @return The shard, also in metrics_local
+ */
+metrics_shard_t *metrics_register();
+
+/*
+ * @brief Record a latency in the calling thread's shard
+ *
+ * @param histogram The histogram
+ * @param ns The latency
+ */
+void metrics_observe(metrics_histogram_e histogram, uint64_t ns);
+
+/*
+ * @brief Write every shard's sum in the Prometheus text exposition format
+ *
+ * @param file Destination
+ */
+void metrics_write(FILE *file);
+
+/*
+ * @brief Start a thread that rewrites a file with metrics_write() output,
+ * then the writer's, every interval
+ *
+ * @param path The file
+ * @param interval_ms Time between writes
+ * @param writer Extra samples, NULL for none
+ * @param user Passed to writer
+ *
+ * @return The exporter, NULL on failure
+ */
+metrics_exporter_t *metrics_export_start(const char *path, uint32_t interval_ms,
+    metrics_writer_t writer, void *user);
+
+/*
+ * @brief Write the file a last time and stop the thread
+ *
+ * @param exporter The exporter, NULL is ignored
+ */
+void metrics_export_stop(metrics_exporter_t *exporter);
+
+#else
+
+#define METRICS_ADD(field, n)
+#define METRICS_BUS(address)
+#define METRICS_SET(field, value)
+#define metrics_register() (NULL)
+#define metrics_observe(histogram, ns)
+#define metrics_write(file)
+#define metrics_export_start(path, interval_ms, writer, user) (NULL)
+#define metrics_export_stop(exporter)
+
+#endif // NES_CONF_METRICS_ENABLE
+
+#endif // __METRICS_H__
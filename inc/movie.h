@@ -0,0 +1,130 @@
+#ifndef __MOVIE_H__
+#define __MOVIE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "nes_conf.h"
+#include "controller.h"
+#include "nes.h"
+
+/*
+ * @brief Movie file layout
+ *
+ * A MOVIE_HEADER_SIZE header (magic, version, checkpoint interval, frame
+ * count and the FNV-1a hash of the iNES image, all little-endian) is
+ * followed by tagged chunks:
+ *
+ * MOVIE_TAG_INPUT: varint run length, then one byte per controller port,
+ * held for that many frames
+ * MOVIE_TAG_CHECKPOINT: nes_hash_ram() after the preceding frames
+ * MOVIE_TAG_END: end of the movie
+ */
+#define MOVIE_MAGIC "NESM"
+#define MOVIE_VERSION 1U
+#define MOVIE_HEADER_SIZE 20U
+
+#define MOVIE_TAG_END 0x00U
+#define MOVIE_TAG_INPUT 0x01U
+#define MOVIE_TAG_CHECKPOINT 0x02U
+
+#define MOVIE_DEFAULT_INTERVAL 60U
+
+/*
+ * @brief Movie recorder
+ *
+ * @warning The fields should not be used outside of the movie module
+ *
+ * @attribute nes Console being recorded
+ * @attribute file Output file
+ * @attribute interval Frames between checkpoints, 0 for none
+ * @attribute frames Frames recorded
+ * @attribute input Input of the pending run
+ * @attribute run Length of the pending run
+ */
+typedef struct {
+    nes_t *nes;
+    FILE *file;
+    uint16_t interval;
+    uint32_t frames;
+    uint8_t input[CONTROLLER_PORTS];
+    uint32_t run;
+} movie_recorder_t;
+
+/*
+ * @brief Playback result
+ *
+ * @attribute frames Frames played to the end
+ * @attribute checkpoints Checkpoints verified
+ * @attribute failed_frame Frame of the first mismatching checkpoint
+ */
+typedef struct {
+    uint32_t frames;
+    uint32_t checkpoints;
+    uint32_t failed_frame;
+} movie_result_t;
+
+#ifdef NES_CONF_MOVIE_ENABLE
+
+/*
+ * @brief Load a ROM and start recording a movie of it
+ *
+ * @param recorder Recorder to initialize
+ * @param nes Console to load the ROM into
+ * @param path Output file
+ * @param rom The iNES image
+ * @param size The size of the image
+ * @param interval Frames between RAM hash checkpoints, 0 for none
+ *
+ * @return 0 on success, -1 on failure
+ */
+int movie_record_open(movie_recorder_t *recorder, nes_t *nes,
+    const char *path, const uint8_t *rom, size_t size, uint16_t interval);
+
+/*
+ * @brief Run one frame with the given input and record it
+ *
+ * @param recorder Recorder
+ * @param buttons Buttons held on each controller port
+ */
+void movie_record_frame(movie_recorder_t *recorder,
+    const uint8_t buttons[CONTROLLER_PORTS]);
+
+/*
+ * @brief Finish the movie and close the file
+ *
+ * @param recorder Recorder
+ *
+ * @return 0 on success, -1 if writing failed
+ */
+int movie_record_close(movie_recorder_t *recorder);
+
+/*
+ * @brief Replay a movie as fast as possible and verify its checkpoints,
+ * with video and audio off until it returns, then as they were
+ *
+ * @param nes Console to load the ROM into
+ * @param movie The movie file contents
+ * @param movie_size The size of the movie
+ * @param rom The iNES image the movie was recorded with
+ * @param rom_size The size of the image
+ * @param result Playback result
+ *
+ * @return 0 if every checkpoint matched, 1 on a mismatch, 2 if a watchpoint
+ * or breakpoint stopped the console, -1 if the movie is invalid or was
+ * recorded with another ROM
+ */
+int movie_play(nes_t *nes, const uint8_t *movie, size_t movie_size,
+    const uint8_t *rom, size_t rom_size, movie_result_t *result);
+
+#else
+
+#define movie_record_open(recorder, nes, path, rom, size, interval) (-1)
+#define movie_record_frame(recorder, buttons)
+#define movie_record_close(recorder) (-1)
+#define movie_play(nes, movie, movie_size, rom, rom_size, result) (-1)
+
+#endif // NES_CONF_MOVIE_ENABLE
+
+#endif // __MOVIE_H__
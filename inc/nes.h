@@ -0,0 +1,506 @@
+#ifndef __NES_H__
+#define __NES_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nes_conf.h"
+#include "arena.h"
+#include "cartridge.h"
+#include "controller.h"
+#include "cpu.h"
+#include "memory.h"
+#include "ppu.h"
+#include "render.h"
+#include "watch.h"
+
+/*
+ * @brief NTSC frame timing, the PPU runs three dots per CPU cycle
+ */
+#define NES_FRAME_DOTS 89342U
+#define NES_DOTS_PER_CYCLE 3U
+
+/*
+ * @brief Video and audio output of a frame
+ *
+ * Pixels are palette indices. Until the APU is emulated a frame has no
+ * audio samples.
+ */
+#define NES_SCREEN_WIDTH 256U
+#define NES_SCREEN_HEIGHT 240U
+#define NES_AUDIO_RATE 48000U
+#define NES_AUDIO_FRAME_SAMPLES 800U
+
+#define NES_FNV_OFFSET 0xcbf29ce484222325ULL
+#define NES_FNV_PRIME 0x100000001b3ULL
+
+/*
+ * @brief Version of the libnes ABI, bumped on any incompatible change to
+ * the exported functions
+ */
+#define NES_API_VERSION 1U
+
+/*
+ * @brief Marks the functions exported by libnes.so, everything else is
+ * built with hidden visibility
+ */
+#define NES_API __attribute__((visibility("default")))
+
+/*
+ * @brief A console instance, see nes_create()
+ */
+typedef struct nes nes_t;
+
+/*
+ * @brief Console state, everything but the ROM
+ *
+ * @warning The layout is not part of the libnes ABI, library users should
+ * allocate nes_state_size() bytes instead of sizeof(nes_state_t)
+ *
+ * @attribute cpu CPU state
+ * @attribute memory Internal RAM
+ * @attribute controller Controller ports
+ * @attribute ppu PPU registers and memories
+ * @attribute frame Frames run since reset
+ * @attribute base_cycles CPU cycle counter at reset
+ * @attribute cartridge_ram_hash Zobrist hash of cartridge_ram
+ * @attribute cartridge_ram Cartridge RAM, only the mapper's RAM size is used
+ * @attribute chr_ram CHR RAM, unused with CHR ROM
+ */
+typedef struct {
+    cpu_t cpu;
+    memory_t memory;
+    controller_t controller;
+    ppu_t ppu;
+    uint64_t frame;
+    uint64_t base_cycles;
+    uint64_t cartridge_ram_hash;
+    uint8_t cartridge_ram[CARTRIDGE_RAM_MAX_SIZE];
+    uint8_t chr_ram[CHR_RAM_SIZE];
+} nes_state_t;
+
+/*
+ * @brief Run-ahead counters, the cost added per frame is
+ * (save_ns + ahead_ns + load_ns) / frames
+ *
+ * @attribute frames Frames run with run-ahead
+ * @attribute ahead Frames run ahead and rolled back
+ * @attribute save_ns Time spent saving the state
+ * @attribute ahead_ns Time spent running ahead
+ * @attribute load_ns Time spent rolling back
+ */
+typedef struct {
+    uint64_t frames;
+    uint64_t ahead;
+    uint64_t save_ns;
+    uint64_t ahead_ns;
+    uint64_t load_ns;
+} nes_run_ahead_stats_t;
+
+#ifdef NES_CONF_NES_ENABLE
+
+/*
+ * @brief Get the ABI version of the library
+ *
+ * @return NES_API_VERSION of the library build
+ */
+NES_API uint32_t nes_api_version();
+
+/*
+ * @brief Create a console with no ROM loaded
+ *
+ * This is the only call that allocates, every instance is independent and
+ * instances may run concurrently on different threads.
+ *
+ * @return The console, NULL if out of memory
+ */
+NES_API nes_t *nes_create();
+
+/*
+ * @brief Create a console with no ROM loaded in an arena, with no heap
+ * allocation
+ *
+ * @param arena Arena from nes_arena_create()
+ *
+ * @return The console, NULL if the arena is full
+ */
+NES_API nes_t *nes_create_in(arena_t *arena);
+
+/*
+ * @brief Create an arena for consoles, a single mapping on huge pages when
+ * the system has them
+ *
+ * @param count Most consoles the arena holds
+ *
+ * @return The arena, NULL on failure
+ */
+NES_API arena_t *nes_arena_create(size_t count);
+
+/*
+ * @brief Destroy an arena, its consoles must be destroyed first
+ *
+ * @param arena The arena, NULL is ignored
+ */
+NES_API void nes_arena_destroy(arena_t *arena);
+
+/*
+ * @brief Get the arena counters, e.g. whether huge pages back it
+ *
+ * @param arena The arena
+ * @param stats Destination counters
+ */
+NES_API void nes_arena_get_stats(arena_t *arena, arena_stats_t *stats);
+
+/*
+ * @brief Destroy a console
+ *
+ * @param nes The console, NULL is ignored
+ */
+NES_API void nes_destroy(nes_t *nes);
+
+/*
+ * @brief Make a console the one the calling thread's cpu_*, memory_*,
+ * cartridge_* and controller_* calls operate on
+ *
+ * Every nes_* call taking a console binds it first, so this is only needed
+ * to use the module functions directly.
+ *
+ * @param nes The console
+ */
+NES_API void nes_bind(nes_t *nes);
+
+/*
+ * @brief Load an iNES image and reset the console
+ *
+ * @param nes The console
+ * @param rom The iNES image
+ * @param size The size of the image
+ *
+ * @return 0 on success, -1 if the image cannot be loaded, the console is
+ * then left as it was
+ */
+NES_API int nes_load_rom(nes_t *nes, const uint8_t *rom, size_t size);
+
+/*
+ * @brief Reset the console, as with the reset button
+ *
+ * @param nes The console
+ */
+NES_API void nes_reset(nes_t *nes);
+
+/*
+ * @brief Map a save file as the cartridge RAM, see cartridge_map_ram().
+ * Writes reach the file with no copy and the file stays mapped until the
+ * next ROM is loaded or the console is destroyed.
+ *
+ * @param nes The console, with a ROM loaded
+ * @param path The save file, created if missing
+ *
+ * @return 0 on success, -1 on failure
+ */
+NES_API int nes_map_save(nes_t *nes, const char *path);
+
+/*
+ * @brief Write the save file out and wait for it
+ *
+ * @param nes The console
+ *
+ * @return 0 on success or if no file is mapped, -1 on failure
+ */
+NES_API int nes_sync_save(nes_t *nes);
+
+/*
+ * @brief Whether the loaded ROM has battery-backed RAM to map a save
+ * file for
+ *
+ * @param nes The console
+ *
+ * @return 1 if it has, 0 otherwise
+ */
+NES_API uint8_t nes_has_battery(nes_t *nes);
+
+/*
+ * @brief Run the ROM from pre-decoded instructions, see codemap_attach()
+ *
+ * @param nes The console
+ * @param decoded CPU_DECODED_SIZE instructions, see cpu_set_decoded(), not
+ * copied. NULL to stop using them, loading a ROM also does.
+ */
+NES_API void nes_set_decoded(nes_t *nes, const cpu_instruction_t *const *decoded);
+
+/*
+ * @brief Set the buttons held on a controller port
+ *
+ * @param nes The console
+ * @param port The port, 0 or 1
+ * @param buttons Mask of controller_button_e
+ */
+NES_API void nes_set_buttons(nes_t *nes, uint8_t port, uint8_t buttons);
+
+/*
+ * @brief Run the CPU for a number of video frames
+ *
+ * @param nes The console
+ * @param frames Number of frames
+ *
+ * @return 0 when every frame ran, 1 if a watchpoint or breakpoint stopped
+ * the console, see nes_get_hit()
+ */
+NES_API int nes_step_frames(nes_t *nes, uint32_t frames);
+
+/*
+ * @brief Set the input of and run many consoles in one call
+ *
+ * @param nes The consoles
+ * @param count Number of consoles
+ * @param frames Number of frames to run each console for
+ * @param buttons count * CONTROLLER_PORTS button masks, console after
+ * console, NULL to keep the current input
+ *
+ * @return Number of consoles stopped by a watchpoint or breakpoint
+ */
+NES_API size_t nes_step_frames_many(nes_t **nes, size_t count, uint32_t frames,
+    const uint8_t *buttons);
+
+/*
+ * @brief Get the number of frames run since the last reset
+ *
+ * @param nes The console
+ *
+ * @return The frame count
+ */
+NES_API uint64_t nes_get_frame(nes_t *nes);
+
+/*
+ * @brief Get the internal RAM, e.g. to read game variables
+ *
+ * @param nes The console
+ *
+ * @return The MEMORY_RAM_SIZE bytes of RAM
+ */
+NES_API const uint8_t *nes_get_ram(nes_t *nes);
+
+/*
+ * @brief Get the picture of the last frame
+ *
+ * @param nes The console
+ *
+ * @return NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT palette indices, row by row
+ */
+NES_API const uint8_t *nes_get_framebuffer(nes_t *nes);
+
+/*
+ * @brief Get the audio of the last frame
+ *
+ * @param nes The console
+ * @param count Set to the number of samples, at most NES_AUDIO_FRAME_SAMPLES,
+ * 0 until the APU is emulated
+ *
+ * @return Signed 16-bit mono samples at NES_AUDIO_RATE
+ */
+NES_API const int16_t *nes_get_audio(nes_t *nes, size_t *count);
+
+/*
+ * @brief Watch writes to an address, or stop watching it
+ *
+ * Only writes to the 256 byte pages holding a watched address leave the
+ * memory fast path.
+ *
+ * @param nes The console
+ * @param address The address
+ * @param mode Watch mode, WATCH_MODE_NONE to remove
+ *
+ * @return 0 on success, -1 if the mode is not valid for the address
+ */
+NES_API int nes_watch(nes_t *nes, uint16_t address, watch_mode_e mode);
+
+/*
+ * @brief Set or clear a breakpoint, the console stops before executing the
+ * instruction and runs it when resumed
+ *
+ * @param nes The console
+ * @param address The instruction address
+ * @param enable Non-zero to set, 0 to clear
+ */
+NES_API void nes_set_breakpoint(nes_t *nes, uint16_t address, uint8_t enable);
+
+/*
+ * @brief Set the function called on every hit, which decides whether the
+ * console stops
+ *
+ * @param nes The console
+ * @param handler The handler, NULL to stop on every hit
+ * @param user Passed to handler
+ */
+NES_API void nes_set_watch_handler(nes_t *nes, watch_handler_t handler,
+    void *user);
+
+/*
+ * @brief Get the last watchpoint or breakpoint hit
+ *
+ * @param nes The console
+ * @param hit Destination hit
+ */
+NES_API void nes_get_hit(nes_t *nes, watch_hit_t *hit);
+
+/*
+ * @brief Get the size of a saved console state
+ *
+ * @return The size in bytes
+ */
+NES_API size_t nes_state_size();
+
+/*
+ * @brief Save the console state
+ *
+ * @param nes The console
+ * @param state Destination state
+ */
+NES_API void nes_save_state(nes_t *nes, nes_state_t *state);
+
+/*
+ * @brief Restore a console state saved with the same ROM loaded
+ *
+ * @param nes The console
+ * @param state Source state
+ */
+NES_API void nes_load_state(nes_t *nes, const nes_state_t *state);
+
+/*
+ * @brief Enable run-ahead to hide the game's input lag
+ *
+ * Every frame then runs the real frame with its output skipped, saves the
+ * state, runs frames more with the same input, shows the output of the
+ * last one and rolls back. nes_get_framebuffer() and nes_get_audio() are
+ * thus frames ahead of nes_get_frame(). Watches and breakpoints also see
+ * the frames run ahead, a stop there only cuts them short.
+ *
+ * @param nes The console
+ * @param frames Frames to run ahead, 0 to disable
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+NES_API int nes_set_run_ahead(nes_t *nes, uint32_t frames);
+
+/*
+ * @brief Get the run-ahead counters, reset by nes_set_run_ahead()
+ *
+ * @param nes The console
+ * @param stats Destination counters
+ */
+NES_API void nes_get_run_ahead_stats(nes_t *nes, nes_run_ahead_stats_t *stats);
+
+/*
+ * @brief Turn video and audio on or off, e.g. off to replay input as fast
+ * as possible. While off, frames run without being drawn and
+ * nes_get_framebuffer() and nes_get_audio() keep the last output.
+ *
+ * @param nes The console
+ * @param enable 1 to produce output, the default, 0 to skip it
+ */
+NES_API void nes_set_output(nes_t *nes, uint8_t enable);
+
+/*
+ * @brief Get whether video and audio are on, see nes_set_output()
+ *
+ * @param nes The console
+ *
+ * @return 1 if on, 0 if off
+ */
+NES_API uint8_t nes_get_output(nes_t *nes);
+
+/*
+ * @brief Draw the console's frames on a thread of their own, so a console
+ * keeps two cores busy
+ *
+ * The CPU thread logs the PPU accesses of a frame and hands the log over
+ * at its end. The render thread replays it onto its copy of the PPU and
+ * draws the frame while the CPU runs the next one. Sprite 0 hits and
+ * status reads are still computed on the CPU thread, so the emulation is
+ * unchanged. nes_get_framebuffer() waits for the frame to be drawn: the
+ * draw overlaps the CPU when several frames are stepped per call or when
+ * the framebuffer is read after other work.
+ *
+ * @param nes The console
+ * @param enable 1 to draw on the thread, 0 to draw on the CPU thread
+ *
+ * @return 0 on success, -1 if the thread could not be started
+ */
+NES_API int nes_set_render_thread(nes_t *nes, uint8_t enable);
+
+/*
+ * @brief Continue a 64-bit FNV-1a hash over a buffer
+ *
+ * @param hash The hash so far, NES_FNV_OFFSET to start
+ * @param data The data to hash
+ * @param size The size of data
+ *
+ * @return The updated hash
+ */
+NES_API uint64_t nes_fnv(uint64_t hash, const uint8_t *data, size_t size);
+
+/*
+ * @brief Hash the internal and cartridge RAM
+ *
+ * @param nes The console
+ *
+ * @return 64-bit FNV-1a hash of the RAM contents
+ */
+NES_API uint64_t nes_hash_ram(nes_t *nes);
+
+/*
+ * @brief Get a fingerprint of the internal RAM, cartridge RAM and CPU
+ * registers, e.g. to deduplicate states in a search
+ *
+ * The RAM hashes are maintained on every write, so this is O(1). Frame and
+ * cycle counters are left out, equal states reached at different times
+ * have equal fingerprints.
+ *
+ * @param nes The console
+ *
+ * @return 64-bit fingerprint
+ */
+NES_API uint64_t nes_fingerprint(nes_t *nes);
+
+#else
+
+#define nes_api_version() (0U)
+#define nes_create() (NULL)
+#define nes_create_in(arena) (NULL)
+#define nes_arena_create(count) (NULL)
+#define nes_arena_destroy(arena)
+#define nes_arena_get_stats(arena, stats)
+#define nes_destroy(nes)
+#define nes_bind(nes)
+#define nes_load_rom(nes, rom, size) (-1)
+#define nes_reset(nes)
+#define nes_map_save(nes, path) (-1)
+#define nes_sync_save(nes) (0)
+#define nes_has_battery(nes) (0U)
+#define nes_set_decoded(nes, decoded)
+#define nes_set_buttons(nes, port, buttons)
+#define nes_step_frames(nes, frames) (0)
+#define nes_step_frames_many(nes, count, frames, buttons) (0U)
+#define nes_get_frame(nes) (0U)
+#define nes_get_ram(nes) (NULL)
+#define nes_get_framebuffer(nes) (NULL)
+#define nes_get_audio(nes, count) (*(count) = 0, NULL)
+#define nes_watch(nes, address, mode) (-1)
+#define nes_set_breakpoint(nes, address, enable)
+#define nes_set_watch_handler(nes, handler, user)
+#define nes_get_hit(nes, hit)
+#define nes_state_size() (0U)
+#define nes_save_state(nes, state)
+#define nes_load_state(nes, state)
+#define nes_set_run_ahead(nes, frames) (-1)
+#define nes_get_run_ahead_stats(nes, stats)
+#define nes_set_output(nes, enable)
+#define nes_get_output(nes) (0U)
+#define nes_set_render_thread(nes, enable) (-1)
+#define nes_fnv(hash, data, size) (hash)
+#define nes_hash_ram(nes) (0U)
+#define nes_fingerprint(nes) (0U)
+
+#endif // NES_CONF_NES_ENABLE
+
+#endif // __NES_H__
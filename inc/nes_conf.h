@@ -1,8 +1,40 @@
 #ifndef __NES_CONF_H__
 #define __NES_CONF_H__
 
-//#define NES_CONF_CPU_ENABLE
+#define NES_CONF_CPU_ENABLE
 #define NES_CONF_MEMORY_ENABLE
 #define NES_CONF_CARTRIDGE_ENABLE
+#define NES_CONF_CONTROLLER_ENABLE
+#define NES_CONF_TRACE_ENABLE
+#define NES_CONF_NES_ENABLE
+#define NES_CONF_MOVIE_ENABLE
+#define NES_CONF_REWIND_ENABLE
+#define NES_CONF_WATCH_ENABLE
+#define NES_CONF_STREAM_ENABLE
+#define NES_CONF_CAPTURE_ENABLE
+#define NES_CONF_POOL_ENABLE
+#define NES_CONF_ARENA_ENABLE
+#define NES_CONF_RUNNER_ENABLE
+#define NES_CONF_CODEMAP_ENABLE
+#define NES_CONF_METRICS_ENABLE
+#define NES_CONF_OBSERVE_ENABLE
+#define NES_CONF_CONTROL_ENABLE
+#define NES_CONF_CHR_ENABLE
+#define NES_CONF_PPU_ENABLE
+#define NES_CONF_RENDER_ENABLE
+
+/*
+ * @brief Fix the mapper at compile time, to a cartridge_type_e value.
+ * Cartridge accesses then call that mapper's handlers directly instead of
+ * through function pointers, and ROMs of other mappers are rejected.
+ * Usually set by building with make MAPPER=n.
+ */
+// #define NES_CONF_MAPPER CARTRIDGE_TYPE_NROM
+
+/*
+ * @brief Count CPU bus accesses by region in the metrics. Off by default,
+ * it adds a counter update to every memory access.
+ */
+// #define NES_CONF_METRICS_BUS_ENABLE
 
 #endif // __NES_CONF_H__
@@ -0,0 +1,206 @@
+#ifndef __OBSERVE_H__
+#define __OBSERVE_H__
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nes_conf.h"
+#include "nes.h"
+
+/*
+ * @brief Channel layout, checked by consumers before they read
+ */
+#define OBSERVE_MAGIC 0x4f53454eU /* "NESO" */
+#define OBSERVE_VERSION 1U
+
+/*
+ * @brief Header and slots written by different processes are kept on
+ * separate cache lines
+ */
+#define OBSERVE_CACHE_LINE 64U
+
+/*
+ * @brief Publications alternate between two slots, so readers of the last
+ * one are only disturbed when the producer laps them
+ */
+#define OBSERVE_SLOTS 2U
+
+/*
+ * @brief One published step of a console
+ *
+ * @attribute frame Frames run since reset
+ * @attribute fingerprint nes_fingerprint() of the console
+ * @attribute cpu CPU registers and cycle counter
+ * @attribute buttons Buttons held on every port
+ * @attribute ram Internal RAM
+ * @attribute framebuffer Palette indices of the last frame, row by row
+ */
+typedef struct {
+    uint64_t frame;
+    uint64_t fingerprint;
+    cpu_t cpu;
+    uint8_t buttons[CONTROLLER_PORTS];
+    uint8_t ram[MEMORY_RAM_SIZE];
+    uint8_t framebuffer[NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT];
+} observe_observation_t;
+
+/*
+ * @brief A slot guarded by a seqlock
+ *
+ * @attribute sequence Odd while the producer writes the slot
+ * @attribute observation The observation
+ */
+typedef struct {
+    _Alignas(OBSERVE_CACHE_LINE) _Atomic uint32_t sequence;
+    _Alignas(OBSERVE_CACHE_LINE) observe_observation_t observation;
+} observe_slot_t;
+
+/*
+ * @brief Layout of the shared memory region
+ *
+ * @warning The fields should not be used outside of the observe module
+ *
+ * @attribute magic OBSERVE_MAGIC
+ * @attribute version OBSERVE_VERSION
+ * @attribute size Size of the region, in case the layout changes
+ * @attribute published Publications so far, the futex consumers wait on.
+ * Publication n is in slot n % OBSERVE_SLOTS.
+ * @attribute waiters Consumers waiting, the producer only wakes when set
+ * @attribute slots The slots
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+
+    _Alignas(OBSERVE_CACHE_LINE) _Atomic uint32_t published;
+    _Alignas(OBSERVE_CACHE_LINE) _Atomic uint32_t waiters;
+
+    observe_slot_t slots[OBSERVE_SLOTS];
+} observe_region_t;
+
+/*
+ * @brief A process' mapping of a channel
+ *
+ * @warning The fields should not be used outside of the observe module
+ *
+ * @attribute region The mapping
+ * @attribute name Name of the shared memory object, unlinked by the
+ * producer on destroy, NULL for consumers
+ */
+typedef struct {
+    observe_region_t *region;
+    char *name;
+} observe_channel_t;
+
+/*
+ * @brief An observation being read in place
+ *
+ * @attribute observation The observation, only valid if observe_read_end()
+ * succeeds
+ * @attribute published Publication it belongs to
+ * @attribute slot Its slot
+ * @attribute sequence Sequence of the slot when the read began
+ */
+typedef struct {
+    const observe_observation_t *observation;
+    uint32_t published;
+    uint32_t slot;
+    uint32_t sequence;
+} observe_read_t;
+
+#ifdef NES_CONF_OBSERVE_ENABLE
+
+/*
+ * @brief Create a channel for a console to publish to
+ *
+ * @param name POSIX shared memory object name, e.g. "/nes-0"
+ *
+ * @return The channel, NULL on failure
+ */
+NES_API observe_channel_t *observe_create(const char *name);
+
+/*
+ * @brief Remove the shared memory object and unmap it, consumers keep
+ * their mappings
+ *
+ * @param channel The channel, NULL is ignored
+ */
+NES_API void observe_destroy(observe_channel_t *channel);
+
+/*
+ * @brief Publish the state of a console, e.g. after each step, and wake
+ * the consumers waiting
+ *
+ * A channel has a single producer. The observation is written into the
+ * slot consumers are not reading under a seqlock, then the publication
+ * counter is bumped.
+ *
+ * @param channel The channel
+ * @param nes The console
+ */
+NES_API void observe_publish(observe_channel_t *channel, nes_t *nes);
+
+/*
+ * @brief Map a channel from a consumer process
+ *
+ * @param name The name given to observe_create()
+ *
+ * @return The channel, NULL if it does not exist or its layout differs
+ */
+NES_API observe_channel_t *observe_open(const char *name);
+
+/*
+ * @brief Unmap a channel opened by a consumer
+ *
+ * @param channel The channel, NULL is ignored
+ */
+NES_API void observe_close(observe_channel_t *channel);
+
+/*
+ * @brief Start reading the last observation in place, without copying it
+ *
+ * @param channel The channel
+ * @param read Destination
+ *
+ * @return 0 on success, -1 if nothing was published yet
+ */
+NES_API int observe_read_begin(observe_channel_t *channel, observe_read_t *read);
+
+/*
+ * @brief Check that an observation was not overwritten while it was read
+ *
+ * @param channel The channel
+ * @param read The read, as set by observe_read_begin()
+ *
+ * @return 0 if what was read is consistent, -1 if the producer lapped the
+ * reader and the read has to start over
+ */
+NES_API int observe_read_end(observe_channel_t *channel, const observe_read_t *read);
+
+/*
+ * @brief Wait for a publication after a given one
+ *
+ * @param channel The channel
+ * @param published Last publication seen, e.g. observe_read_t.published
+ * @param timeout_ms Most time to wait, 0 to wait forever
+ *
+ * @return 0 if there is a newer publication, 1 on timeout
+ */
+NES_API int observe_wait(observe_channel_t *channel, uint32_t published, uint32_t timeout_ms);
+
+#else
+
+#define observe_create(name) (NULL)
+#define observe_destroy(channel)
+#define observe_publish(channel, nes)
+#define observe_open(name) (NULL)
+#define observe_close(channel)
+#define observe_read_begin(channel, read) (-1)
+#define observe_read_end(channel, read) (-1)
+#define observe_wait(channel, published, timeout_ms) (1)
+
+#endif // NES_CONF_OBSERVE_ENABLE
+
+#endif // __OBSERVE_H__
@@ -0,0 +1,135 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nes_conf.h"
+#include "nes.h"
+
+/*
+ * @brief Pool settings
+ *
+ * @attribute boot_frames Frames run from reset, with no button held,
+ * before the golden snapshot is taken
+ * @attribute warm Consoles created up front
+ * @attribute capacity Most idle consoles kept for reuse, released ones
+ * beyond it are destroyed
+ */
+typedef struct {
+    uint32_t boot_frames;
+    size_t warm;
+    size_t capacity;
+} pool_config_t;
+
+/*
+ * @brief Pool counters
+ *
+ * @attribute acquired Consoles handed out
+ * @attribute created Consoles created, up front or because none was idle
+ * @attribute idle Consoles idle right now
+ * @attribute boot_ns Time the boot frames took, paid once per pool
+ */
+typedef struct {
+    uint64_t acquired;
+    uint64_t created;
+    uint64_t idle;
+    uint64_t boot_ns;
+} pool_stats_t;
+
+/*
+ * @brief Consoles of one ROM, served from a golden snapshot
+ *
+ * @warning The fields should not be used outside of the pool module
+ *
+ * @attribute rom Copy of the iNES image, to create more consoles
+ * @attribute rom_size Size of rom
+ * @attribute golden State after the boot frames
+ * @attribute consoles Idle consoles
+ * @attribute count Number of idle consoles
+ * @attribute capacity Size of consoles
+ * @attribute acquired Consoles handed out
+ * @attribute created Consoles created
+ * @attribute boot_ns Time the boot frames took
+ * @attribute lock Guards the idle consoles and the counters
+ */
+typedef struct {
+    uint8_t *rom;
+    size_t rom_size;
+    nes_state_t *golden;
+
+    nes_t **consoles;
+    size_t count;
+    size_t capacity;
+
+    uint64_t acquired;
+    uint64_t created;
+    uint64_t boot_ns;
+
+    pthread_mutex_t lock;
+} pool_t;
+
+#ifdef NES_CONF_POOL_ENABLE
+
+/*
+ * @brief Boot a ROM once, take its golden snapshot and create the warm
+ * consoles
+ *
+ * @param rom The iNES image, copied
+ * @param size Size of the image
+ * @param config Pool settings
+ *
+ * @return The pool, NULL if the image is invalid or on allocation failure
+ */
+NES_API pool_t *pool_create(const uint8_t *rom, size_t size, const pool_config_t *config);
+
+/*
+ * @brief Destroy a pool and its idle consoles, consoles still acquired
+ * must be destroyed with nes_destroy()
+ *
+ * @param pool The pool, NULL is ignored
+ */
+NES_API void pool_destroy(pool_t *pool);
+
+/*
+ * @brief Get a console in the golden snapshot state
+ *
+ * An idle console only has the snapshot restored into it, a new one is
+ * created when none is idle. Thread safe.
+ *
+ * @param pool The pool
+ *
+ * @return The console, NULL on allocation failure
+ */
+NES_API nes_t *pool_acquire(pool_t *pool);
+
+/*
+ * @brief Hand a console back for reuse. Its watches, breakpoints,
+ * run-ahead, render thread and save file are cleared and its output is
+ * turned back on. Thread safe.
+ *
+ * @param pool The pool the console was acquired from
+ * @param nes The console
+ */
+NES_API void pool_release(pool_t *pool, nes_t *nes);
+
+/*
+ * @brief Get the pool counters
+ *
+ * @param pool The pool
+ * @param stats Destination counters
+ */
+NES_API void pool_get_stats(pool_t *pool, pool_stats_t *stats);
+
+#else
+
+#define pool_create(rom, size, config) (NULL)
+#define pool_destroy(pool)
+#define pool_acquire(pool) (NULL)
+#define pool_release(pool, nes)
+#define pool_get_stats(pool, stats)
+
+#endif // NES_CONF_POOL_ENABLE
+
+#endif // __POOL_H__
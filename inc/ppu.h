@@ -0,0 +1,356 @@
+#ifndef __PPU_H__
+#define __PPU_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nes_conf.h"
+#include "chr.h"
+
+/*
+ * @brief Registers, relative to MEMORY_PPU_REG_BASE, and the OAM DMA
+ * register relative to MEMORY_APU_IO_REG_BASE
+ */
+#define PPU_REG_CTRL 0x00U
+#define PPU_REG_MASK 0x01U
+#define PPU_REG_STATUS 0x02U
+#define PPU_REG_OAM_ADDR 0x03U
+#define PPU_REG_OAM_DATA 0x04U
+#define PPU_REG_SCROLL 0x05U
+#define PPU_REG_ADDR 0x06U
+#define PPU_REG_DATA 0x07U
+#define PPU_REG_OAM_DMA 0x14U
+
+/*
+ * @brief PPU address space
+ */
+#define PPU_NAMETABLE_BASE 0x2000U
+#define PPU_NAMETABLE_SIZE 0x0400U
+#define PPU_PALETTE_BASE 0x3F00U
+#define PPU_PALETTE_SIZE 0x20U
+#define PPU_ADDRESS_MASK 0x3FFFU
+
+/*
+ * @brief Page table of the address space in 1 KB pages: 8 of pattern
+ * tables, 4 nametable slots, then the same 4 slots mirrored up to the
+ * palette
+ */
+#define PPU_PAGE_SIZE 0x400U
+#define PPU_PAGES 16U
+#define PPU_PATTERN_PAGES 8U
+#define PPU_NAMETABLE_SLOTS 4U
+
+/*
+ * @brief Memories, VRAM is sized for four nametables so four-screen
+ * boards need no extra RAM
+ */
+#define PPU_VRAM_SIZE 0x1000U
+#define PPU_OAM_SIZE 0x100U
+#define PPU_SPRITES 64U
+#define PPU_SPRITES_PER_LINE 8U
+
+/*
+ * @brief NTSC timing in dots. A frame starts when vertical blank does, on
+ * line 241; the pre-render line follows 20 lines later and the visible
+ * lines after it.
+ */
+#define PPU_DOTS_PER_LINE 341U
+#define PPU_VBLANK_LINES 20U
+#define PPU_PRERENDER_DOT (PPU_VBLANK_LINES * PPU_DOTS_PER_LINE + 1U)
+#define PPU_VISIBLE_DOT ((PPU_VBLANK_LINES + 1U) * PPU_DOTS_PER_LINE)
+
+/*
+ * @brief PPUCTRL bits
+ */
+#define PPU_CTRL_NAMETABLE 0x03U
+#define PPU_CTRL_INCREMENT 0x04U
+#define PPU_CTRL_SPRITE_TABLE 0x08U
+#define PPU_CTRL_BACKGROUND_TABLE 0x10U
+#define PPU_CTRL_SPRITE_16 0x20U
+#define PPU_CTRL_NMI 0x80U
+
+/*
+ * @brief PPUMASK bits
+ */
+#define PPU_MASK_GRAYSCALE 0x01U
+#define PPU_MASK_BACKGROUND_LEFT 0x02U
+#define PPU_MASK_SPRITES_LEFT 0x04U
+#define PPU_MASK_BACKGROUND 0x08U
+#define PPU_MASK_SPRITES 0x10U
+
+/*
+ * @brief PPUSTATUS bits
+ */
+#define PPU_STATUS_SPRITE_ZERO 0x40U
+#define PPU_STATUS_VBLANK 0x80U
+
+/*
+ * @brief Sprite attribute bits
+ */
+#define PPU_SPRITE_PALETTE 0x03U
+#define PPU_SPRITE_BEHIND 0x20U
+#define PPU_SPRITE_FLIP_X 0x40U
+#define PPU_SPRITE_FLIP_Y 0x80U
+
+/*
+ * @brief Log of what a PPU went through, for a copy of it to replay, see
+ * ppu_set_log()
+ *
+ * @attribute data Events, back to back
+ * @attribute size Bytes used
+ * @attribute capacity Bytes allocated
+ * @attribute clock CPU cycle counter the events are timestamped with
+ * @attribute failed An event could not be stored, the log is incomplete
+ */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    const uint64_t *clock;
+    uint8_t failed;
+} ppu_log_t;
+
+/*
+ * @brief PPU state
+ *
+ * The page table points into this console's VRAM and cartridge, the
+ * drawing bookkeeping describes its framebuffer and the log belongs to
+ * its render thread, so they are kept when a state is loaded rather than
+ * copied from it.
+ *
+ * @attribute pages Memory behind each page of the address space, see
+ * ppu_map_pattern() and ppu_map_nametable()
+ * @attribute tiles First decoded tile of each pattern table page
+ * @attribute chr Pattern data the pattern table pages map, see ppu_set_chr()
+ * @attribute chr_ram The pattern data is CHR RAM, written through PPUDATA
+ * @attribute log Log the PPU records to, NULL for none
+ * @attribute generation Bumped whenever something the picture is drawn
+ * from changes: nametables, palette, OAM, pattern tables mapped, the
+ * registers the renderer reads and the latched scroll
+ * @attribute drawn Value of generation when the framebuffer was last drawn
+ * @attribute drawn_chr Generation of the pattern data then
+ * @attribute redraw The whole framebuffer is to be drawn again
+ * @attribute rows Tile rows of each nametable in VRAM written since the
+ * framebuffer was drawn
+ * @attribute drawn_ctrl, drawn_mask, drawn_scroll, drawn_scroll_x,
+ * drawn_palette, drawn_oam What the framebuffer was drawn with
+ * @attribute ctrl PPUCTRL
+ * @attribute mask PPUMASK
+ * @attribute status PPUSTATUS
+ * @attribute oam_addr OAMADDR
+ * @attribute latch Last value written to a register, read back from the
+ * undriven bits
+ * @attribute buffer PPUDATA read buffer
+ * @attribute v Current VRAM address
+ * @attribute t Temporary VRAM address, the scroll of the next frame
+ * @attribute x Fine X scroll
+ * @attribute w Second write of PPUSCROLL or PPUADDR
+ * @attribute scroll t when the frame started rendering, the picture is
+ * drawn with it
+ * @attribute scroll_x x when the frame started rendering
+ * @attribute sprite_zero Dot of the frame sprite 0 hits at, 0 if it does
+ * not or already did
+ * @attribute vram Nametables
+ * @attribute palette Palette RAM
+ * @attribute oam Sprite attributes
+ */
+typedef struct {
+    uint8_t *pages[PPU_PAGES];
+    uint32_t tiles[PPU_PATTERN_PAGES];
+    chr_cache_t *chr;
+    uint8_t chr_ram;
+    ppu_log_t *log;
+
+    uint64_t generation;
+    uint64_t drawn;
+    uint64_t drawn_chr;
+    uint8_t redraw;
+    uint32_t rows[PPU_VRAM_SIZE / PPU_NAMETABLE_SIZE];
+    uint8_t drawn_ctrl;
+    uint8_t drawn_mask;
+    uint16_t drawn_scroll;
+    uint8_t drawn_scroll_x;
+    uint8_t drawn_palette[PPU_PALETTE_SIZE];
+    uint8_t drawn_oam[PPU_OAM_SIZE];
+
+    uint8_t ctrl;
+    uint8_t mask;
+    uint8_t status;
+    uint8_t oam_addr;
+    uint8_t latch;
+    uint8_t buffer;
+    uint16_t v;
+    uint16_t t;
+    uint8_t x;
+    uint8_t w;
+    uint16_t scroll;
+    uint8_t scroll_x;
+    uint32_t sprite_zero;
+
+    uint8_t vram[PPU_VRAM_SIZE];
+    uint8_t palette[PPU_PALETTE_SIZE];
+    uint8_t oam[PPU_OAM_SIZE];
+} ppu_t;
+
+#ifdef NES_CONF_PPU_ENABLE
+
+/*
+ * @brief Make a PPU state the one the calling thread operates on
+ *
+ * @param ppu The PPU state
+ */
+void ppu_bind(ppu_t *ppu);
+
+/*
+ * @brief Initialize the PPU, keeping the page table the cartridge set up
+ */
+void ppu_init();
+
+/*
+ * @brief Set the pattern data of the cartridge, unmapping every pattern
+ * table page until ppu_map_pattern() maps them
+ *
+ * @param chr The pattern data, NULL for none
+ * @param ram 1 if it is CHR RAM, which PPUDATA writes go to
+ */
+void ppu_set_chr(chr_cache_t *chr, uint8_t ram);
+
+/*
+ * @brief Map a page of the pattern tables, e.g. when a mapper switches
+ * CHR banks
+ *
+ * @param page The page, below PPU_PATTERN_PAGES
+ * @param offset Offset of PPU_PAGE_SIZE bytes in the pattern data, the
+ * page reads as open bus without pattern data
+ */
+void ppu_map_pattern(uint32_t page, uint32_t offset);
+
+/*
+ * @brief Map a nametable slot, and its mirror, to one of the nametables
+ * in VRAM, e.g. when a mapper changes mirroring
+ *
+ * @param slot The slot, below PPU_NAMETABLE_SLOTS
+ * @param nametable The nametable, below PPU_VRAM_SIZE / PPU_NAMETABLE_SIZE
+ */
+void ppu_map_nametable(uint32_t slot, uint32_t nametable);
+
+/*
+ * @brief Write a register
+ *
+ * @param reg The register, PPU_REG_*
+ * @param data Data to write
+ */
+void ppu_write(uint8_t reg, uint8_t data);
+
+/*
+ * @brief Read a register
+ *
+ * @param reg The register, PPU_REG_*
+ *
+ * @return Data read
+ */
+uint8_t ppu_read(uint8_t reg);
+
+/*
+ * @brief Copy a page into OAM, starting at OAMADDR
+ *
+ * @param page PPU_OAM_SIZE bytes
+ */
+void ppu_dma(const uint8_t *page);
+
+/*
+ * @brief Start vertical blank, at the start of a frame
+ *
+ * @return 1 if an NMI is to be raised, 0 otherwise
+ */
+uint8_t ppu_vblank();
+
+/*
+ * @brief End vertical blank, at PPU_PRERENDER_DOT. Latches the scroll the
+ * frame is drawn with and finds where sprite 0 hits.
+ *
+ * @return The dot of the frame sprite 0 hits at, 0 if it does not
+ */
+uint32_t ppu_prerender();
+
+/*
+ * @brief Set the sprite 0 hit flag, at the dot ppu_prerender() returned
+ */
+void ppu_sprite_zero_hit();
+
+/*
+ * @brief Draw the frame from the current nametables, pattern tables,
+ * palette and OAM with the scroll latched by ppu_prerender()
+ *
+ * Only what changed since the last call is drawn: nothing when the
+ * generation has not moved, else the lines whose nametable rows or
+ * sprites changed, or everything when the palette, pattern data, scroll
+ * or registers did.
+ *
+ * @param framebuffer NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT palette indices,
+ * holding the frame the last call drew
+ */
+void ppu_render(uint8_t *framebuffer);
+
+/*
+ * @brief Copy the PPU state out
+ *
+ * @param state Destination state
+ */
+void ppu_get_state(ppu_t *state);
+
+/*
+ * @brief Replace the PPU state
+ *
+ * @param state Source state
+ */
+void ppu_set_state(const ppu_t *state);
+
+/*
+ * @brief Record everything that changes the PPU to a log from now on,
+ * starting with a snapshot of it: the pattern data and page table, CHR
+ * RAM and the state. Register accesses are timestamped with the CPU cycle
+ * they happen on, so a copy replaying them latches the scroll at the
+ * right point of the frame.
+ *
+ * @param log The log, appended to, NULL to stop recording
+ */
+void ppu_set_log(ppu_log_t *log);
+
+/*
+ * @brief Bring the PPU the calling thread operates on, a copy of the one
+ * that recorded the log, up to the end of the frame the log covers
+ *
+ * The copy ends vertical blank itself when the log reaches the pre-render
+ * line. Its status flags and sprite 0 hit are not kept, only what the
+ * picture is drawn from.
+ *
+ * @param log The log of a frame
+ * @param prerender CPU cycle of the frame's pre-render line
+ * @param chr_ram The copy's own CHR RAM, CHR_RAM_SIZE bytes, used when
+ * the recording PPU has CHR RAM. CHR ROM is shared.
+ */
+void ppu_replay(const ppu_log_t *log, uint64_t prerender, chr_cache_t *chr_ram);
+
+#else
+
+#define ppu_bind(ppu)
+#define ppu_init()
+#define ppu_set_chr(chr, ram)
+#define ppu_map_pattern(page, offset)
+#define ppu_map_nametable(slot, nametable)
+#define ppu_write(reg, data)
+#define ppu_read(reg) (0U)
+#define ppu_dma(page)
+#define ppu_vblank() (0U)
+#define ppu_prerender() (0U)
+#define ppu_sprite_zero_hit()
+#define ppu_render(framebuffer)
+#define ppu_get_state(state)
+#define ppu_set_state(state)
+#define ppu_set_log(log)
+#define ppu_replay(log, prerender, chr_ram)
+
+#endif // NES_CONF_PPU_ENABLE
+
+#endif // __PPU_H__
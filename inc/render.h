@@ -0,0 +1,112 @@
+#ifndef __RENDER_H__
+#define __RENDER_H__
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "nes_conf.h"
+#include "chr.h"
+#include "ppu.h"
+
+/*
+ * @brief A PPU drawing on its own thread from what a console's PPU logs
+ *
+ * The console's PPU stays the one the CPU reads and the one sprite 0 and
+ * the status flags come from, it only stops drawing. Its log of a frame
+ * is handed over at the end of the frame and replayed onto a copy of the
+ * PPU, which then draws the frame into the console's framebuffer while
+ * the CPU runs the next frame. The copy is the start of frame snapshot
+ * of the frame it replays, it is where the previous replay left it.
+ *
+ * @warning The fields should not be used outside of the render module
+ *
+ * @attribute ppu The copy, only touched by the thread
+ * @attribute chr_ram CHR RAM of the copy, for CHR RAM cartridges
+ * @attribute framebuffer The console's framebuffer, drawn by the thread
+ * @attribute log Log the console's PPU records the current frame to
+ * @attribute replay Log of the frame the thread replays
+ * @attribute prerender CPU cycle of the pre-render line of that frame
+ * @attribute draw The frame is drawn, not only replayed
+ * @attribute pending A frame is handed over and not yet drawn
+ * @attribute quit The thread exits once idle
+ * @attribute lock Guards pending and quit
+ * @attribute wake Signalled when a frame is handed over
+ * @attribute idle Signalled when the thread is done with a frame
+ * @attribute thread The thread
+ */
+typedef struct {
+    ppu_t ppu;
+    chr_cache_t *chr_ram;
+    uint8_t *framebuffer;
+
+    ppu_log_t log;
+    ppu_log_t replay;
+    uint64_t prerender;
+    uint8_t draw;
+    uint8_t pending;
+    uint8_t quit;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    pthread_t thread;
+} render_t;
+
+#ifdef NES_CONF_RENDER_ENABLE
+
+/*
+ * @brief Start drawing the bound PPU's frames on a thread, its log starts
+ * with a snapshot of it
+ *
+ * @param framebuffer NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT palette indices
+ * @param clock CPU cycle counter of the console
+ *
+ * @return The render thread, NULL on failure
+ */
+render_t *render_create(uint8_t *framebuffer, const uint64_t *clock);
+
+/*
+ * @brief Stop the thread once it drew the frame handed over, the bound PPU
+ * stops logging and draws its frames again
+ *
+ * @param render The render thread, NULL is ignored
+ */
+void render_destroy(render_t *render);
+
+/*
+ * @brief Hand the frame the bound PPU just ended over to the thread, once
+ * it is done with the previous one
+ *
+ * @param render The render thread
+ * @param prerender CPU cycle of the frame's pre-render line
+ * @param draw 1 to draw the frame, 0 to only keep the copy in step
+ */
+void render_submit(render_t *render, uint64_t prerender, uint8_t draw);
+
+/*
+ * @brief Wait until the framebuffer holds the last frame handed over
+ *
+ * @param render The render thread
+ */
+void render_wait(render_t *render);
+
+/*
+ * @brief Wait for the thread then start the log over from a snapshot of
+ * the bound PPU, when what it logged may no longer be valid, e.g. the
+ * CHR ROM it points to after the cartridge changed
+ *
+ * @param render The render thread
+ */
+void render_sync(render_t *render);
+
+#else
+
+#define render_create(framebuffer, clock) (NULL)
+#define render_destroy(render)
+#define render_submit(render, prerender, draw)
+#define render_wait(render)
+#define render_sync(render)
+
+#endif // NES_CONF_RENDER_ENABLE
+
+#endif // __RENDER_H__
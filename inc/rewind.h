@@ -0,0 +1,159 @@
+#ifndef __REWIND_H__
+#define __REWIND_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nes_conf.h"
+#include "nes.h"
+
+/*
+ * @brief The state is compared and encoded a 64-bit word at a time
+ */
+#define REWIND_WORD_SIZE sizeof(uint64_t)
+#define REWIND_STATE_WORDS \
+    ((sizeof(nes_state_t) + REWIND_WORD_SIZE - 1) / REWIND_WORD_SIZE)
+
+/*
+ * @brief Worst case encoded frame: every word is a literal, with a zero
+ * run and a literal length varint around each one
+ */
+#define REWIND_FRAME_MAX_SIZE \
+    (REWIND_STATE_WORDS * (REWIND_WORD_SIZE + 10U) + 10U)
+
+#define REWIND_DEFAULT_KEYFRAME_INTERVAL 60U
+
+/*
+ * @brief A console state viewed as words for XOR and zero run detection
+ *
+ * @attribute state Console state
+ * @attribute words The state as 64-bit words, zero padded
+ */
+typedef union {
+    nes_state_t state;
+    uint64_t words[REWIND_STATE_WORDS];
+} rewind_state_t;
+
+/*
+ * @brief One captured frame in the ring
+ *
+ * @attribute offset Offset of the encoded frame in the data ring
+ * @attribute size Size of the encoded frame
+ * @attribute keyframe The frame is encoded against zero instead of the
+ * previous frame
+ */
+typedef struct {
+    size_t offset;
+    uint32_t size;
+    uint8_t keyframe;
+} rewind_entry_t;
+
+/*
+ * @brief Rewind buffer
+ *
+ * Keyframes are run-length encoded states, the frames in between are the
+ * run-length encoded XOR with the previous frame. Because XOR is its own
+ * inverse, stepping back from a delta frame is a single decode.
+ *
+ * @warning The fields should not be used outside of the rewind module
+ *
+ * @attribute data Encoded frames, used as a ring
+ * @attribute capacity Size of data
+ * @attribute entries Captured frames, used as a ring
+ * @attribute max_entries Size of entries
+ * @attribute first Index of the oldest entry
+ * @attribute count Number of entries
+ * @attribute keyframe_interval Frames between keyframes
+ * @attribute since_keyframe Entries after the newest keyframe
+ * @attribute current State of the newest entry
+ * @attribute scratch State being captured
+ * @attribute encoded Encode buffer
+ */
+typedef struct {
+    uint8_t *data;
+    size_t capacity;
+
+    rewind_entry_t *entries;
+    size_t max_entries;
+    size_t first;
+    size_t count;
+
+    uint32_t keyframe_interval;
+    uint32_t since_keyframe;
+
+    rewind_state_t *current;
+    rewind_state_t *scratch;
+    uint8_t *encoded;
+} rewind_t;
+
+#ifdef NES_CONF_REWIND_ENABLE
+
+/*
+ * @brief Create a rewind buffer
+ *
+ * All memory is allocated here, capturing and rewinding never allocate.
+ *
+ * @param frames Most frames kept, e.g. seconds * 60
+ * @param bytes Size of the encoded frame ring, at least
+ * REWIND_FRAME_MAX_SIZE
+ * @param keyframe_interval Frames between keyframes
+ *
+ * @return The rewind buffer, NULL on failure
+ */
+rewind_t *rewind_create(size_t frames, size_t bytes, uint32_t keyframe_interval);
+
+/*
+ * @brief Destroy a rewind buffer
+ *
+ * @param rewind The rewind buffer
+ */
+void rewind_destroy(rewind_t *rewind);
+
+/*
+ * @brief Drop every captured frame, e.g. after loading a state
+ *
+ * @param rewind The rewind buffer
+ */
+void rewind_clear(rewind_t *rewind);
+
+/*
+ * @brief Capture the current console state, evicting the oldest frames
+ * when the buffer is full
+ *
+ * @param rewind The rewind buffer
+ * @param nes The console
+ */
+void rewind_push(rewind_t *rewind, nes_t *nes);
+
+/*
+ * @brief Restore the console to the frame captured before the newest one
+ * and drop the newest one
+ *
+ * @param rewind The rewind buffer
+ * @param nes The console, with the ROM the frames were captured with
+ *
+ * @return 0 on success, -1 if no older frame is left
+ */
+int rewind_pop(rewind_t *rewind, nes_t *nes);
+
+/*
+ * @brief Get the number of captured frames
+ *
+ * @param rewind The rewind buffer
+ *
+ * @return The number of frames
+ */
+size_t rewind_count(const rewind_t *rewind);
+
+#else
+
+#define rewind_create(frames, bytes, keyframe_interval) (NULL)
+#define rewind_destroy(rewind)
+#define rewind_clear(rewind)
+#define rewind_push(rewind, nes)
+#define rewind_pop(rewind, nes) (-1)
+#define rewind_count(rewind) (0U)
+
+#endif // NES_CONF_REWIND_ENABLE
+
+#endif // __REWIND_H__
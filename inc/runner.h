@@ -0,0 +1,228 @@
+#ifndef __RUNNER_H__
+#define __RUNNER_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nes_conf.h"
+#include "metrics.h"
+#include "nes.h"
+
+/*
+ * @brief Most CPUs the topology is read for
+ */
+#define RUNNER_MAX_CPUS 1024U
+
+/*
+ * @brief Where the topology is read from
+ */
+#define RUNNER_SYS_CPU "/sys/devices/system/cpu"
+
+/*
+ * @brief Consoles of one ROM to run
+ *
+ * @attribute rom The iNES image, only read while the runner is created
+ * @attribute size Size of the image
+ * @attribute count Number of consoles
+ */
+typedef struct {
+    const uint8_t *rom;
+    size_t size;
+    size_t count;
+} runner_job_t;
+
+/*
+ * @brief Runner settings
+ *
+ * @attribute workers Worker threads, 0 for one per CPU the process may run
+ * on. More workers than CPUs share them round-robin.
+ */
+typedef struct {
+    size_t workers;
+} runner_config_t;
+
+/*
+ * @brief A CPU and the caches and memory it is close to
+ *
+ * @attribute cpu CPU number
+ * @attribute node NUMA node, 0 without NUMA
+ * @attribute l2 Lowest CPU sharing its L2 cache, -1 if unknown
+ * @attribute l3 Lowest CPU sharing its L3 cache, -1 if unknown
+ */
+typedef struct {
+    int cpu;
+    int node;
+    int l2;
+    int l3;
+} runner_placement_t;
+
+/*
+ * @brief A worker thread and the consoles it runs
+ *
+ * @warning The fields should not be used outside of the runner module
+ *
+ * @attribute placement CPU the worker is pinned to
+ * @attribute first Index of its first console
+ * @attribute count Number of its consoles
+ * @attribute arena Its consoles, allocated on its NUMA node
+ * @attribute stopped Consoles a hit stopped in the last step
+ * @attribute runner The runner
+ * @attribute thread The thread
+ */
+typedef struct {
+    runner_placement_t placement;
+    size_t first;
+    size_t count;
+    arena_t *arena;
+    size_t stopped;
+    void *runner;
+    pthread_t thread;
+} runner_worker_t;
+
+/*
+ * @brief Consoles spread over worker threads by topology
+ *
+ * @warning The fields should not be used outside of the runner module
+ *
+ * @attribute jobs Jobs, only while the workers create the consoles
+ * @attribute job_count Number of jobs
+ * @attribute workers Workers, in topology order
+ * @attribute worker_count Number of workers
+ * @attribute consoles Every console, in job order
+ * @attribute count Number of consoles
+ * @attribute console_frames Frame counter of every console as of the last
+ * step, for the metrics exporter
+ * @attribute exporter Metrics exporter, NULL if not started
+ * @attribute frames Frames of the current step
+ * @attribute buttons Buttons of the current step
+ * @attribute generation Bumped to start a step
+ * @attribute pending Workers still busy with the step
+ * @attribute quit The workers exit at the next step
+ * @attribute failed A worker could not create its consoles
+ * @attribute lock Guards generation and pending
+ * @attribute wake Signalled when a step starts
+ * @attribute idle Signalled when the last worker finishes a step
+ */
+typedef struct {
+    const runner_job_t *jobs;
+    size_t job_count;
+
+    runner_worker_t *workers;
+    size_t worker_count;
+
+    nes_t **consoles;
+    size_t count;
+    _Atomic uint64_t *console_frames;
+    metrics_exporter_t *exporter;
+
+    uint32_t frames;
+    const uint8_t *buttons;
+    uint64_t generation;
+    size_t pending;
+    int quit;
+    _Atomic int failed;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+} runner_t;
+
+#ifdef NES_CONF_RUNNER_ENABLE
+
+/*
+ * @brief Read the topology of the CPUs the process may run on, ordered by
+ * NUMA node, L3 cache, L2 cache and CPU number
+ *
+ * @param placements Destination, RUNNER_MAX_CPUS entries
+ *
+ * @return Number of CPUs
+ */
+NES_API size_t runner_get_topology(runner_placement_t *placements);
+
+/*
+ * @brief Create the consoles and their pinned workers
+ *
+ * Workers take CPUs in topology order. Consoles are split in job order
+ * into contiguous, even shares, so consoles of a ROM run on neighbouring
+ * CPUs that share caches. Each worker copies the ROM, creates its arena
+ * and loads its consoles after it is pinned, so they sit on its NUMA node.
+ *
+ * @param jobs Consoles to create per ROM
+ * @param job_count Number of jobs
+ * @param config Runner settings
+ *
+ * @return The runner, NULL if a ROM is invalid or on failure
+ */
+NES_API runner_t *runner_create(const runner_job_t *jobs, size_t job_count,
+    const runner_config_t *config);
+
+/*
+ * @brief Stop the workers and destroy the consoles
+ *
+ * @param runner The runner, NULL is ignored
+ */
+NES_API void runner_destroy(runner_t *runner);
+
+/*
+ * @brief Run every console for a number of frames on the workers, see
+ * nes_step_frames_many()
+ *
+ * @param runner The runner
+ * @param frames Frames to run
+ * @param buttons Buttons of every console per port, NULL to leave them
+ *
+ * @return Number of consoles a hit stopped
+ */
+NES_API size_t runner_step(runner_t *runner, uint32_t frames, const uint8_t *buttons);
+
+/*
+ * @brief Get a console, e.g. to read its RAM between steps
+ *
+ * @param runner The runner
+ * @param index Index of the console, in job order
+ *
+ * @return The console
+ */
+NES_API nes_t *runner_get(runner_t *runner, size_t index);
+
+/*
+ * @brief Get where a console runs
+ *
+ * @param runner The runner
+ * @param index Index of the console, in job order
+ * @param placement Destination placement
+ */
+NES_API void runner_get_placement(runner_t *runner, size_t index,
+    runner_placement_t *placement);
+
+/*
+ * @brief Rewrite a file with the runner's metrics in the Prometheus text
+ * exposition format every interval, until the runner is destroyed
+ *
+ * Besides the process totals of metrics_write(), the file has the frame
+ * counter of every console labelled with its index and CPU, so frames per
+ * second per instance is their rate.
+ *
+ * @param runner The runner
+ * @param path The file, e.g. in a node exporter textfile directory
+ * @param interval_ms Time between writes
+ *
+ * @return 0 on success, -1 if already exporting or on failure
+ */
+NES_API int runner_export_metrics(runner_t *runner, const char *path, uint32_t interval_ms);
+
+#else
+
+#define runner_get_topology(placements) (0U)
+#define runner_create(jobs, job_count, config) (NULL)
+#define runner_destroy(runner)
+#define runner_step(runner, frames, buttons) (0U)
+#define runner_get(runner, index) (NULL)
+#define runner_get_placement(runner, index, placement)
+#define runner_export_metrics(runner, path, interval_ms) (-1)
+
+#endif // NES_CONF_RUNNER_ENABLE
+
+#endif // __RUNNER_H__
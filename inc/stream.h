@@ -0,0 +1,309 @@
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nes_conf.h"
+#include "nes.h"
+
+/*
+ * @brief Ring indices and counters written by different threads are kept
+ * on separate cache lines
+ */
+#define STREAM_CACHE_LINE 64U
+
+#define STREAM_DEFAULT_SLOTS 4U
+
+/*
+ * @brief What the producer does when a ring is full
+ *
+ * @value STREAM_POLICY_DROP_OLDEST Overwrite the oldest unread slot, the
+ * producer never waits
+ * @value STREAM_POLICY_BLOCK Wait until the consumer frees a slot
+ */
+typedef enum {
+    STREAM_POLICY_DROP_OLDEST = 0x00,
+    STREAM_POLICY_BLOCK = 0x01,
+} stream_policy_e;
+
+/*
+ * @brief Ring counters
+ *
+ * @attribute produced Slots published
+ * @attribute consumed Slots read
+ * @attribute dropped Slots overwritten before they were read
+ * @attribute stalls Times the producer waited for a free slot
+ */
+typedef struct {
+    uint64_t produced;
+    uint64_t consumed;
+    uint64_t dropped;
+    uint64_t stalls;
+} stream_ring_stats_t;
+
+/*
+ * @brief Lock-free single-producer single-consumer ring of fixed size slots
+ *
+ * head and tail only grow, a slot index is taken modulo the slot count.
+ * With STREAM_POLICY_DROP_OLDEST both threads may advance tail, the
+ * consumer copies a slot out and only keeps the copy if its compare and
+ * swap of tail succeeds, so a slot the producer reclaimed meanwhile is
+ * never returned.
+ *
+ * @warning The fields should not be used outside of the stream module
+ *
+ * @attribute head Next slot to publish, written by the producer
+ * @attribute dropped Slots dropped, written by the producer
+ * @attribute stalls Producer waits, written by the producer
+ * @attribute tail Next slot to read
+ * @attribute consumed Slots read, written by the consumer
+ * @attribute slots Slot storage
+ * @attribute slot_size Size of a slot
+ * @attribute stride Distance between slots, a multiple of STREAM_CACHE_LINE
+ * @attribute mask Slot count minus one, the count is a power of two
+ * @attribute policy Full ring policy
+ * @attribute closed The producer gives up waiting, see stream_ring_close()
+ */
+typedef struct {
+    _Alignas(STREAM_CACHE_LINE) _Atomic uint64_t head;
+    _Atomic uint64_t dropped;
+    _Atomic uint64_t stalls;
+
+    _Alignas(STREAM_CACHE_LINE) _Atomic uint64_t tail;
+    _Atomic uint64_t consumed;
+
+    _Alignas(STREAM_CACHE_LINE) uint8_t *slots;
+    size_t slot_size;
+    size_t stride;
+    uint64_t mask;
+    stream_policy_e policy;
+    _Atomic int closed;
+} stream_ring_t;
+
+/*
+ * @brief A published video frame
+ *
+ * @attribute frame Frame number since reset
+ * @attribute fingerprint nes_fingerprint() after the frame
+ * @attribute pixels Palette indices, see nes_get_framebuffer()
+ */
+typedef struct {
+    uint64_t frame;
+    uint64_t fingerprint;
+    uint8_t pixels[NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT];
+} stream_frame_t;
+
+/*
+ * @brief A published audio block
+ *
+ * @attribute frame Frame number the samples belong to
+ * @attribute count Number of samples
+ * @attribute samples Samples, see nes_get_audio()
+ */
+typedef struct {
+    uint64_t frame;
+    uint32_t count;
+    int16_t samples[NES_AUDIO_FRAME_SAMPLES];
+} stream_audio_t;
+
+/*
+ * @brief Stream settings
+ *
+ * @attribute video_slots Video ring size, 0 for no video
+ * @attribute audio_slots Audio ring size, 0 for no audio
+ * @attribute policy Full ring policy of both rings
+ * @attribute period_ns Frame period to pace emulation to, 0 to run as fast
+ * as possible
+ */
+typedef struct {
+    size_t video_slots;
+    size_t audio_slots;
+    stream_policy_e policy;
+    uint64_t period_ns;
+} stream_config_t;
+
+/*
+ * @brief Stream counters
+ *
+ * @attribute frames Frames emulated
+ * @attribute late Frames that finished after their deadline
+ * @attribute video Video ring counters
+ * @attribute audio Audio ring counters
+ */
+typedef struct {
+    uint64_t frames;
+    uint64_t late;
+    stream_ring_stats_t video;
+    stream_ring_stats_t audio;
+} stream_stats_t;
+
+/*
+ * @brief A console running on its own emulation thread
+ *
+ * @warning The fields should not be used outside of the stream module
+ *
+ * @attribute nes The console, owned by the thread while the stream runs
+ * @attribute video Video ring, NULL for none
+ * @attribute audio Audio ring, NULL for none
+ * @attribute period_ns Frame period, 0 when unpaced
+ * @attribute buttons Buttons held on each port, read before every frame
+ * @attribute running The thread keeps emulating
+ * @attribute frames Frames emulated
+ * @attribute late Frames that finished after their deadline
+ * @attribute thread Emulation thread
+ */
+typedef struct {
+    nes_t *nes;
+    stream_ring_t *video;
+    stream_ring_t *audio;
+    uint64_t period_ns;
+
+    _Atomic uint8_t buttons[CONTROLLER_PORTS];
+    _Atomic int running;
+    _Atomic uint64_t frames;
+    _Atomic uint64_t late;
+
+    pthread_t thread;
+} stream_t;
+
+#ifdef NES_CONF_STREAM_ENABLE
+
+/*
+ * @brief Create a ring
+ *
+ * @param slot_size Size of a slot
+ * @param slots Number of slots, rounded up to a power of two
+ * @param policy Full ring policy
+ *
+ * @return The ring, NULL on failure
+ */
+NES_API stream_ring_t *stream_ring_create(size_t slot_size, size_t slots,
+    stream_policy_e policy);
+
+/*
+ * @brief Destroy a ring
+ *
+ * @param ring The ring, NULL is ignored
+ */
+NES_API void stream_ring_destroy(stream_ring_t *ring);
+
+/*
+ * @brief Get the slot to fill next, producer only
+ *
+ * @param ring The ring
+ *
+ * @return The slot, NULL if the ring was closed while waiting for space
+ */
+NES_API void *stream_ring_acquire(stream_ring_t *ring);
+
+/*
+ * @brief Publish the slot returned by stream_ring_acquire(), producer only
+ *
+ * @param ring The ring
+ */
+NES_API void stream_ring_publish(stream_ring_t *ring);
+
+/*
+ * @brief Copy the oldest published slot out, consumer only
+ *
+ * @param ring The ring
+ * @param data Destination, the slot size
+ *
+ * @return 1 if a slot was read, 0 if the ring is empty
+ */
+NES_API int stream_ring_read(stream_ring_t *ring, void *data);
+
+/*
+ * @brief Wake a blocked producer and make it give up
+ *
+ * @param ring The ring
+ */
+NES_API void stream_ring_close(stream_ring_t *ring);
+
+/*
+ * @brief Get the ring counters
+ *
+ * @param ring The ring
+ * @param stats Destination counters
+ */
+NES_API void stream_ring_get_stats(stream_ring_t *ring, stream_ring_stats_t *stats);
+
+/*
+ * @brief Start emulating a console on its own thread, publishing a
+ * stream_frame_t and a stream_audio_t per frame
+ *
+ * The console must not be used by other threads until stream_stop().
+ *
+ * @param nes The console, with a ROM loaded
+ * @param config Stream settings
+ *
+ * @return The stream, NULL on failure
+ */
+NES_API stream_t *stream_start(nes_t *nes, const stream_config_t *config);
+
+/*
+ * @brief Stop the emulation thread and destroy the stream and its rings,
+ * consumers must be done reading them. The console is left where it
+ * stopped.
+ *
+ * @param stream The stream
+ */
+NES_API void stream_stop(stream_t *stream);
+
+/*
+ * @brief Get the video ring to read stream_frame_t from
+ *
+ * @param stream The stream
+ *
+ * @return The ring, NULL if the stream has no video
+ */
+NES_API stream_ring_t *stream_get_video(stream_t *stream);
+
+/*
+ * @brief Get the audio ring to read stream_audio_t from
+ *
+ * @param stream The stream
+ *
+ * @return The ring, NULL if the stream has no audio
+ */
+NES_API stream_ring_t *stream_get_audio(stream_t *stream);
+
+/*
+ * @brief Set the buttons held on a port, applied from the next frame
+ *
+ * @param stream The stream
+ * @param port The port, 0 or 1
+ * @param buttons Mask of controller_button_e
+ */
+NES_API void stream_set_buttons(stream_t *stream, uint8_t port, uint8_t buttons);
+
+/*
+ * @brief Get the stream counters
+ *
+ * @param stream The stream
+ * @param stats Destination counters
+ */
+NES_API void stream_get_stats(stream_t *stream, stream_stats_t *stats);
+
+#else
+
+#define stream_ring_create(slot_size, slots, policy) (NULL)
+#define stream_ring_destroy(ring)
+#define stream_ring_acquire(ring) (NULL)
+#define stream_ring_publish(ring)
+#define stream_ring_read(ring, data) (0)
+#define stream_ring_close(ring)
+#define stream_ring_get_stats(ring, stats)
+#define stream_start(nes, config) (NULL)
+#define stream_stop(stream)
+#define stream_get_video(stream) (NULL)
+#define stream_get_audio(stream) (NULL)
+#define stream_set_buttons(stream, port, buttons)
+#define stream_get_stats(stream, stats)
+
+#endif // NES_CONF_STREAM_ENABLE
+
+#endif // __STREAM_H__
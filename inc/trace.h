@@ -0,0 +1,189 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "nes_conf.h"
+#include "cpu.h"
+
+/*
+ * @brief Trace file layout
+ *
+ * The file starts with TRACE_MAGIC and a version byte, followed by
+ * independent blocks of up to TRACE_BLOCK_RECORDS records. Each block is
+ * a little-endian record count and payload size, then the payload. Inside
+ * a block every record is delta-encoded against the previous one, and the
+ * first record against an all-zero record, so blocks decode on their own.
+ */
+#define TRACE_MAGIC "NTRC"
+#define TRACE_VERSION 1U
+#define TRACE_HEADER_SIZE 8U
+#define TRACE_BLOCK_HEADER_SIZE 8U
+
+#define TRACE_BLOCK_RECORDS 4096U
+#define TRACE_QUEUE_BLOCKS 8U
+
+/*
+ * @brief Largest encoded record: mask, opcode, operands, pc, registers and
+ * a 10 byte cycle delta varint
+ */
+#define TRACE_RECORD_MAX_SIZE 21U
+
+/*
+ * @brief Record mask bits, the low two bits hold the operand count
+ */
+#define TRACE_MASK_OPERANDS 0x03U
+#define TRACE_MASK_PC 0x04U
+#define TRACE_MASK_A 0x08U
+#define TRACE_MASK_X 0x10U
+#define TRACE_MASK_Y 0x20U
+#define TRACE_MASK_FLAGS 0x40U
+#define TRACE_MASK_SP 0x80U
+
+/*
+ * @brief Trace output modes
+ *
+ * @value TRACE_MODE_FILE Stream every block to the file as it fills
+ * @value TRACE_MODE_RING Keep only the newest blocks in memory and write
+ * them to the file when the trace is closed. The CPU never waits for the
+ * writer, when it falls behind the oldest blocks not yet encoded are
+ * dropped and the trace has a gap.
+ */
+typedef enum {
+    TRACE_MODE_FILE = 0x00,
+    TRACE_MODE_RING = 0x01,
+} trace_mode_e;
+
+/*
+ * @brief One traced instruction, with the CPU state before it executes
+ *
+ * @attribute cycles Cycle counter
+ * @attribute pc Program counter
+ * @attribute opcode Opcode
+ * @attribute operands Operand bytes, only the first size - 1 are valid
+ * @attribute size Instruction size in bytes
+ * @attribute a The accumulator
+ * @attribute x The x register
+ * @attribute y The y register
+ * @attribute flags The CPU flags
+ * @attribute sp The stack pointer
+ */
+typedef struct {
+    uint64_t cycles;
+    uint16_t pc;
+    uint8_t opcode;
+    uint8_t operands[2];
+    uint8_t size;
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t flags;
+    uint8_t sp;
+} trace_record_t;
+
+/*
+ * @brief Trace file reader
+ *
+ * @warning The fields should not be used outside of the trace module
+ *
+ * @attribute file Trace file
+ * @attribute block Current block payload
+ * @attribute capacity Allocated size of block
+ * @attribute pos Read position in block
+ * @attribute size Payload size of block
+ * @attribute remaining Records left in block
+ * @attribute prev Previously decoded record
+ */
+typedef struct {
+    FILE *file;
+    uint8_t *block;
+    size_t capacity;
+    size_t pos;
+    size_t size;
+    uint32_t remaining;
+    trace_record_t prev;
+} trace_reader_t;
+
+#ifdef NES_CONF_TRACE_ENABLE
+
+/*
+ * @brief Start tracing every cpu_step of the console bound on the calling
+ * thread into a file
+ *
+ * There is one trace per process and it follows that console alone,
+ * other consoles stepping at the same time on other threads are not
+ * recorded. Open and close it while the console is not stepping.
+ * Encoding and writing happen on a background thread, the CPU side only
+ * copies the record into the block being filled.
+ *
+ * @param path Output file
+ * @param mode Output mode
+ * @param ring_blocks Number of blocks kept in TRACE_MODE_RING
+ *
+ * @return 0 on success, -1 on failure
+ */
+int trace_open(const char *path, trace_mode_e mode, size_t ring_blocks);
+
+/*
+ * @brief Flush pending records, stop the writer thread and close the file
+ */
+void trace_close();
+
+/*
+ * @brief Record the instruction at the program counter
+ *
+ * Does nothing when no trace is open or it follows another console.
+ *
+ * @param cpu CPU state before the instruction executes
+ * @param opcode Opcode at the program counter
+ * @param size Instruction size in bytes
+ */
+void trace_record(const cpu_t *cpu, uint8_t opcode, uint8_t size);
+
+/*
+ * @brief Open a trace file for decoding
+ *
+ * @param reader Reader to initialize
+ * @param path Trace file
+ *
+ * @return 0 on success, -1 on failure
+ */
+int trace_reader_open(trace_reader_t *reader, const char *path);
+
+/*
+ * @brief Decode the next record
+ *
+ * @param reader Reader
+ * @param record Decoded record
+ *
+ * @return 1 when a record was decoded, 0 at end of file, -1 on corruption
+ */
+int trace_reader_next(trace_reader_t *reader, trace_record_t *record);
+
+/*
+ * @brief Close a trace reader
+ *
+ * @param reader Reader
+ */
+void trace_reader_close(trace_reader_t *reader);
+
+/*
+ * @brief Format a record as a nestest style log line
+ *
+ * @param record Record to format
+ * @param buffer Output buffer
+ * @param size Size of buffer
+ */
+void trace_format(const trace_record_t *record, char *buffer, size_t size);
+
+#else
+
+#define trace_open(path, mode, ring_blocks) (-1)
+#define trace_close()
+#define trace_record(cpu, opcode, size)
+
+#endif // NES_CONF_TRACE_ENABLE
+
+#endif // __TRACE_H__
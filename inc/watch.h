@@ -0,0 +1,186 @@
+#ifndef __WATCH_H__
+#define __WATCH_H__
+
+#include <stdint.h>
+
+#include "nes_conf.h"
+
+/*
+ * @brief Bus pages and address bitmaps
+ *
+ * memory_write only leaves its fast path on pages flagged in the page
+ * table, and cpu_step tests one bit of the breakpoint bitmap per
+ * instruction.
+ */
+#define WATCH_PAGE_SIZE 0x100U
+#define WATCH_PAGES 0x100U
+#define WATCH_BITMAP_SIZE (0x10000U / 8U)
+
+#define WATCH_BIT(bitmap, address) \
+    ((bitmap)[(address) >> 3] & (1U << ((address) & 7U)))
+
+/*
+ * @brief Watch modes
+ *
+ * @value WATCH_MODE_NONE Not watched
+ * @value WATCH_MODE_WRITE Hit on every write
+ * @value WATCH_MODE_CHANGE Hit on writes that change the value, only for
+ * internal RAM and cartridge addresses, which read without side effects
+ */
+typedef enum {
+    WATCH_MODE_NONE = 0x00,
+    WATCH_MODE_WRITE = 0x01,
+    WATCH_MODE_CHANGE = 0x02,
+} watch_mode_e;
+
+/*
+ * @brief Hit types
+ *
+ * @value WATCH_HIT_WRITE A watched address was written
+ * @value WATCH_HIT_BREAK The CPU is about to execute a breakpoint
+ */
+typedef enum {
+    WATCH_HIT_WRITE = 0x01,
+    WATCH_HIT_BREAK = 0x02,
+} watch_hit_e;
+
+/*
+ * @brief A watchpoint or breakpoint hit
+ *
+ * @attribute type Hit type
+ * @attribute address Address written, or the breakpoint address
+ * @attribute value Value written
+ * @attribute old Value before the write, for WATCH_MODE_CHANGE
+ * @attribute pc Program counter at the hit
+ * @attribute cycles CPU cycle counter at the start of the instruction
+ */
+typedef struct {
+    uint8_t type;
+    uint16_t address;
+    uint8_t value;
+    uint8_t old;
+    uint16_t pc;
+    uint64_t cycles;
+} watch_hit_t;
+
+/*
+ * @brief Hit handler
+ *
+ * @param user User pointer given to watch_set_handler()
+ * @param hit The hit
+ *
+ * @return Non-zero to stop the CPU, 0 to keep running
+ */
+typedef int (*watch_handler_t)(void *user, const watch_hit_t *hit);
+
+/*
+ * @brief Watchpoints and breakpoints of a console
+ *
+ * @warning The fields should not be used outside of the watch module
+ *
+ * @attribute pages Non-zero for pages holding a watched address
+ * @attribute writes Addresses watched with WATCH_MODE_WRITE
+ * @attribute changes Addresses watched with WATCH_MODE_CHANGE
+ * @attribute breakpoints Breakpoint addresses
+ * @attribute handler Hit handler, NULL to stop on every hit
+ * @attribute user User pointer of handler
+ * @attribute hit Last hit
+ * @attribute resume The CPU stopped at the breakpoint in hit, which is
+ * skipped once when it resumes
+ */
+typedef struct {
+    uint8_t pages[WATCH_PAGES];
+    uint8_t writes[WATCH_BITMAP_SIZE];
+    uint8_t changes[WATCH_BITMAP_SIZE];
+    uint8_t breakpoints[WATCH_BITMAP_SIZE];
+
+    watch_handler_t handler;
+    void *user;
+
+    watch_hit_t hit;
+    uint8_t resume;
+} watch_t;
+
+#ifdef NES_CONF_WATCH_ENABLE
+
+/*
+ * @brief Make a watch state the one the calling thread operates on, and
+ * point the memory page traps and CPU breakpoints at it
+ *
+ * @param watch The watch state
+ */
+void watch_bind(watch_t *watch);
+
+/*
+ * @brief Remove every watchpoint, breakpoint and the handler
+ */
+void watch_init();
+
+/*
+ * @brief Watch an address, or stop watching it. An internal RAM address
+ * is watched through all of its mirrors, a write to $0810 hits a watch on
+ * $0010 and the other way round.
+ *
+ * @param address The address
+ * @param mode Watch mode, WATCH_MODE_NONE to remove
+ *
+ * @return 0 on success, -1 if the mode is not valid for the address
+ */
+int watch_set(uint16_t address, watch_mode_e mode);
+
+/*
+ * @brief Set or clear a breakpoint
+ *
+ * @param address The instruction address
+ * @param enable Non-zero to set, 0 to clear
+ */
+void watch_set_breakpoint(uint16_t address, uint8_t enable);
+
+/*
+ * @brief Set the hit handler
+ *
+ * @param handler The handler, NULL to stop on every hit
+ * @param user Passed to handler
+ */
+void watch_set_handler(watch_handler_t handler, void *user);
+
+/*
+ * @brief Get the last hit
+ *
+ * @param hit Destination hit
+ */
+void watch_get_hit(watch_hit_t *hit);
+
+/*
+ * @brief Slow path of memory_write for flagged pages, called before the
+ * data is stored
+ *
+ * @param address The address written
+ * @param data The data written
+ */
+void watch_write(uint16_t address, uint8_t data);
+
+/*
+ * @brief Slow path of cpu_step for breakpoint addresses
+ *
+ * @param pc The program counter
+ * @param cycles The CPU cycle counter
+ *
+ * @return Non-zero if the CPU stops before the instruction
+ */
+int watch_break(uint16_t pc, uint64_t cycles);
+
+#else
+
+#define watch_bind(watch)
+#define watch_init()
+#define watch_set(address, mode) (-1)
+#define watch_set_breakpoint(address, enable)
+#define watch_set_handler(handler, user)
+#define watch_get_hit(hit)
+#define watch_write(address, data)
+#define watch_break(pc, cycles) (0)
+
+#endif // NES_CONF_WATCH_ENABLE
+
+#endif // __WATCH_H__
@@ -0,0 +1,91 @@
+#define _GNU_SOURCE
+
+#include "arena.h"
+
+#ifdef NES_CONF_ARENA_ENABLE
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+arena_t *arena_create(size_t slot_size, size_t slots) {
+    arena_t *arena;
+
+    if (!slot_size || !slots || !(arena = calloc(1, sizeof(arena_t)))) {
+        return NULL;
+    }
+
+    arena->slot_size = (slot_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    arena->slots = slots;
+    arena->size = (arena->slot_size * slots + ARENA_HUGE_PAGE_SIZE - 1) &
+        ~(size_t)(ARENA_HUGE_PAGE_SIZE - 1);
+
+    /* Reserved huge pages first, then transparent ones, then base pages */
+    arena->base = mmap(NULL, arena->size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    arena->pages = ARENA_PAGES_HUGETLB;
+
+    if (arena->base == MAP_FAILED) {
+        arena->base = mmap(NULL, arena->size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (arena->base == MAP_FAILED) {
+            free(arena);
+            return NULL;
+        }
+        arena->pages = madvise(arena->base, arena->size, MADV_HUGEPAGE) == 0 ?
+            ARENA_PAGES_TRANSPARENT : ARENA_PAGES_NORMAL;
+    }
+
+    pthread_mutex_init(&arena->lock, NULL);
+    return arena;
+}
+
+void arena_destroy(arena_t *arena) {
+    if (arena) {
+        munmap(arena->base, arena->size);
+        pthread_mutex_destroy(&arena->lock);
+        free(arena);
+    }
+}
+
+void *arena_alloc(arena_t *arena) {
+    void *slot = NULL;
+    int reused = 0;
+
+    pthread_mutex_lock(&arena->lock);
+    if (arena->free) {
+        slot = arena->free;
+        arena->free = *(void **)slot;
+        reused = 1;
+    } else if (arena->next < arena->slots) {
+        slot = arena->base + arena->next++ * arena->slot_size;
+    }
+    arena->used += slot != NULL;
+    pthread_mutex_unlock(&arena->lock);
+
+    /* Never used slots are fresh anonymous pages, already zero */
+    if (reused) {
+        memset(slot, 0, arena->slot_size);
+    }
+    return slot;
+}
+
+void arena_free(arena_t *arena, void *slot) {
+    pthread_mutex_lock(&arena->lock);
+    *(void **)slot = arena->free;
+    arena->free = slot;
+    arena->used--;
+    pthread_mutex_unlock(&arena->lock);
+}
+
+void arena_get_stats(arena_t *arena, arena_stats_t *stats) {
+    pthread_mutex_lock(&arena->lock);
+    stats->slots = arena->slots;
+    stats->used = arena->used;
+    stats->slot_size = arena->slot_size;
+    stats->size = arena->size;
+    stats->pages = arena->pages;
+    pthread_mutex_unlock(&arena->lock);
+}
+
+#endif // NES_CONF_ARENA_ENABLE
@@ -0,0 +1,391 @@
+#define _GNU_SOURCE
+
+#include "capture.h"
+
+#ifdef NES_CONF_CAPTURE_ENABLE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * @brief Writer idle sleep when both rings are empty
+ */
+#define CAPTURE_IDLE_SLEEP_NS 1000000L
+
+#define CAPTURE_PLANE_SIZE (NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT)
+
+/*
+ * @brief 2C02 palette, RGB
+ */
+static const uint8_t _capture_palette[64][3] = {
+    {  84,  84,  84 }, {   0,  30, 116 }, {   8,  16, 144 }, {  48,   0, 136 },
+    {  68,   0, 100 }, {  92,   0,  48 }, {  84,   4,   0 }, {  60,  24,   0 },
+    {  32,  42,   0 }, {   8,  58,   0 }, {   0,  64,   0 }, {   0,  60,   0 },
+    {   0,  50,  60 }, {   0,   0,   0 }, {   0,   0,   0 }, {   0,   0,   0 },
+    { 152, 150, 152 }, {   8,  76, 196 }, {  48,  50, 236 }, {  92,  30, 228 },
+    { 136,  20, 176 }, { 160,  20, 100 }, { 152,  34,  32 }, { 120,  60,   0 },
+    {  84,  90,   0 }, {  40, 114,   0 }, {   8, 124,   0 }, {   0, 118,  40 },
+    {   0, 102, 120 }, {   0,   0,   0 }, {   0,   0,   0 }, {   0,   0,   0 },
+    { 236, 238, 236 }, {  76, 154, 236 }, { 120, 124, 236 }, { 176,  98, 236 },
+    { 228,  84, 236 }, { 236,  88, 180 }, { 236, 106, 100 }, { 212, 136,  32 },
+    { 160, 170,   0 }, { 116, 196,   0 }, {  76, 208,  32 }, {  56, 204, 108 },
+    {  56, 180, 204 }, {  60,  60,  60 }, {   0,   0,   0 }, {   0,   0,   0 },
+    { 236, 238, 236 }, { 168, 204, 236 }, { 188, 188, 236 }, { 212, 178, 236 },
+    { 236, 174, 236 }, { 236, 174, 212 }, { 236, 180, 176 }, { 228, 196, 144 },
+    { 204, 210, 120 }, { 180, 222, 120 }, { 168, 226, 144 }, { 152, 226, 180 },
+    { 160, 214, 228 }, { 160, 162, 160 }, {   0,   0,   0 }, {   0,   0,   0 },
+};
+
+/*
+ * @brief The palette as BT.601 limited range Y, Cb and Cr
+ */
+static uint8_t _capture_yuv[3][64];
+static pthread_once_t _capture_yuv_once = PTHREAD_ONCE_INIT;
+
+static void _capture_init_yuv() {
+    for (int i = 0; i < 64; i++) {
+        double r = _capture_palette[i][0];
+        double g = _capture_palette[i][1];
+        double b = _capture_palette[i][2];
+
+        _capture_yuv[0][i] = 16.5 + (65.481 * r + 128.553 * g + 24.966 * b) / 255.0;
+        _capture_yuv[1][i] = 128.5 + (-37.797 * r - 74.203 * g + 112.0 * b) / 255.0;
+        _capture_yuv[2][i] = 128.5 + (112.0 * r - 93.786 * g - 18.214 * b) / 255.0;
+    }
+}
+
+static void _capture_put_le(uint8_t *p, uint32_t value, int size) {
+    for (int i = 0; i < size; i++) {
+        p[i] = value >> (8 * i);
+    }
+}
+
+/*
+ * @brief Open an output file, with O_DIRECT where the file system allows it
+ */
+static int _capture_file_open(capture_file_t *file, const char *path, size_t size) {
+    file->fd = -1;
+    file->size = size;
+
+    if (!(file->buffer = aligned_alloc(CAPTURE_ALIGN, size))) {
+        return -1;
+    }
+
+    file->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    file->direct = file->fd >= 0;
+    if (file->fd < 0 && errno == EINVAL) {
+        file->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+
+    return file->fd >= 0 ? 0 : -1;
+}
+
+static void _capture_file_write(capture_file_t *file, size_t size) {
+    size_t done = 0;
+
+    while (done < size && !file->failed) {
+        ssize_t n = write(file->fd, file->buffer + done, size - done);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            file->failed = 1;
+            break;
+        }
+        done += n;
+    }
+
+    atomic_fetch_add_explicit(&file->written, done, memory_order_relaxed);
+}
+
+/*
+ * @brief Append to the buffer, writing it out in whole, aligned buffers
+ */
+static void _capture_file_put(capture_file_t *file, const void *data, size_t size) {
+    const uint8_t *p = data;
+
+    while (size) {
+        size_t n = file->size - file->used;
+
+        if (n > size) {
+            n = size;
+        }
+        memcpy(file->buffer + file->used, p, n);
+        file->used += n;
+        p += n;
+        size -= n;
+
+        if (file->used == file->size) {
+            _capture_file_write(file, file->used);
+            file->used = 0;
+        }
+    }
+}
+
+/*
+ * @brief Write the buffered tail, O_DIRECT only takes whole blocks so the
+ * partial last block and later writes go through the page cache
+ */
+static void _capture_file_flush(capture_file_t *file) {
+    size_t aligned = file->used & ~(size_t)(CAPTURE_ALIGN - 1);
+
+    _capture_file_write(file, aligned);
+    memmove(file->buffer, file->buffer + aligned, file->used - aligned);
+    file->used -= aligned;
+
+    if (file->direct) {
+        fcntl(file->fd, F_SETFL, fcntl(file->fd, F_GETFL) & ~O_DIRECT);
+        file->direct = 0;
+    }
+    _capture_file_write(file, file->used);
+    file->used = 0;
+}
+
+static int _capture_file_close(capture_file_t *file) {
+    int status;
+
+    if (file->fd >= 0) {
+        _capture_file_flush(file);
+    }
+
+    status = file->failed ? -1 : 0;
+    if (file->fd >= 0 && close(file->fd) != 0) {
+        status = -1;
+    }
+
+    free(file->buffer);
+    file->fd = -1;
+    file->buffer = NULL;
+    return status;
+}
+
+/*
+ * @brief Close a file capture_open() gave up on, removing it rather than
+ * flushing what was buffered
+ */
+static void _capture_file_discard(capture_file_t *file, const char *path) {
+    if (file->fd >= 0) {
+        close(file->fd);
+        unlink(path);
+    }
+
+    free(file->buffer);
+    file->fd = -1;
+    file->buffer = NULL;
+}
+
+static void _capture_write_frame(capture_t *capture) {
+    const uint8_t *pixels = capture->frame.pixels;
+
+    for (int plane = 0; plane < 3; plane++) {
+        uint8_t *out = capture->planes + plane * CAPTURE_PLANE_SIZE;
+
+        for (size_t i = 0; i < CAPTURE_PLANE_SIZE; i++) {
+            out[i] = _capture_yuv[plane][pixels[i] & 0x3F];
+        }
+    }
+
+    if (capture->video_format == CAPTURE_VIDEO_Y4M) {
+        _capture_file_put(&capture->video, CAPTURE_Y4M_FRAME, strlen(CAPTURE_Y4M_FRAME));
+    }
+    _capture_file_put(&capture->video, capture->planes, sizeof(capture->planes));
+    atomic_fetch_add_explicit(&capture->frames, 1, memory_order_relaxed);
+}
+
+static void _capture_write_block(capture_t *capture) {
+    uint8_t samples[NES_AUDIO_FRAME_SAMPLES * 2];
+    uint32_t count = capture->block.count;
+
+    if (count > NES_AUDIO_FRAME_SAMPLES) {
+        count = NES_AUDIO_FRAME_SAMPLES;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        _capture_put_le(&samples[2 * i], (uint16_t)capture->block.samples[i], 2);
+    }
+
+    _capture_file_put(&capture->audio, samples, 2 * count);
+    atomic_fetch_add_explicit(&capture->blocks, 1, memory_order_relaxed);
+}
+
+/*
+ * @brief Drain both rings, return the number of slots written
+ */
+static int _capture_drain(capture_t *capture) {
+    int count = 0;
+
+    while (capture->video_ring && stream_ring_read(capture->video_ring, &capture->frame)) {
+        _capture_write_frame(capture);
+        count++;
+    }
+    while (capture->audio_ring && stream_ring_read(capture->audio_ring, &capture->block)) {
+        _capture_write_block(capture);
+        count++;
+    }
+
+    return count;
+}
+
+/*
+ * @brief Writer thread, encodes and writes queued frames until closed
+ */
+static void *_capture_run(void *arg) {
+    capture_t *capture = arg;
+    struct timespec ts = { 0, CAPTURE_IDLE_SLEEP_NS };
+
+    while (atomic_load_explicit(&capture->running, memory_order_acquire)) {
+        if (!_capture_drain(capture)) {
+            nanosleep(&ts, NULL);
+        }
+    }
+    _capture_drain(capture);
+
+    return NULL;
+}
+
+static void _capture_free(capture_t *capture) {
+    stream_ring_destroy(capture->video_ring);
+    stream_ring_destroy(capture->audio_ring);
+    free(capture);
+}
+
+capture_t *capture_open(const capture_config_t *config) {
+    size_t slots = config->slots ? config->slots : CAPTURE_DEFAULT_SLOTS;
+    size_t size = config->buffer_size ? config->buffer_size : CAPTURE_DEFAULT_BUFFER_SIZE;
+    capture_t *capture;
+    int status = 0;
+
+    if (size % CAPTURE_ALIGN || !(capture = calloc(1, sizeof(capture_t)))) {
+        return NULL;
+    }
+
+    pthread_once(&_capture_yuv_once, _capture_init_yuv);
+
+    capture->video.fd = -1;
+    capture->audio.fd = -1;
+    capture->video_format = config->video_format;
+
+    if (config->video_path) {
+        status |= _capture_file_open(&capture->video, config->video_path, size);
+        if (!status && !(capture->video_ring = stream_ring_create(
+                sizeof(stream_frame_t), slots, STREAM_POLICY_DROP_OLDEST))) {
+            status = -1;
+        }
+        if (!status && capture->video_format == CAPTURE_VIDEO_Y4M) {
+            _capture_file_put(&capture->video, CAPTURE_Y4M_HEADER, strlen(CAPTURE_Y4M_HEADER));
+        }
+    }
+
+    if (!status && config->audio_path) {
+        uint8_t header[CAPTURE_WAV_HEADER_SIZE] = { 0 };
+
+        status |= _capture_file_open(&capture->audio, config->audio_path, size);
+        if (!status && !(capture->audio_ring = stream_ring_create(
+                sizeof(stream_audio_t), slots, STREAM_POLICY_DROP_OLDEST))) {
+            status = -1;
+        }
+
+        /* Sizes are filled in by capture_close */
+        if (!status) {
+            memcpy(&header[0], "RIFF", 4);
+            memcpy(&header[8], "WAVEfmt ", 8);
+            _capture_put_le(&header[16], 16, 4);
+            _capture_put_le(&header[20], 1, 2);
+            _capture_put_le(&header[22], 1, 2);
+            _capture_put_le(&header[24], NES_AUDIO_RATE, 4);
+            _capture_put_le(&header[28], NES_AUDIO_RATE * 2, 4);
+            _capture_put_le(&header[32], 2, 2);
+            _capture_put_le(&header[34], 16, 2);
+            memcpy(&header[36], "data", 4);
+            _capture_file_put(&capture->audio, header, sizeof(header));
+        }
+    }
+
+    atomic_store(&capture->running, 1);
+    if (!status && pthread_create(&capture->thread, NULL, _capture_run, capture) == 0) {
+        return capture;
+    }
+
+    _capture_file_discard(&capture->video, config->video_path);
+    _capture_file_discard(&capture->audio, config->audio_path);
+    _capture_free(capture);
+    return NULL;
+}
+
+void capture_frame(capture_t *capture, nes_t *nes) {
+    if (capture->video_ring) {
+        stream_frame_t *frame = stream_ring_acquire(capture->video_ring);
+
+        frame->frame = nes_get_frame(nes);
+        frame->fingerprint = nes_fingerprint(nes);
+        memcpy(frame->pixels, nes_get_framebuffer(nes), sizeof(frame->pixels));
+        stream_ring_publish(capture->video_ring);
+    }
+
+    if (capture->audio_ring) {
+        size_t count;
+        const int16_t *samples = nes_get_audio(nes, &count);
+        stream_audio_t *block = stream_ring_acquire(capture->audio_ring);
+
+        block->frame = nes_get_frame(nes);
+        block->count = count;
+        memcpy(block->samples, samples, count * sizeof(int16_t));
+        stream_ring_publish(capture->audio_ring);
+    }
+}
+
+int capture_close(capture_t *capture) {
+    capture_file_t *audio = &capture->audio;
+    int status = 0;
+
+    atomic_store_explicit(&capture->running, 0, memory_order_release);
+    pthread_join(capture->thread, NULL);
+
+    if (audio->fd >= 0) {
+        uint8_t riff[4], data[4];
+        uint64_t size;
+
+        _capture_file_flush(audio);
+        size = atomic_load(&audio->written) - CAPTURE_WAV_HEADER_SIZE;
+
+        /* Fill in the RIFF and data chunk sizes left out by capture_open */
+        _capture_put_le(riff, size + CAPTURE_WAV_HEADER_SIZE - 8, 4);
+        _capture_put_le(data, size, 4);
+        if (pwrite(audio->fd, riff, 4, 4) != 4 || pwrite(audio->fd, data, 4, 40) != 4) {
+            audio->failed = 1;
+        }
+    }
+
+    status |= _capture_file_close(audio);
+    status |= _capture_file_close(&capture->video);
+
+    _capture_free(capture);
+    return status;
+}
+
+void capture_get_stats(capture_t *capture, capture_stats_t *stats) {
+    stream_ring_stats_t ring;
+
+    memset(stats, 0, sizeof(capture_stats_t));
+
+    stats->frames = atomic_load_explicit(&capture->frames, memory_order_relaxed);
+    stats->blocks = atomic_load_explicit(&capture->blocks, memory_order_relaxed);
+    stats->bytes = atomic_load_explicit(&capture->video.written, memory_order_relaxed) +
+        atomic_load_explicit(&capture->audio.written, memory_order_relaxed);
+    stats->direct = capture->video.direct + capture->audio.direct;
+
+    if (capture->video_ring) {
+        stream_ring_get_stats(capture->video_ring, &ring);
+        stats->dropped += ring.dropped;
+    }
+    if (capture->audio_ring) {
+        stream_ring_get_stats(capture->audio_ring, &ring);
+        stats->dropped += ring.dropped;
+    }
+}
+
+#endif // NES_CONF_CAPTURE_ENABLE
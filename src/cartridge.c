@@ -1,13 +1,53 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "cartridge.h"
+#include "hash.h"
+#include "ppu.h"
 
 #include <string.h>
 
 #ifdef NES_CONF_CARTRIDGE_ENABLE
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * @brief Cartridge the calling thread operates on, see cartridge_bind()
+ */
+static cartridge_t _cartridge_default;
+static _Thread_local cartridge_t *_cartridge = &_cartridge_default;
+
 /*
- * @brief Cartridge data
+ * @brief Map 1 KB of the pattern data into a pattern table page of the PPU
+ *
+ * @param page The page, below PPU_PATTERN_PAGES
+ * @param offset Offset of the 1 KB in the pattern data
  */
-static cartridge_t _cartridge;
+static void _cartridge_map_chr(uint32_t page, uint32_t offset) {
+    ppu_map_pattern(page, offset);
+}
+
+/*
+ * @brief Set the mirroring and map the nametable slots of the PPU to match
+ */
+static void _cartridge_set_mirroring(cartridge_mirroring_e mirroring) {
+    _cartridge->mirroring = mirroring;
+
+    for (uint32_t slot = 0; slot < PPU_NAMETABLE_SLOTS; slot++) {
+        switch (mirroring) {
+        case CARTRIDGE_MIRRORING_HORIZONTAL:
+            ppu_map_nametable(slot, slot >> 1);
+            break;
+        case CARTRIDGE_MIRRORING_VERTICAL:
+            ppu_map_nametable(slot, slot & 1);
+            break;
+        default:
+            ppu_map_nametable(slot, slot);
+            break;
+        }
+    }
+}
 
 /*
  * @brief NROM cartridge write handler
@@ -16,7 +56,11 @@ static void _cartridge_nrom_write(uint16_t address, uint8_t data) {
     if (address >= CARTRIDGE_NROM_RAM_START && 
         address < CARTRIDGE_NROM_RAM_START + CARTRIDGE_NROM_RAM_SIZE) {
 
-        _cartridge.data.nrom.mem[address - CARTRIDGE_NROM_RAM_START] = data;
+        address -= CARTRIDGE_NROM_RAM_START;
+        _cartridge->ram_hash ^=
+            hash_byte(HASH_DOMAIN_CARTRIDGE_RAM, address, _cartridge->ram[address]) ^
+            hash_byte(HASH_DOMAIN_CARTRIDGE_RAM, address, data);
+        _cartridge->ram[address] = data;
     } 
 }
 
@@ -24,7 +68,83 @@ static void _cartridge_nrom_write(uint16_t address, uint8_t data) {
  * @brief NROM cartridge read handler
  */
 static uint8_t _cartridge_nrom_read(uint16_t address) {
-    return _cartridge.data.nrom.mem[address - CARTRIDGE_START];
+    if (address < CARTRIDGE_START) {
+        return 0;
+    }
+    if (address < CARTRIDGE_NROM_ROM_START) {
+        return _cartridge->ram[address - CARTRIDGE_NROM_RAM_START];
+    }
+    return _cartridge->data.nrom.mem[address - CARTRIDGE_START];
+}
+
+/*
+ * @brief NROM peek handler, RAM and ROM are both plain memory
+ */
+static const uint8_t *_cartridge_nrom_peek(uint16_t address, size_t *size) {
+    if (address < CARTRIDGE_START) {
+        return NULL;
+    }
+    if (address < CARTRIDGE_NROM_ROM_START) {
+        *size = CARTRIDGE_NROM_ROM_START - address;
+        return &_cartridge->ram[address - CARTRIDGE_NROM_RAM_START];
+    }
+    *size = 0x10000U - address;
+    return &_cartridge->data.nrom.mem[address - CARTRIDGE_START];
+}
+
+/*
+ * @brief NROM initializer, the RAM sits at the start of mem unless a save
+ * file is mapped over it
+ */
+static void _cartridge_nrom_init() {
+    _cartridge->ram = _cartridge->data.nrom.mem;
+    _cartridge->ram_size = CARTRIDGE_NROM_RAM_SIZE;
+}
+
+/*
+ * @brief NROM image check, 16 KB or 32 KB of PRG ROM
+ */
+static int _cartridge_nrom_check(size_t prg_size) {
+    if (prg_size != CARTRIDGE_NROM_ROM_SIZE &&
+            prg_size != CARTRIDGE_NROM_ROM_SIZE / 2) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * @brief NROM image loader, mirrors a single 16 KB PRG bank
+ */
+static void _cartridge_nrom_load(const uint8_t *prg, size_t prg_size) {
+    uint8_t *rom = &_cartridge->data.nrom.mem[CARTRIDGE_NROM_ROM_START - CARTRIDGE_START];
+
+    memcpy(rom, prg, prg_size);
+    if (prg_size != CARTRIDGE_NROM_ROM_SIZE) {
+        memcpy(rom + prg_size, prg, prg_size);
+    }
+}
+
+/*
+ * @brief NROM PPU mapper, the first 8 KB of pattern data are fixed
+ */
+static void _cartridge_nrom_map() {
+    for (uint32_t page = 0; page < PPU_PATTERN_PAGES; page++) {
+        _cartridge_map_chr(page, page * PPU_PAGE_SIZE);
+    }
+    _cartridge_set_mirroring(_cartridge->mirroring);
+}
+
+/*
+ * @brief NROM ROM patcher, the window is a plain copy of the image
+ */
+static void _cartridge_nrom_patch(uint16_t address, const uint8_t *data, size_t size) {
+    if (address < CARTRIDGE_NROM_ROM_START) {
+        return;
+    }
+    if (size > 0x10000U - address) {
+        size = 0x10000U - address;
+    }
+    memcpy(&_cartridge->data.nrom.mem[address - CARTRIDGE_START], data, size);
 }
 
 /*
@@ -32,10 +152,24 @@ static uint8_t _cartridge_nrom_read(uint16_t address) {
  *
  * @attribute write Write handler
  * @attribute read Read handler
+ * @attribute peek Direct access handler, see cartridge_peek()
+ * @attribute init Initializer, run after the cartridge is cleared
+ * @attribute check Whether the mapper takes a PRG ROM size, run before
+ * anything of the current cartridge is touched
+ * @attribute load PRG ROM loader, for a size the check accepted
+ * @attribute map Maps the PPU pattern tables and nametables from the
+ * current banks and mirroring
+ * @attribute patch ROM patcher, see cartridge_patch_rom()
  */
 typedef struct {
     cartridge_write_handler_t write;
     cartridge_read_handler_t read;
+    const uint8_t *(*peek)(uint16_t address, size_t *size);
+    void (*init)();
+    int (*check)(size_t prg_size);
+    void (*load)(const uint8_t *prg, size_t prg_size);
+    void (*map)();
+    void (*patch)(uint16_t address, const uint8_t *data, size_t size);
 } cartridge_handler_t;
 
 /*
@@ -44,26 +178,224 @@ typedef struct {
 static const cartridge_handler_t _cartridge_handlers[] = {
     [CARTRIDGE_TYPE_NROM] = {
         .write = _cartridge_nrom_write,
-        .read = _cartridge_nrom_read
+        .read = _cartridge_nrom_read,
+        .peek = _cartridge_nrom_peek,
+        .init = _cartridge_nrom_init,
+        .check = _cartridge_nrom_check,
+        .load = _cartridge_nrom_load,
+        .map = _cartridge_nrom_map,
+        .patch = _cartridge_nrom_patch
     }
 };
 
+#ifdef NES_CONF_MAPPER
+_Static_assert(NES_CONF_MAPPER < sizeof(_cartridge_handlers) / sizeof(_cartridge_handlers[0]),
+    "NES_CONF_MAPPER is not a supported mapper");
+
+/*
+ * @brief The mapper of the build, whatever the type asked for, and the
+ * only one images may use
+ */
+#define _CARTRIDGE_TYPE(type) ((cartridge_type_e)NES_CONF_MAPPER)
+#define _CARTRIDGE_SUPPORTED(mapper) ((mapper) == NES_CONF_MAPPER)
+#else
+#define _CARTRIDGE_TYPE(type) (type)
+#define _CARTRIDGE_SUPPORTED(mapper) (1)
+#endif
+
+void cartridge_bind(cartridge_t *cartridge) {
+    _cartridge = cartridge;
+}
+
 void cartridge_init(cartridge_type_e type) {
 
-    memset(&_cartridge, 0, sizeof(cartridge_t));
+    type = _CARTRIDGE_TYPE(type);
+    cartridge_release();
+    memset(_cartridge, 0, sizeof(cartridge_t));
+
+    _cartridge->type = type;
+
+    _cartridge->write = _cartridge_handlers[type].write;
+    _cartridge->read = _cartridge_handlers[type].read;
+
+    _cartridge_handlers[type].init();
+    ppu_set_chr(NULL, 0);
+    _cartridge_handlers[type].map();
+}
+
+void cartridge_release() {
+    cartridge_unmap_ram();
+    chr_release(_cartridge->chr);
+    _cartridge->chr = NULL;
+}
+
+#ifdef NES_CONF_MAPPER
 
-    _cartridge.type = type;
+/* The handlers are known at compile time and get inlined */
+void cartridge_write(uint16_t address, uint8_t data) {
+    _cartridge_handlers[NES_CONF_MAPPER].write(address, data);
+}
 
-    _cartridge.write = _cartridge_handlers[type].write;
-    _cartridge.read = _cartridge_handlers[type].read;
+uint8_t cartridge_read(uint16_t address) {
+    return _cartridge_handlers[NES_CONF_MAPPER].read(address);
 }
 
+#else
+
 void cartridge_write(uint16_t address, uint8_t data) {
-    _cartridge.write(address, data);
+    _cartridge->write(address, data);
 }
 
 uint8_t cartridge_read(uint16_t address) {
-    return _cartridge.read(address);
+    return _cartridge->read(address);
+}
+
+#endif // NES_CONF_MAPPER
+
+const uint8_t *cartridge_get_ram(size_t *size) {
+    *size = _cartridge->ram_size;
+    return _cartridge->ram;
+}
+
+uint64_t cartridge_get_ram_hash() {
+    return _cartridge->ram_hash;
+}
+
+void cartridge_set_ram(const uint8_t *data, uint64_t hash) {
+    if (_cartridge->ram) {
+        memcpy(_cartridge->ram, data, _cartridge->ram_size);
+        _cartridge->ram_hash = hash;
+    }
+}
+
+int cartridge_map_ram(const char *path) {
+    uint8_t *ram;
+    int fd;
+
+    if (!_cartridge->ram || _cartridge->mapped) {
+        return -1;
+    }
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0) {
+        return -1;
+    }
+
+    /* A new file reads as zeroed RAM, a short one is zero extended */
+    if (ftruncate(fd, _cartridge->ram_size) != 0 ||
+        (ram = mmap(NULL, _cartridge->ram_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    /* The mapping keeps the file open */
+    close(fd);
+
+    _cartridge->ram = ram;
+    _cartridge->ram_hash = hash_memory(HASH_DOMAIN_CARTRIDGE_RAM, ram, _cartridge->ram_size);
+    _cartridge->mapped = 1;
+
+    return 0;
+}
+
+int cartridge_sync_ram() {
+    if (!_cartridge->mapped) {
+        return 0;
+    }
+    return msync(_cartridge->ram, _cartridge->ram_size, MS_SYNC) == 0 ? 0 : -1;
+}
+
+void cartridge_unmap_ram() {
+    if (!_cartridge->mapped) {
+        return;
+    }
+
+    munmap(_cartridge->ram, _cartridge->ram_size);
+    _cartridge->mapped = 0;
+
+    _cartridge_handlers[_cartridge->type].init();
+    memset(_cartridge->ram, 0, _cartridge->ram_size);
+    _cartridge->ram_hash = 0;
+}
+
+uint8_t cartridge_has_battery() {
+    return _cartridge->battery;
+}
+
+const uint8_t *cartridge_peek(uint16_t address, size_t *size) {
+    return _cartridge_handlers[_cartridge->type].peek(address, size);
+}
+
+void cartridge_patch_rom(uint16_t address, const uint8_t *data, size_t size) {
+    _cartridge_handlers[_cartridge->type].patch(address, data, size);
+}
+
+const uint8_t *cartridge_get_chr_ram(size_t *size) {
+    if (!_cartridge->chr_ram) {
+        *size = 0;
+        return NULL;
+    }
+    *size = _cartridge->chr->size;
+    return _cartridge->chr->data;
+}
+
+void cartridge_set_chr_ram(const uint8_t *data) {
+    if (_cartridge->chr_ram) {
+        chr_set(_cartridge->chr, data);
+    }
+}
+
+int cartridge_load(const uint8_t *data, size_t size) {
+    const uint8_t *prg = data + CARTRIDGE_INES_HEADER_SIZE;
+    size_t prg_size, chr_size;
+    uint8_t mapper;
+    chr_cache_t *chr;
+
+    if (size < CARTRIDGE_INES_HEADER_SIZE ||
+            memcmp(data, CARTRIDGE_INES_MAGIC, 4) != 0) {
+        return -1;
+    }
+
+    prg_size = data[4] * CARTRIDGE_INES_PRG_BANK_SIZE;
+    chr_size = data[5] * CARTRIDGE_INES_CHR_BANK_SIZE;
+    mapper = (data[6] >> 4) | (data[7] & 0xF0);
+
+    if (data[6] & CARTRIDGE_INES_FLAGS6_TRAINER) {
+        prg += CARTRIDGE_INES_TRAINER_SIZE;
+    }
+
+    /* Only the first 8 KB of CHR ROM are seen until a mapper banks it */
+    if (mapper >= sizeof(_cartridge_handlers) / sizeof(_cartridge_handlers[0]) ||
+            !_CARTRIDGE_SUPPORTED(mapper) ||
+            (chr_size && chr_size < CARTRIDGE_CHR_SIZE) ||
+            (size_t)(prg - data) + prg_size + chr_size > size ||
+            _cartridge_handlers[mapper].check(prg_size) != 0) {
+        return -1;
+    }
+
+    /* Consoles running the same ROM share its decoded tiles */
+    chr = chr_size ? chr_acquire(prg + prg_size, chr_size) :
+        chr_create(CHR_RAM_SIZE);
+    if (!chr) {
+        return -1;
+    }
+
+    /* Nothing fails past this point, a rejected image leaves the cartridge as it was */
+    cartridge_init(mapper);
+    _cartridge->battery = (data[6] & CARTRIDGE_INES_FLAGS6_BATTERY) != 0;
+    if (data[6] & CARTRIDGE_INES_FLAGS6_FOUR_SCREEN) {
+        _cartridge->mirroring = CARTRIDGE_MIRRORING_FOUR_SCREEN;
+    } else if (data[6] & CARTRIDGE_INES_FLAGS6_VERTICAL) {
+        _cartridge->mirroring = CARTRIDGE_MIRRORING_VERTICAL;
+    }
+
+    _cartridge->chr_ram = !chr_size;
+    _cartridge->chr = chr;
+    ppu_set_chr(_cartridge->chr, _cartridge->chr_ram);
+    _cartridge_handlers[mapper].map();
+    _cartridge_handlers[mapper].load(prg, prg_size);
+
+    return 0;
 }
 
 #endif //NES_CONF_CARTRIDGE_ENABLE
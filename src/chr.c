@@ -0,0 +1,173 @@
+#include "chr.h"
+
+#ifdef NES_CONF_CHR_ENABLE
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * @brief Shared CHR ROM caches, guarded by _chr_lock
+ */
+static chr_cache_t *_chr_roms;
+static pthread_mutex_t _chr_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * @brief Spread the bits of a bitplane byte, most significant first, into
+ * the low bit of each byte of a row
+ */
+static uint64_t _chr_spread(uint8_t plane) {
+    uint64_t row = 0;
+
+    for (uint32_t x = 0; x < 8; x++) {
+        row |= (uint64_t)((plane >> (7 - x)) & 1) << (x * 8);
+    }
+    return row;
+}
+
+static void _chr_decode(chr_cache_t *cache, uint32_t tile) {
+    const uint8_t *planes = cache->data + tile * CHR_TILE_SIZE;
+    uint64_t *rows = cache->rows + tile * CHR_TILE_ROWS;
+
+    for (uint32_t y = 0; y < CHR_TILE_ROWS; y++) {
+        rows[y] = _chr_spread(planes[y]) | (_chr_spread(planes[y + 8]) << 1);
+    }
+}
+
+static uint64_t _chr_hash(const uint8_t *data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/*
+ * @brief Allocate a cache, its tiles not decoded
+ */
+static chr_cache_t *_chr_alloc(size_t size) {
+    chr_cache_t *cache = calloc(1, sizeof(chr_cache_t));
+
+    if (!cache || !size || size % CHR_TILE_SIZE) {
+        free(cache);
+        return NULL;
+    }
+
+    cache->size = size;
+    cache->tiles = size / CHR_TILE_SIZE;
+    if (!(cache->data = calloc(1, size)) ||
+            !(cache->rows = calloc(cache->tiles * CHR_TILE_ROWS, sizeof(uint64_t)))) {
+        free(cache->data);
+        free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+static void _chr_free(chr_cache_t *cache) {
+    free(cache->dirty);
+    free(cache->rows);
+    free(cache->data);
+    free(cache);
+}
+
+chr_cache_t *chr_acquire(const uint8_t *rom, size_t size) {
+    uint64_t hash = _chr_hash(rom, size);
+    chr_cache_t *cache;
+
+    pthread_mutex_lock(&_chr_lock);
+
+    cache = _chr_roms;
+    while (cache && (cache->size != size || cache->hash != hash ||
+            memcmp(cache->data, rom, size) != 0)) {
+        cache = cache->next;
+    }
+
+    if (!cache && (cache = _chr_alloc(size))) {
+        memcpy(cache->data, rom, size);
+        for (uint32_t tile = 0; tile < cache->tiles; tile++) {
+            _chr_decode(cache, tile);
+        }
+        cache->hash = hash;
+        cache->next = _chr_roms;
+        _chr_roms = cache;
+    }
+    if (cache) {
+        cache->references++;
+    }
+
+    pthread_mutex_unlock(&_chr_lock);
+    return cache;
+}
+
+chr_cache_t *chr_create(size_t size) {
+    chr_cache_t *cache = _chr_alloc(size);
+
+    /* Zeroed RAM decodes to zeroed rows, nothing is dirty */
+    if (cache && !(cache->dirty = calloc((cache->tiles + 63) / 64, sizeof(uint64_t)))) {
+        _chr_free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void chr_release(chr_cache_t *cache) {
+    chr_cache_t **link;
+
+    if (!cache) {
+        return;
+    }
+    if (cache->dirty) {
+        _chr_free(cache);
+        return;
+    }
+
+    pthread_mutex_lock(&_chr_lock);
+    if (--cache->references == 0) {
+        link = &_chr_roms;
+        while (*link != cache) {
+            link = &(*link)->next;
+        }
+        *link = cache->next;
+        _chr_free(cache);
+    }
+    pthread_mutex_unlock(&_chr_lock);
+}
+
+void chr_write(chr_cache_t *cache, uint32_t address, uint8_t data) {
+    uint32_t tile = address / CHR_TILE_SIZE;
+
+    if (cache->data[address] == data) {
+        return;
+    }
+    cache->data[address] = data;
+    cache->dirty[tile / 64] |= 1ULL << (tile % 64);
+    cache->generation++;
+}
+
+void chr_set(chr_cache_t *cache, const uint8_t *data) {
+    for (uint32_t tile = 0; tile < cache->tiles; tile++) {
+        size_t offset = tile * CHR_TILE_SIZE;
+
+        if (memcmp(cache->data + offset, data + offset, CHR_TILE_SIZE) != 0) {
+            memcpy(cache->data + offset, data + offset, CHR_TILE_SIZE);
+            cache->dirty[tile / 64] |= 1ULL << (tile % 64);
+            cache->generation++;
+        }
+    }
+}
+
+const uint64_t *chr_tile(chr_cache_t *cache, uint32_t tile) {
+    if (cache->dirty && (cache->dirty[tile / 64] & (1ULL << (tile % 64)))) {
+        cache->dirty[tile / 64] &= ~(1ULL << (tile % 64));
+        _chr_decode(cache, tile);
+    }
+    return cache->rows + tile * CHR_TILE_ROWS;
+}
+
+uint64_t chr_get_generation(const chr_cache_t *cache) {
+    return cache->generation;
+}
+
+#endif // NES_CONF_CHR_ENABLE
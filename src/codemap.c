@@ -0,0 +1,348 @@
+#include "codemap.h"
+
+#ifdef NES_CONF_CODEMAP_ENABLE
+
+#include "cartridge.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * @brief Flags that end a walk, the byte is already known
+ */
+#define _CODEMAP_KNOWN (CODEMAP_CODE | CODEMAP_OPERAND | CODEMAP_TABLE)
+
+/*
+ * @brief Code reached but not walked yet
+ *
+ * @attribute addresses Queued addresses, each queued at most once
+ * @attribute count Number of queued addresses
+ */
+typedef struct {
+    uint16_t addresses[CPU_DECODED_SIZE];
+    size_t count;
+} _codemap_queue_t;
+
+/*
+ * @brief Read the ROM window of a console and hash it
+ */
+static uint64_t _codemap_window(nes_t *nes, uint8_t *window) {
+    nes_bind(nes);
+    for (uint32_t i = 0; i < CPU_DECODED_SIZE; i++) {
+        window[i] = cartridge_read(CPU_DECODED_BASE + i);
+    }
+    return nes_fnv(NES_FNV_OFFSET, window, CPU_DECODED_SIZE);
+}
+
+static uint16_t _codemap_word(const uint8_t *window, uint32_t address) {
+    return window[(address - CPU_DECODED_BASE) & (CPU_DECODED_SIZE - 1)] |
+        (window[(address + 1 - CPU_DECODED_BASE) & (CPU_DECODED_SIZE - 1)] << 8);
+}
+
+/*
+ * @brief Mark an address as an entry point and queue it
+ */
+static void _codemap_push(codemap_t *map, _codemap_queue_t *queue, uint32_t address) {
+    uint8_t *flags;
+
+    if (address < CPU_DECODED_BASE || address > 0xFFFF) {
+        return;
+    }
+
+    flags = &map->flags[address - CPU_DECODED_BASE];
+    if (!(*flags & (CODEMAP_ENTRY | CODEMAP_CODE))) {
+        queue->addresses[queue->count++] = address;
+    }
+    *flags |= CODEMAP_ENTRY;
+}
+
+/*
+ * @brief Follow a jump table read by two indexed loads
+ *
+ * @param lo Base of the low bytes, or of a table of words
+ * @param hi Base of the high bytes, lo + 1 for a table of words
+ * @param offset Added to every entry, 1 for pushed RTS addresses
+ */
+static void _codemap_table(codemap_t *map, _codemap_queue_t *queue, const uint8_t *window,
+        uint16_t lo, uint16_t hi, uint16_t offset) {
+    uint32_t stride = hi == lo + 1 ? 2 : 1;
+
+    for (uint32_t i = 0; i < CODEMAP_MAX_TABLE; i++) {
+        uint32_t lo_address = lo + i * stride, hi_address = hi + i * stride;
+        uint32_t target;
+
+        if (hi_address > 0xFFFF || lo_address > 0xFFFF ||
+                (map->flags[lo_address - CPU_DECODED_BASE] & _CODEMAP_KNOWN & ~CODEMAP_TABLE) ||
+                (map->flags[hi_address - CPU_DECODED_BASE] & _CODEMAP_KNOWN & ~CODEMAP_TABLE)) {
+            break;
+        }
+
+        target = (window[lo_address - CPU_DECODED_BASE] |
+            (window[hi_address - CPU_DECODED_BASE] << 8)) + offset;
+        if (target < CPU_DECODED_BASE || target > 0xFFFF) {
+            break;
+        }
+
+        map->flags[lo_address - CPU_DECODED_BASE] |= CODEMAP_TABLE;
+        map->flags[hi_address - CPU_DECODED_BASE] |= CODEMAP_TABLE;
+        map->stats.table_entries++;
+        _codemap_push(map, queue, target);
+    }
+}
+
+static int _codemap_is(const cpu_instruction_t *instr, const char *const *mnemonics) {
+    for (; *mnemonics; mnemonics++) {
+        if (strcmp(instr->mnemonic, *mnemonics) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * @brief Walk straight-line code from an address until it leaves, jumps
+ * away or runs into known bytes
+ */
+static void _codemap_walk(codemap_t *map, _codemap_queue_t *queue, const uint8_t *window,
+        uint32_t address) {
+    static const char *const loads[] = { "LDA", "LDX", "LDY", NULL };
+    static const char *const writes[] = {
+        "STA", "STX", "STY", "INC", "DEC", "ASL", "LSR", "ROL", "ROR", NULL
+    };
+    uint16_t table[2] = { 0, 0 };
+    uint32_t tables = 0, pushes = 0;
+
+    while (address >= CPU_DECODED_BASE && address <= 0xFFFF) {
+        uint32_t offset = address - CPU_DECODED_BASE;
+        uint8_t opcode = window[offset];
+        const cpu_instruction_t *instr = cpu_get_instruction(opcode);
+        uint8_t size = cpu_get_instruction_size(opcode);
+        uint16_t operand = 0;
+
+        if ((map->flags[offset] & _CODEMAP_KNOWN) || !instr->handler ||
+                offset + size > CPU_DECODED_SIZE) {
+            return;
+        }
+        for (uint8_t i = 1; i < size; i++) {
+            if (map->flags[offset + i] & _CODEMAP_KNOWN) {
+                return;
+            }
+        }
+
+        map->flags[offset] |= CODEMAP_CODE;
+        for (uint8_t i = 1; i < size; i++) {
+            map->flags[offset + i] |= CODEMAP_OPERAND;
+            operand |= window[offset + i] << (8 * (i - 1));
+        }
+        address += size;
+
+        switch (opcode) {
+        case 0x4C: /* JMP absolute */
+            _codemap_push(map, queue, operand);
+            return;
+        case 0x6C: /* JMP indirect, through a ROM pointer or a RAM one built from a table */
+            map->flags[offset] |= CODEMAP_JUMP_TABLE;
+            if (operand >= CPU_DECODED_BASE) {
+                /* The pointer's high byte wraps within its page */
+                _codemap_push(map, queue, window[operand - CPU_DECODED_BASE] |
+                    (window[((operand & 0xFF00) | ((operand + 1) & 0xFF)) - CPU_DECODED_BASE] << 8));
+            } else if (tables >= 2) {
+                _codemap_table(map, queue, window, table[0], table[1], 0);
+            }
+            return;
+        case 0x20: /* JSR */
+            _codemap_push(map, queue, operand);
+            break;
+        case 0x60: /* RTS, a jump if the high then low byte of a table entry were pushed */
+            if (tables >= 2 && pushes >= 2) {
+                map->flags[offset] |= CODEMAP_JUMP_TABLE;
+                _codemap_table(map, queue, window, table[1], table[0], 1);
+            }
+            return;
+        case 0x40: /* RTI */
+        case 0x00: /* BRK */
+            return;
+        case 0x48: /* PHA */
+            pushes++;
+            break;
+        default:
+            break;
+        }
+
+        if (instr->mode == CPU_MODE_REL) {
+            _codemap_push(map, queue, address + (int8_t)operand);
+        }
+
+        if ((instr->mode == CPU_MODE_ABSX || instr->mode == CPU_MODE_ABSY) &&
+                operand >= CPU_DECODED_BASE && _codemap_is(instr, loads)) {
+            table[0] = table[1];
+            table[1] = operand;
+            tables++;
+        }
+
+        if ((instr->mode == CPU_MODE_ABS || instr->mode == CPU_MODE_ABSX ||
+                instr->mode == CPU_MODE_ABSY) && operand >= CPU_DECODED_BASE &&
+                _codemap_is(instr, writes)) {
+            map->flags[offset] |= CODEMAP_BANK_SWITCH;
+        }
+    }
+}
+
+/*
+ * @brief Pre-decode the instructions marked as code and count the flags
+ */
+static void _codemap_finish(codemap_t *map, const uint8_t *window) {
+    uint32_t table_entries = map->stats.table_entries;
+
+    memset(&map->stats, 0, sizeof(codemap_stats_t));
+    map->stats.table_entries = table_entries;
+
+    for (uint32_t i = 0; i < CPU_DECODED_SIZE; i++) {
+        uint8_t flags = map->flags[i];
+
+        map->decoded[i] = flags & CODEMAP_CODE ? cpu_get_instruction(window[i]) : NULL;
+        map->stats.code += (flags & (CODEMAP_CODE | CODEMAP_OPERAND)) != 0;
+        map->stats.instructions += (flags & CODEMAP_CODE) != 0;
+        map->stats.entries += (flags & CODEMAP_ENTRY) != 0;
+        map->stats.jump_tables += (flags & CODEMAP_JUMP_TABLE) != 0;
+        map->stats.bank_switches += (flags & CODEMAP_BANK_SWITCH) != 0;
+    }
+}
+
+void codemap_analyze(codemap_t *map, nes_t *nes) {
+    static const uint16_t vectors[] = { NMI_ADDR_LO, RES_ADDR_LO, IRQ_ADDR_LO };
+    uint8_t *window = malloc(CPU_DECODED_SIZE);
+    _codemap_queue_t *queue = malloc(sizeof(_codemap_queue_t));
+
+    memset(map, 0, sizeof(codemap_t));
+    if (!window || !queue) {
+        free(window);
+        free(queue);
+        return;
+    }
+
+    map->hash = _codemap_window(nes, window);
+    queue->count = 0;
+
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        _codemap_push(map, queue, _codemap_word(window, vectors[i]));
+    }
+    while (queue->count) {
+        _codemap_walk(map, queue, window, queue->addresses[--queue->count]);
+    }
+
+    _codemap_finish(map, window);
+    free(queue);
+    free(window);
+}
+
+int codemap_save(const codemap_t *map, const char *path) {
+    uint8_t header[CODEMAP_HEADER_SIZE] = { 0 };
+    FILE *file = fopen(path, "wb");
+    int status = 0;
+
+    if (!file) {
+        return -1;
+    }
+
+    memcpy(header, CODEMAP_MAGIC, 4);
+    header[4] = CODEMAP_VERSION;
+    for (size_t i = 0; i < 8; i++) {
+        header[8 + i] = map->hash >> (8 * i);
+    }
+    fwrite(header, 1, sizeof(header), file);
+
+    for (uint32_t i = 0, run; i < CPU_DECODED_SIZE; i += run) {
+        uint8_t chunk[5 + 1];
+        size_t size = 0;
+
+        run = 1;
+        while (i + run < CPU_DECODED_SIZE && map->flags[i + run] == map->flags[i]) {
+            run++;
+        }
+
+        for (uint32_t length = run; ; length >>= 7) {
+            chunk[size++] = (length & 0x7f) | (length > 0x7f ? 0x80 : 0);
+            if (length <= 0x7f) {
+                break;
+            }
+        }
+        chunk[size++] = map->flags[i];
+        fwrite(chunk, 1, size, file);
+    }
+
+    if (ferror(file)) {
+        status = -1;
+    }
+    if (fclose(file) != 0) {
+        status = -1;
+    }
+    return status;
+}
+
+int codemap_load(codemap_t *map, nes_t *nes, const uint8_t *data, size_t size) {
+    const uint8_t *p = data + CODEMAP_HEADER_SIZE, *end = data + size;
+    uint8_t *window;
+    uint64_t hash = 0;
+    uint32_t i = 0;
+
+    if (size < CODEMAP_HEADER_SIZE || memcmp(data, CODEMAP_MAGIC, 4) != 0 ||
+            data[4] != CODEMAP_VERSION || !(window = malloc(CPU_DECODED_SIZE))) {
+        return -1;
+    }
+
+    for (size_t b = 0; b < 8; b++) {
+        hash |= (uint64_t)data[8 + b] << (8 * b);
+    }
+
+    memset(map, 0, sizeof(codemap_t));
+    map->hash = _codemap_window(nes, window);
+
+    while (hash == map->hash && p < end && i < CPU_DECODED_SIZE) {
+        uint32_t run = 0;
+
+        for (int shift = 0; p < end && shift < 35; shift += 7) {
+            uint8_t byte = *p++;
+
+            run |= (uint32_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        if (p >= end || !run || run > CPU_DECODED_SIZE - i) {
+            break;
+        }
+        memset(&map->flags[i], *p++, run);
+        i += run;
+    }
+
+    if (hash != map->hash || i != CPU_DECODED_SIZE) {
+        free(window);
+        return -1;
+    }
+
+    for (i = 0; i < CPU_DECODED_SIZE; i++) {
+        map->stats.table_entries += (map->flags[i] & CODEMAP_TABLE) != 0;
+    }
+    /* A table entry spans two flagged bytes */
+    map->stats.table_entries /= 2;
+
+    _codemap_finish(map, window);
+    free(window);
+    return 0;
+}
+
+int codemap_attach(const codemap_t *map, nes_t *nes) {
+    uint8_t *window = malloc(CPU_DECODED_SIZE);
+    int status = -1;
+
+    if (window && _codemap_window(nes, window) == map->hash) {
+        nes_set_decoded(nes, map->decoded);
+        status = 0;
+    }
+    free(window);
+    return status;
+}
+
+#endif // NES_CONF_CODEMAP_ENABLE
@@ -0,0 +1,536 @@
+#define _GNU_SOURCE
+
+#include "control.h"
+
+#ifdef NES_CONF_CONTROL_ENABLE
+
+#include "hash.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * @brief iovecs gathered per sendmsg(), the kernel's UIO_MAXIOV
+ */
+#define _CONTROL_IOVECS 1024U
+
+/*
+ * @brief Start of the part of a PPU state a load copies, what comes
+ * before it is host pointers and drawing bookkeeping, see ppu_set_state()
+ */
+#define _CONTROL_PPU_STATE offsetof(ppu_t, ctrl)
+
+/*
+ * @brief Turn a saved state into its wire form, with no host addresses
+ */
+static void _control_state_out(nes_state_t *state) {
+    memset(&state->ppu, 0, _CONTROL_PPU_STATE);
+}
+
+/*
+ * @brief Turn a state off the wire into one the console can load: the
+ * hashes it claims are replaced by ones computed from its RAM
+ *
+ * @param nes The console it is loaded into, whose mapper sizes the
+ * cartridge RAM
+ */
+static void _control_state_in(nes_t *nes, nes_state_t *state) {
+    size_t size;
+
+    nes_bind(nes);
+    cartridge_get_ram(&size);
+
+    state->memory.hash = hash_memory(HASH_DOMAIN_RAM, state->memory.ram, MEMORY_RAM_SIZE);
+    state->cartridge_ram_hash = hash_memory(HASH_DOMAIN_CARTRIDGE_RAM,
+        state->cartridge_ram, size);
+}
+
+/*
+ * @brief Read or write exactly size bytes
+ *
+ * @return 0 on success, -1 on error or end of file
+ */
+static int _control_recv(int fd, void *data, size_t size) {
+    uint8_t *bytes = data;
+
+    while (size) {
+        ssize_t n = recv(fd, bytes, size, MSG_WAITALL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        bytes += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int _control_send(int fd, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+
+    while (size) {
+        ssize_t n = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        bytes += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/*
+ * @brief Send the reply gathered so far
+ *
+ * @return 0 on success, -1 if the client is gone
+ */
+static int _control_flush(control_t *control, int fd) {
+    struct msghdr msg = { .msg_iov = control->iov, .msg_iovlen = control->iov_count };
+
+    while (msg.msg_iovlen) {
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        /* A short write, resume where it stopped */
+        while (msg.msg_iovlen && (size_t)n >= msg.msg_iov->iov_len) {
+            n -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen) {
+            msg.msg_iov->iov_base = (uint8_t *)msg.msg_iov->iov_base + n;
+            msg.msg_iov->iov_len -= n;
+        }
+    }
+
+    control->iov_count = 0;
+    control->ram = 0;
+    control->sent++;
+    return 0;
+}
+
+static int _control_push(control_t *control, int fd, const void *data, size_t size) {
+    if (!size) {
+        return 0;
+    }
+    if (control->iov_count == _CONTROL_IOVECS && _control_flush(control, fd) != 0) {
+        return -1;
+    }
+
+    control->iov[control->iov_count].iov_base = (void *)data;
+    control->iov[control->iov_count].iov_len = size;
+    control->iov_count++;
+    return 0;
+}
+
+/*
+ * @brief Check a command, and size its reply
+ *
+ * @return 0 if the command can run, -1 if not
+ */
+static int _control_check(control_t *control, const control_command_t *command,
+        control_reply_t *reply) {
+    uint64_t count = command->count;
+    uint64_t size = 0;
+
+    if ((uint64_t)command->first + count > control->count) {
+        return -1;
+    }
+
+    switch (command->op) {
+    case CONTROL_STEP:
+        if (command->size && command->size != count * CONTROLLER_PORTS) {
+            return -1;
+        }
+        break;
+    case CONTROL_SAVE:
+        size = count * sizeof(nes_state_t);
+        break;
+    case CONTROL_LOAD:
+        if (command->size != count * sizeof(nes_state_t)) {
+            return -1;
+        }
+        break;
+    case CONTROL_READ:
+        if ((uint64_t)command->arg0 + command->arg1 > MEMORY_RAM_SIZE) {
+            return -1;
+        }
+        size = count * command->arg1;
+        break;
+    default:
+        return -1;
+    }
+
+    if (size > UINT32_MAX) {
+        return -1;
+    }
+    reply->size = size;
+    return 0;
+}
+
+/*
+ * @brief Run a command, gathering its reply
+ *
+ * Anything a later command changes is flushed before it does, pointing
+ * at state in place is otherwise free.
+ *
+ * @return 0 on success, -1 if the client is gone
+ */
+static int _control_run(control_t *control, int fd, const control_command_t *command,
+        const uint8_t *payload, control_reply_t *reply) {
+    nes_t **consoles = control->consoles + command->first;
+    size_t state = command->first;
+
+    if ((command->op == CONTROL_STEP || command->op == CONTROL_LOAD) && control->ram &&
+            _control_flush(control, fd) != 0) {
+        return -1;
+    }
+
+    switch (command->op) {
+    case CONTROL_STEP:
+        reply->value = nes_step_frames_many(consoles, command->count, command->arg0,
+            command->size ? payload : NULL);
+        return _control_push(control, fd, reply, sizeof(control_reply_t));
+
+    case CONTROL_SAVE:
+        if (_control_push(control, fd, reply, sizeof(control_reply_t)) != 0) {
+            return -1;
+        }
+        for (uint32_t i = 0; i < command->count; i++, state++) {
+            if (control->pending[state] == control->sent + 1 &&
+                    _control_flush(control, fd) != 0) {
+                return -1;
+            }
+            nes_save_state(consoles[i], &control->states[state]);
+            _control_state_out(&control->states[state]);
+            control->pending[state] = control->sent + 1;
+            if (_control_push(control, fd, &control->states[state], sizeof(nes_state_t)) != 0) {
+                return -1;
+            }
+        }
+        return 0;
+
+    case CONTROL_LOAD:
+        /* The payload is not aligned, it goes through the state buffers */
+        for (uint32_t i = 0; i < command->count; i++, state++) {
+            if (control->pending[state] == control->sent + 1 &&
+                    _control_flush(control, fd) != 0) {
+                return -1;
+            }
+            memcpy(&control->states[state], payload + i * sizeof(nes_state_t),
+                sizeof(nes_state_t));
+            _control_state_in(consoles[i], &control->states[state]);
+            nes_load_state(consoles[i], &control->states[state]);
+        }
+        return _control_push(control, fd, reply, sizeof(control_reply_t));
+
+    case CONTROL_READ:
+        if (_control_push(control, fd, reply, sizeof(control_reply_t)) != 0) {
+            return -1;
+        }
+        for (uint32_t i = 0; i < command->count; i++) {
+            if (_control_push(control, fd, nes_get_ram(consoles[i]) + command->arg0,
+                    command->arg1) != 0) {
+                return -1;
+            }
+        }
+        control->ram |= command->count && command->arg1;
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * @brief Read a request from a client, run it and reply
+ *
+ * @return 0 on success, -1 if the client is gone or sent a malformed
+ * request, it is then disconnected
+ */
+static int _control_serve(control_t *control, int fd) {
+    control_header_t header, reply_header;
+    control_command_t command;
+    size_t offset = 0;
+
+    if (_control_recv(fd, &header, sizeof(header)) != 0 || header.magic != CONTROL_MAGIC ||
+            header.size > CONTROL_MAX_REQUEST ||
+            header.commands > header.size / sizeof(control_command_t)) {
+        return -1;
+    }
+
+    if (header.size > control->request_capacity) {
+        uint8_t *request = realloc(control->request, header.size);
+        if (!request) {
+            return -1;
+        }
+        control->request = request;
+        control->request_capacity = header.size;
+    }
+    if (header.commands > control->replies_capacity) {
+        control_reply_t *replies = realloc(control->replies,
+            header.commands * sizeof(control_reply_t));
+        if (!replies) {
+            return -1;
+        }
+        control->replies = replies;
+        control->replies_capacity = header.commands;
+    }
+    if (_control_recv(fd, control->request, header.size) != 0) {
+        return -1;
+    }
+
+    /* Every reply is sized first, the header carries their total */
+    reply_header.magic = CONTROL_MAGIC;
+    reply_header.commands = header.commands;
+    reply_header.size = 0;
+    for (uint32_t i = 0; i < header.commands; i++) {
+        control_reply_t *reply = &control->replies[i];
+
+        if (header.size - offset < sizeof(command)) {
+            return -1;
+        }
+        memcpy(&command, control->request + offset, sizeof(command));
+        offset += sizeof(command);
+        if (header.size - offset < command.size) {
+            return -1;
+        }
+        offset += command.size;
+
+        reply->value = 0;
+        reply->size = 0;
+        reply->status = _control_check(control, &command, reply);
+        if ((uint64_t)reply_header.size + sizeof(control_reply_t) + reply->size > UINT32_MAX) {
+            reply->status = -1;
+            reply->size = 0;
+        }
+        reply_header.size += sizeof(control_reply_t) + reply->size;
+    }
+    if (offset != header.size) {
+        return -1;
+    }
+
+    if (_control_push(control, fd, &reply_header, sizeof(reply_header)) != 0) {
+        return -1;
+    }
+
+    offset = 0;
+    for (uint32_t i = 0; i < header.commands; i++) {
+        control_reply_t *reply = &control->replies[i];
+
+        memcpy(&command, control->request + offset, sizeof(command));
+        offset += sizeof(command);
+
+        if (reply->status != 0) {
+            if (_control_push(control, fd, reply, sizeof(control_reply_t)) != 0) {
+                return -1;
+            }
+        } else if (_control_run(control, fd, &command, control->request + offset, reply) != 0) {
+            return -1;
+        }
+        offset += command.size;
+    }
+
+    return control->iov_count ? _control_flush(control, fd) : 0;
+}
+
+static void _control_disconnect(control_t *control, size_t client) {
+    close(control->clients[client]);
+    control->clients[client] = -1;
+    control->iov_count = 0;
+    control->ram = 0;
+    control->sent++;
+}
+
+static void *_control_main(void *arg) {
+    control_t *control = arg;
+    struct pollfd fds[CONTROL_MAX_CLIENTS + 2];
+
+    for (;;) {
+        fds[0].fd = control->wake[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = control->listener;
+        fds[1].events = POLLIN;
+        for (size_t i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+            fds[i + 2].fd = control->clients[i];
+            fds[i + 2].events = POLLIN;
+        }
+
+        if (poll(fds, CONTROL_MAX_CLIENTS + 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (fds[0].revents) {
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            int fd = accept4(control->listener, NULL, NULL, SOCK_CLOEXEC);
+            size_t i = 0;
+
+            while (i < CONTROL_MAX_CLIENTS && control->clients[i] >= 0) {
+                i++;
+            }
+            if (fd >= 0 && i < CONTROL_MAX_CLIENTS) {
+                control->clients[i] = fd;
+            } else if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        for (size_t i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+            if (fds[i + 2].fd >= 0 && fds[i + 2].revents &&
+                    _control_serve(control, control->clients[i]) != 0) {
+                _control_disconnect(control, i);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static int _control_address(const char *path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        return -1;
+    }
+    strcpy(address->sun_path, path);
+    return 0;
+}
+
+control_t *control_create(const char *path, nes_t **consoles, size_t count) {
+    control_t *control = calloc(1, sizeof(control_t));
+    struct sockaddr_un address;
+
+    if (!control || _control_address(path, &address) != 0) {
+        free(control);
+        return NULL;
+    }
+
+    control->consoles = consoles;
+    control->count = count;
+    control->listener = -1;
+    control->wake[0] = control->wake[1] = -1;
+    for (size_t i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        control->clients[i] = -1;
+    }
+
+    if (!(control->path = strdup(path)) ||
+            !(control->states = malloc((count ? count : 1) * sizeof(nes_state_t))) ||
+            !(control->pending = calloc(count ? count : 1, sizeof(uint64_t))) ||
+            !(control->iov = malloc(_CONTROL_IOVECS * sizeof(struct iovec))) ||
+            pipe2(control->wake, O_CLOEXEC) != 0 ||
+            (control->listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        goto fail;
+    }
+
+    /* A socket left by a server that crashed is replaced, and only the
+     * owner may connect as commands load states from the wire */
+    unlink(path);
+    if (bind(control->listener, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        goto fail;
+    }
+    if (chmod(path, 0600) != 0 || listen(control->listener, CONTROL_MAX_CLIENTS) != 0 ||
+            pthread_create(&control->thread, NULL, _control_main, control) != 0) {
+        unlink(path);
+        goto fail;
+    }
+
+    return control;
+
+fail:
+    if (control->listener >= 0) {
+        close(control->listener);
+    }
+    if (control->wake[0] >= 0) {
+        close(control->wake[0]);
+        close(control->wake[1]);
+    }
+    free(control->iov);
+    free(control->pending);
+    free(control->states);
+    free(control->path);
+    free(control);
+    return NULL;
+}
+
+void control_destroy(control_t *control) {
+    if (!control) {
+        return;
+    }
+
+    while (write(control->wake[1], "", 1) < 0 && errno == EINTR) {
+        /* Retried, the thread has to wake */
+    }
+    pthread_join(control->thread, NULL);
+
+    for (size_t i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (control->clients[i] >= 0) {
+            close(control->clients[i]);
+        }
+    }
+    close(control->listener);
+    close(control->wake[0]);
+    close(control->wake[1]);
+    unlink(control->path);
+
+    free(control->request);
+    free(control->replies);
+    free(control->iov);
+    free(control->pending);
+    free(control->states);
+    free(control->path);
+    free(control);
+}
+
+int control_connect(const char *path) {
+    struct sockaddr_un address;
+    int fd;
+
+    if (_control_address(path, &address) != 0 ||
+            (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+long control_call(int fd, const void *request, size_t size, void *reply, size_t capacity) {
+    control_header_t header;
+
+    if (capacity < sizeof(header) || _control_send(fd, request, size) != 0 ||
+            _control_recv(fd, &header, sizeof(header)) != 0 || header.magic != CONTROL_MAGIC ||
+            header.size > capacity - sizeof(header)) {
+        return -1;
+    }
+
+    memcpy(reply, &header, sizeof(header));
+    if (_control_recv(fd, (uint8_t *)reply + sizeof(header), header.size) != 0) {
+        return -1;
+    }
+    return sizeof(header) + header.size;
+}
+
+#endif // NES_CONF_CONTROL_ENABLE
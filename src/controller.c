@@ -0,0 +1,58 @@
+#include "controller.h"
+
+#ifdef NES_CONF_CONTROLLER_ENABLE
+
+#include <string.h>
+
+/*
+ * @brief Controller ports the calling thread operates on, see
+ * controller_bind()
+ */
+static controller_t _controller_default;
+static _Thread_local controller_t *_controller = &_controller_default;
+
+void controller_bind(controller_t *controller) {
+    _controller = controller;
+}
+
+void controller_init() {
+    memset(_controller, 0, sizeof(controller_t));
+}
+
+void controller_set_buttons(uint8_t port, uint8_t buttons) {
+    _controller->buttons[port] = buttons;
+    if (_controller->strobe) {
+        _controller->shift[port] = buttons;
+    }
+}
+
+void controller_write(uint8_t data) {
+    _controller->strobe = data & 1;
+    if (_controller->strobe) {
+        memcpy(_controller->shift, _controller->buttons, CONTROLLER_PORTS);
+    }
+}
+
+uint8_t controller_read(uint8_t port) {
+    uint8_t bit;
+
+    if (_controller->strobe) {
+        return (_controller->buttons[port] & CONTROLLER_BUTTON_A) | CONTROLLER_OPEN_BUS;
+    }
+
+    /* Official controllers report 1 once all eight buttons are shifted out */
+    bit = _controller->shift[port] & 1;
+    _controller->shift[port] = (_controller->shift[port] >> 1) | 0x80;
+
+    return bit | CONTROLLER_OPEN_BUS;
+}
+
+void controller_get_state(controller_t *state) {
+    *state = *_controller;
+}
+
+void controller_set_state(const controller_t *state) {
+    *_controller = *state;
+}
+
+#endif // NES_CONF_CONTROLLER_ENABLE
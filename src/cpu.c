@@ -1,172 +1,196 @@
 #include "cpu.h"
 #include "memory.h"
+#include "metrics.h"
+#include "trace.h"
+#include "watch.h"
 
 #include <string.h>
 
 #ifdef NES_CONF_CPU_ENABLE
 
-static cpu_t _cpu;
+/*
+ * @brief CPU state the calling thread operates on, see cpu_bind()
+ */
+static cpu_t _cpu_default;
+static _Thread_local cpu_t *_cpu = &_cpu_default;
+
+/*
+ * @brief Breakpoint bitmap checked by cpu_step, see cpu_set_breakpoints()
+ */
+static const uint8_t _cpu_no_breakpoints[WATCH_BITMAP_SIZE];
+static _Thread_local const uint8_t *_cpu_breakpoints = _cpu_no_breakpoints;
+
+/*
+ * @brief Pre-decoded instructions of the ROM window, see cpu_set_decoded()
+ */
+static _Thread_local const cpu_instruction_t *const *_cpu_decoded;
+
+/*
+ * @brief Cycle counter cpu_run_until stops at, cleared by cpu_stop()
+ */
+static _Thread_local uint64_t _cpu_target;
+static _Thread_local uint8_t _cpu_stopped;
 
 static void _cpu_adc_imm() {
 
     uint8_t operand = cpu_fetch_imm();
-    uint8_t carry = ((uint16_t)operand + (uint16_t)_cpu.a) >> 8;
+    uint8_t carry = ((uint16_t)operand + (uint16_t)_cpu->a) >> 8;
 
-    _cpu.a += cpu_fetch_imm();
+    _cpu->a += cpu_fetch_imm();
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     cpu_set_flag(CPU_FLAG_CARRY, carry);
         /** @todo overflow */
 }
 
 static void _cpu_adc_zp() {
     uint8_t operand = memory_read(cpu_fetch_zp());
-    uint8_t carry = ((uint16_t)operand + (uint16_t)_cpu.a) >> 8;
+    uint8_t carry = ((uint16_t)operand + (uint16_t)_cpu->a) >> 8;
 
-    _cpu.a += cpu_fetch_imm();
+    _cpu->a += cpu_fetch_imm();
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     cpu_set_flag(CPU_FLAG_CARRY, carry);
     /** @todo overflow */
 }
 
 static void _cpu_adc_zpx() {
     uint8_t operand = memory_read(cpu_fetch_zpx());
-    uint8_t carry = ((uint16_t)operand + (uint16_t)_cpu.a) >> 8;
+    uint8_t carry = ((uint16_t)operand + (uint16_t)_cpu->a) >> 8;
 
-    _cpu.a += cpu_fetch_imm();
+    _cpu->a += cpu_fetch_imm();
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     cpu_set_flag(CPU_FLAG_CARRY, carry);
     /** @todo overflow */
 }
 
 static void _cpu_adc_abs() {
     uint8_t operand = memory_read(cpu_fetch_abs());
-    uint8_t carry = ((uint16_t)operand + (uint16_t)_cpu.a) >> 8;
+    uint8_t carry = ((uint16_t)operand + (uint16_t)_cpu->a) >> 8;
 
-    _cpu.a += cpu_fetch_imm();
+    _cpu->a += cpu_fetch_imm();
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     cpu_set_flag(CPU_FLAG_CARRY, carry);
     /** @todo overflow */
 }
 
 static void _cpu_adc_absx() {
     uint8_t operand = memory_read(cpu_fetch_absx());
-    uint8_t carry = ((uint16_t)operand + (uint16_t)_cpu.a) >> 8;
+    uint8_t carry = ((uint16_t)operand + (uint16_t)_cpu->a) >> 8;
 
-    _cpu.a += cpu_fetch_imm();
+    _cpu->a += cpu_fetch_imm();
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     cpu_set_flag(CPU_FLAG_CARRY, carry);
     /** @todo overflow */
 }
 
 static void _cpu_adc_absy() {
     uint8_t operand = memory_read(cpu_fetch_absy());
-    uint8_t carry = ((uint16_t)operand + (uint16_t)_cpu.a) >> 8;
+    uint8_t carry = ((uint16_t)operand + (uint16_t)_cpu->a) >> 8;
 
-    _cpu.a += cpu_fetch_imm();
+    _cpu->a += cpu_fetch_imm();
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     cpu_set_flag(CPU_FLAG_CARRY, carry);
     /** @todo overflow */
 }
 
 static void _cpu_adc_indx() {
     uint8_t operand = memory_read(cpu_fetch_indx());
-    uint8_t carry = ((uint16_t)operand + (uint16_t)_cpu.a) >> 8;
+    uint8_t carry = ((uint16_t)operand + (uint16_t)_cpu->a) >> 8;
 
-    _cpu.a += cpu_fetch_imm();
+    _cpu->a += cpu_fetch_imm();
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     cpu_set_flag(CPU_FLAG_CARRY, carry);
     /** @todo overflow */
 }
 
 static void _cpu_adc_indy() {
     uint8_t operand = memory_read(cpu_fetch_indy());
-    uint8_t carry = ((uint16_t)operand + (uint16_t)_cpu.a) >> 8;
+    uint8_t carry = ((uint16_t)operand + (uint16_t)_cpu->a) >> 8;
 
-    _cpu.a += cpu_fetch_imm();
+    _cpu->a += cpu_fetch_imm();
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     cpu_set_flag(CPU_FLAG_CARRY, carry);
     /** @todo overflow */
 }
 
 static void _cpu_and_imm() {
-    _cpu.a &= cpu_fetch_imm();
+    _cpu->a &= cpu_fetch_imm();
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_and_zp() {
-    _cpu.a &= memory_read(cpu_fetch_zp());
+    _cpu->a &= memory_read(cpu_fetch_zp());
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_and_zpx() {
-    _cpu.a &= memory_read(cpu_fetch_zpx());
+    _cpu->a &= memory_read(cpu_fetch_zpx());
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_and_abs() {
-    _cpu.a &= memory_read(cpu_fetch_abs());
+    _cpu->a &= memory_read(cpu_fetch_abs());
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_and_absx() {
-    _cpu.a &= memory_read(cpu_fetch_absx());
+    _cpu->a &= memory_read(cpu_fetch_absx());
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_and_absy() {
-    _cpu.a &= memory_read(cpu_fetch_absy());
+    _cpu->a &= memory_read(cpu_fetch_absy());
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_and_indx() {
-    _cpu.a &= memory_read(cpu_fetch_indx());
+    _cpu->a &= memory_read(cpu_fetch_indx());
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_and_indy() {
-    _cpu.a &= memory_read(cpu_fetch_indy());
+    _cpu->a &= memory_read(cpu_fetch_indy());
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_asl_a() {
-    cpu_set_flag(CPU_FLAG_CARRY, _cpu.a >> 7);
+    cpu_set_flag(CPU_FLAG_CARRY, _cpu->a >> 7);
 
-    _cpu.a = _cpu.a >> 1;
+    _cpu->a = _cpu->a >> 1;
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_asl_zp() {
@@ -221,21 +245,21 @@ static void _cpu_bcc() {
     uint8_t data = cpu_fetch_imm();
 
     if (cpu_get_flag(CPU_FLAG_CARRY) == 0)
-        _cpu.pc = (int)_cpu.pc + (int8_t)data;
+        _cpu->pc = (int)_cpu->pc + (int8_t)data;
 }
 
 static void _cpu_bcs() {
     uint8_t data = cpu_fetch_imm();
 
     if (cpu_get_flag(CPU_FLAG_CARRY) == 1)
-        _cpu.pc = (int)_cpu.pc + (int8_t)data;
+        _cpu->pc = (int)_cpu->pc + (int8_t)data;
 }
 
 static void _cpu_beq() {
     uint8_t data = cpu_fetch_imm();
 
     if (cpu_get_flag(CPU_FLAG_ZERO) == 1)
-        _cpu.pc = (int)_cpu.pc + (int8_t)data;
+        _cpu->pc = (int)_cpu->pc + (int8_t)data;
 }
 
 static void _cpu_bit_zp() {
@@ -243,7 +267,7 @@ static void _cpu_bit_zp() {
 
     cpu_set_flag(CPU_FLAG_NEGATIVE, data>>7);
     cpu_set_flag(CPU_FLAG_OVERFLOW, data>>6 & 1);
-    cpu_set_flag(CPU_FLAG_ZERO, (data & _cpu.a) == 0);
+    cpu_set_flag(CPU_FLAG_ZERO, (data & _cpu->a) == 0);
 }
 
 static void _cpu_bit_abs() {
@@ -251,50 +275,50 @@ static void _cpu_bit_abs() {
 
     cpu_set_flag(CPU_FLAG_NEGATIVE, data>>7);
     cpu_set_flag(CPU_FLAG_OVERFLOW, data>>6 & 1);
-    cpu_set_flag(CPU_FLAG_ZERO, (data & _cpu.a) == 0);
+    cpu_set_flag(CPU_FLAG_ZERO, (data & _cpu->a) == 0);
 }
 
 static void _cpu_bmi() {
     uint8_t data = cpu_fetch_imm();
 
     if (cpu_get_flag(CPU_FLAG_NEGATIVE) == 1)
-        _cpu.pc = (int)_cpu.pc + (int8_t)data;
+        _cpu->pc = (int)_cpu->pc + (int8_t)data;
 }
 
 static void _cpu_bne() {
     uint8_t data = cpu_fetch_imm();
 
     if (cpu_get_flag(CPU_FLAG_ZERO) == 0)
-        _cpu.pc = (int)_cpu.pc + (int8_t)data;
+        _cpu->pc = (int)_cpu->pc + (int8_t)data;
 }
 
 static void _cpu_bpl() {
     uint8_t data = cpu_fetch_imm();
 
     if (cpu_get_flag(CPU_FLAG_ZERO) != 0)
-        _cpu.pc = (int)_cpu.pc + (int8_t)data;
+        _cpu->pc = (int)_cpu->pc + (int8_t)data;
 }
 
 static void _cpu_brk() {
-    PUSH_16(_cpu.pc+1);
+    PUSH_16(_cpu->pc+1);
     
     cpu_set_flag(CPU_FLAG_INTERRUPT, 1);
-    PUSH_8(_cpu.flags | CPU_FLAG_BREAK);
-    _cpu.pc = memory_read(IRQ_ADDR_LO) | (memory_read(IRQ_ADDR_HI) << 8);
+    PUSH_8(_cpu->flags | CPU_FLAG_BREAK);
+    _cpu->pc = memory_read(IRQ_ADDR_LO) | (memory_read(IRQ_ADDR_HI) << 8);
 }
 
 static void _cpu_bvc(){
     uint8_t data = cpu_fetch_imm();
 
     if (cpu_get_flag(CPU_FLAG_OVERFLOW) == 0)
-        _cpu.pc = (int)_cpu.pc + (int8_t)data;
+        _cpu->pc = (int)_cpu->pc + (int8_t)data;
 }
 
 static void _cpu_bvs() {
     uint8_t data = cpu_fetch_imm();
 
     if (cpu_get_flag(CPU_FLAG_OVERFLOW) == 1)
-        _cpu.pc = (int)_cpu.pc + (int8_t)data;
+        _cpu->pc = (int)_cpu->pc + (int8_t)data;
 }
 
 static void _cpu_clc() {
@@ -314,7 +338,7 @@ static void _cpu_clv() {
 }
 
 static void _cpu_cmp_imm() {
-    uint8_t result = _cpu.a - cpu_fetch_imm();
+    uint8_t result = _cpu->a - cpu_fetch_imm();
 
     //cpu_set_flag(CPU_FLAG_CARRY, result >> 7);
     cpu_set_flag(CPU_FLAG_NEGATIVE, result >> 7);
@@ -323,7 +347,7 @@ static void _cpu_cmp_imm() {
 }
 
 static void _cpu_cmp_zp() {
-    uint8_t result = _cpu.a - memory_read(cpu_fetch_zp());
+    uint8_t result = _cpu->a - memory_read(cpu_fetch_zp());
 
     //cpu_set_flag(CPU_FLAG_CARRY, result >> 7);
     cpu_set_flag(CPU_FLAG_NEGATIVE, result >> 7);
@@ -332,7 +356,7 @@ static void _cpu_cmp_zp() {
 }
 
 static void _cpu_cmp_zpx() {
-    uint8_t result = _cpu.a - memory_read(cpu_fetch_zpx());
+    uint8_t result = _cpu->a - memory_read(cpu_fetch_zpx());
 
     //cpu_set_flag(cpu_flag_carry, result >> 7);
     cpu_set_flag(CPU_FLAG_NEGATIVE, result >> 7);
@@ -341,7 +365,7 @@ static void _cpu_cmp_zpx() {
 }
 
 static void _cpu_cmp_abs() {
-    uint8_t result = _cpu.a - memory_read(cpu_fetch_abs());
+    uint8_t result = _cpu->a - memory_read(cpu_fetch_abs());
 
     //cpu_set_flag(cpu_flag_carry, result >> 7);
     cpu_set_flag(CPU_FLAG_NEGATIVE, result >> 7);
@@ -350,7 +374,7 @@ static void _cpu_cmp_abs() {
 }
 
 static void _cpu_cmp_absx() {
-    uint8_t result = _cpu.a - memory_read(cpu_fetch_absx());
+    uint8_t result = _cpu->a - memory_read(cpu_fetch_absx());
 
     //cpu_set_flag(cpu_flag_carry, result >> 7);
     cpu_set_flag(CPU_FLAG_NEGATIVE, result >> 7);
@@ -359,7 +383,7 @@ static void _cpu_cmp_absx() {
 }
 
 static void _cpu_cmp_absy() {
-    uint8_t result = _cpu.a - memory_read(cpu_fetch_absy());
+    uint8_t result = _cpu->a - memory_read(cpu_fetch_absy());
 
     //cpu_set_flag(cpu_flag_carry, result >> 7);
     cpu_set_flag(CPU_FLAG_NEGATIVE, result >> 7);
@@ -368,7 +392,7 @@ static void _cpu_cmp_absy() {
 }
 
 static void _cpu_cmp_indx() {
-    uint8_t result = _cpu.a - memory_read(cpu_fetch_indx());
+    uint8_t result = _cpu->a - memory_read(cpu_fetch_indx());
 
     //cpu_set_flag(cpu_flag_carry, result >> 7);
     cpu_set_flag(CPU_FLAG_NEGATIVE, result >> 7);
@@ -377,7 +401,7 @@ static void _cpu_cmp_indx() {
 }
 
 static void _cpu_cmp_indy() {
-    uint8_t result = _cpu.a - memory_read(cpu_fetch_indy());
+    uint8_t result = _cpu->a - memory_read(cpu_fetch_indy());
 
     //cpu_set_flag(cpu_flag_carry, result >> 7);
     cpu_set_flag(CPU_FLAG_NEGATIVE, result >> 7);
@@ -386,7 +410,7 @@ static void _cpu_cmp_indy() {
 }
 
 static void _cpu_cpx_imm() {
-    uint8_t result = _cpu.x - cpu_fetch_imm();
+    uint8_t result = _cpu->x - cpu_fetch_imm();
 
     //cpu_set_flag(cpu_flag_carry, result >> 7);
     cpu_set_flag(CPU_FLAG_NEGATIVE, result >> 7);
@@ -395,7 +419,7 @@ static void _cpu_cpx_imm() {
 }
 
 static void _cpu_cpx_zp() {
-    uint8_t result = _cpu.x - memory_read(cpu_fetch_zp());
+    uint8_t result = _cpu->x - memory_read(cpu_fetch_zp());
 
     //cpu_set_flag(cpu_flag_carry, result >> 7);
     cpu_set_flag(CPU_FLAG_NEGATIVE, result >> 7);
@@ -404,7 +428,7 @@ static void _cpu_cpx_zp() {
 }
 
 static void _cpu_cpx_abs() {
-    uint8_t result = _cpu.x - memory_read(cpu_fetch_abs());
+    uint8_t result = _cpu->x - memory_read(cpu_fetch_abs());
 
     //cpu_set_flag(cpu_flag_carry, result >> 7);
     cpu_set_flag(CPU_FLAG_NEGATIVE, result >> 7);
@@ -413,7 +437,7 @@ static void _cpu_cpx_abs() {
 }
 
 static void _cpu_cpy_imm() {
-    uint8_t result = _cpu.y - cpu_fetch_imm();
+    uint8_t result = _cpu->y - cpu_fetch_imm();
 
     //cpu_set_flag(cpu_flag_carry, result >> 7);
     cpu_set_flag(CPU_FLAG_NEGATIVE, result >> 7);
@@ -422,7 +446,7 @@ static void _cpu_cpy_imm() {
 }
 
 static void _cpu_cpy_zp() {
-    uint8_t result = _cpu.y - memory_read(cpu_fetch_zp());
+    uint8_t result = _cpu->y - memory_read(cpu_fetch_zp());
 
     //cpu_set_flag(cpu_flag_carry, result >> 7);
     cpu_set_flag(CPU_FLAG_NEGATIVE, result >> 7);
@@ -431,7 +455,7 @@ static void _cpu_cpy_zp() {
 }
 
 static void _cpu_cpy_abs() {
-    uint8_t result = _cpu.y - memory_read(cpu_fetch_abs());
+    uint8_t result = _cpu->y - memory_read(cpu_fetch_abs());
 
     //cpu_set_flag(cpu_flag_carry, result >> 7);
     cpu_set_flag(CPU_FLAG_NEGATIVE, result >> 7);
@@ -480,89 +504,89 @@ static void _cpu_dec_absx() {
 }
 
 static void _cpu_dex() {
-    _cpu.x--;
+    _cpu->x--;
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.x >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.x == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->x >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->x == 0);
 }
 
 static void _cpu_dey() {
-    _cpu.y--;
+    _cpu->y--;
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.y >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.y == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->y >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->y == 0);
 }
 
 static void _cpu_eor_imm() {
     uint8_t value = cpu_fetch_imm();
 
-    _cpu.a = _cpu.a ^ value;
+    _cpu->a = _cpu->a ^ value;
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_eor_zp() {
     uint8_t value = memory_read(cpu_fetch_zp());
 
-    _cpu.a = _cpu.a ^ value;
+    _cpu->a = _cpu->a ^ value;
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_eor_zpx() {
     uint8_t value = memory_read(cpu_fetch_zpx());
 
-    _cpu.a = _cpu.a ^ value;
+    _cpu->a = _cpu->a ^ value;
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_eor_abs() {
     uint8_t value = memory_read(cpu_fetch_abs());
 
-    _cpu.a = _cpu.a ^ value;
+    _cpu->a = _cpu->a ^ value;
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_eor_absx() {
     uint8_t value = memory_read(cpu_fetch_absx());
 
-    _cpu.a = _cpu.a ^ value;
+    _cpu->a = _cpu->a ^ value;
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_eor_absy() {
     uint8_t value = memory_read(cpu_fetch_absy());
 
-    _cpu.a = _cpu.a ^ value;
+    _cpu->a = _cpu->a ^ value;
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_eor_indx() {
     uint8_t value = memory_read(cpu_fetch_indx());
 
-    _cpu.a = _cpu.a ^ value;
+    _cpu->a = _cpu->a ^ value;
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_eor_indy() {
     uint8_t value = memory_read(cpu_fetch_indy());
 
-    _cpu.a = _cpu.a ^ value;
+    _cpu->a = _cpu->a ^ value;
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_inc_zp() {
@@ -571,8 +595,8 @@ static void _cpu_inc_zp() {
 
     memory_write(address, value);
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_inc_zpx() {
@@ -581,8 +605,8 @@ static void _cpu_inc_zpx() {
 
     memory_write(address, value);
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_inc_abs() {
@@ -591,8 +615,8 @@ static void _cpu_inc_abs() {
 
     memory_write(address, value);
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_inc_absx() {
@@ -601,167 +625,167 @@ static void _cpu_inc_absx() {
 
     memory_write(address, value);
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_inx() {
-    _cpu.x++;
+    _cpu->x++;
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.x >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.x == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->x >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->x == 0);
 }
 
 static void _cpu_iny() {
-    _cpu.y++;
+    _cpu->y++;
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.y >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.y == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->y >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->y == 0);
 }
 
 static void _cpu_jmp_abs() {
-    _cpu.pc = cpu_fetch_abs();
+    _cpu->pc = cpu_fetch_abs();
 }
 
 static void _cpu_jmp_ind() {
-    _cpu.pc = cpu_fetch_ind();
+    _cpu->pc = cpu_fetch_ind();
 }
 
 static void _cpu_jsr() {
-    PUSH_16(_cpu.pc+2);
-    _cpu.pc = cpu_fetch_abs();
+    PUSH_16(_cpu->pc+2);
+    _cpu->pc = cpu_fetch_abs();
 }
 
 static void _cpu_lda_imm() {
-    _cpu.a = cpu_fetch_imm();
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    _cpu->a = cpu_fetch_imm();
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 
 }
 
 static void _cpu_lda_zp() {
-    _cpu.a = memory_read(cpu_fetch_zp());
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    _cpu->a = memory_read(cpu_fetch_zp());
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 
 }
 
 static void _cpu_lda_zpx() {
-    _cpu.a = memory_read(cpu_fetch_zpx());
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    _cpu->a = memory_read(cpu_fetch_zpx());
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 
 }
 
 static void _cpu_lda_abs() {
-    _cpu.a = memory_read(cpu_fetch_abs());
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    _cpu->a = memory_read(cpu_fetch_abs());
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 
 }
 
 static void _cpu_lda_absx() {
-    _cpu.a = memory_read(cpu_fetch_absx());
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    _cpu->a = memory_read(cpu_fetch_absx());
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 
 }
 
 static void _cpu_lda_absy() {
-    _cpu.a = memory_read(cpu_fetch_absy());
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    _cpu->a = memory_read(cpu_fetch_absy());
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 
 }
 
 static void _cpu_lda_indx() {
-    _cpu.a = memory_read(cpu_fetch_indx());
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    _cpu->a = memory_read(cpu_fetch_indx());
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 
 }
 
 static void _cpu_lda_indy() {
-    _cpu.a = memory_read(cpu_fetch_indy());
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    _cpu->a = memory_read(cpu_fetch_indy());
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 
 }
 
 static void _cpu_ldx_imm() {
-    _cpu.x = cpu_fetch_imm();
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.x & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.x == 0);
+    _cpu->x = cpu_fetch_imm();
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->x & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->x == 0);
 
 }
 
 static void _cpu_ldx_zp() {
-    _cpu.x = memory_read(cpu_fetch_zp());
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.x & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.x == 0);
+    _cpu->x = memory_read(cpu_fetch_zp());
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->x & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->x == 0);
 
 }
 
 static void _cpu_ldx_zpy() {
-    _cpu.x = memory_read(cpu_fetch_zpy());
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.x & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.x == 0);
+    _cpu->x = memory_read(cpu_fetch_zpy());
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->x & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->x == 0);
 
 }
 
 static void _cpu_ldx_abs() {
-    _cpu.x = memory_read(cpu_fetch_abs());
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.x & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.x == 0);
+    _cpu->x = memory_read(cpu_fetch_abs());
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->x & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->x == 0);
 
 }
 
 static void _cpu_ldx_absy() {
-    _cpu.x = memory_read(cpu_fetch_absy());
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.x & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.x == 0);
+    _cpu->x = memory_read(cpu_fetch_absy());
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->x & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->x == 0);
 
 }
 
 static void _cpu_ldy_imm() {
-    _cpu.y = cpu_fetch_imm();
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.y & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.y == 0);
+    _cpu->y = cpu_fetch_imm();
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->y & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->y == 0);
 
 }
 
 static void _cpu_ldy_zp() {
-    _cpu.y = memory_read(cpu_fetch_zp());
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.y & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.y == 0);
+    _cpu->y = memory_read(cpu_fetch_zp());
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->y & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->y == 0);
 
 }
 
 static void _cpu_ldy_zpx() {
-    _cpu.y = memory_read(cpu_fetch_zpx());
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.y & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.y == 0);
+    _cpu->y = memory_read(cpu_fetch_zpx());
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->y & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->y == 0);
 
 }
 
 static void _cpu_ldy_abs() {
-    _cpu.y = memory_read(cpu_fetch_abs());
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.y & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.y == 0);
+    _cpu->y = memory_read(cpu_fetch_abs());
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->y & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->y == 0);
 
 }
 
 static void _cpu_ldy_absx() {
-    _cpu.y = memory_read(cpu_fetch_absx());
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.y & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.y == 0);
+    _cpu->y = memory_read(cpu_fetch_absx());
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->y & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->y == 0);
 
 }
 
 static void _cpu_lsr_a() {
-    cpu_set_flag(CPU_FLAG_CARRY, _cpu.a & 0x01);
-    _cpu.a = _cpu.a >> 1;
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_CARRY, _cpu->a & 0x01);
+    _cpu->a = _cpu->a >> 1;
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     cpu_set_flag(CPU_FLAG_NEGATIVE, 0);
 }
 
@@ -806,87 +830,87 @@ static void _cpu_nop() {
 }
 
 static void _cpu_ora_imm() {
-    _cpu.a |= cpu_fetch_imm();
+    _cpu->a |= cpu_fetch_imm();
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_ora_zp() {
-    _cpu.a |= memory_read(cpu_fetch_zp());
+    _cpu->a |= memory_read(cpu_fetch_zp());
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_ora_zpx() {
-    _cpu.a |= memory_read(cpu_fetch_zpx());
+    _cpu->a |= memory_read(cpu_fetch_zpx());
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_ora_abs() {
-    _cpu.a |= memory_read(cpu_fetch_abs());
+    _cpu->a |= memory_read(cpu_fetch_abs());
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_ora_absx() {
-    _cpu.a |= memory_read(cpu_fetch_absx());
+    _cpu->a |= memory_read(cpu_fetch_absx());
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_ora_absy() {
-    _cpu.a |= memory_read(cpu_fetch_absy());
+    _cpu->a |= memory_read(cpu_fetch_absy());
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_ora_indx() {
-    _cpu.a |= memory_read(cpu_fetch_indx());
+    _cpu->a |= memory_read(cpu_fetch_indx());
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_ora_indy() {
-    _cpu.a |= memory_read(cpu_fetch_indy());
+    _cpu->a |= memory_read(cpu_fetch_indy());
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_pha() {
-    PUSH_8(_cpu.a);
+    PUSH_8(_cpu->a);
 }
 
 static void _cpu_php() {
-    PUSH_8(_cpu.flags | CPU_FLAG_BREAK);
+    PUSH_8(_cpu->flags | CPU_FLAG_BREAK);
 }
 
 static void _cpu_pla() {
-    _cpu.a = PULL_8();
+    _cpu->a = PULL_8();
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_plp() {
-    _cpu.flags = PULL_8();
+    _cpu->flags = PULL_8();
 }
 
 static void _cpu_rol_a() {
-    uint8_t carry = _cpu.a >> 7;
+    uint8_t carry = _cpu->a >> 7;
 
-    _cpu.a = (_cpu.a << 1) | cpu_get_flag(CPU_FLAG_CARRY);
+    _cpu->a = (_cpu->a << 1) | cpu_get_flag(CPU_FLAG_CARRY);
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     cpu_set_flag(CPU_FLAG_CARRY, carry);
 }
 
@@ -955,11 +979,11 @@ static void _cpu_rol_absx() {
 }
 
 static void _cpu_ror_a() {
-    uint8_t carry = _cpu.a & 1;
-    _cpu.a = (_cpu.a >> 1) | cpu_get_flag(CPU_FLAG_CARRY) << 7;
+    uint8_t carry = _cpu->a & 1;
+    _cpu->a = (_cpu->a >> 1) | cpu_get_flag(CPU_FLAG_CARRY) << 7;
 
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a >> 7);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a >> 7);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     cpu_set_flag(CPU_FLAG_CARRY, carry);
 }
 
@@ -1024,91 +1048,91 @@ static void _cpu_ror_absx() {
 }
 
 static void _cpu_rti() {
-    _cpu.flags = PULL_8() & ~(CPU_FLAG_BREAK);
-    _cpu.pc = PULL_16();
+    _cpu->flags = PULL_8() & ~(CPU_FLAG_BREAK);
+    _cpu->pc = PULL_16();
 }
 
 static void _cpu_rts() {
-    _cpu.pc = PULL_16();
+    _cpu->pc = PULL_16();
 }
 
 static void _cpu_sbc_imm(){
     uint8_t val = cpu_fetch_imm();
-    uint8_t prev = _cpu.a;
-    _cpu.a = _cpu.a - val - ~cpu_get_flag(CPU_FLAG_CARRY);
+    uint8_t prev = _cpu->a;
+    _cpu->a = _cpu->a - val - ~cpu_get_flag(CPU_FLAG_CARRY);
     cpu_set_flag(CPU_FLAG_CARRY, prev >= val);
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & 0x80);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & 0x80);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     /** @todo overflow */
 }
 
 static void _cpu_sbc_zp(){
     uint8_t val = memory_read(cpu_fetch_zp());
-    uint8_t prev = _cpu.a;
-    _cpu.a = _cpu.a - val - ~cpu_get_flag(CPU_FLAG_CARRY);
+    uint8_t prev = _cpu->a;
+    _cpu->a = _cpu->a - val - ~cpu_get_flag(CPU_FLAG_CARRY);
     cpu_set_flag(CPU_FLAG_CARRY, prev >= val);
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & 0x80);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & 0x80);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     /** @todo overflow */
 }
 
 static void _cpu_sbc_zpx(){
     uint8_t val = memory_read(cpu_fetch_zpx());
-    uint8_t prev = _cpu.a;
-    _cpu.a = _cpu.a - val - ~cpu_get_flag(CPU_FLAG_CARRY);
+    uint8_t prev = _cpu->a;
+    _cpu->a = _cpu->a - val - ~cpu_get_flag(CPU_FLAG_CARRY);
     cpu_set_flag(CPU_FLAG_CARRY, prev >= val);
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & 0x80);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & 0x80);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     /** @todo overflow */
 }
 
 static void _cpu_sbc_abs(){
     uint8_t val = memory_read(cpu_fetch_abs());
-    uint8_t prev = _cpu.a;
-    _cpu.a = _cpu.a - val - ~cpu_get_flag(CPU_FLAG_CARRY);
+    uint8_t prev = _cpu->a;
+    _cpu->a = _cpu->a - val - ~cpu_get_flag(CPU_FLAG_CARRY);
     cpu_set_flag(CPU_FLAG_CARRY, prev >= val);
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & 0x80);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & 0x80);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     /** @todo overflow */
 }
 
 static void _cpu_sbc_absx(){
     uint8_t val = memory_read(cpu_fetch_absx());
-    uint8_t prev = _cpu.a;
-    _cpu.a = _cpu.a - val - ~cpu_get_flag(CPU_FLAG_CARRY);
+    uint8_t prev = _cpu->a;
+    _cpu->a = _cpu->a - val - ~cpu_get_flag(CPU_FLAG_CARRY);
     cpu_set_flag(CPU_FLAG_CARRY, prev >= val);
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & 0x80);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & 0x80);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     /** @todo overflow */
 }
 
 static void _cpu_sbc_absy(){
     uint8_t val = memory_read(cpu_fetch_absy());
-    uint8_t prev = _cpu.a;
-    _cpu.a = _cpu.a - val - ~cpu_get_flag(CPU_FLAG_CARRY);
+    uint8_t prev = _cpu->a;
+    _cpu->a = _cpu->a - val - ~cpu_get_flag(CPU_FLAG_CARRY);
     cpu_set_flag(CPU_FLAG_CARRY, prev >= val);
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & 0x80);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & 0x80);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     /** @todo overflow */
 }
 
 static void _cpu_sbc_indx(){
     uint8_t val = memory_read(cpu_fetch_indx());
-    uint8_t prev = _cpu.a;
-    _cpu.a = _cpu.a - val - ~cpu_get_flag(CPU_FLAG_CARRY);
+    uint8_t prev = _cpu->a;
+    _cpu->a = _cpu->a - val - ~cpu_get_flag(CPU_FLAG_CARRY);
     cpu_set_flag(CPU_FLAG_CARRY, prev >= val);
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & 0x80);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & 0x80);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     /** @todo overflow */
 }
 
 static void _cpu_sbc_indy(){
     uint8_t val = memory_read(cpu_fetch_indy());
-    uint8_t prev = _cpu.a;
-    _cpu.a = _cpu.a - val - ~cpu_get_flag(CPU_FLAG_CARRY);
+    uint8_t prev = _cpu->a;
+    _cpu->a = _cpu->a - val - ~cpu_get_flag(CPU_FLAG_CARRY);
     cpu_set_flag(CPU_FLAG_CARRY, prev >= val);
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & 0x80);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & 0x80);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
     /** @todo overflow */
 }
 
@@ -1126,443 +1150,558 @@ static void _cpu_sei(){
 }
 
 static void _cpu_sta_zp(){
-    memory_write(cpu_fetch_zp(), _cpu.a);
+    memory_write(cpu_fetch_zp(), _cpu->a);
 }
 
 static void _cpu_sta_zpx(){
-    memory_write(cpu_fetch_zpx(), _cpu.a);
+    memory_write(cpu_fetch_zpx(), _cpu->a);
 }
 
 static void _cpu_sta_abs(){
-    memory_write(cpu_fetch_abs(), _cpu.a);
+    memory_write(cpu_fetch_abs(), _cpu->a);
 }
 
 static void _cpu_sta_absx(){
-    memory_write(cpu_fetch_absx(), _cpu.a);
+    memory_write(cpu_fetch_absx(), _cpu->a);
 }
 
 static void _cpu_sta_absy(){
-    memory_write(cpu_fetch_absy(), _cpu.a);
+    memory_write(cpu_fetch_absy(), _cpu->a);
 }
 
 static void _cpu_sta_indx(){
-    memory_write(cpu_fetch_indx(), _cpu.a);
+    memory_write(cpu_fetch_indx(), _cpu->a);
 }
 
 static void _cpu_sta_indy(){
-    memory_write(cpu_fetch_indy(), _cpu.a);
+    memory_write(cpu_fetch_indy(), _cpu->a);
 }
 
 static void _cpu_stx_zp(){
-    memory_write(cpu_fetch_zp(), _cpu.x);
+    memory_write(cpu_fetch_zp(), _cpu->x);
 }
 
 static void _cpu_stx_zpy(){
-    memory_write(cpu_fetch_zpy(), _cpu.x);
+    memory_write(cpu_fetch_zpy(), _cpu->x);
 }
 
 static void _cpu_stx_abs(){
-    memory_write(cpu_fetch_abs(), _cpu.x);
+    memory_write(cpu_fetch_abs(), _cpu->x);
 }
 
 static void _cpu_sty_zp(){
-    memory_write(cpu_fetch_zp(), _cpu.y);
+    memory_write(cpu_fetch_zp(), _cpu->y);
 }
 
 static void _cpu_sty_zpx(){
-    memory_write(cpu_fetch_zpx(), _cpu.y);
+    memory_write(cpu_fetch_zpx(), _cpu->y);
 }
 
 static void _cpu_sty_abs(){
-    memory_write(cpu_fetch_abs(), _cpu.y);
+    memory_write(cpu_fetch_abs(), _cpu->y);
 }
 
 static void _cpu_tax(){
-    _cpu.x = _cpu.a;
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.x & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.x == 0);
+    _cpu->x = _cpu->a;
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->x & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->x == 0);
 }
 
 static void _cpu_tay(){
-    _cpu.y = _cpu.a;
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.y & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.y == 0);
+    _cpu->y = _cpu->a;
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->y & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->y == 0);
 }
 
 static void _cpu_tsx(){
-    _cpu.x = _cpu.sp;
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.x & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.x == 0);
+    _cpu->x = _cpu->sp;
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->x & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->x == 0);
 }
 
 static void _cpu_txa(){
-    _cpu.a = _cpu.x;
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    _cpu->a = _cpu->x;
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
 static void _cpu_txs(){
-    _cpu.sp = _cpu.x;
+    _cpu->sp = _cpu->x;
 }
 
 static void _cpu_tya(){
-    _cpu.a = _cpu.y;
-    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu.a & CPU_FLAG_NEGATIVE);
-    cpu_set_flag(CPU_FLAG_ZERO, _cpu.a == 0);
+    _cpu->a = _cpu->y;
+    cpu_set_flag(CPU_FLAG_NEGATIVE, _cpu->a & CPU_FLAG_NEGATIVE);
+    cpu_set_flag(CPU_FLAG_ZERO, _cpu->a == 0);
 }
 
-static cpu_instruction_t _instr_table[0xff] = {
+static cpu_instruction_t _instr_table[0x100] = {
     // ADC
-    [0x69] = { .handler = _cpu_adc_imm, .cycles = 2 },
-    [0x65] = { .handler = _cpu_adc_zp, .cycles = 3 },
-    [0x75] = { .handler = _cpu_adc_zpx, .cycles = 4 },
-    [0x6d] = { .handler = _cpu_adc_abs, .cycles = 4 },
-    [0x7d] = { .handler = _cpu_adc_absx, .cycles = 4 },
-    [0x79] = { .handler = _cpu_adc_absy, .cycles = 4 },
-    [0x61] = { .handler = _cpu_adc_indx, .cycles = 6 },
-    [0x71] = { .handler = _cpu_adc_indy, .cycles = 5 },
+    [0x69] = { .handler = _cpu_adc_imm, .cycles = 2, .mode = CPU_MODE_IMM, .mnemonic = "ADC" },
+    [0x65] = { .handler = _cpu_adc_zp, .cycles = 3, .mode = CPU_MODE_ZP, .mnemonic = "ADC" },
+    [0x75] = { .handler = _cpu_adc_zpx, .cycles = 4, .mode = CPU_MODE_ZPX, .mnemonic = "ADC" },
+    [0x6d] = { .handler = _cpu_adc_abs, .cycles = 4, .mode = CPU_MODE_ABS, .mnemonic = "ADC" },
+    [0x7d] = { .handler = _cpu_adc_absx, .cycles = 4, .mode = CPU_MODE_ABSX, .mnemonic = "ADC" },
+    [0x79] = { .handler = _cpu_adc_absy, .cycles = 4, .mode = CPU_MODE_ABSY, .mnemonic = "ADC" },
+    [0x61] = { .handler = _cpu_adc_indx, .cycles = 6, .mode = CPU_MODE_INDX, .mnemonic = "ADC" },
+    [0x71] = { .handler = _cpu_adc_indy, .cycles = 5, .mode = CPU_MODE_INDY, .mnemonic = "ADC" },
 
     // AND
-    [0x29] = { .handler = _cpu_and_imm, .cycles = 2 },
-    [0x25] = { .handler = _cpu_and_zp, .cycles = 3 },
-    [0x35] = { .handler = _cpu_and_zpx, .cycles = 4 },
-    [0x2d] = { .handler = _cpu_and_abs, .cycles = 4 },
-    [0x3d] = { .handler = _cpu_and_absx, .cycles = 4 },
-    [0x39] = { .handler = _cpu_and_absy, .cycles = 4 },
-    [0x21] = { .handler = _cpu_and_indx, .cycles = 6 },
-    [0x31] = { .handler = _cpu_and_indy, .cycles = 5 },
+    [0x29] = { .handler = _cpu_and_imm, .cycles = 2, .mode = CPU_MODE_IMM, .mnemonic = "AND" },
+    [0x25] = { .handler = _cpu_and_zp, .cycles = 3, .mode = CPU_MODE_ZP, .mnemonic = "AND" },
+    [0x35] = { .handler = _cpu_and_zpx, .cycles = 4, .mode = CPU_MODE_ZPX, .mnemonic = "AND" },
+    [0x2d] = { .handler = _cpu_and_abs, .cycles = 4, .mode = CPU_MODE_ABS, .mnemonic = "AND" },
+    [0x3d] = { .handler = _cpu_and_absx, .cycles = 4, .mode = CPU_MODE_ABSX, .mnemonic = "AND" },
+    [0x39] = { .handler = _cpu_and_absy, .cycles = 4, .mode = CPU_MODE_ABSY, .mnemonic = "AND" },
+    [0x21] = { .handler = _cpu_and_indx, .cycles = 6, .mode = CPU_MODE_INDX, .mnemonic = "AND" },
+    [0x31] = { .handler = _cpu_and_indy, .cycles = 5, .mode = CPU_MODE_INDY, .mnemonic = "AND" },
 
     // ASL
-    [0x0a] = { .handler = _cpu_asl_a, .cycles = 2 },
-    [0x06] = { .handler = _cpu_asl_zp, .cycles = 5 },
-    [0x16] = { .handler = _cpu_asl_zpx, .cycles = 6 },
-    [0x0e] = { .handler = _cpu_asl_abs, .cycles = 6 },
-    [0x1e] = { .handler = _cpu_asl_absx, .cycles = 7 },
+    [0x0a] = { .handler = _cpu_asl_a, .cycles = 2, .mode = CPU_MODE_ACC, .mnemonic = "ASL" },
+    [0x06] = { .handler = _cpu_asl_zp, .cycles = 5, .mode = CPU_MODE_ZP, .mnemonic = "ASL" },
+    [0x16] = { .handler = _cpu_asl_zpx, .cycles = 6, .mode = CPU_MODE_ZPX, .mnemonic = "ASL" },
+    [0x0e] = { .handler = _cpu_asl_abs, .cycles = 6, .mode = CPU_MODE_ABS, .mnemonic = "ASL" },
+    [0x1e] = { .handler = _cpu_asl_absx, .cycles = 7, .mode = CPU_MODE_ABSX, .mnemonic = "ASL" },
 
     // BCC
-    [0x90] = { .handler = _cpu_bcc, .cycles = 2 },
+    [0x90] = { .handler = _cpu_bcc, .cycles = 2, .mode = CPU_MODE_REL, .mnemonic = "BCC" },
 
     // BCS
-    [0xb0] = { .handler = _cpu_bcs, .cycles = 2 },
+    [0xb0] = { .handler = _cpu_bcs, .cycles = 2, .mode = CPU_MODE_REL, .mnemonic = "BCS" },
 
     // BEQ
-    [0xf0] = { .handler = _cpu_beq, .cycles = 2 },
+    [0xf0] = { .handler = _cpu_beq, .cycles = 2, .mode = CPU_MODE_REL, .mnemonic = "BEQ" },
 
     // BIT
-    [0x24] = { .handler = _cpu_bit_zp, .cycles = 3 },
-    [0x2c] = { .handler = _cpu_bit_abs, .cycles = 4 },
+    [0x24] = { .handler = _cpu_bit_zp, .cycles = 3, .mode = CPU_MODE_ZP, .mnemonic = "BIT" },
+    [0x2c] = { .handler = _cpu_bit_abs, .cycles = 4, .mode = CPU_MODE_ABS, .mnemonic = "BIT" },
 
     // BMI
-    [0x30] = { .handler = _cpu_bmi, .cycles = 2 },
+    [0x30] = { .handler = _cpu_bmi, .cycles = 2, .mode = CPU_MODE_REL, .mnemonic = "BMI" },
 
     // BNE
-    [0xd0] = { .handler = _cpu_bne, .cycles = 2 },
+    [0xd0] = { .handler = _cpu_bne, .cycles = 2, .mode = CPU_MODE_REL, .mnemonic = "BNE" },
 
     // BPL
-    [0x10] = { .handler = _cpu_bpl, .cycles = 2 },
+    [0x10] = { .handler = _cpu_bpl, .cycles = 2, .mode = CPU_MODE_REL, .mnemonic = "BPL" },
 
     // BRK
-    [0x00] = { .handler = _cpu_brk, .cycles = 7 },
+    [0x00] = { .handler = _cpu_brk, .cycles = 7, .mode = CPU_MODE_IMP, .mnemonic = "BRK" },
 
     // BVC
-    [0x50] = { .handler = _cpu_bvc, .cycles = 2 },
+    [0x50] = { .handler = _cpu_bvc, .cycles = 2, .mode = CPU_MODE_REL, .mnemonic = "BVC" },
 
     // BVS
-    [0x70] = { .handler = _cpu_bvs, .cycles = 2 },
+    [0x70] = { .handler = _cpu_bvs, .cycles = 2, .mode = CPU_MODE_REL, .mnemonic = "BVS" },
 
     // CLC
-    [0x18] = { .handler = _cpu_clc, .cycles = 2 },
+    [0x18] = { .handler = _cpu_clc, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "CLC" },
 
     // CLD
-    [0xd8] = { .handler = _cpu_cld, .cycles = 2 },
+    [0xd8] = { .handler = _cpu_cld, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "CLD" },
 
     // CLI
-    [0x58] = { .handler = _cpu_cli, .cycles = 2 },
+    [0x58] = { .handler = _cpu_cli, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "CLI" },
 
     // CLV
-    [0xb8] = { .handler = _cpu_clv, .cycles = 2 },
+    [0xb8] = { .handler = _cpu_clv, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "CLV" },
 
     // CMP
-    [0xc9] = { .handler = _cpu_cmp_imm, .cycles = 2 },
-    [0xc5] = { .handler = _cpu_cmp_zp, .cycles = 3 },
-    [0xd5] = { .handler = _cpu_cmp_zpx, .cycles = 4 },
-    [0xcd] = { .handler = _cpu_cmp_abs, .cycles = 4 },
-    [0xdd] = { .handler = _cpu_cmp_absx, .cycles = 4 },
-    [0xd9] = { .handler = _cpu_cmp_absy, .cycles = 4 },
-    [0xc1] = { .handler = _cpu_cmp_indx, .cycles = 6 },
-    [0xd1] = { .handler = _cpu_cmp_indy, .cycles = 5 },
+    [0xc9] = { .handler = _cpu_cmp_imm, .cycles = 2, .mode = CPU_MODE_IMM, .mnemonic = "CMP" },
+    [0xc5] = { .handler = _cpu_cmp_zp, .cycles = 3, .mode = CPU_MODE_ZP, .mnemonic = "CMP" },
+    [0xd5] = { .handler = _cpu_cmp_zpx, .cycles = 4, .mode = CPU_MODE_ZPX, .mnemonic = "CMP" },
+    [0xcd] = { .handler = _cpu_cmp_abs, .cycles = 4, .mode = CPU_MODE_ABS, .mnemonic = "CMP" },
+    [0xdd] = { .handler = _cpu_cmp_absx, .cycles = 4, .mode = CPU_MODE_ABSX, .mnemonic = "CMP" },
+    [0xd9] = { .handler = _cpu_cmp_absy, .cycles = 4, .mode = CPU_MODE_ABSY, .mnemonic = "CMP" },
+    [0xc1] = { .handler = _cpu_cmp_indx, .cycles = 6, .mode = CPU_MODE_INDX, .mnemonic = "CMP" },
+    [0xd1] = { .handler = _cpu_cmp_indy, .cycles = 5, .mode = CPU_MODE_INDY, .mnemonic = "CMP" },
 
     // CPX
-    [0xe0] = { .handler = _cpu_cpx_imm, .cycles = 2 },
-    [0xe4] = { .handler = _cpu_cpx_zp, .cycles = 3 },
-    [0xec] = { .handler = _cpu_cpx_abs, .cycles = 4 },
+    [0xe0] = { .handler = _cpu_cpx_imm, .cycles = 2, .mode = CPU_MODE_IMM, .mnemonic = "CPX" },
+    [0xe4] = { .handler = _cpu_cpx_zp, .cycles = 3, .mode = CPU_MODE_ZP, .mnemonic = "CPX" },
+    [0xec] = { .handler = _cpu_cpx_abs, .cycles = 4, .mode = CPU_MODE_ABS, .mnemonic = "CPX" },
 
     // CPY
-    [0xc0] = { .handler = _cpu_cpy_imm, .cycles = 2 },
-    [0xc4] = { .handler = _cpu_cpy_zp, .cycles = 3 },
-    [0xcc] = { .handler = _cpu_cpy_abs, .cycles = 4 },
+    [0xc0] = { .handler = _cpu_cpy_imm, .cycles = 2, .mode = CPU_MODE_IMM, .mnemonic = "CPY" },
+    [0xc4] = { .handler = _cpu_cpy_zp, .cycles = 3, .mode = CPU_MODE_ZP, .mnemonic = "CPY" },
+    [0xcc] = { .handler = _cpu_cpy_abs, .cycles = 4, .mode = CPU_MODE_ABS, .mnemonic = "CPY" },
 
     // DEC
-    [0xc6] = { .handler = _cpu_dec_zp, .cycles = 5 },
-    [0xd6] = { .handler = _cpu_dec_zpx, .cycles = 6 },
-    [0xce] = { .handler = _cpu_dec_abs, .cycles = 6 },
-    [0xde] = { .handler = _cpu_dec_absx, .cycles = 7 },
+    [0xc6] = { .handler = _cpu_dec_zp, .cycles = 5, .mode = CPU_MODE_ZP, .mnemonic = "DEC" },
+    [0xd6] = { .handler = _cpu_dec_zpx, .cycles = 6, .mode = CPU_MODE_ZPX, .mnemonic = "DEC" },
+    [0xce] = { .handler = _cpu_dec_abs, .cycles = 6, .mode = CPU_MODE_ABS, .mnemonic = "DEC" },
+    [0xde] = { .handler = _cpu_dec_absx, .cycles = 7, .mode = CPU_MODE_ABSX, .mnemonic = "DEC" },
 
     // DEX
-    [0xca] = { .handler = _cpu_dex, .cycles = 2 },
+    [0xca] = { .handler = _cpu_dex, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "DEX" },
 
     // DEY
-    [0x88] = { .handler = _cpu_dey, .cycles = 2 },
+    [0x88] = { .handler = _cpu_dey, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "DEY" },
 
     // EOR
-    [0x49] = { .handler = _cpu_eor_imm, .cycles = 2 },
-    [0x45] = { .handler = _cpu_eor_zp, .cycles = 3 },
-    [0x55] = { .handler = _cpu_eor_zpx, .cycles = 4 },
-    [0x4d] = { .handler = _cpu_eor_abs, .cycles = 4 },
-    [0x5d] = { .handler = _cpu_eor_absx, .cycles = 4 },
-    [0x59] = { .handler = _cpu_eor_absy, .cycles = 4 },
-    [0x41] = { .handler = _cpu_eor_indx, .cycles = 6 },
-    [0x51] = { .handler = _cpu_eor_indy, .cycles = 5 },
+    [0x49] = { .handler = _cpu_eor_imm, .cycles = 2, .mode = CPU_MODE_IMM, .mnemonic = "EOR" },
+    [0x45] = { .handler = _cpu_eor_zp, .cycles = 3, .mode = CPU_MODE_ZP, .mnemonic = "EOR" },
+    [0x55] = { .handler = _cpu_eor_zpx, .cycles = 4, .mode = CPU_MODE_ZPX, .mnemonic = "EOR" },
+    [0x4d] = { .handler = _cpu_eor_abs, .cycles = 4, .mode = CPU_MODE_ABS, .mnemonic = "EOR" },
+    [0x5d] = { .handler = _cpu_eor_absx, .cycles = 4, .mode = CPU_MODE_ABSX, .mnemonic = "EOR" },
+    [0x59] = { .handler = _cpu_eor_absy, .cycles = 4, .mode = CPU_MODE_ABSY, .mnemonic = "EOR" },
+    [0x41] = { .handler = _cpu_eor_indx, .cycles = 6, .mode = CPU_MODE_INDX, .mnemonic = "EOR" },
+    [0x51] = { .handler = _cpu_eor_indy, .cycles = 5, .mode = CPU_MODE_INDY, .mnemonic = "EOR" },
 
     // INC
-    [0xe6] = { .handler = _cpu_inc_zp, .cycles = 5 },
-    [0xf6] = { .handler = _cpu_inc_zpx, .cycles = 6 },
-    [0xee] = { .handler = _cpu_inc_abs, .cycles = 6 },
-    [0xfe] = { .handler = _cpu_inc_absx, .cycles = 7 },
+    [0xe6] = { .handler = _cpu_inc_zp, .cycles = 5, .mode = CPU_MODE_ZP, .mnemonic = "INC" },
+    [0xf6] = { .handler = _cpu_inc_zpx, .cycles = 6, .mode = CPU_MODE_ZPX, .mnemonic = "INC" },
+    [0xee] = { .handler = _cpu_inc_abs, .cycles = 6, .mode = CPU_MODE_ABS, .mnemonic = "INC" },
+    [0xfe] = { .handler = _cpu_inc_absx, .cycles = 7, .mode = CPU_MODE_ABSX, .mnemonic = "INC" },
 
     // INX
-    [0xe8] = { .handler = _cpu_inx, .cycles = 2 },
+    [0xe8] = { .handler = _cpu_inx, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "INX" },
 
     // INY
-    [0xc8] = { .handler = _cpu_iny, .cycles = 2 },
+    [0xc8] = { .handler = _cpu_iny, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "INY" },
 
     // JMP
-    [0x4c] = { .handler = _cpu_jmp_abs, .cycles = 3 },
-    [0x6c] = { .handler = _cpu_jmp_ind, .cycles = 5 },
+    [0x4c] = { .handler = _cpu_jmp_abs, .cycles = 3, .mode = CPU_MODE_ABS, .mnemonic = "JMP" },
+    [0x6c] = { .handler = _cpu_jmp_ind, .cycles = 5, .mode = CPU_MODE_IND, .mnemonic = "JMP" },
 
     // JSR
-    [0x20] = { .handler = _cpu_jsr, .cycles = 6 },
+    [0x20] = { .handler = _cpu_jsr, .cycles = 6, .mode = CPU_MODE_ABS, .mnemonic = "JSR" },
 
     // LDA
-    [0xa9] = { .handler = _cpu_lda_imm, .cycles = 2 },
-    [0xa5] = { .handler = _cpu_lda_zp, .cycles = 3 },
-    [0xb5] = { .handler = _cpu_lda_zpx, .cycles = 4 },
-    [0xad] = { .handler = _cpu_lda_abs, .cycles = 4 },
-    [0xbd] = { .handler = _cpu_lda_absx, .cycles = 4 },
-    [0xb9] = { .handler = _cpu_lda_absy, .cycles = 4 },
-    [0xa1] = { .handler = _cpu_lda_indx, .cycles = 6 },
-    [0xb1] = { .handler = _cpu_lda_indy, .cycles = 5 },
+    [0xa9] = { .handler = _cpu_lda_imm, .cycles = 2, .mode = CPU_MODE_IMM, .mnemonic = "LDA" },
+    [0xa5] = { .handler = _cpu_lda_zp, .cycles = 3, .mode = CPU_MODE_ZP, .mnemonic = "LDA" },
+    [0xb5] = { .handler = _cpu_lda_zpx, .cycles = 4, .mode = CPU_MODE_ZPX, .mnemonic = "LDA" },
+    [0xad] = { .handler = _cpu_lda_abs, .cycles = 4, .mode = CPU_MODE_ABS, .mnemonic = "LDA" },
+    [0xbd] = { .handler = _cpu_lda_absx, .cycles = 4, .mode = CPU_MODE_ABSX, .mnemonic = "LDA" },
+    [0xb9] = { .handler = _cpu_lda_absy, .cycles = 4, .mode = CPU_MODE_ABSY, .mnemonic = "LDA" },
+    [0xa1] = { .handler = _cpu_lda_indx, .cycles = 6, .mode = CPU_MODE_INDX, .mnemonic = "LDA" },
+    [0xb1] = { .handler = _cpu_lda_indy, .cycles = 5, .mode = CPU_MODE_INDY, .mnemonic = "LDA" },
 
     // LDX
-    [0xa2] = { .handler = _cpu_ldx_imm, .cycles = 2 },
-    [0xa6] = { .handler = _cpu_ldx_zp, .cycles = 3 },
-    [0xb6] = { .handler = _cpu_ldx_zpy, .cycles = 4 },
-    [0xae] = { .handler = _cpu_ldx_abs, .cycles = 4 },
-    [0xbe] = { .handler = _cpu_ldx_absy, .cycles = 4 },
+    [0xa2] = { .handler = _cpu_ldx_imm, .cycles = 2, .mode = CPU_MODE_IMM, .mnemonic = "LDX" },
+    [0xa6] = { .handler = _cpu_ldx_zp, .cycles = 3, .mode = CPU_MODE_ZP, .mnemonic = "LDX" },
+    [0xb6] = { .handler = _cpu_ldx_zpy, .cycles = 4, .mode = CPU_MODE_ZPY, .mnemonic = "LDX" },
+    [0xae] = { .handler = _cpu_ldx_abs, .cycles = 4, .mode = CPU_MODE_ABS, .mnemonic = "LDX" },
+    [0xbe] = { .handler = _cpu_ldx_absy, .cycles = 4, .mode = CPU_MODE_ABSY, .mnemonic = "LDX" },
 
     // LDY
-    [0xa0] = { .handler = _cpu_ldy_imm, .cycles = 2 },
-    [0xa4] = { .handler = _cpu_ldy_zp, .cycles = 3 },
-    [0xb4] = { .handler = _cpu_ldy_zpx, .cycles = 4 },
-    [0xac] = { .handler = _cpu_ldy_abs, .cycles = 4 },
-    [0xbc] = { .handler = _cpu_ldy_absx, .cycles = 4 },
+    [0xa0] = { .handler = _cpu_ldy_imm, .cycles = 2, .mode = CPU_MODE_IMM, .mnemonic = "LDY" },
+    [0xa4] = { .handler = _cpu_ldy_zp, .cycles = 3, .mode = CPU_MODE_ZP, .mnemonic = "LDY" },
+    [0xb4] = { .handler = _cpu_ldy_zpx, .cycles = 4, .mode = CPU_MODE_ZPX, .mnemonic = "LDY" },
+    [0xac] = { .handler = _cpu_ldy_abs, .cycles = 4, .mode = CPU_MODE_ABS, .mnemonic = "LDY" },
+    [0xbc] = { .handler = _cpu_ldy_absx, .cycles = 4, .mode = CPU_MODE_ABSX, .mnemonic = "LDY" },
 
     // LSR
-    [0x4a] = { .handler = _cpu_lsr_a, .cycles = 2 },
-    [0x46] = { .handler = _cpu_lsr_zp, .cycles = 5 },
-    [0x56] = { .handler = _cpu_lsr_zpx, .cycles = 6 },
-    [0x4e] = { .handler = _cpu_lsr_abs, .cycles = 6 },
-    [0x5e] = { .handler = _cpu_lsr_absx, .cycles = 7 },
+    [0x4a] = { .handler = _cpu_lsr_a, .cycles = 2, .mode = CPU_MODE_ACC, .mnemonic = "LSR" },
+    [0x46] = { .handler = _cpu_lsr_zp, .cycles = 5, .mode = CPU_MODE_ZP, .mnemonic = "LSR" },
+    [0x56] = { .handler = _cpu_lsr_zpx, .cycles = 6, .mode = CPU_MODE_ZPX, .mnemonic = "LSR" },
+    [0x4e] = { .handler = _cpu_lsr_abs, .cycles = 6, .mode = CPU_MODE_ABS, .mnemonic = "LSR" },
+    [0x5e] = { .handler = _cpu_lsr_absx, .cycles = 7, .mode = CPU_MODE_ABSX, .mnemonic = "LSR" },
 
     // NOP
-    [0xea] = { .handler = _cpu_nop, .cycles = 2 },
+    [0xea] = { .handler = _cpu_nop, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "NOP" },
 
     // ORA
-    [0x09] = { .handler = _cpu_ora_imm, .cycles = 2 },
-    [0x05] = { .handler = _cpu_ora_zp, .cycles = 3 },
-    [0x15] = { .handler = _cpu_ora_zpx, .cycles = 4 },
-    [0x0d] = { .handler = _cpu_ora_abs, .cycles = 4 },
-    [0x1d] = { .handler = _cpu_ora_absx, .cycles = 4 },
-    [0x19] = { .handler = _cpu_ora_absy, .cycles = 4 },
-    [0x01] = { .handler = _cpu_ora_indx, .cycles = 6 },
-    [0x11] = { .handler = _cpu_ora_indy, .cycles = 5 },
+    [0x09] = { .handler = _cpu_ora_imm, .cycles = 2, .mode = CPU_MODE_IMM, .mnemonic = "ORA" },
+    [0x05] = { .handler = _cpu_ora_zp, .cycles = 3, .mode = CPU_MODE_ZP, .mnemonic = "ORA" },
+    [0x15] = { .handler = _cpu_ora_zpx, .cycles = 4, .mode = CPU_MODE_ZPX, .mnemonic = "ORA" },
+    [0x0d] = { .handler = _cpu_ora_abs, .cycles = 4, .mode = CPU_MODE_ABS, .mnemonic = "ORA" },
+    [0x1d] = { .handler = _cpu_ora_absx, .cycles = 4, .mode = CPU_MODE_ABSX, .mnemonic = "ORA" },
+    [0x19] = { .handler = _cpu_ora_absy, .cycles = 4, .mode = CPU_MODE_ABSY, .mnemonic = "ORA" },
+    [0x01] = { .handler = _cpu_ora_indx, .cycles = 6, .mode = CPU_MODE_INDX, .mnemonic = "ORA" },
+    [0x11] = { .handler = _cpu_ora_indy, .cycles = 5, .mode = CPU_MODE_INDY, .mnemonic = "ORA" },
 
     // PHA
-    [0x48] = { .handler = _cpu_pha, .cycles = 3 },
+    [0x48] = { .handler = _cpu_pha, .cycles = 3, .mode = CPU_MODE_IMP, .mnemonic = "PHA" },
 
     // PHP
-    [0x08] = { .handler = _cpu_php, .cycles = 3 },
+    [0x08] = { .handler = _cpu_php, .cycles = 3, .mode = CPU_MODE_IMP, .mnemonic = "PHP" },
 
     // PLA
-    [0x68] = { .handler = _cpu_pla, .cycles = 4 },
+    [0x68] = { .handler = _cpu_pla, .cycles = 4, .mode = CPU_MODE_IMP, .mnemonic = "PLA" },
 
     // PLP
-    [0x28] = { .handler = _cpu_plp, .cycles = 4 },
+    [0x28] = { .handler = _cpu_plp, .cycles = 4, .mode = CPU_MODE_IMP, .mnemonic = "PLP" },
 
     // ROL
-    [0x2a] = { .handler = _cpu_rol_a, .cycles = 2 },
-    [0x26] = { .handler = _cpu_rol_zp, .cycles = 5 },
-    [0x36] = { .handler = _cpu_rol_zpx, .cycles = 6 },
-    [0x2e] = { .handler = _cpu_rol_abs, .cycles = 6 },
-    [0x3e] = { .handler = _cpu_rol_absx, .cycles = 7 },
+    [0x2a] = { .handler = _cpu_rol_a, .cycles = 2, .mode = CPU_MODE_ACC, .mnemonic = "ROL" },
+    [0x26] = { .handler = _cpu_rol_zp, .cycles = 5, .mode = CPU_MODE_ZP, .mnemonic = "ROL" },
+    [0x36] = { .handler = _cpu_rol_zpx, .cycles = 6, .mode = CPU_MODE_ZPX, .mnemonic = "ROL" },
+    [0x2e] = { .handler = _cpu_rol_abs, .cycles = 6, .mode = CPU_MODE_ABS, .mnemonic = "ROL" },
+    [0x3e] = { .handler = _cpu_rol_absx, .cycles = 7, .mode = CPU_MODE_ABSX, .mnemonic = "ROL" },
 
     // ROR
-    [0x6a] = { .handler = _cpu_ror_a, .cycles = 2 },
-    [0x66] = { .handler = _cpu_ror_zp, .cycles = 5 },
-    [0x76] = { .handler = _cpu_ror_zpx, .cycles = 6 },
-    [0x6e] = { .handler = _cpu_ror_abs, .cycles = 6 },
-    [0x7e] = { .handler = _cpu_ror_absx, .cycles = 7 },
+    [0x6a] = { .handler = _cpu_ror_a, .cycles = 2, .mode = CPU_MODE_ACC, .mnemonic = "ROR" },
+    [0x66] = { .handler = _cpu_ror_zp, .cycles = 5, .mode = CPU_MODE_ZP, .mnemonic = "ROR" },
+    [0x76] = { .handler = _cpu_ror_zpx, .cycles = 6, .mode = CPU_MODE_ZPX, .mnemonic = "ROR" },
+    [0x6e] = { .handler = _cpu_ror_abs, .cycles = 6, .mode = CPU_MODE_ABS, .mnemonic = "ROR" },
+    [0x7e] = { .handler = _cpu_ror_absx, .cycles = 7, .mode = CPU_MODE_ABSX, .mnemonic = "ROR" },
 
     // RTI
-    [0x40] = { .handler = _cpu_rti, .cycles = 6 },
+    [0x40] = { .handler = _cpu_rti, .cycles = 6, .mode = CPU_MODE_IMP, .mnemonic = "RTI" },
 
     // RTS
-    [0x60] = { .handler = _cpu_rts, .cycles = 6 },
+    [0x60] = { .handler = _cpu_rts, .cycles = 6, .mode = CPU_MODE_IMP, .mnemonic = "RTS" },
 
     // SBC
-    [0xe9] = { .handler = _cpu_sbc_imm, .cycles = 2 },
-    [0xe5] = { .handler = _cpu_sbc_zp, .cycles = 3 },
-    [0xf5] = { .handler = _cpu_sbc_zpx, .cycles = 4 },
-    [0xed] = { .handler = _cpu_sbc_abs, .cycles = 4 },
-    [0xfd] = { .handler = _cpu_sbc_absx, .cycles = 4 },
-    [0xf9] = { .handler = _cpu_sbc_absy, .cycles = 4 },
-    [0xe1] = { .handler = _cpu_sbc_indx, .cycles = 6 },
-    [0xf1] = { .handler = _cpu_sbc_indy, .cycles = 5 },
+    [0xe9] = { .handler = _cpu_sbc_imm, .cycles = 2, .mode = CPU_MODE_IMM, .mnemonic = "SBC" },
+    [0xe5] = { .handler = _cpu_sbc_zp, .cycles = 3, .mode = CPU_MODE_ZP, .mnemonic = "SBC" },
+    [0xf5] = { .handler = _cpu_sbc_zpx, .cycles = 4, .mode = CPU_MODE_ZPX, .mnemonic = "SBC" },
+    [0xed] = { .handler = _cpu_sbc_abs, .cycles = 4, .mode = CPU_MODE_ABS, .mnemonic = "SBC" },
+    [0xfd] = { .handler = _cpu_sbc_absx, .cycles = 4, .mode = CPU_MODE_ABSX, .mnemonic = "SBC" },
+    [0xf9] = { .handler = _cpu_sbc_absy, .cycles = 4, .mode = CPU_MODE_ABSY, .mnemonic = "SBC" },
+    [0xe1] = { .handler = _cpu_sbc_indx, .cycles = 6, .mode = CPU_MODE_INDX, .mnemonic = "SBC" },
+    [0xf1] = { .handler = _cpu_sbc_indy, .cycles = 5, .mode = CPU_MODE_INDY, .mnemonic = "SBC" },
 
     // SEC
-    [0x38] = { .handler = _cpu_sec, .cycles = 2 },
+    [0x38] = { .handler = _cpu_sec, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "SEC" },
 
     // SED
-    [0xf8] = { .handler = _cpu_sed, .cycles = 2 },
+    [0xf8] = { .handler = _cpu_sed, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "SED" },
 
     // SEI
-    [0x78] = { .handler = _cpu_sei, .cycles = 2 },
+    [0x78] = { .handler = _cpu_sei, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "SEI" },
 
     // STA
-    [0x85] = { .handler = _cpu_sta_zp, .cycles = 3 },
-    [0x95] = { .handler = _cpu_sta_zpx, .cycles = 4 },
-    [0x8d] = { .handler = _cpu_sta_abs, .cycles = 4 },
-    [0x9d] = { .handler = _cpu_sta_absx, .cycles = 5 },
-    [0x99] = { .handler = _cpu_sta_absy, .cycles = 5 },
-    [0x81] = { .handler = _cpu_sta_indx, .cycles = 6 },
-    [0x91] = { .handler = _cpu_sta_indy, .cycles = 6 },
+    [0x85] = { .handler = _cpu_sta_zp, .cycles = 3, .mode = CPU_MODE_ZP, .mnemonic = "STA" },
+    [0x95] = { .handler = _cpu_sta_zpx, .cycles = 4, .mode = CPU_MODE_ZPX, .mnemonic = "STA" },
+    [0x8d] = { .handler = _cpu_sta_abs, .cycles = 4, .mode = CPU_MODE_ABS, .mnemonic = "STA" },
+    [0x9d] = { .handler = _cpu_sta_absx, .cycles = 5, .mode = CPU_MODE_ABSX, .mnemonic = "STA" },
+    [0x99] = { .handler = _cpu_sta_absy, .cycles = 5, .mode = CPU_MODE_ABSY, .mnemonic = "STA" },
+    [0x81] = { .handler = _cpu_sta_indx, .cycles = 6, .mode = CPU_MODE_INDX, .mnemonic = "STA" },
+    [0x91] = { .handler = _cpu_sta_indy, .cycles = 6, .mode = CPU_MODE_INDY, .mnemonic = "STA" },
 
     // STX
-    [0x86] = { .handler = _cpu_stx_zp, .cycles = 3 },
-    [0x96] = { .handler = _cpu_stx_zpy, .cycles = 4 },
-    [0x8e] = { .handler = _cpu_stx_abs, .cycles = 4 },
+    [0x86] = { .handler = _cpu_stx_zp, .cycles = 3, .mode = CPU_MODE_ZP, .mnemonic = "STX" },
+    [0x96] = { .handler = _cpu_stx_zpy, .cycles = 4, .mode = CPU_MODE_ZPY, .mnemonic = "STX" },
+    [0x8e] = { .handler = _cpu_stx_abs, .cycles = 4, .mode = CPU_MODE_ABS, .mnemonic = "STX" },
 
     // STY
-    [0x84] = { .handler = _cpu_sty_zp, .cycles = 3 },
-    [0x94] = { .handler = _cpu_sty_zpx, .cycles = 4 },
-    [0x8c] = { .handler = _cpu_sty_abs, .cycles = 4 },
+    [0x84] = { .handler = _cpu_sty_zp, .cycles = 3, .mode = CPU_MODE_ZP, .mnemonic = "STY" },
+    [0x94] = { .handler = _cpu_sty_zpx, .cycles = 4, .mode = CPU_MODE_ZPX, .mnemonic = "STY" },
+    [0x8c] = { .handler = _cpu_sty_abs, .cycles = 4, .mode = CPU_MODE_ABS, .mnemonic = "STY" },
 
     // TAX
-    [0xaa] = { .handler = _cpu_tax, .cycles = 2 },
+    [0xaa] = { .handler = _cpu_tax, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "TAX" },
 
     // TAY
-    [0xa8] = { .handler = _cpu_tay, .cycles = 2 },
+    [0xa8] = { .handler = _cpu_tay, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "TAY" },
 
     // TSX
-    [0xba] = { .handler = _cpu_tsx, .cycles = 2 },
+    [0xba] = { .handler = _cpu_tsx, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "TSX" },
 
     // TXA
-    [0x8a] = { .handler = _cpu_txa, .cycles = 2 },
+    [0x8a] = { .handler = _cpu_txa, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "TXA" },
 
     // TXS
-    [0x9a] = { .handler = _cpu_txs, .cycles = 2 },
+    [0x9a] = { .handler = _cpu_txs, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "TXS" },
 
     // TYA
-    [0x98] = { .handler = _cpu_tya, .cycles = 2 },
+    [0x98] = { .handler = _cpu_tya, .cycles = 2, .mode = CPU_MODE_IMP, .mnemonic = "TYA" },
 };
 
+/*
+ * @brief Instruction size by addressing mode, opcode included
+ */
+static const uint8_t _mode_size[] = {
+    [CPU_MODE_IMP] = 1,
+    [CPU_MODE_ACC] = 1,
+    [CPU_MODE_IMM] = 2,
+    [CPU_MODE_ZP] = 2,
+    [CPU_MODE_ZPX] = 2,
+    [CPU_MODE_ZPY] = 2,
+    [CPU_MODE_ABS] = 3,
+    [CPU_MODE_ABSX] = 3,
+    [CPU_MODE_ABSY] = 3,
+    [CPU_MODE_IND] = 3,
+    [CPU_MODE_INDX] = 2,
+    [CPU_MODE_INDY] = 2,
+    [CPU_MODE_REL] = 2
+};
+
+void cpu_bind(cpu_t *cpu) {
+    _cpu = cpu;
+}
+
+const cpu_t *cpu_get_bound() {
+    return _cpu;
+}
+
 void cpu_init() {
-    memset(&_cpu, 0, sizeof(cpu_t));
+    memset(_cpu, 0, sizeof(cpu_t));
 }
 
 void cpu_reset() {
     memory_reset();
-    _cpu.pc = memory_read(RES_ADDR_LO) | (memory_read(RES_ADDR_HI) << 8);
-    _cpu.sp = 0xFF;
-    _cpu.a = 0;
-    _cpu.x = 0;
-    _cpu.y = 0;
+    _cpu->pc = memory_read(RES_ADDR_LO) | (memory_read(RES_ADDR_HI) << 8);
+    _cpu->sp = 0xFF;
+    _cpu->a = 0;
+    _cpu->x = 0;
+    _cpu->y = 0;
     /** @todo */
 }
 
 void cpu_step() {
-    uint8_t opcode = memory_read(_cpu.pc++);
-    cpu_instruction_t instr = _instr_table[opcode];
+    uint8_t opcode;
+    cpu_instruction_t instr;
+    const cpu_instruction_t *decoded = NULL;
+
+#ifdef NES_CONF_WATCH_ENABLE
+    if (WATCH_BIT(_cpu_breakpoints, _cpu->pc) && watch_break(_cpu->pc, _cpu->cycles)) {
+        return;
+    }
+#endif
+
+    if (_cpu_decoded && _cpu->pc >= CPU_DECODED_BASE) {
+        decoded = _cpu_decoded[_cpu->pc - CPU_DECODED_BASE];
+    }
+
+    if (decoded) {
+        instr = *decoded;
+        opcode = decoded - _instr_table;
+        METRICS_ADD(decoded, 1);
+    } else {
+        opcode = memory_read(_cpu->pc);
+        instr = _instr_table[opcode];
+    }
+
+#ifdef NES_CONF_TRACE_ENABLE
+    trace_record(_cpu, opcode, _mode_size[instr.mode]);
+#endif
+
+    _cpu->pc++;
 
     if (instr.handler) {
         instr.handler();
     } 
+    _cpu->cycles += instr.cycles;
 }    
 
+void cpu_nmi() {
+    PUSH_16(_cpu->pc);
+
+    PUSH_8(_cpu->flags & ~CPU_FLAG_BREAK);
+    cpu_set_flag(CPU_FLAG_INTERRUPT, 1);
+    _cpu->pc = memory_read(NMI_ADDR_LO) | (memory_read(NMI_ADDR_HI) << 8);
+    _cpu->cycles += 7;
+}
+
+void cpu_stall(uint32_t cycles) {
+    _cpu->cycles += cycles;
+}
+
+int cpu_run_until(uint64_t cycles) {
+    uint8_t stopped;
+    uint64_t steps = 0;
+
+    _cpu_target = cycles;
+    _cpu_stopped = 0;
+    while (_cpu->cycles < _cpu_target) {
+        cpu_step();
+        steps++;
+    }
+    METRICS_ADD(instructions, steps);
+
+    stopped = _cpu_stopped;
+    _cpu_stopped = 0;
+    return stopped;
+}
+
+void cpu_stop() {
+    _cpu_target = 0;
+    _cpu_stopped = 1;
+}
+
+void cpu_set_breakpoints(const uint8_t *bitmap) {
+    _cpu_breakpoints = bitmap;
+}
+
+void cpu_set_decoded(const cpu_instruction_t *const *decoded) {
+    _cpu_decoded = decoded;
+}
+
+void cpu_get_state(cpu_t *state) {
+    *state = *_cpu;
+}
+
+void cpu_set_state(const cpu_t *state) {
+    *_cpu = *state;
+}
+
+const cpu_instruction_t *cpu_get_instruction(uint8_t opcode) {
+    return &_instr_table[opcode];
+}
+
+uint8_t cpu_get_instruction_size(uint8_t opcode) {
+    return _mode_size[_instr_table[opcode].mode];
+}
+
 uint8_t cpu_fetch_imm() {
-    return memory_read(_cpu.pc++);
+    return memory_read(_cpu->pc++);
 }
 
 uint16_t cpu_fetch_abs() {
-    uint16_t address = memory_read(_cpu.pc++);
-    address |= memory_read(_cpu.pc++) << 8;
+    uint16_t address = memory_read(_cpu->pc++);
+    address |= memory_read(_cpu->pc++) << 8;
     return address;
 }
 
 uint16_t cpu_fetch_absx() {
-    uint16_t address = memory_read(_cpu.pc++);
-    address |= memory_read(_cpu.pc++) << 8;
-    address += _cpu.x;
+    uint16_t address = memory_read(_cpu->pc++);
+    address |= memory_read(_cpu->pc++) << 8;
+    address += _cpu->x;
     return address;
 }
 
 uint16_t cpu_fetch_absy() {
-    uint16_t address = memory_read(_cpu.pc++);
-    address |= memory_read(_cpu.pc++) << 8;
-    address += _cpu.y;
+    uint16_t address = memory_read(_cpu->pc++);
+    address |= memory_read(_cpu->pc++) << 8;
+    address += _cpu->y;
     return address;
 }
 
 
 uint16_t cpu_fetch_ind() {
-    uint16_t address = memory_read(_cpu.pc++);
-    address |= memory_read(_cpu.pc++) << 8;
+    uint16_t address = memory_read(_cpu->pc++);
+    address |= memory_read(_cpu->pc++) << 8;
     return address;
 }
 
 uint16_t cpu_fetch_indx() {
-    uint16_t address = memory_read(_cpu.pc++);
-    address |= memory_read(_cpu.pc++) << 8;
-    address += _cpu.x;
+    uint16_t address = memory_read(_cpu->pc++);
+    address |= memory_read(_cpu->pc++) << 8;
+    address += _cpu->x;
     return address;
 }
 
 uint16_t cpu_fetch_indy() {
-    uint16_t address = memory_read(_cpu.pc++);
-    address |= memory_read(_cpu.pc++) << 8;
-    address += _cpu.y;
+    uint16_t address = memory_read(_cpu->pc++);
+    address |= memory_read(_cpu->pc++) << 8;
+    address += _cpu->y;
     return address;
 }
 
 uint8_t cpu_fetch_zp() {
-    return memory_read(_cpu.pc++);
+    return memory_read(_cpu->pc++);
 }
 
 uint8_t cpu_fetch_zpx() {
-    return (memory_read(_cpu.pc++) + _cpu.x) & 0xff;
+    return (memory_read(_cpu->pc++) + _cpu->x) & 0xff;
 }
 
 uint8_t cpu_fetch_zpy() {
-    return (memory_read(_cpu.pc++) + _cpu.y) & 0xff;
+    return (memory_read(_cpu->pc++) + _cpu->y) & 0xff;
 }
 
 void cpu_set_flag(cpu_flag_t mask, uint8_t value) {
-    _cpu.flags &= ~(1 << mask);
-    _cpu.flags |= value != 0 << mask;
+    _cpu->flags &= ~mask;
+    if (value) {
+        _cpu->flags |= mask;
+    }
 }
 
 uint8_t cpu_get_flag(cpu_flag_t mask){
-    return (_cpu.flags & (1<<mask)) != 0;
+    return (_cpu->flags & mask) != 0;
 }
 
 #endif // MODULE_CPU_ENABLE
@@ -1,15 +1,46 @@
 #include "memory.h"
 
 #include "cartridge.h"
+#include "controller.h"
+#include "cpu.h"
+#include "hash.h"
+#include "metrics.h"
+#include "ppu.h"
+#include "watch.h"
 
 #ifdef NES_CONF_MEMORY_ENABLE
 
 #include <string.h>
 
-static memory_t _memory;
+/*
+ * @brief CPU cycles OAM DMA halts the CPU for, one more when it starts on
+ * an odd cycle
+ */
+#define _MEMORY_DMA_CYCLES 513U
+
+/*
+ * @brief Memory the calling thread operates on, see memory_bind()
+ */
+static memory_t _memory_default;
+static _Thread_local memory_t *_memory = &_memory_default;
+
+/*
+ * @brief Pages whose writes go through watch_write, see memory_set_traps()
+ */
+static const uint8_t _memory_no_traps[WATCH_PAGES];
+static _Thread_local const uint8_t *_memory_traps = _memory_no_traps;
+
+void memory_bind(memory_t *memory) {
+    _memory = memory;
+}
+
+void memory_set_traps(const uint8_t *pages) {
+    _memory_traps = pages;
+}
 
 void memory_init() {
-    memset(_memory.ram, 0, sizeof(_memory.ram));
+    memset(_memory->ram, 0, sizeof(_memory->ram));
+    _memory->hash = 0;
 }
 
 void memory_reset() {
@@ -17,20 +48,40 @@ void memory_reset() {
 }
 
 void memory_write(uint16_t address, uint8_t data) {
-    if (address <= MEMORY_RAM_BASE + MEMORY_RAM_MIRROR_SIZE) {
+    METRICS_BUS(address);
+
+#ifdef NES_CONF_WATCH_ENABLE
+    if (_memory_traps[address >> 8]) {
+        watch_write(address, data);
+    }
+#endif
+
+    if (address < MEMORY_PPU_REG_BASE) {
         address = (address - MEMORY_RAM_BASE) % MEMORY_RAM_SIZE;
-        _memory.ram[address] = data;
-    } else if (
-            address >= MEMORY_PPU_REG_BASE &&
-            address <= MEMORY_PPU_REG_BASE + MEMORY_PPU_REG_SIZE) {
+        _memory->hash ^= hash_byte(HASH_DOMAIN_RAM, address, _memory->ram[address]) ^
+            hash_byte(HASH_DOMAIN_RAM, address, data);
+        _memory->ram[address] = data;
+    } else if (address < MEMORY_APU_IO_REG_BASE) {
         address = (address - MEMORY_PPU_REG_BASE) % MEMORY_PPU_REG_SIZE;
-        /** @todo */
+        ppu_write(address, data);
 
-    } else if (
-            address >= MEMORY_APU_IO_REG_BASE &&
-            address <= MEMORY_APU_IO_REG_BASE + MEMORY_APU_IO_REG_SIZE) {
+    } else if (address < MEMORY_CARTRIDGE_BASE) {
         address = (address - MEMORY_APU_IO_REG_BASE) % MEMORY_APU_IO_REG_SIZE;
-        /** @todo */
+        if (address == CONTROLLER_REG_STROBE) {
+            controller_write(data);
+        } else if (address == PPU_REG_OAM_DMA) {
+            uint8_t page[PPU_OAM_SIZE];
+
+            for (uint32_t i = 0; i < PPU_OAM_SIZE; i++) {
+                page[i] = memory_read((data << 8) | i);
+            }
+            ppu_dma(page);
+
+            /* The counter is still at the start of the 4 cycle store, so
+             * its parity is that of the cycle after the write */
+            cpu_stall(_MEMORY_DMA_CYCLES + (cpu_get_bound()->cycles & 1));
+        }
+        /** @todo APU */
         
     } else {
         cartridge_write(address, data);
@@ -38,24 +89,37 @@ void memory_write(uint16_t address, uint8_t data) {
 }
 
 uint8_t memory_read(uint16_t address) {
+    METRICS_BUS(address);
 
-    if (address <= MEMORY_RAM_BASE + MEMORY_RAM_MIRROR_SIZE) {
+    if (address < MEMORY_PPU_REG_BASE) {
         address = (address - MEMORY_RAM_BASE) % MEMORY_RAM_SIZE;
-        return _memory.ram[address];
-    } else if (
-            address >= MEMORY_PPU_REG_BASE &&
-            address <= MEMORY_PPU_REG_BASE + MEMORY_PPU_REG_SIZE) {
+        return _memory->ram[address];
+    } else if (address < MEMORY_APU_IO_REG_BASE) {
         address = (address - MEMORY_PPU_REG_BASE) % MEMORY_PPU_REG_SIZE;
-        /** @todo */
+        return ppu_read(address);
 
-    } else if (
-            address >= MEMORY_APU_IO_REG_BASE &&
-            address <= MEMORY_APU_IO_REG_BASE + MEMORY_APU_IO_REG_SIZE) {
+    } else if (address < MEMORY_CARTRIDGE_BASE) {
         address = (address - MEMORY_APU_IO_REG_BASE) % MEMORY_APU_IO_REG_SIZE;
-        /** @todo */
+        if (address == CONTROLLER_REG_PORT_1 || address == CONTROLLER_REG_PORT_2) {
+            return controller_read(address - CONTROLLER_REG_PORT_1);
+        }
+        /** @todo APU */
+        return 0;
 
     }
     return cartridge_read(address);
 }
 
+const uint8_t *memory_get_ram() {
+    return _memory->ram;
+}
+
+void memory_get_state(memory_t *state) {
+    *state = *_memory;
+}
+
+void memory_set_state(const memory_t *state) {
+    *_memory = *state;
+}
+
 #endif // MODULE_MEMORY_ENABLE
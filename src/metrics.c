@@ -0,0 +1,307 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "metrics.h"
+
+#ifdef NES_CONF_METRICS_ENABLE
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+_Thread_local metrics_shard_t *metrics_local;
+
+/*
+ * @brief Every shard ever registered, guarded by _metrics_lock. Only
+ * registration and readers take the lock.
+ */
+static metrics_shard_t *_metrics_shards;
+static pthread_mutex_t _metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * @brief Releases the calling thread's shard when it exits
+ */
+static pthread_key_t _metrics_key;
+static pthread_once_t _metrics_once = PTHREAD_ONCE_INIT;
+
+/*
+ * @brief Upper bounds of the histogram buckets but the last, in ns
+ */
+static const uint64_t _metrics_bounds[METRICS_HISTOGRAMS][METRICS_BUCKETS - 1] = {
+    [METRICS_FRAME_TIME] = {
+        50000, 100000, 200000, 500000, 1000000,
+        2000000, 5000000, 10000000, 20000000, 50000000
+    },
+    [METRICS_SNAPSHOT_TIME] = {
+        100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000
+    },
+};
+
+static const char *const _metrics_histogram_names[METRICS_HISTOGRAMS] = {
+    [METRICS_FRAME_TIME] = "nes_frame_seconds",
+    [METRICS_SNAPSHOT_TIME] = "nes_snapshot_seconds",
+};
+
+static const char *const _metrics_histogram_help[METRICS_HISTOGRAMS] = {
+    [METRICS_FRAME_TIME] = "Time to emulate one frame of one console.",
+    [METRICS_SNAPSHOT_TIME] = "Time to save or load a console state.",
+};
+
+#ifdef NES_CONF_METRICS_BUS_ENABLE
+/*
+ * @brief Region of every bus page
+ */
+static const char *const _metrics_regions[METRICS_BUS_PAGES] = {
+    "ram", "ppu", "io", "cartridge_ram", "rom", "rom", "rom", "rom"
+};
+#endif
+
+static void _metrics_release(void *shard) {
+    pthread_mutex_lock(&_metrics_lock);
+    ((metrics_shard_t *)shard)->live = 0;
+    /* Counters keep adding up, a gauge of a thread that is gone reads 0 */
+    atomic_store_explicit(&((metrics_shard_t *)shard)->queue_depth, 0, memory_order_relaxed);
+    pthread_mutex_unlock(&_metrics_lock);
+}
+
+static void _metrics_init() {
+    pthread_key_create(&_metrics_key, _metrics_release);
+}
+
+metrics_shard_t *metrics_register() {
+    metrics_shard_t *shard;
+
+    pthread_once(&_metrics_once, _metrics_init);
+    pthread_mutex_lock(&_metrics_lock);
+
+    /* Take over the shard of a thread that exited, if any */
+    shard = _metrics_shards;
+    while (shard && shard->live) {
+        shard = shard->next;
+    }
+
+    if (!shard && (shard = aligned_alloc(METRICS_CACHE_LINE, sizeof(metrics_shard_t)))) {
+        memset(shard, 0, sizeof(metrics_shard_t));
+        shard->next = _metrics_shards;
+        _metrics_shards = shard;
+    }
+
+    if (!shard) {
+        /* Out of memory, count into a shard nobody reads */
+        static _Thread_local metrics_shard_t lost;
+        shard = &lost;
+    } else {
+        shard->live = 1;
+        pthread_setspecific(_metrics_key, shard);
+    }
+
+    pthread_mutex_unlock(&_metrics_lock);
+    return metrics_local = shard;
+}
+
+void metrics_observe(metrics_histogram_e histogram, uint64_t ns) {
+    size_t bucket = 0;
+
+    while (bucket < METRICS_BUCKETS - 1 && ns > _metrics_bounds[histogram][bucket]) {
+        bucket++;
+    }
+    METRICS_ADD(histograms[histogram].buckets[bucket], 1);
+    METRICS_ADD(histograms[histogram].sum_ns, ns);
+}
+
+static uint64_t _metrics_load(const _Atomic uint64_t *counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+void metrics_write(FILE *file) {
+    uint64_t instructions = 0, decoded = 0, frames = 0, queue_depth = 0;
+    uint64_t bus[METRICS_BUS_PAGES] = { 0 };
+    uint64_t buckets[METRICS_HISTOGRAMS][METRICS_BUCKETS] = { { 0 } };
+    uint64_t sums[METRICS_HISTOGRAMS] = { 0 };
+    size_t threads = 0;
+
+    pthread_mutex_lock(&_metrics_lock);
+    for (metrics_shard_t *shard = _metrics_shards; shard; shard = shard->next) {
+        instructions += _metrics_load(&shard->instructions);
+        decoded += _metrics_load(&shard->decoded);
+        frames += _metrics_load(&shard->frames);
+        queue_depth += _metrics_load(&shard->queue_depth);
+        threads += shard->live;
+        for (size_t page = 0; page < METRICS_BUS_PAGES; page++) {
+            bus[page] += _metrics_load(&shard->bus[page]);
+        }
+        for (size_t h = 0; h < METRICS_HISTOGRAMS; h++) {
+            for (size_t b = 0; b < METRICS_BUCKETS; b++) {
+                buckets[h][b] += _metrics_load(&shard->histograms[h].buckets[b]);
+            }
+            sums[h] += _metrics_load(&shard->histograms[h].sum_ns);
+        }
+    }
+    pthread_mutex_unlock(&_metrics_lock);
+
+    fprintf(file,
+        "# HELP nes_instructions_total CPU instructions run.\n"
+        "# TYPE nes_instructions_total counter\n"
+        "nes_instructions_total %llu\n"
+        "# HELP nes_decoded_instructions_total Instructions dispatched from a code map.\n"
+        "# TYPE nes_decoded_instructions_total counter\n"
+        "nes_decoded_instructions_total %llu\n"
+        "# HELP nes_frames_total Frames completed by all consoles.\n"
+        "# TYPE nes_frames_total counter\n"
+        "nes_frames_total %llu\n"
+        "# HELP nes_stream_queue_depth Frames queued in the stream rings.\n"
+        "# TYPE nes_stream_queue_depth gauge\n"
+        "nes_stream_queue_depth %llu\n"
+        "# HELP nes_metrics_threads Threads reporting metrics.\n"
+        "# TYPE nes_metrics_threads gauge\n"
+        "nes_metrics_threads %zu\n",
+        (unsigned long long)instructions, (unsigned long long)decoded,
+        (unsigned long long)frames, (unsigned long long)queue_depth, threads);
+
+#ifdef NES_CONF_METRICS_BUS_ENABLE
+    fprintf(file,
+        "# HELP nes_bus_accesses_total CPU bus reads and writes by region.\n"
+        "# TYPE nes_bus_accesses_total counter\n");
+    for (size_t page = 0; page < METRICS_BUS_PAGES; page++) {
+        /* Pages of one region are reported once, summed */
+        if (page && strcmp(_metrics_regions[page], _metrics_regions[page - 1]) == 0) {
+            continue;
+        }
+        uint64_t accesses = 0;
+        for (size_t p = page; p < METRICS_BUS_PAGES &&
+                strcmp(_metrics_regions[p], _metrics_regions[page]) == 0; p++) {
+            accesses += bus[p];
+        }
+        fprintf(file, "nes_bus_accesses_total{region=\"%s\"} %llu\n",
+            _metrics_regions[page], (unsigned long long)accesses);
+    }
+#endif
+
+    for (size_t h = 0; h < METRICS_HISTOGRAMS; h++) {
+        uint64_t count = 0;
+
+        fprintf(file, "# HELP %s %s\n# TYPE %s histogram\n", _metrics_histogram_names[h],
+            _metrics_histogram_help[h], _metrics_histogram_names[h]);
+        for (size_t b = 0; b < METRICS_BUCKETS; b++) {
+            count += buckets[h][b];
+            if (b < METRICS_BUCKETS - 1) {
+                fprintf(file, "%s_bucket{le=\"%g\"} %llu\n", _metrics_histogram_names[h],
+                    _metrics_bounds[h][b] * 1e-9, (unsigned long long)count);
+            } else {
+                fprintf(file, "%s_bucket{le=\"+Inf\"} %llu\n", _metrics_histogram_names[h],
+                    (unsigned long long)count);
+            }
+        }
+        fprintf(file, "%s_sum %.9f\n%s_count %llu\n", _metrics_histogram_names[h],
+            sums[h] * 1e-9, _metrics_histogram_names[h], (unsigned long long)count);
+    }
+}
+
+/*
+ * @brief Write the file through a temporary, so readers never see it half
+ * written
+ */
+static void _metrics_export(metrics_exporter_t *exporter) {
+    size_t size = strlen(exporter->path) + sizeof(".tmp");
+    char *tmp = malloc(size);
+    FILE *file;
+
+    if (!tmp) {
+        return;
+    }
+    snprintf(tmp, size, "%s.tmp", exporter->path);
+
+    if ((file = fopen(tmp, "w"))) {
+        metrics_write(file);
+        if (exporter->writer) {
+            exporter->writer(file, exporter->user);
+        }
+        if (fclose(file) == 0) {
+            rename(tmp, exporter->path);
+        } else {
+            remove(tmp);
+        }
+    }
+    free(tmp);
+}
+
+static void *_metrics_run(void *arg) {
+    metrics_exporter_t *exporter = arg;
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    pthread_mutex_lock(&exporter->lock);
+    while (!exporter->quit) {
+        pthread_mutex_unlock(&exporter->lock);
+        _metrics_export(exporter);
+
+        deadline.tv_sec += exporter->interval_ms / 1000;
+        deadline.tv_nsec += (exporter->interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        pthread_mutex_lock(&exporter->lock);
+        while (!exporter->quit &&
+                pthread_cond_timedwait(&exporter->wake, &exporter->lock, &deadline) == 0) {
+            /* Woken early, by a stop or spuriously */
+        }
+    }
+    pthread_mutex_unlock(&exporter->lock);
+
+    /* The last totals */
+    _metrics_export(exporter);
+    return NULL;
+}
+
+metrics_exporter_t *metrics_export_start(const char *path, uint32_t interval_ms,
+        metrics_writer_t writer, void *user) {
+    metrics_exporter_t *exporter = calloc(1, sizeof(metrics_exporter_t));
+    pthread_condattr_t attr;
+
+    if (!exporter || !(exporter->path = malloc(strlen(path) + 1))) {
+        free(exporter);
+        return NULL;
+    }
+
+    strcpy(exporter->path, path);
+    exporter->interval_ms = interval_ms ? interval_ms : 1;
+    exporter->writer = writer;
+    exporter->user = user;
+
+    pthread_mutex_init(&exporter->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&exporter->wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&exporter->thread, NULL, _metrics_run, exporter) != 0) {
+        pthread_cond_destroy(&exporter->wake);
+        pthread_mutex_destroy(&exporter->lock);
+        free(exporter->path);
+        free(exporter);
+        return NULL;
+    }
+
+    return exporter;
+}
+
+void metrics_export_stop(metrics_exporter_t *exporter) {
+    if (!exporter) {
+        return;
+    }
+
+    pthread_mutex_lock(&exporter->lock);
+    exporter->quit = 1;
+    pthread_cond_signal(&exporter->wake);
+    pthread_mutex_unlock(&exporter->lock);
+    pthread_join(exporter->thread, NULL);
+
+    pthread_cond_destroy(&exporter->wake);
+    pthread_mutex_destroy(&exporter->lock);
+    free(exporter->path);
+    free(exporter);
+}
+
+#endif // NES_CONF_METRICS_ENABLE
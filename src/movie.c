@@ -0,0 +1,193 @@
+#include "movie.h"
+
+#ifdef NES_CONF_MOVIE_ENABLE
+
+#include "nes.h"
+
+#include <string.h>
+
+static void _movie_put(uint8_t *out, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        out[i] = value >> (8 * i);
+    }
+}
+
+static uint64_t _movie_get(const uint8_t *in, size_t size) {
+    uint64_t value = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+/*
+ * @brief Write the pending input run
+ */
+static void _movie_flush(movie_recorder_t *recorder) {
+    uint8_t chunk[1 + 5 + CONTROLLER_PORTS];
+    uint32_t run = recorder->run;
+    size_t size = 0;
+
+    if (!run) {
+        return;
+    }
+
+    chunk[size++] = MOVIE_TAG_INPUT;
+    do {
+        chunk[size++] = (run & 0x7f) | (run > 0x7f ? 0x80 : 0);
+        run >>= 7;
+    } while (run);
+    memcpy(&chunk[size], recorder->input, CONTROLLER_PORTS);
+    size += CONTROLLER_PORTS;
+
+    fwrite(chunk, 1, size, recorder->file);
+    recorder->run = 0;
+}
+
+int movie_record_open(movie_recorder_t *recorder, nes_t *nes,
+        const char *path, const uint8_t *rom, size_t size, uint16_t interval) {
+    uint8_t header[MOVIE_HEADER_SIZE] = { 0 };
+
+    memset(recorder, 0, sizeof(movie_recorder_t));
+
+    if (nes_load_rom(nes, rom, size) != 0 || !(recorder->file = fopen(path, "wb"))) {
+        return -1;
+    }
+
+    recorder->nes = nes;
+    recorder->interval = interval;
+
+    memcpy(header, MOVIE_MAGIC, 4);
+    header[4] = MOVIE_VERSION;
+    _movie_put(&header[6], interval, 2);
+    _movie_put(&header[12], nes_fnv(NES_FNV_OFFSET, rom, size), 8);
+    fwrite(header, 1, sizeof(header), recorder->file);
+
+    return 0;
+}
+
+void movie_record_frame(movie_recorder_t *recorder,
+        const uint8_t buttons[CONTROLLER_PORTS]) {
+    if (recorder->run && memcmp(recorder->input, buttons, CONTROLLER_PORTS) != 0) {
+        _movie_flush(recorder);
+    }
+    memcpy(recorder->input, buttons, CONTROLLER_PORTS);
+    recorder->run++;
+
+    for (uint8_t port = 0; port < CONTROLLER_PORTS; port++) {
+        nes_set_buttons(recorder->nes, port, buttons[port]);
+    }
+    nes_step_frames(recorder->nes, 1);
+    recorder->frames++;
+
+    if (recorder->interval && recorder->frames % recorder->interval == 0) {
+        uint8_t chunk[1 + 8];
+
+        _movie_flush(recorder);
+        chunk[0] = MOVIE_TAG_CHECKPOINT;
+        _movie_put(&chunk[1], nes_hash_ram(recorder->nes), 8);
+        fwrite(chunk, 1, sizeof(chunk), recorder->file);
+    }
+}
+
+int movie_record_close(movie_recorder_t *recorder) {
+    uint8_t frames[4];
+    int status;
+
+    _movie_flush(recorder);
+    fputc(MOVIE_TAG_END, recorder->file);
+
+    _movie_put(frames, recorder->frames, 4);
+    status = fseek(recorder->file, 8, SEEK_SET) == 0 &&
+        fwrite(frames, 1, sizeof(frames), recorder->file) == sizeof(frames) &&
+        !ferror(recorder->file) ? 0 : -1;
+
+    if (fclose(recorder->file) != 0) {
+        status = -1;
+    }
+    recorder->file = NULL;
+
+    return status;
+}
+
+static int _movie_play(nes_t *nes, const uint8_t *movie, size_t movie_size,
+        const uint8_t *rom, size_t rom_size, movie_result_t *result) {
+    const uint8_t *p = movie + MOVIE_HEADER_SIZE;
+    const uint8_t *end = movie + movie_size;
+    uint64_t frame;
+    int stopped;
+
+    memset(result, 0, sizeof(movie_result_t));
+
+    if (movie_size < MOVIE_HEADER_SIZE || memcmp(movie, MOVIE_MAGIC, 4) != 0 ||
+            movie[4] != MOVIE_VERSION ||
+            _movie_get(&movie[12], 8) != nes_fnv(NES_FNV_OFFSET, rom, rom_size) ||
+            nes_load_rom(nes, rom, rom_size) != 0) {
+        return -1;
+    }
+
+    while (p < end) {
+        uint8_t tag = *p++;
+
+        if (tag == MOVIE_TAG_END) {
+            return result->frames == _movie_get(&movie[8], 4) ? 0 : -1;
+        } else if (tag == MOVIE_TAG_INPUT) {
+            uint32_t run = 0;
+
+            for (int shift = 0;; shift += 7) {
+                if (p == end || shift > 28) {
+                    return -1;
+                }
+                run |= (uint32_t)(*p & 0x7f) << shift;
+                if (!(*p++ & 0x80)) {
+                    break;
+                }
+            }
+            if ((size_t)(end - p) < CONTROLLER_PORTS) {
+                return -1;
+            }
+
+            for (uint8_t port = 0; port < CONTROLLER_PORTS; port++) {
+                nes_set_buttons(nes, port, p[port]);
+            }
+            p += CONTROLLER_PORTS;
+
+            /* A stop cuts the run short, frames counts what ran */
+            frame = nes_get_frame(nes);
+            stopped = nes_step_frames(nes, run);
+            result->frames += nes_get_frame(nes) - frame;
+            if (stopped) {
+                return 2;
+            }
+        } else if (tag == MOVIE_TAG_CHECKPOINT) {
+            if (end - p < 8) {
+                return -1;
+            }
+            if (_movie_get(p, 8) != nes_hash_ram(nes)) {
+                result->failed_frame = result->frames;
+                return 1;
+            }
+            p += 8;
+            result->checkpoints++;
+        } else {
+            return -1;
+        }
+    }
+
+    return -1;
+}
+
+int movie_play(nes_t *nes, const uint8_t *movie, size_t movie_size,
+        const uint8_t *rom, size_t rom_size, movie_result_t *result) {
+    uint8_t output = nes_get_output(nes);
+    int status;
+
+    /* Checkpoints hash RAM, nothing needs drawing */
+    nes_set_output(nes, 0);
+    status = _movie_play(nes, movie, movie_size, rom, rom_size, result);
+    nes_set_output(nes, output);
+    return status;
+}
+
+#endif // NES_CONF_MOVIE_ENABLE
@@ -0,0 +1,534 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "nes.h"
+
+#ifdef NES_CONF_NES_ENABLE
+
+#include "hash.h"
+#include "metrics.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * @brief Console instance
+ *
+ * Laid out hot to cold, each group on its own cache lines: the CPU with
+ * the per frame fields, the RAM, the cartridge, the PPU, the watch page
+ * table memory_write checks, then what is only touched at the end of a
+ * frame or by the host.
+ *
+ * @attribute cpu CPU state
+ * @attribute controller Controller ports
+ * @attribute frame Frames run since reset
+ * @attribute base_cycles CPU cycle counter at reset
+ * @attribute skip_output The frame being run is discarded, its video and
+ * audio are not produced
+ * @attribute output_off The host turned video and audio off, see
+ * nes_set_output()
+ * @attribute run_ahead Frames run ahead of every frame, 0 when disabled
+ * @attribute decoded Pre-decoded instructions of the ROM, NULL for none
+ * @attribute memory Internal RAM
+ * @attribute cartridge Cartridge
+ * @attribute ppu PPU
+ * @attribute watch Watchpoints and breakpoints
+ * @attribute framebuffer Picture of the last frame
+ * @attribute audio Audio of the last frame
+ * @attribute audio_count Number of samples in audio, 0 until the APU is
+ * emulated
+ * @attribute ahead_state State the run-ahead frames are rolled back to
+ * @attribute ahead_stats Run-ahead counters
+ * @attribute render Thread the frames are drawn on, NULL to draw them on
+ * the CPU thread
+ * @attribute arena Arena the console was allocated from, NULL for the heap
+ */
+struct nes {
+    _Alignas(ARENA_ALIGN) cpu_t cpu;
+    controller_t controller;
+    uint64_t frame;
+    uint64_t base_cycles;
+    uint8_t skip_output;
+    uint8_t output_off;
+    uint32_t run_ahead;
+    const cpu_instruction_t *const *decoded;
+
+    _Alignas(ARENA_ALIGN) memory_t memory;
+    _Alignas(ARENA_ALIGN) cartridge_t cartridge;
+    _Alignas(ARENA_ALIGN) ppu_t ppu;
+    _Alignas(ARENA_ALIGN) watch_t watch;
+
+    _Alignas(ARENA_ALIGN) uint8_t framebuffer[NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT];
+    int16_t audio[NES_AUDIO_FRAME_SAMPLES];
+    size_t audio_count;
+    nes_state_t *ahead_state;
+    nes_run_ahead_stats_t ahead_stats;
+    render_t *render;
+    arena_t *arena;
+};
+
+/*
+ * @brief Run the bound console until the end of its next frame
+ *
+ * The frame starts in vertical blank. The CPU runs up to the pre-render
+ * line, where vertical blank ends, then up to the sprite 0 hit if there
+ * is one, then to the end of the frame where the picture is drawn, or
+ * handed to the render thread, and the next vertical blank raises the NMI.
+ *
+ * @return 0 when the frame completed, 1 if a hit stopped the CPU, in which
+ * case the next call resumes the same frame
+ */
+static inline int _nes_step_frame(nes_t *nes) {
+    uint64_t start = nes->base_cycles + nes->frame * NES_FRAME_DOTS / NES_DOTS_PER_CYCLE;
+    uint64_t target = nes->base_cycles +
+        (nes->frame + 1) * NES_FRAME_DOTS / NES_DOTS_PER_CYCLE;
+    uint64_t prerender = start + PPU_PRERENDER_DOT / NES_DOTS_PER_CYCLE;
+    uint64_t event = prerender;
+    int stopped;
+
+    if (nes->cpu.cycles < event) {
+        stopped = cpu_run_until(event);
+        if (nes->cpu.cycles >= event) {
+            ppu_prerender();
+        }
+        if (stopped) {
+            return 1;
+        }
+    }
+
+    if (nes->ppu.sprite_zero) {
+        event = start + nes->ppu.sprite_zero / NES_DOTS_PER_CYCLE;
+        stopped = cpu_run_until(event);
+        if (nes->cpu.cycles >= event) {
+            ppu_sprite_zero_hit();
+        }
+        if (stopped) {
+            return 1;
+        }
+    }
+
+    stopped = cpu_run_until(target);
+    if (nes->cpu.cycles >= target) {
+        uint8_t output = !nes->skip_output && !nes->output_off;
+
+        nes->frame++;
+        if (nes->render) {
+            render_submit(nes->render, prerender, output);
+        } else if (output) {
+            ppu_render(nes->framebuffer);
+        }
+        if (ppu_vblank()) {
+            cpu_nmi();
+        }
+    }
+    return stopped;
+}
+
+static uint64_t _nes_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void _nes_save_state(nes_t *nes, nes_state_t *state) {
+    size_t size, chr_size;
+    const uint8_t *ram = cartridge_get_ram(&size);
+    const uint8_t *chr_ram = cartridge_get_chr_ram(&chr_size);
+
+    cpu_get_state(&state->cpu);
+    memory_get_state(&state->memory);
+    controller_get_state(&state->controller);
+    ppu_get_state(&state->ppu);
+    state->frame = nes->frame;
+    state->base_cycles = nes->base_cycles;
+    state->cartridge_ram_hash = cartridge_get_ram_hash();
+    if (ram) {
+        memcpy(state->cartridge_ram, ram, size);
+    }
+    if (chr_ram) {
+        memcpy(state->chr_ram, chr_ram, chr_size);
+    }
+}
+
+static void _nes_load_state(nes_t *nes, const nes_state_t *state) {
+    cpu_set_state(&state->cpu);
+    memory_set_state(&state->memory);
+    controller_set_state(&state->controller);
+    cartridge_set_chr_ram(state->chr_ram);
+    ppu_set_state(&state->ppu);
+    nes->frame = state->frame;
+    nes->base_cycles = state->base_cycles;
+    cartridge_set_ram(state->cartridge_ram, state->cartridge_ram_hash);
+}
+
+/*
+ * @brief Run the bound console one frame with run-ahead: the real frame
+ * without output, then run_ahead frames with the same input of which only
+ * the last produces output, then roll back to the end of the real frame
+ *
+ * @return 0 when the frame completed, 1 if a hit stopped the CPU in the
+ * real frame. A stop in the frames run ahead only cuts them short.
+ */
+static int _nes_step_ahead(nes_t *nes) {
+    uint64_t start, saved, ahead;
+
+    nes->skip_output = 1;
+    if (_nes_step_frame(nes)) {
+        nes->skip_output = 0;
+        return 1;
+    }
+
+    start = _nes_now();
+    _nes_save_state(nes, nes->ahead_state);
+    saved = _nes_now();
+
+    for (uint32_t i = 1; i <= nes->run_ahead; i++) {
+        nes->skip_output = i < nes->run_ahead;
+        nes->ahead_stats.ahead++;
+        if (_nes_step_frame(nes)) {
+            break;
+        }
+    }
+    nes->skip_output = 0;
+
+    ahead = _nes_now();
+    _nes_load_state(nes, nes->ahead_state);
+
+    nes->ahead_stats.frames++;
+    nes->ahead_stats.save_ns += saved - start;
+    nes->ahead_stats.ahead_ns += ahead - saved;
+    nes->ahead_stats.load_ns += _nes_now() - ahead;
+    return 0;
+}
+
+static inline int _nes_step(nes_t *nes) {
+#ifdef NES_CONF_METRICS_ENABLE
+    uint64_t start = _nes_now();
+    uint64_t frame = nes->frame;
+    int stopped = nes->run_ahead ? _nes_step_ahead(nes) : _nes_step_frame(nes);
+
+    /* Frames run ahead are rolled back, only the ones kept count */
+    METRICS_ADD(frames, nes->frame - frame);
+    metrics_observe(METRICS_FRAME_TIME, _nes_now() - start);
+    return stopped;
+#else
+    return nes->run_ahead ? _nes_step_ahead(nes) : _nes_step_frame(nes);
+#endif
+}
+
+uint32_t nes_api_version() {
+    return NES_API_VERSION;
+}
+
+/*
+ * @brief Set up a zeroed console
+ */
+static nes_t *_nes_init(nes_t *nes) {
+    nes_bind(nes);
+
+    /* An empty NROM board until a ROM is loaded, reads return zero */
+    cartridge_init(CARTRIDGE_TYPE_NROM);
+    memory_init();
+    controller_init();
+    ppu_init();
+    cpu_init();
+    watch_init();
+
+    return nes;
+}
+
+nes_t *nes_create() {
+    nes_t *nes = aligned_alloc(ARENA_ALIGN, sizeof(nes_t));
+
+    if (!nes) {
+        return NULL;
+    }
+
+    memset(nes, 0, sizeof(nes_t));
+    return _nes_init(nes);
+}
+
+nes_t *nes_create_in(arena_t *arena) {
+    nes_t *nes = arena_alloc(arena);
+
+    if (!nes) {
+        return NULL;
+    }
+
+    nes->arena = arena;
+    return _nes_init(nes);
+}
+
+void nes_destroy(nes_t *nes) {
+    if (!nes) {
+        return;
+    }
+
+    nes_bind(nes);
+    render_destroy(nes->render);
+    cartridge_release();
+    free(nes->ahead_state);
+
+    if (nes->arena) {
+        arena_free(nes->arena, nes);
+    } else {
+        free(nes);
+    }
+}
+
+arena_t *nes_arena_create(size_t count) {
+    return arena_create(sizeof(nes_t), count);
+}
+
+void nes_arena_destroy(arena_t *arena) {
+    arena_destroy(arena);
+}
+
+void nes_arena_get_stats(arena_t *arena, arena_stats_t *stats) {
+    arena_get_stats(arena, stats);
+}
+
+void nes_bind(nes_t *nes) {
+    cpu_bind(&nes->cpu);
+    cpu_set_decoded(nes->decoded);
+    memory_bind(&nes->memory);
+    cartridge_bind(&nes->cartridge);
+    controller_bind(&nes->controller);
+    ppu_bind(&nes->ppu);
+    watch_bind(&nes->watch);
+}
+
+int nes_load_rom(nes_t *nes, const uint8_t *rom, size_t size) {
+    nes_bind(nes);
+
+    /* The render thread may still draw from the previous CHR ROM, and the
+     * log points to it */
+    if (nes->render) {
+        render_wait(nes->render);
+    }
+    if (cartridge_load(rom, size) != 0) {
+        if (nes->render) {
+            render_sync(nes->render);
+        }
+        return -1;
+    }
+
+    /* Decoded instructions are those of the previous ROM */
+    nes->decoded = NULL;
+    cpu_set_decoded(NULL);
+
+    memory_init();
+    controller_init();
+    ppu_init();
+    cpu_init();
+    nes_reset(nes);
+    if (nes->render) {
+        render_sync(nes->render);
+    }
+
+    return 0;
+}
+
+void nes_reset(nes_t *nes) {
+    cpu_t cpu;
+
+    nes_bind(nes);
+    cpu_reset();
+    cpu_get_state(&cpu);
+
+    nes->frame = 0;
+    nes->base_cycles = cpu.cycles;
+}
+
+int nes_map_save(nes_t *nes, const char *path) {
+    nes_bind(nes);
+    return cartridge_map_ram(path);
+}
+
+int nes_sync_save(nes_t *nes) {
+    nes_bind(nes);
+    return cartridge_sync_ram();
+}
+
+uint8_t nes_has_battery(nes_t *nes) {
+    nes_bind(nes);
+    return cartridge_has_battery();
+}
+
+void nes_set_decoded(nes_t *nes, const cpu_instruction_t *const *decoded) {
+    nes->decoded = decoded;
+    nes_bind(nes);
+}
+
+void nes_set_buttons(nes_t *nes, uint8_t port, uint8_t buttons) {
+    nes_bind(nes);
+    controller_set_buttons(port, buttons);
+}
+
+int nes_step_frames(nes_t *nes, uint32_t frames) {
+    nes_bind(nes);
+
+    for (uint32_t i = 0; i < frames; i++) {
+        if (_nes_step(nes)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+size_t nes_step_frames_many(nes_t **nes, size_t count, uint32_t frames,
+        const uint8_t *buttons) {
+    size_t stopped = 0;
+
+    for (size_t n = 0; n < count; n++) {
+        nes_bind(nes[n]);
+
+        if (buttons) {
+            for (uint8_t port = 0; port < CONTROLLER_PORTS; port++) {
+                controller_set_buttons(port, buttons[n * CONTROLLER_PORTS + port]);
+            }
+        }
+
+        for (uint32_t i = 0; i < frames; i++) {
+            if (_nes_step(nes[n])) {
+                stopped++;
+                break;
+            }
+        }
+    }
+    return stopped;
+}
+
+uint64_t nes_get_frame(nes_t *nes) {
+    return nes->frame;
+}
+
+const uint8_t *nes_get_ram(nes_t *nes) {
+    return nes->memory.ram;
+}
+
+const uint8_t *nes_get_framebuffer(nes_t *nes) {
+    if (nes->render) {
+        render_wait(nes->render);
+    }
+    return nes->framebuffer;
+}
+
+const int16_t *nes_get_audio(nes_t *nes, size_t *count) {
+    *count = nes->audio_count;
+    return nes->audio;
+}
+
+int nes_watch(nes_t *nes, uint16_t address, watch_mode_e mode) {
+    nes_bind(nes);
+    return watch_set(address, mode);
+}
+
+void nes_set_breakpoint(nes_t *nes, uint16_t address, uint8_t enable) {
+    nes_bind(nes);
+    watch_set_breakpoint(address, enable);
+}
+
+void nes_set_watch_handler(nes_t *nes, watch_handler_t handler, void *user) {
+    nes_bind(nes);
+    watch_set_handler(handler, user);
+}
+
+void nes_get_hit(nes_t *nes, watch_hit_t *hit) {
+    nes_bind(nes);
+    watch_get_hit(hit);
+}
+
+size_t nes_state_size() {
+    return sizeof(nes_state_t);
+}
+
+void nes_save_state(nes_t *nes, nes_state_t *state) {
+#ifdef NES_CONF_METRICS_ENABLE
+    uint64_t start = _nes_now();
+#endif
+
+    nes_bind(nes);
+    _nes_save_state(nes, state);
+    metrics_observe(METRICS_SNAPSHOT_TIME, _nes_now() - start);
+}
+
+void nes_load_state(nes_t *nes, const nes_state_t *state) {
+#ifdef NES_CONF_METRICS_ENABLE
+    uint64_t start = _nes_now();
+#endif
+
+    nes_bind(nes);
+    _nes_load_state(nes, state);
+    metrics_observe(METRICS_SNAPSHOT_TIME, _nes_now() - start);
+}
+
+int nes_set_run_ahead(nes_t *nes, uint32_t frames) {
+    if (frames && !nes->ahead_state &&
+        !(nes->ahead_state = malloc(sizeof(nes_state_t)))) {
+        return -1;
+    }
+
+    nes->run_ahead = frames;
+    memset(&nes->ahead_stats, 0, sizeof(nes_run_ahead_stats_t));
+    return 0;
+}
+
+void nes_get_run_ahead_stats(nes_t *nes, nes_run_ahead_stats_t *stats) {
+    *stats = nes->ahead_stats;
+}
+
+void nes_set_output(nes_t *nes, uint8_t enable) {
+    nes->output_off = !enable;
+}
+
+uint8_t nes_get_output(nes_t *nes) {
+    return !nes->output_off;
+}
+
+int nes_set_render_thread(nes_t *nes, uint8_t enable) {
+    nes_bind(nes);
+
+    if (enable && !nes->render) {
+        if (!(nes->render = render_create(nes->framebuffer, &nes->cpu.cycles))) {
+            return -1;
+        }
+    } else if (!enable && nes->render) {
+        render_destroy(nes->render);
+        nes->render = NULL;
+    }
+    return 0;
+}
+
+uint64_t nes_fnv(uint64_t hash, const uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * NES_FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t nes_hash_ram(nes_t *nes) {
+    size_t size;
+    const uint8_t *ram;
+    uint64_t hash;
+
+    nes_bind(nes);
+    ram = cartridge_get_ram(&size);
+    hash = nes_fnv(NES_FNV_OFFSET, memory_get_ram(), MEMORY_RAM_SIZE);
+
+    return ram ? nes_fnv(hash, ram, size) : hash;
+}
+
+uint64_t nes_fingerprint(nes_t *nes) {
+    const cpu_t *cpu = &nes->cpu;
+    uint64_t registers = ((uint64_t)HASH_DOMAIN_CPU << 56) |
+        ((uint64_t)cpu->pc << 40) | ((uint64_t)cpu->a << 32) |
+        ((uint64_t)cpu->x << 24) | ((uint64_t)cpu->y << 16) |
+        ((uint64_t)cpu->flags << 8) | cpu->sp;
+
+    nes_bind(nes);
+    return nes->memory.hash ^ cartridge_get_ram_hash() ^ hash_mix(registers);
+}
+
+#endif // NES_CONF_NES_ENABLE
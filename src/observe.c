@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+
+#include "observe.h"
+
+#ifdef NES_CONF_OBSERVE_ENABLE
+
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * @brief Futex operations on the publication counter, shared between
+ * processes so not FUTEX_PRIVATE_FLAG
+ */
+static void _observe_futex_wait(_Atomic uint32_t *word, uint32_t value,
+        const struct timespec *timeout) {
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, value, timeout, NULL, 0);
+}
+
+static void _observe_futex_wake(_Atomic uint32_t *word) {
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/*
+ * @brief Map a shared memory object
+ *
+ * @param flags O_CREAT | O_EXCL to create it, 0 to open it
+ */
+static observe_region_t *_observe_map(const char *name, int flags) {
+    observe_region_t *region;
+    struct stat st;
+    int fd;
+
+    if ((fd = shm_open(name, O_RDWR | flags, 0600)) < 0) {
+        return NULL;
+    }
+
+    if (flags & O_CREAT) {
+        if (ftruncate(fd, sizeof(observe_region_t)) != 0) {
+            close(fd);
+            shm_unlink(name);
+            return NULL;
+        }
+    } else if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(observe_region_t)) {
+        close(fd);
+        return NULL;
+    }
+
+    region = mmap(NULL, sizeof(observe_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (region == MAP_FAILED) {
+        if (flags & O_CREAT) {
+            shm_unlink(name);
+        }
+        return NULL;
+    }
+    return region;
+}
+
+observe_channel_t *observe_create(const char *name) {
+    observe_channel_t *channel = calloc(1, sizeof(observe_channel_t));
+
+    if (!channel || !(channel->name = strdup(name))) {
+        free(channel);
+        return NULL;
+    }
+
+    /* A stale object of a crashed producer is replaced */
+    shm_unlink(name);
+    if (!(channel->region = _observe_map(name, O_CREAT | O_EXCL))) {
+        free(channel->name);
+        free(channel);
+        return NULL;
+    }
+
+    /* ftruncate zeroed the region, so nothing is published yet */
+    channel->region->magic = OBSERVE_MAGIC;
+    channel->region->version = OBSERVE_VERSION;
+    channel->region->size = sizeof(observe_region_t);
+    return channel;
+}
+
+void observe_destroy(observe_channel_t *channel) {
+    if (!channel) {
+        return;
+    }
+
+    shm_unlink(channel->name);
+    munmap(channel->region, sizeof(observe_region_t));
+    free(channel->name);
+    free(channel);
+}
+
+void observe_publish(observe_channel_t *channel, nes_t *nes) {
+    observe_region_t *region = channel->region;
+    uint32_t published = atomic_load_explicit(&region->published, memory_order_relaxed) + 1;
+    observe_slot_t *slot = &region->slots[published % OBSERVE_SLOTS];
+    uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+    observe_observation_t *observation = &slot->observation;
+    controller_t controller;
+
+    /* Odd while writing, readers that began on the slot will retry */
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    nes_bind(nes);
+    cpu_get_state(&observation->cpu);
+    controller_get_state(&controller);
+    observation->frame = nes_get_frame(nes);
+    observation->fingerprint = nes_fingerprint(nes);
+    memcpy(observation->buttons, controller.buttons, sizeof(observation->buttons));
+    memcpy(observation->ram, nes_get_ram(nes), sizeof(observation->ram));
+    memcpy(observation->framebuffer, nes_get_framebuffer(nes), sizeof(observation->framebuffer));
+
+    atomic_store_explicit(&slot->sequence, sequence + 2, memory_order_release);
+    atomic_store_explicit(&region->published, published, memory_order_seq_cst);
+
+    /* The doorbell, a system call only when someone sleeps */
+    if (atomic_load_explicit(&region->waiters, memory_order_seq_cst)) {
+        _observe_futex_wake(&region->published);
+    }
+}
+
+observe_channel_t *observe_open(const char *name) {
+    observe_channel_t *channel = calloc(1, sizeof(observe_channel_t));
+
+    if (!channel || !(channel->region = _observe_map(name, 0))) {
+        free(channel);
+        return NULL;
+    }
+
+    if (channel->region->magic != OBSERVE_MAGIC ||
+            channel->region->version != OBSERVE_VERSION ||
+            channel->region->size != sizeof(observe_region_t)) {
+        observe_close(channel);
+        return NULL;
+    }
+    return channel;
+}
+
+void observe_close(observe_channel_t *channel) {
+    if (!channel) {
+        return;
+    }
+
+    munmap(channel->region, sizeof(observe_region_t));
+    free(channel);
+}
+
+int observe_read_begin(observe_channel_t *channel, observe_read_t *read) {
+    observe_region_t *region = channel->region;
+
+    for (;;) {
+        read->published = atomic_load_explicit(&region->published, memory_order_acquire);
+        if (!read->published) {
+            return -1;
+        }
+
+        read->slot = read->published % OBSERVE_SLOTS;
+        read->sequence = atomic_load_explicit(&region->slots[read->slot].sequence,
+            memory_order_acquire);
+
+        /* Being rewritten, a newer publication is on its way */
+        if (!(read->sequence & 1)) {
+            read->observation = &region->slots[read->slot].observation;
+            return 0;
+        }
+    }
+}
+
+int observe_read_end(observe_channel_t *channel, const observe_read_t *read) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&channel->region->slots[read->slot].sequence,
+        memory_order_relaxed) == read->sequence ? 0 : -1;
+}
+
+int observe_wait(observe_channel_t *channel, uint32_t published, uint32_t timeout_ms) {
+    observe_region_t *region = channel->region;
+    struct timespec deadline, now, timeout;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    atomic_fetch_add_explicit(&region->waiters, 1, memory_order_seq_cst);
+
+    /* The futex returns at once if a publication lands after this load */
+    while (atomic_load_explicit(&region->published, memory_order_seq_cst) == published) {
+        if (timeout_ms) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            timeout.tv_sec = deadline.tv_sec - now.tv_sec;
+            timeout.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+            if (timeout.tv_nsec < 0) {
+                timeout.tv_sec--;
+                timeout.tv_nsec += 1000000000L;
+            }
+            if (timeout.tv_sec < 0) {
+                break;
+            }
+        }
+        _observe_futex_wait(&region->published, published, timeout_ms ? &timeout : NULL);
+    }
+
+    atomic_fetch_sub_explicit(&region->waiters, 1, memory_order_relaxed);
+    return atomic_load_explicit(&region->published, memory_order_acquire) == published ? 1 : 0;
+}
+
+#endif // NES_CONF_OBSERVE_ENABLE
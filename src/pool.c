@@ -0,0 +1,151 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "pool.h"
+
+#ifdef NES_CONF_POOL_ENABLE
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t _pool_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * @brief Create a console with the pool's ROM loaded, not yet in the golden
+ * state
+ */
+static nes_t *_pool_new(pool_t *pool) {
+    nes_t *nes = nes_create();
+
+    if (nes && nes_load_rom(nes, pool->rom, pool->rom_size) != 0) {
+        nes_destroy(nes);
+        return NULL;
+    }
+    return nes;
+}
+
+pool_t *pool_create(const uint8_t *rom, size_t size, const pool_config_t *config) {
+    pool_t *pool = calloc(1, sizeof(pool_t));
+    nes_t *nes = NULL;
+    uint64_t start;
+
+    if (!pool) {
+        return NULL;
+    }
+
+    pool->rom_size = size;
+    pool->capacity = config->capacity > config->warm ? config->capacity : config->warm;
+    pthread_mutex_init(&pool->lock, NULL);
+
+    if (!(pool->rom = malloc(size)) ||
+        !(pool->golden = malloc(sizeof(nes_state_t))) ||
+        !(pool->consoles = calloc(pool->capacity ? pool->capacity : 1, sizeof(nes_t *)))) {
+        pool_destroy(pool);
+        return NULL;
+    }
+    memcpy(pool->rom, rom, size);
+
+    if (!(nes = _pool_new(pool))) {
+        pool_destroy(pool);
+        return NULL;
+    }
+    pool->created++;
+
+    start = _pool_now();
+    nes_step_frames(nes, config->boot_frames);
+    pool->boot_ns = _pool_now() - start;
+    nes_save_state(nes, pool->golden);
+
+    /* The booting console is already in the golden state */
+    if (pool->capacity) {
+        pool->consoles[pool->count++] = nes;
+    } else {
+        nes_destroy(nes);
+    }
+
+    while (pool->count < config->warm && (nes = _pool_new(pool))) {
+        nes_load_state(nes, pool->golden);
+        pool->consoles[pool->count++] = nes;
+        pool->created++;
+    }
+
+    return pool;
+}
+
+void pool_destroy(pool_t *pool) {
+    if (!pool) {
+        return;
+    }
+
+    while (pool->count) {
+        nes_destroy(pool->consoles[--pool->count]);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->consoles);
+    free(pool->golden);
+    free(pool->rom);
+    free(pool);
+}
+
+nes_t *pool_acquire(pool_t *pool) {
+    nes_t *nes = NULL;
+    int created = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count) {
+        nes = pool->consoles[--pool->count];
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!nes) {
+        if (!(nes = _pool_new(pool))) {
+            return NULL;
+        }
+        created = 1;
+    }
+
+    nes_load_state(nes, pool->golden);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->acquired++;
+    pool->created += created;
+    pthread_mutex_unlock(&pool->lock);
+
+    return nes;
+}
+
+void pool_release(pool_t *pool, nes_t *nes) {
+    /* Drop what the session set up, the state is restored on acquire */
+    nes_bind(nes);
+    watch_init();
+    cartridge_unmap_ram();
+    nes_set_run_ahead(nes, 0);
+    nes_set_render_thread(nes, 0);
+    nes_set_output(nes, 1);
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count < pool->capacity) {
+        pool->consoles[pool->count++] = nes;
+        nes = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    nes_destroy(nes);
+}
+
+void pool_get_stats(pool_t *pool, pool_stats_t *stats) {
+    pthread_mutex_lock(&pool->lock);
+    stats->acquired = pool->acquired;
+    stats->created = pool->created;
+    stats->idle = pool->count;
+    stats->boot_ns = pool->boot_ns;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+#endif // NES_CONF_POOL_ENABLE
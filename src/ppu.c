@@ -0,0 +1,774 @@
+#include "ppu.h"
+
+#include "nes.h"
+
+#ifdef NES_CONF_PPU_ENABLE
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * @brief PPU the calling thread operates on, see ppu_bind()
+ */
+static ppu_t _ppu_default;
+static _Thread_local ppu_t *_ppu = &_ppu_default;
+
+/*
+ * @brief Low bit of every byte of a decoded row whose pixel is opaque
+ */
+#define _PPU_OPAQUE(row) (((row) | ((row) >> 1)) & 0x0101010101010101ULL)
+
+/*
+ * @brief Sprite pixels of a line hold their palette index, with this bit
+ * set when the sprite is behind the background
+ */
+#define _PPU_LINE_BEHIND 0x80U
+
+void ppu_bind(ppu_t *ppu) {
+    _ppu = ppu;
+}
+
+/*
+ * @brief What unmapped pattern pages read as
+ */
+static uint8_t _ppu_open_bus[PPU_PAGE_SIZE];
+
+/*
+ * @brief Offset in palette RAM of each palette address, the sprite
+ * backdrop entries mirror the background ones
+ */
+static const uint8_t _ppu_palette_index[PPU_PALETTE_SIZE] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+    0x00, 0x11, 0x12, 0x13, 0x04, 0x15, 0x16, 0x17,
+    0x08, 0x19, 0x1A, 0x1B, 0x0C, 0x1D, 0x1E, 0x1F,
+};
+
+/*
+ * @brief Start of what ppu_init() clears and a state replaces, past the
+ * page table and drawing bookkeeping
+ */
+#define _PPU_STATE offsetof(ppu_t, ctrl)
+
+/*
+ * @brief Byte at an address below the palette, through the page table
+ */
+#define _PPU_FETCH(address) \
+    (_ppu->pages[((address) >> 10) & (PPU_PAGES - 1)][(address) & (PPU_PAGE_SIZE - 1)])
+
+/*
+ * @brief Decoded rows of a tile of the pattern tables, 256 per table
+ */
+#define _PPU_TILE(chr, tile) \
+    chr_tile((chr), _ppu->tiles[(tile) >> 6] + ((tile) & 63))
+
+/*
+ * @brief PPUCTRL and PPUMASK bits the renderer reads
+ */
+#define _PPU_CTRL_DRAWN (PPU_CTRL_SPRITE_TABLE | PPU_CTRL_BACKGROUND_TABLE | PPU_CTRL_SPRITE_16)
+#define _PPU_MASK_DRAWN (PPU_MASK_GRAYSCALE | PPU_MASK_BACKGROUND_LEFT | \
+    PPU_MASK_SPRITES_LEFT | PPU_MASK_BACKGROUND | PPU_MASK_SPRITES)
+
+/*
+ * @brief Log events, see ppu_set_log()
+ *
+ * @value _PPU_EVENT_WRITE Register arg written with value
+ * @value _PPU_EVENT_READ Register arg read, for the reads that change the
+ * state
+ * @value _PPU_EVENT_DMA OAM DMA of the page that follows
+ * @value _PPU_EVENT_INIT ppu_init()
+ * @value _PPU_EVENT_STATE ppu_set_state() with the state that follows
+ * @value _PPU_EVENT_CHR ppu_set_chr(), arg set for CHR RAM, else the cache
+ * pointer follows
+ * @value _PPU_EVENT_CHR_DATA CHR RAM contents that follow
+ * @value _PPU_EVENT_MAP_PATTERN ppu_map_pattern() of page arg at offset value
+ * @value _PPU_EVENT_MAP_NAMETABLE ppu_map_nametable() of slot arg to value
+ */
+typedef enum {
+    _PPU_EVENT_WRITE,
+    _PPU_EVENT_READ,
+    _PPU_EVENT_DMA,
+    _PPU_EVENT_INIT,
+    _PPU_EVENT_STATE,
+    _PPU_EVENT_CHR,
+    _PPU_EVENT_CHR_DATA,
+    _PPU_EVENT_MAP_PATTERN,
+    _PPU_EVENT_MAP_NAMETABLE,
+} _ppu_event_e;
+
+/*
+ * @brief Header of a log event, its payload follows padded to 8 bytes
+ *
+ * @attribute cycle CPU cycle the event happened on
+ * @attribute type _ppu_event_e
+ * @attribute arg, value Arguments
+ * @attribute size Size of the payload
+ */
+typedef struct {
+    uint64_t cycle;
+    uint32_t type;
+    uint32_t arg;
+    uint32_t value;
+    uint32_t size;
+} _ppu_event_t;
+
+#define _PPU_EVENT_PAD(size) (((size) + 7U) & ~(size_t)7U)
+
+/*
+ * @brief Append an event to the log. Once one does not fit the log is
+ * failed and takes no more, a partial log is never replayed.
+ */
+static void _ppu_log(uint32_t type, uint32_t arg, uint32_t value, const void *payload,
+        uint32_t size) {
+    ppu_log_t *log = _ppu->log;
+    _ppu_event_t event = { *log->clock, type, arg, value, size };
+    size_t needed = log->size + sizeof(event) + _PPU_EVENT_PAD(size);
+    uint8_t *data;
+
+    if (log->failed) {
+        return;
+    }
+    if (needed > log->capacity) {
+        size_t capacity = log->capacity ? log->capacity : PPU_OAM_SIZE * 16;
+
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        if (!(data = realloc(log->data, capacity))) {
+            log->failed = 1;
+            return;
+        }
+        log->data = data;
+        log->capacity = capacity;
+    }
+
+    memcpy(log->data + log->size, &event, sizeof(event));
+    if (size) {
+        memcpy(log->data + log->size + sizeof(event), payload, size);
+    }
+    log->size = needed;
+}
+
+/*
+ * @brief Record an event if the PPU is logged
+ */
+#define _PPU_LOG(type, arg, value, payload, size) do { \
+        if (_ppu->log) { \
+            _ppu_log((type), (arg), (value), (payload), (size)); \
+        } \
+    } while (0)
+
+/*
+ * @brief Record the CHR RAM contents, with a CHR RAM cartridge
+ */
+static void _ppu_log_chr_ram() {
+    if (_ppu->chr_ram) {
+        _PPU_LOG(_PPU_EVENT_CHR_DATA, 0, 0, _ppu->chr->data, _ppu->chr->size);
+    }
+}
+
+/*
+ * @brief Something the picture is drawn from changed, everywhere when
+ * there is no finer record of where
+ */
+static void _ppu_changed(uint8_t everywhere) {
+    _ppu->generation++;
+    _ppu->redraw |= everywhere;
+}
+
+void ppu_init() {
+    memset((uint8_t *)_ppu + _PPU_STATE, 0, sizeof(ppu_t) - _PPU_STATE);
+    _ppu_changed(1);
+    _PPU_LOG(_PPU_EVENT_INIT, 0, 0, NULL, 0);
+}
+
+void ppu_set_chr(chr_cache_t *chr, uint8_t ram) {
+    _ppu->chr = chr;
+    _ppu->chr_ram = chr && ram;
+    for (uint32_t page = 0; page < PPU_PATTERN_PAGES; page++) {
+        _ppu->pages[page] = _ppu_open_bus;
+        _ppu->tiles[page] = 0;
+    }
+    _ppu_changed(1);
+
+    _PPU_LOG(_PPU_EVENT_CHR, _ppu->chr_ram, 0, &chr, _ppu->chr_ram ? 0 : sizeof(chr));
+    _ppu_log_chr_ram();
+}
+
+void ppu_map_pattern(uint32_t page, uint32_t offset) {
+    _ppu->pages[page] = _ppu->chr ? _ppu->chr->data + offset : _ppu_open_bus;
+    _ppu->tiles[page] = _ppu->chr ? offset / CHR_TILE_SIZE : 0;
+    _ppu_changed(1);
+    _PPU_LOG(_PPU_EVENT_MAP_PATTERN, page, offset, NULL, 0);
+}
+
+void ppu_map_nametable(uint32_t slot, uint32_t nametable) {
+    uint8_t *data = _ppu->vram + nametable * PPU_NAMETABLE_SIZE;
+
+    _ppu->pages[PPU_PATTERN_PAGES + slot] = data;
+    _ppu->pages[PPU_PATTERN_PAGES + PPU_NAMETABLE_SLOTS + slot] = data;
+    _ppu_changed(1);
+    _PPU_LOG(_PPU_EVENT_MAP_NAMETABLE, slot, nametable, NULL, 0);
+}
+
+/*
+ * @brief Write a nametable byte, recording the tile rows it shows in.
+ * An attribute byte colors 4 rows, and is itself a tile of row 30 or 31
+ * when scrolled there.
+ */
+static void _ppu_nametable_write(uint8_t *cell, uint8_t data) {
+    uint32_t offset = cell - _ppu->vram;
+    uint32_t entry = offset & (PPU_NAMETABLE_SIZE - 1);
+    uint32_t rows = 1U << (entry >> 5);
+
+    if (*cell == data) {
+        return;
+    }
+    *cell = data;
+
+    if (entry >= 0x3C0U) {
+        rows |= 0xFU << (((entry - 0x3C0U) >> 3) * 4);
+    }
+    _ppu->rows[offset / PPU_NAMETABLE_SIZE] |= rows;
+    _ppu_changed(0);
+}
+
+static uint8_t _ppu_bus_read(uint16_t address) {
+    address &= PPU_ADDRESS_MASK;
+
+    if (address >= PPU_PALETTE_BASE) {
+        return _ppu->palette[_ppu_palette_index[address & (PPU_PALETTE_SIZE - 1)]];
+    }
+    return _PPU_FETCH(address);
+}
+
+static void _ppu_bus_write(uint16_t address, uint8_t data) {
+    address &= PPU_ADDRESS_MASK;
+
+    if (address >= PPU_PALETTE_BASE) {
+        uint8_t *entry = &_ppu->palette[_ppu_palette_index[address & (PPU_PALETTE_SIZE - 1)]];
+
+        if (*entry != data) {
+            *entry = data;
+            _ppu_changed(0);
+        }
+    } else if (address >= PPU_NAMETABLE_BASE) {
+        _ppu_nametable_write(&_PPU_FETCH(address), data);
+    } else if (_ppu->chr_ram) {
+        /* Through the cache, which marks the tile to decode again */
+        chr_write(_ppu->chr, _ppu->tiles[address >> 10] * CHR_TILE_SIZE +
+            (address & (PPU_PAGE_SIZE - 1)), data);
+    }
+}
+
+static void _ppu_increment() {
+    _ppu->v = (_ppu->v + (_ppu->ctrl & PPU_CTRL_INCREMENT ? 32 : 1)) & 0x7FFFU;
+}
+
+void ppu_write(uint8_t reg, uint8_t data) {
+    _PPU_LOG(_PPU_EVENT_WRITE, reg, data, NULL, 0);
+    _ppu->latch = data;
+
+    switch (reg) {
+    case PPU_REG_CTRL:
+        if ((_ppu->ctrl ^ data) & _PPU_CTRL_DRAWN) {
+            _ppu_changed(0);
+        }
+        _ppu->ctrl = data;
+        _ppu->t = (_ppu->t & ~0x0C00U) | ((data & PPU_CTRL_NAMETABLE) << 10);
+        break;
+    case PPU_REG_MASK:
+        if ((_ppu->mask ^ data) & _PPU_MASK_DRAWN) {
+            _ppu_changed(0);
+        }
+        _ppu->mask = data;
+        break;
+    case PPU_REG_OAM_ADDR:
+        _ppu->oam_addr = data;
+        break;
+    case PPU_REG_OAM_DATA:
+        if (_ppu->oam[_ppu->oam_addr] != data) {
+            _ppu_changed(0);
+        }
+        _ppu->oam[_ppu->oam_addr++] = data;
+        break;
+    case PPU_REG_SCROLL:
+        if (!_ppu->w) {
+            _ppu->t = (_ppu->t & ~0x001FU) | (data >> 3);
+            _ppu->x = data & 7;
+        } else {
+            _ppu->t = (_ppu->t & ~0x73E0U) | ((data & 7) << 12) | ((data & 0xF8U) << 2);
+        }
+        _ppu->w ^= 1;
+        break;
+    case PPU_REG_ADDR:
+        if (!_ppu->w) {
+            _ppu->t = (_ppu->t & 0x00FFU) | ((data & 0x3FU) << 8);
+        } else {
+            _ppu->t = (_ppu->t & 0xFF00U) | data;
+            _ppu->v = _ppu->t;
+        }
+        _ppu->w ^= 1;
+        break;
+    case PPU_REG_DATA:
+        _ppu_bus_write(_ppu->v, data);
+        _ppu_increment();
+        break;
+    }
+}
+
+uint8_t ppu_read(uint8_t reg) {
+    uint16_t address;
+    uint8_t data;
+
+    /* Reads of the other registers change nothing */
+    if (reg == PPU_REG_STATUS || reg == PPU_REG_DATA) {
+        _PPU_LOG(_PPU_EVENT_READ, reg, 0, NULL, 0);
+    }
+
+    switch (reg) {
+    case PPU_REG_STATUS:
+        data = (_ppu->status & 0xE0U) | (_ppu->latch & 0x1FU);
+        _ppu->status &= ~PPU_STATUS_VBLANK;
+        _ppu->w = 0;
+        break;
+    case PPU_REG_OAM_DATA:
+        data = _ppu->oam[_ppu->oam_addr];
+        break;
+    case PPU_REG_DATA:
+        /* Reads are a byte late, but for the palette whose read still
+         * fills the buffer from the nametable underneath */
+        address = _ppu->v & PPU_ADDRESS_MASK;
+        if (address < PPU_PALETTE_BASE) {
+            data = _ppu->buffer;
+            _ppu->buffer = _ppu_bus_read(address);
+        } else {
+            data = _ppu_bus_read(address);
+            _ppu->buffer = _ppu_bus_read(address - 0x1000U);
+        }
+        _ppu_increment();
+        break;
+    default:
+        return _ppu->latch;
+    }
+
+    _ppu->latch = data;
+    return data;
+}
+
+void ppu_dma(const uint8_t *page) {
+    uint8_t changed = 0;
+
+    _PPU_LOG(_PPU_EVENT_DMA, 0, 0, page, PPU_OAM_SIZE);
+
+    /* Most games copy the same page every frame */
+    for (uint32_t i = 0; i < PPU_OAM_SIZE; i++) {
+        uint8_t *entry = &_ppu->oam[(uint8_t)(_ppu->oam_addr + i)];
+
+        changed |= *entry ^ page[i];
+        *entry = page[i];
+    }
+    if (changed) {
+        _ppu_changed(0);
+    }
+}
+
+/*
+ * @brief Where a line of the screen is in the nametables with the latched
+ * scroll
+ *
+ * @param y The line
+ * @param nametable Set to the nametable slot the line starts in
+ *
+ * @return The line in that nametable
+ */
+static uint32_t _ppu_scroll_line(uint32_t y, uint32_t *nametable) {
+    uint32_t coarse_y = (_ppu->scroll >> 5) & 31;
+    uint32_t sy = coarse_y * 8 + ((_ppu->scroll >> 12) & 7) + y;
+
+    *nametable = (_ppu->scroll >> 10) & 3;
+
+    /* Scrolling down past the last row continues in the nametable below,
+     * rows 30 and 31 of the attribute area only wrap around */
+    if (coarse_y < 30 && sy >= NES_SCREEN_HEIGHT) {
+        sy -= NES_SCREEN_HEIGHT;
+        *nametable ^= 2;
+    }
+    return sy & 0xFFU;
+}
+
+/*
+ * @brief Draw a line of background, palette indices with 0 where the
+ * background is transparent
+ *
+ * @param chr Pattern data
+ * @param y The line
+ * @param line NES_SCREEN_WIDTH indices
+ */
+static void _ppu_background_line(chr_cache_t *chr, uint32_t y, uint8_t *line) {
+    uint8_t tiles[(NES_SCREEN_WIDTH / 8 + 1) * 8];
+    uint32_t nametable;
+    uint32_t sy = _ppu_scroll_line(y, &nametable);
+    uint32_t sx = (_ppu->scroll & 31) * 8 + _ppu->scroll_x;
+    uint32_t table = _ppu->ctrl & PPU_CTRL_BACKGROUND_TABLE ? 256 : 0;
+
+    for (uint32_t i = 0; i <= NES_SCREEN_WIDTH / 8; i++) {
+        uint32_t tx = (sx >> 3) + i;
+        uint16_t base = PPU_NAMETABLE_BASE | ((nametable ^ ((tx >> 5) & 1)) << 10);
+        uint8_t tile, attribute;
+        uint64_t row;
+
+        tx &= 31;
+        tile = _PPU_FETCH(base | ((sy >> 3) << 5) | tx);
+        attribute = _PPU_FETCH(base | 0x3C0U | ((sy >> 5) << 3) | (tx >> 2));
+        attribute = (attribute >> (((sy & 16) >> 2) | (tx & 2))) & 3;
+
+        row = _PPU_TILE(chr, table + tile)[sy & 7];
+        row |= _PPU_OPAQUE(row) * (attribute << 2);
+        memcpy(tiles + i * 8, &row, sizeof(row));
+    }
+
+    memcpy(line, tiles + (sx & 7), NES_SCREEN_WIDTH);
+}
+
+/*
+ * @brief Decoded row of a sprite, flipped as its attributes ask
+ *
+ * @param sprite The sprite's 4 OAM bytes
+ * @param row Row of the sprite, below its height
+ * @param height 8 or 16
+ */
+static uint64_t _ppu_sprite_row(chr_cache_t *chr, const uint8_t *sprite, uint32_t row,
+        uint32_t height) {
+    uint32_t tile;
+    uint64_t bits;
+
+    if (sprite[2] & PPU_SPRITE_FLIP_Y) {
+        row = height - 1 - row;
+    }
+
+    if (height == 16) {
+        tile = ((sprite[1] & 1) << 8) | ((sprite[1] & 0xFEU) + (row >> 3));
+    } else {
+        tile = (_ppu->ctrl & PPU_CTRL_SPRITE_TABLE ? 256 : 0) + sprite[1];
+    }
+
+    bits = _PPU_TILE(chr, tile)[row & 7];
+    return sprite[2] & PPU_SPRITE_FLIP_X ? __builtin_bswap64(bits) : bits;
+}
+
+/*
+ * @brief Draw a line of sprites, palette indices with _PPU_LINE_BEHIND
+ * for sprites behind the background and 0 where there is none
+ *
+ * @param chr Pattern data
+ * @param y The line
+ * @param line NES_SCREEN_WIDTH indices
+ */
+static void _ppu_sprite_line(chr_cache_t *chr, uint32_t y, uint8_t *line) {
+    uint32_t height = _ppu->ctrl & PPU_CTRL_SPRITE_16 ? 16 : 8;
+    uint32_t count = 0;
+
+    memset(line, 0, NES_SCREEN_WIDTH);
+
+    /* The first sprites in OAM are in front, and only 8 fit on a line */
+    for (uint32_t s = 0; s < PPU_SPRITES && count < PPU_SPRITES_PER_LINE; s++) {
+        const uint8_t *sprite = &_ppu->oam[s * 4];
+        uint32_t row = y - (sprite[0] + 1U);
+        uint64_t bits;
+
+        if (row >= height) {
+            continue;
+        }
+        count++;
+
+        bits = _ppu_sprite_row(chr, sprite, row, height);
+        bits |= _PPU_OPAQUE(bits) * (0x10U | ((sprite[2] & PPU_SPRITE_PALETTE) << 2) |
+            (sprite[2] & PPU_SPRITE_BEHIND ? _PPU_LINE_BEHIND : 0));
+
+        for (uint32_t x = 0; x < 8 && sprite[3] + x < NES_SCREEN_WIDTH; x++) {
+            uint8_t pixel = bits >> (x * 8);
+
+            if (pixel && !line[sprite[3] + x]) {
+                line[sprite[3] + x] = pixel;
+            }
+        }
+    }
+}
+
+/*
+ * @brief Find the first pixel where sprite 0 overlaps opaque background
+ *
+ * @return The dot of the frame, 0 if there is none
+ */
+static uint32_t _ppu_find_sprite_zero(chr_cache_t *chr) {
+    uint8_t background[NES_SCREEN_WIDTH];
+    uint32_t height = _ppu->ctrl & PPU_CTRL_SPRITE_16 ? 16 : 8;
+    uint32_t top = _ppu->oam[0] + 1U, left = _ppu->oam[3];
+    uint32_t first = (_ppu->mask & PPU_MASK_BACKGROUND_LEFT) &&
+        (_ppu->mask & PPU_MASK_SPRITES_LEFT) ? 0 : 8;
+
+    if (!chr || (_ppu->mask & (PPU_MASK_BACKGROUND | PPU_MASK_SPRITES)) !=
+            (PPU_MASK_BACKGROUND | PPU_MASK_SPRITES)) {
+        return 0;
+    }
+
+    for (uint32_t row = 0; row < height && top + row < NES_SCREEN_HEIGHT; row++) {
+        uint64_t bits = _ppu_sprite_row(chr, _ppu->oam, row, height);
+
+        if (!bits) {
+            continue;
+        }
+        _ppu_background_line(chr, top + row, background);
+
+        /* Never on the last column */
+        for (uint32_t x = 0; x < 8 && left + x < NES_SCREEN_WIDTH - 1; x++) {
+            if (left + x >= first && ((bits >> (x * 8)) & 3) && background[left + x]) {
+                return PPU_VISIBLE_DOT + (top + row) * PPU_DOTS_PER_LINE + left + x + 1;
+            }
+        }
+    }
+    return 0;
+}
+
+uint8_t ppu_vblank() {
+    _ppu->status |= PPU_STATUS_VBLANK;
+    return (_ppu->ctrl & PPU_CTRL_NMI) != 0;
+}
+
+uint32_t ppu_prerender() {
+    _ppu->status = 0;
+    if (_ppu->mask & (PPU_MASK_BACKGROUND | PPU_MASK_SPRITES)) {
+        _ppu->v = _ppu->t;
+    }
+
+    if (_ppu->scroll != _ppu->t || _ppu->scroll_x != _ppu->x) {
+        _ppu_changed(0);
+    }
+    _ppu->scroll = _ppu->t;
+    _ppu->scroll_x = _ppu->x;
+    return _ppu->sprite_zero = _ppu_find_sprite_zero(_ppu->chr);
+}
+
+void ppu_sprite_zero_hit() {
+    _ppu->status |= PPU_STATUS_SPRITE_ZERO;
+    _ppu->sprite_zero = 0;
+}
+
+/*
+ * @brief Mark the lines a sprite covers
+ */
+static void _ppu_sprite_lines(const uint8_t *sprite, uint32_t height, uint8_t *lines) {
+    for (uint32_t y = sprite[0] + 1U; y < sprite[0] + 1U + height && y < NES_SCREEN_HEIGHT; y++) {
+        lines[y] = 1;
+    }
+}
+
+/*
+ * @brief Find the lines to draw again, the framebuffer holding a frame
+ * drawn with the same palette, pattern data, scroll and registers: those
+ * showing a nametable row written since, and those a changed sprite
+ * covered or covers
+ *
+ * @param lines NES_SCREEN_HEIGHT flags, set for the lines to draw
+ */
+static void _ppu_dirty_lines(uint8_t *lines) {
+    uint32_t height = _ppu->ctrl & PPU_CTRL_SPRITE_16 ? 16 : 8;
+
+    memset(lines, 0, NES_SCREEN_HEIGHT);
+
+    for (uint32_t y = 0; y < NES_SCREEN_HEIGHT; y++) {
+        uint32_t nametable, sy = _ppu_scroll_line(y, &nametable);
+        uint32_t left = (_ppu->pages[PPU_PATTERN_PAGES + nametable] - _ppu->vram) /
+            PPU_NAMETABLE_SIZE;
+        uint32_t right = (_ppu->pages[PPU_PATTERN_PAGES + (nametable ^ 1)] - _ppu->vram) /
+            PPU_NAMETABLE_SIZE;
+
+        /* A line spans its nametable and the one to the right */
+        lines[y] = (((_ppu->rows[left] | _ppu->rows[right]) >> (sy >> 3)) & 1);
+    }
+
+    for (uint32_t s = 0; s < PPU_SPRITES; s++) {
+        const uint8_t *sprite = &_ppu->oam[s * 4], *drawn = &_ppu->drawn_oam[s * 4];
+
+        if (memcmp(sprite, drawn, 4) != 0) {
+            _ppu_sprite_lines(drawn, height, lines);
+            _ppu_sprite_lines(sprite, height, lines);
+        }
+    }
+}
+
+void ppu_render(uint8_t *framebuffer) {
+    chr_cache_t *chr = _ppu->chr;
+    uint8_t background[NES_SCREEN_WIDTH], sprites[NES_SCREEN_WIDTH], lines[NES_SCREEN_HEIGHT];
+    uint8_t colors = _ppu->mask & PPU_MASK_GRAYSCALE ? 0x30U : 0x3FU;
+    uint8_t show_background = chr && (_ppu->mask & PPU_MASK_BACKGROUND);
+    uint8_t show_sprites = chr && (_ppu->mask & PPU_MASK_SPRITES);
+    uint64_t chr_generation = chr ? chr_get_generation(chr) : 0;
+
+    /* Nothing changed, the framebuffer already holds this frame */
+    if (!_ppu->redraw && _ppu->drawn == _ppu->generation && _ppu->drawn_chr == chr_generation) {
+        return;
+    }
+
+    if (_ppu->redraw || _ppu->drawn_chr != chr_generation ||
+            _ppu->drawn_ctrl != (_ppu->ctrl & _PPU_CTRL_DRAWN) ||
+            _ppu->drawn_mask != (_ppu->mask & _PPU_MASK_DRAWN) ||
+            _ppu->drawn_scroll != _ppu->scroll || _ppu->drawn_scroll_x != _ppu->scroll_x ||
+            memcmp(_ppu->drawn_palette, _ppu->palette, PPU_PALETTE_SIZE) != 0) {
+        memset(lines, 1, sizeof(lines));
+    } else {
+        _ppu_dirty_lines(lines);
+    }
+
+    _ppu->drawn = _ppu->generation;
+    _ppu->drawn_chr = chr_generation;
+    _ppu->redraw = 0;
+    memset(_ppu->rows, 0, sizeof(_ppu->rows));
+    _ppu->drawn_ctrl = _ppu->ctrl & _PPU_CTRL_DRAWN;
+    _ppu->drawn_mask = _ppu->mask & _PPU_MASK_DRAWN;
+    _ppu->drawn_scroll = _ppu->scroll;
+    _ppu->drawn_scroll_x = _ppu->scroll_x;
+    memcpy(_ppu->drawn_palette, _ppu->palette, PPU_PALETTE_SIZE);
+    memcpy(_ppu->drawn_oam, _ppu->oam, PPU_OAM_SIZE);
+
+    memset(background, 0, sizeof(background));
+
+    for (uint32_t y = 0; y < NES_SCREEN_HEIGHT; y++) {
+        uint8_t *out = framebuffer + y * NES_SCREEN_WIDTH;
+
+        if (!lines[y]) {
+            continue;
+        }
+
+        if (show_background) {
+            _ppu_background_line(chr, y, background);
+            if (!(_ppu->mask & PPU_MASK_BACKGROUND_LEFT)) {
+                memset(background, 0, 8);
+            }
+        }
+
+        if (!show_sprites) {
+            for (uint32_t x = 0; x < NES_SCREEN_WIDTH; x++) {
+                out[x] = _ppu->palette[background[x]] & colors;
+            }
+            continue;
+        }
+
+        _ppu_sprite_line(chr, y, sprites);
+        if (!(_ppu->mask & PPU_MASK_SPRITES_LEFT)) {
+            memset(sprites, 0, 8);
+        }
+        for (uint32_t x = 0; x < NES_SCREEN_WIDTH; x++) {
+            uint8_t color = background[x], sprite = sprites[x];
+
+            if (sprite && (!(sprite & _PPU_LINE_BEHIND) || !color)) {
+                color = sprite & (PPU_PALETTE_SIZE - 1);
+            }
+            out[x] = _ppu->palette[color] & colors;
+        }
+    }
+}
+
+void ppu_get_state(ppu_t *state) {
+    *state = *_ppu;
+}
+
+void ppu_set_state(const ppu_t *state) {
+    memcpy((uint8_t *)_ppu + _PPU_STATE, (const uint8_t *)state + _PPU_STATE,
+        sizeof(ppu_t) - _PPU_STATE);
+    _ppu_changed(1);
+
+    /* The CHR RAM of the state is already in place */
+    _PPU_LOG(_PPU_EVENT_STATE, 0, 0, state, sizeof(ppu_t));
+    _ppu_log_chr_ram();
+}
+
+void ppu_set_log(ppu_log_t *log) {
+    chr_cache_t *chr = _ppu->chr;
+
+    _ppu->log = log;
+    if (!log) {
+        /* Someone else drew the framebuffer meanwhile */
+        _ppu_changed(1);
+        return;
+    }
+
+    _PPU_LOG(_PPU_EVENT_CHR, _ppu->chr_ram, 0, &chr, _ppu->chr_ram ? 0 : sizeof(chr));
+    _ppu_log_chr_ram();
+    for (uint32_t page = 0; page < PPU_PATTERN_PAGES; page++) {
+        _PPU_LOG(_PPU_EVENT_MAP_PATTERN, page, _ppu->tiles[page] * CHR_TILE_SIZE, NULL, 0);
+    }
+    for (uint32_t slot = 0; slot < PPU_NAMETABLE_SLOTS; slot++) {
+        _PPU_LOG(_PPU_EVENT_MAP_NAMETABLE, slot,
+            (_ppu->pages[PPU_PATTERN_PAGES + slot] - _ppu->vram) / PPU_NAMETABLE_SIZE, NULL, 0);
+    }
+    _PPU_LOG(_PPU_EVENT_STATE, 0, 0, _ppu, sizeof(ppu_t));
+}
+
+void ppu_replay(const ppu_log_t *log, uint64_t prerender, chr_cache_t *chr_ram) {
+    uint8_t prerendered = 0;
+    size_t offset = 0;
+
+    while (offset < log->size) {
+        const uint8_t *payload = log->data + offset + sizeof(_ppu_event_t);
+        _ppu_event_t event;
+        chr_cache_t *chr;
+
+        memcpy(&event, log->data + offset, sizeof(event));
+        offset += sizeof(event) + _PPU_EVENT_PAD(event.size);
+
+        /* Accesses before the pre-render line started their instruction
+         * before the CPU thread ended vertical blank */
+        if (!prerendered && event.cycle >= prerender) {
+            ppu_prerender();
+            prerendered = 1;
+        }
+
+        switch (event.type) {
+        case _PPU_EVENT_WRITE:
+            ppu_write(event.arg, event.value);
+            break;
+        case _PPU_EVENT_READ:
+            ppu_read(event.arg);
+            break;
+        case _PPU_EVENT_DMA:
+            ppu_dma(payload);
+            break;
+        case _PPU_EVENT_INIT:
+            ppu_init();
+            break;
+        case _PPU_EVENT_STATE:
+            /* A state of the pre-render line or later has its scroll */
+            ppu_set_state((const ppu_t *)payload);
+            prerendered = event.cycle >= prerender;
+            break;
+        case _PPU_EVENT_CHR:
+            if (event.arg) {
+                ppu_set_chr(chr_ram, 1);
+            } else {
+                memcpy(&chr, payload, sizeof(chr));
+                ppu_set_chr(chr, 0);
+            }
+            break;
+        case _PPU_EVENT_CHR_DATA:
+            if (chr_ram && event.size == CHR_RAM_SIZE) {
+                chr_set(chr_ram, payload);
+            }
+            break;
+        case _PPU_EVENT_MAP_PATTERN:
+            ppu_map_pattern(event.arg, event.value);
+            break;
+        case _PPU_EVENT_MAP_NAMETABLE:
+            ppu_map_nametable(event.arg, event.value);
+            break;
+        }
+    }
+
+    if (!prerendered) {
+        ppu_prerender();
+    }
+}
+
+#endif // NES_CONF_PPU_ENABLE
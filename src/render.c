@@ -0,0 +1,141 @@
+#include "render.h"
+
+#ifdef NES_CONF_RENDER_ENABLE
+
+#include <stdlib.h>
+
+static void *_render_run(void *arg) {
+    render_t *render = arg;
+    uint8_t pending;
+
+    ppu_bind(&render->ppu);
+
+    for (;;) {
+        pthread_mutex_lock(&render->lock);
+        while (!render->pending && !render->quit) {
+            pthread_cond_wait(&render->wake, &render->lock);
+        }
+        pending = render->pending;
+        pthread_mutex_unlock(&render->lock);
+
+        /* A frame handed over before quitting is still drawn */
+        if (!pending) {
+            break;
+        }
+
+        ppu_replay(&render->replay, render->prerender, render->chr_ram);
+        if (render->draw) {
+            ppu_render(render->framebuffer);
+        }
+
+        pthread_mutex_lock(&render->lock);
+        render->pending = 0;
+        pthread_cond_signal(&render->idle);
+        pthread_mutex_unlock(&render->lock);
+    }
+    return NULL;
+}
+
+/*
+ * @brief Empty the log and record a snapshot of the bound PPU into it
+ */
+static void _render_restart(render_t *render) {
+    render->log.size = 0;
+    render->log.failed = 0;
+    ppu_set_log(&render->log);
+}
+
+render_t *render_create(uint8_t *framebuffer, const uint64_t *clock) {
+    render_t *render = calloc(1, sizeof(render_t));
+
+    if (!render) {
+        return NULL;
+    }
+    if (!(render->chr_ram = chr_create(CHR_RAM_SIZE))) {
+        free(render);
+        return NULL;
+    }
+
+    render->framebuffer = framebuffer;
+    render->log.clock = clock;
+    pthread_mutex_init(&render->lock, NULL);
+    pthread_cond_init(&render->wake, NULL);
+    pthread_cond_init(&render->idle, NULL);
+
+    if (pthread_create(&render->thread, NULL, _render_run, render) != 0) {
+        pthread_cond_destroy(&render->idle);
+        pthread_cond_destroy(&render->wake);
+        pthread_mutex_destroy(&render->lock);
+        chr_release(render->chr_ram);
+        free(render);
+        return NULL;
+    }
+
+    _render_restart(render);
+    return render;
+}
+
+void render_destroy(render_t *render) {
+    if (!render) {
+        return;
+    }
+
+    ppu_set_log(NULL);
+
+    pthread_mutex_lock(&render->lock);
+    render->quit = 1;
+    pthread_cond_signal(&render->wake);
+    pthread_mutex_unlock(&render->lock);
+    pthread_join(render->thread, NULL);
+
+    pthread_cond_destroy(&render->idle);
+    pthread_cond_destroy(&render->wake);
+    pthread_mutex_destroy(&render->lock);
+    chr_release(render->chr_ram);
+    free(render->replay.data);
+    free(render->log.data);
+    free(render);
+}
+
+void render_submit(render_t *render, uint64_t prerender, uint8_t draw) {
+    ppu_log_t log = render->log;
+
+    render_wait(render);
+
+    /* Events were lost, the end of frame state stands in for them */
+    if (render->log.failed) {
+        _render_restart(render);
+        if (render->log.failed) {
+            return;
+        }
+        log = render->log;
+    }
+
+    /* The logs swap buffers, the recording one keeps its capacity */
+    render->log.data = render->replay.data;
+    render->log.capacity = render->replay.capacity;
+    render->log.size = 0;
+    render->replay = log;
+    render->prerender = prerender;
+    render->draw = draw;
+
+    pthread_mutex_lock(&render->lock);
+    render->pending = 1;
+    pthread_cond_signal(&render->wake);
+    pthread_mutex_unlock(&render->lock);
+}
+
+void render_wait(render_t *render) {
+    pthread_mutex_lock(&render->lock);
+    while (render->pending) {
+        pthread_cond_wait(&render->idle, &render->lock);
+    }
+    pthread_mutex_unlock(&render->lock);
+}
+
+void render_sync(render_t *render) {
+    render_wait(render);
+    _render_restart(render);
+}
+
+#endif // NES_CONF_RENDER_ENABLE
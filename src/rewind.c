@@ -0,0 +1,261 @@
+#include "rewind.h"
+
+#ifdef NES_CONF_REWIND_ENABLE
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * @brief Base keyframes are encoded against
+ */
+static const rewind_state_t _rewind_zero;
+
+static uint8_t *_rewind_put_varint(uint8_t *p, size_t value) {
+    do {
+        *p++ = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+        value >>= 7;
+    } while (value);
+    return p;
+}
+
+static const uint8_t *_rewind_get_varint(const uint8_t *p, size_t *value) {
+    *value = 0;
+    for (int shift = 0;; shift += 7) {
+        *value |= (size_t)(*p & 0x7f) << shift;
+        if (!(*p++ & 0x80)) {
+            return p;
+        }
+    }
+}
+
+/*
+ * @brief Encode state XOR base as alternating zero word runs and literal
+ * word runs
+ *
+ * @return The encoded size
+ */
+static size_t _rewind_encode(const rewind_state_t *state,
+        const rewind_state_t *base, uint8_t *out) {
+    const uint64_t *a = state->words;
+    const uint64_t *b = base->words;
+    uint8_t *p = out;
+    size_t i = 0;
+
+    while (i < REWIND_STATE_WORDS) {
+        size_t zeros = i;
+        while (i < REWIND_STATE_WORDS && a[i] == b[i]) {
+            i++;
+        }
+        zeros = i - zeros;
+
+        size_t start = i;
+        while (i < REWIND_STATE_WORDS && a[i] != b[i]) {
+            i++;
+        }
+
+        p = _rewind_put_varint(p, zeros);
+        p = _rewind_put_varint(p, i - start);
+        for (size_t j = start; j < i; j++) {
+            uint64_t word = a[j] ^ b[j];
+            memcpy(p, &word, REWIND_WORD_SIZE);
+            p += REWIND_WORD_SIZE;
+        }
+    }
+
+    return p - out;
+}
+
+/*
+ * @brief XOR an encoded frame into a state
+ */
+static void _rewind_apply(rewind_state_t *state, const uint8_t *in) {
+    uint64_t *words = state->words;
+    size_t i = 0;
+
+    while (i < REWIND_STATE_WORDS) {
+        size_t zeros, literals;
+
+        in = _rewind_get_varint(in, &zeros);
+        in = _rewind_get_varint(in, &literals);
+        i += zeros;
+
+        for (size_t j = 0; j < literals; j++, i++) {
+            uint64_t word;
+            memcpy(&word, in, REWIND_WORD_SIZE);
+            words[i] ^= word;
+            in += REWIND_WORD_SIZE;
+        }
+    }
+}
+
+static rewind_entry_t *_rewind_entry(rewind_t *rewind, size_t index) {
+    return &rewind->entries[(rewind->first + index) % rewind->max_entries];
+}
+
+/*
+ * @brief Drop the oldest keyframe and the deltas that depend on it
+ */
+static void _rewind_evict(rewind_t *rewind) {
+    do {
+        rewind->first = (rewind->first + 1) % rewind->max_entries;
+        rewind->count--;
+    } while (rewind->count && !_rewind_entry(rewind, 0)->keyframe);
+
+    if (!rewind->count) {
+        rewind->since_keyframe = 0;
+    }
+}
+
+/*
+ * @brief Find room for an encoded frame, evicting the oldest frames
+ *
+ * @return Offset of the room in the data ring
+ */
+static size_t _rewind_reserve(rewind_t *rewind, size_t size) {
+    for (;;) {
+        if (!rewind->count) {
+            return 0;
+        }
+
+        if (rewind->count < rewind->max_entries) {
+            const rewind_entry_t *newest = _rewind_entry(rewind, rewind->count - 1);
+            size_t end = newest->offset + newest->size;
+            size_t oldest = _rewind_entry(rewind, 0)->offset;
+
+            if (oldest < end) {
+                if (end + size <= rewind->capacity) {
+                    return end;
+                }
+                if (size <= oldest) {
+                    return 0;
+                }
+            } else if (end + size <= oldest) {
+                return end;
+            }
+        }
+
+        _rewind_evict(rewind);
+    }
+}
+
+rewind_t *rewind_create(size_t frames, size_t bytes, uint32_t keyframe_interval) {
+    rewind_t *rewind;
+
+    if (frames < 2 || bytes < REWIND_FRAME_MAX_SIZE || keyframe_interval == 0) {
+        return NULL;
+    }
+
+    if (!(rewind = calloc(1, sizeof(rewind_t)))) {
+        return NULL;
+    }
+
+    rewind->capacity = bytes;
+    rewind->max_entries = frames;
+    rewind->keyframe_interval = keyframe_interval;
+    rewind->data = malloc(bytes);
+    rewind->entries = calloc(frames, sizeof(rewind_entry_t));
+    rewind->current = calloc(1, sizeof(rewind_state_t));
+    rewind->scratch = calloc(1, sizeof(rewind_state_t));
+    rewind->encoded = malloc(REWIND_FRAME_MAX_SIZE);
+
+    if (!rewind->data || !rewind->entries || !rewind->current ||
+            !rewind->scratch || !rewind->encoded) {
+        rewind_destroy(rewind);
+        return NULL;
+    }
+
+    return rewind;
+}
+
+void rewind_destroy(rewind_t *rewind) {
+    if (!rewind) {
+        return;
+    }
+
+    free(rewind->encoded);
+    free(rewind->scratch);
+    free(rewind->current);
+    free(rewind->entries);
+    free(rewind->data);
+    free(rewind);
+}
+
+void rewind_clear(rewind_t *rewind) {
+    rewind->first = 0;
+    rewind->count = 0;
+    rewind->since_keyframe = 0;
+}
+
+void rewind_push(rewind_t *rewind, nes_t *nes) {
+    rewind_state_t *swap;
+    rewind_entry_t *entry;
+    int keyframe = !rewind->count ||
+        rewind->since_keyframe + 1 >= rewind->keyframe_interval;
+    size_t size, offset;
+
+    nes_save_state(nes, &rewind->scratch->state);
+
+    size = _rewind_encode(rewind->scratch,
+        keyframe ? &_rewind_zero : rewind->current, rewind->encoded);
+    offset = _rewind_reserve(rewind, size);
+
+    /* Eviction emptied the ring, the frame has nothing to be a delta of */
+    if (!keyframe && !rewind->count) {
+        keyframe = 1;
+        size = _rewind_encode(rewind->scratch, &_rewind_zero, rewind->encoded);
+        offset = 0;
+    }
+
+    memcpy(rewind->data + offset, rewind->encoded, size);
+
+    entry = _rewind_entry(rewind, rewind->count++);
+    entry->offset = offset;
+    entry->size = size;
+    entry->keyframe = keyframe;
+
+    rewind->since_keyframe = keyframe ? 0 : rewind->since_keyframe + 1;
+
+    swap = rewind->current;
+    rewind->current = rewind->scratch;
+    rewind->scratch = swap;
+}
+
+int rewind_pop(rewind_t *rewind, nes_t *nes) {
+    const rewind_entry_t *newest;
+    size_t key;
+
+    if (rewind->count < 2) {
+        return -1;
+    }
+
+    newest = _rewind_entry(rewind, rewind->count - 1);
+
+    if (!newest->keyframe) {
+        _rewind_apply(rewind->current, rewind->data + newest->offset);
+    } else {
+        /* Rebuild the last frame of the previous group from its keyframe */
+        for (key = rewind->count - 2; !_rewind_entry(rewind, key)->keyframe; key--);
+
+        memset(rewind->current, 0, sizeof(rewind_state_t));
+        for (size_t i = key; i < rewind->count - 1; i++) {
+            _rewind_apply(rewind->current,
+                rewind->data + _rewind_entry(rewind, i)->offset);
+        }
+    }
+
+    rewind->count--;
+
+    rewind->since_keyframe = 0;
+    for (size_t i = rewind->count - 1; !_rewind_entry(rewind, i)->keyframe; i--) {
+        rewind->since_keyframe++;
+    }
+
+    nes_load_state(nes, &rewind->current->state);
+    return 0;
+}
+
+size_t rewind_count(const rewind_t *rewind) {
+    return rewind->count;
+}
+
+#endif // NES_CONF_REWIND_ENABLE
@@ -0,0 +1,437 @@
+#define _GNU_SOURCE
+
+#include "runner.h"
+
+#ifdef NES_CONF_RUNNER_ENABLE
+
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * @brief Parse a sysfs CPU list such as "0-3,8-11"
+ *
+ * @param path File holding the list
+ * @param set Set to 1 for every CPU listed, NULL to only get the lowest
+ *
+ * @return The lowest CPU listed, -1 if the file cannot be read
+ */
+static int _runner_read_list(const char *path, uint8_t *set) {
+    char buffer[4096], *p = buffer;
+    int lowest = -1;
+    FILE *fp = fopen(path, "r");
+
+    if (!fp) {
+        return -1;
+    }
+    if (!fgets(buffer, sizeof(buffer), fp)) {
+        buffer[0] = '\0';
+    }
+    fclose(fp);
+
+    while (*p >= '0' && *p <= '9') {
+        long first = strtol(p, &p, 10), last = first;
+
+        if (*p == '-') {
+            last = strtol(p + 1, &p, 10);
+        }
+        if (lowest < 0 || first < lowest) {
+            lowest = first;
+        }
+        for (long cpu = first; set && cpu <= last && cpu < RUNNER_MAX_CPUS; cpu++) {
+            set[cpu] = 1;
+        }
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return lowest;
+}
+
+static int _runner_read_int(const char *path) {
+    int value = -1;
+    FILE *fp = fopen(path, "r");
+
+    if (fp) {
+        if (fscanf(fp, "%d", &value) != 1) {
+            value = -1;
+        }
+        fclose(fp);
+    }
+    return value;
+}
+
+/*
+ * @brief Read where a CPU sits, from its nodeN link and cache indices
+ */
+static void _runner_read_placement(int cpu, runner_placement_t *placement) {
+    char path[256];
+    DIR *dir;
+    struct dirent *entry;
+
+    placement->cpu = cpu;
+    placement->node = 0;
+    placement->l2 = -1;
+    placement->l3 = -1;
+
+    snprintf(path, sizeof(path), RUNNER_SYS_CPU "/cpu%d", cpu);
+    if ((dir = opendir(path))) {
+        while ((entry = readdir(dir))) {
+            if (strncmp(entry->d_name, "node", 4) == 0 &&
+                    entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+                placement->node = atoi(entry->d_name + 4);
+                break;
+            }
+        }
+        closedir(dir);
+    }
+
+    for (int index = 0; ; index++) {
+        int level;
+
+        snprintf(path, sizeof(path), RUNNER_SYS_CPU "/cpu%d/cache/index%d/level", cpu, index);
+        if ((level = _runner_read_int(path)) < 0) {
+            break;
+        }
+
+        snprintf(path, sizeof(path), RUNNER_SYS_CPU "/cpu%d/cache/index%d/shared_cpu_list",
+            cpu, index);
+        if (level == 2) {
+            placement->l2 = _runner_read_list(path, NULL);
+        } else if (level == 3) {
+            placement->l3 = _runner_read_list(path, NULL);
+        }
+    }
+}
+
+static int _runner_compare(const void *a, const void *b) {
+    const runner_placement_t *x = a, *y = b;
+
+    if (x->node != y->node) {
+        return x->node - y->node;
+    }
+    if (x->l3 != y->l3) {
+        return x->l3 - y->l3;
+    }
+    if (x->l2 != y->l2) {
+        return x->l2 - y->l2;
+    }
+    return x->cpu - y->cpu;
+}
+
+size_t runner_get_topology(runner_placement_t *placements) {
+    uint8_t online[RUNNER_MAX_CPUS] = { 0 };
+    cpu_set_t allowed;
+    size_t count = 0;
+
+    if (_runner_read_list(RUNNER_SYS_CPU "/online", online) < 0) {
+        /* No sysfs, take the affinity mask alone */
+        memset(online, 1, sizeof(online));
+    }
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+        CPU_SET(0, &allowed);
+    }
+
+    for (int cpu = 0; cpu < (int)RUNNER_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+        if (online[cpu] && CPU_ISSET(cpu, &allowed)) {
+            _runner_read_placement(cpu, &placements[count++]);
+        }
+    }
+
+    qsort(placements, count, sizeof(runner_placement_t), _runner_compare);
+    return count;
+}
+
+/*
+ * @brief Create a worker's consoles, on the CPU it is pinned to
+ */
+static int _runner_load(runner_t *runner, runner_worker_t *worker) {
+    size_t job = 0, start = 0;
+    uint8_t *replica = NULL;
+
+    if (worker->count && !(worker->arena = nes_arena_create(worker->count))) {
+        return -1;
+    }
+
+    for (size_t i = worker->first; i < worker->first + worker->count; i++) {
+        nes_t *nes;
+
+        while (i >= start + runner->jobs[job].count) {
+            start += runner->jobs[job++].count;
+            free(replica);
+            replica = NULL;
+        }
+
+        /* A node local copy of the ROM to load the consoles from */
+        if (!replica) {
+            if (!(replica = malloc(runner->jobs[job].size))) {
+                return -1;
+            }
+            memcpy(replica, runner->jobs[job].rom, runner->jobs[job].size);
+        }
+
+        if (!(nes = nes_create_in(worker->arena))) {
+            free(replica);
+            return -1;
+        }
+        runner->consoles[i] = nes;
+
+        if (nes_load_rom(nes, replica, runner->jobs[job].size) != 0) {
+            free(replica);
+            return -1;
+        }
+    }
+
+    free(replica);
+    return 0;
+}
+
+/*
+ * @brief Finish a step, the last worker wakes the caller
+ */
+static void _runner_done(runner_t *runner) {
+    pthread_mutex_lock(&runner->lock);
+    if (--runner->pending == 0) {
+        pthread_cond_signal(&runner->idle);
+    }
+    pthread_mutex_unlock(&runner->lock);
+}
+
+static void *_runner_run(void *arg) {
+    runner_worker_t *worker = arg;
+    runner_t *runner = worker->runner;
+    uint64_t generation = 0;
+
+    if (_runner_load(runner, worker) != 0) {
+        atomic_store(&runner->failed, 1);
+    }
+    _runner_done(runner);
+
+    for (;;) {
+        pthread_mutex_lock(&runner->lock);
+        while (runner->generation == generation) {
+            pthread_cond_wait(&runner->wake, &runner->lock);
+        }
+        generation = runner->generation;
+        pthread_mutex_unlock(&runner->lock);
+
+        if (runner->quit) {
+            _runner_done(runner);
+            break;
+        }
+
+        worker->stopped = nes_step_frames_many(&runner->consoles[worker->first],
+            worker->count, runner->frames, runner->buttons ?
+            runner->buttons + worker->first * CONTROLLER_PORTS : NULL);
+        for (size_t i = worker->first; i < worker->first + worker->count; i++) {
+            atomic_store_explicit(&runner->console_frames[i], nes_get_frame(runner->consoles[i]),
+                memory_order_relaxed);
+        }
+        _runner_done(runner);
+    }
+
+    for (size_t i = worker->first; i < worker->first + worker->count; i++) {
+        nes_destroy(runner->consoles[i]);
+    }
+    nes_arena_destroy(worker->arena);
+    return NULL;
+}
+
+/*
+ * @brief Start a step on every worker and wait for it
+ */
+static void _runner_signal(runner_t *runner) {
+    pthread_mutex_lock(&runner->lock);
+    runner->pending = runner->worker_count;
+    runner->generation++;
+    pthread_cond_broadcast(&runner->wake);
+    while (runner->pending) {
+        pthread_cond_wait(&runner->idle, &runner->lock);
+    }
+    pthread_mutex_unlock(&runner->lock);
+}
+
+runner_t *runner_create(const runner_job_t *jobs, size_t job_count,
+        const runner_config_t *config) {
+    runner_placement_t *placements = calloc(RUNNER_MAX_CPUS, sizeof(runner_placement_t));
+    runner_t *runner = calloc(1, sizeof(runner_t));
+    size_t cpus = placements ? runner_get_topology(placements) : 0;
+    size_t started = 0;
+
+    if (!runner || !cpus) {
+        free(placements);
+        free(runner);
+        return NULL;
+    }
+
+    for (size_t job = 0; job < job_count; job++) {
+        runner->count += jobs[job].count;
+    }
+
+    runner->jobs = jobs;
+    runner->job_count = job_count;
+    runner->worker_count = config->workers ? config->workers : cpus;
+    pthread_mutex_init(&runner->lock, NULL);
+    pthread_cond_init(&runner->wake, NULL);
+    pthread_cond_init(&runner->idle, NULL);
+
+    if (!(runner->workers = calloc(runner->worker_count, sizeof(runner_worker_t))) ||
+        !(runner->consoles = calloc(runner->count ? runner->count : 1, sizeof(nes_t *))) ||
+        !(runner->console_frames = calloc(runner->count ? runner->count : 1,
+            sizeof(uint64_t)))) {
+        free(runner->consoles);
+        free(runner->workers);
+        free(runner);
+        free(placements);
+        return NULL;
+    }
+
+    /* pending counts the workers loading, less those that did not start */
+    runner->pending = runner->worker_count;
+
+    for (size_t w = 0; w < runner->worker_count; w++) {
+        runner_worker_t *worker = &runner->workers[w];
+        pthread_attr_t attr;
+        cpu_set_t set;
+
+        worker->placement = placements[w % cpus];
+        worker->first = runner->count * w / runner->worker_count;
+        worker->count = runner->count * (w + 1) / runner->worker_count - worker->first;
+        worker->runner = runner;
+
+        CPU_ZERO(&set);
+        CPU_SET(worker->placement.cpu, &set);
+        pthread_attr_init(&attr);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+
+        if (pthread_create(&worker->thread, &attr, _runner_run, worker) != 0) {
+            atomic_store(&runner->failed, 1);
+            pthread_attr_destroy(&attr);
+            break;
+        }
+        pthread_attr_destroy(&attr);
+        started++;
+    }
+    free(placements);
+
+    pthread_mutex_lock(&runner->lock);
+    runner->pending -= runner->worker_count - started;
+    while (runner->pending) {
+        pthread_cond_wait(&runner->idle, &runner->lock);
+    }
+    pthread_mutex_unlock(&runner->lock);
+
+    runner->jobs = NULL;
+    runner->worker_count = started;
+
+    if (atomic_load(&runner->failed)) {
+        runner_destroy(runner);
+        return NULL;
+    }
+
+    return runner;
+}
+
+void runner_destroy(runner_t *runner) {
+    if (!runner) {
+        return;
+    }
+
+    metrics_export_stop(runner->exporter);
+
+    runner->quit = 1;
+    _runner_signal(runner);
+
+    for (size_t w = 0; w < runner->worker_count; w++) {
+        pthread_join(runner->workers[w].thread, NULL);
+    }
+
+    pthread_cond_destroy(&runner->idle);
+    pthread_cond_destroy(&runner->wake);
+    pthread_mutex_destroy(&runner->lock);
+    free(runner->console_frames);
+    free(runner->consoles);
+    free(runner->workers);
+    free(runner);
+}
+
+size_t runner_step(runner_t *runner, uint32_t frames, const uint8_t *buttons) {
+    size_t stopped = 0;
+
+    runner->frames = frames;
+    runner->buttons = buttons;
+    _runner_signal(runner);
+
+    for (size_t w = 0; w < runner->worker_count; w++) {
+        stopped += runner->workers[w].stopped;
+    }
+    return stopped;
+}
+
+nes_t *runner_get(runner_t *runner, size_t index) {
+    return runner->consoles[index];
+}
+
+void runner_get_placement(runner_t *runner, size_t index,
+        runner_placement_t *placement) {
+    size_t w = index * runner->worker_count / (runner->count ? runner->count : 1);
+
+    /* The share formula rounds, settle on the worker that holds index */
+    while (w + 1 < runner->worker_count && index >= runner->workers[w + 1].first) {
+        w++;
+    }
+    while (w > 0 && index < runner->workers[w].first) {
+        w--;
+    }
+    *placement = runner->workers[w].placement;
+}
+
+#ifdef NES_CONF_METRICS_ENABLE
+
+/*
+ * @brief Write the per console samples of an export
+ */
+static void _runner_write_metrics(FILE *file, void *user) {
+    runner_t *runner = user;
+
+    fprintf(file,
+        "# HELP nes_runner_workers Worker threads of the runner.\n"
+        "# TYPE nes_runner_workers gauge\n"
+        "nes_runner_workers %zu\n"
+        "# HELP nes_console_frames_total Frames completed per console.\n"
+        "# TYPE nes_console_frames_total counter\n", runner->worker_count);
+
+    for (size_t w = 0; w < runner->worker_count; w++) {
+        runner_worker_t *worker = &runner->workers[w];
+
+        for (size_t i = worker->first; i < worker->first + worker->count; i++) {
+            fprintf(file, "nes_console_frames_total{console=\"%zu\",cpu=\"%d\"} %llu\n",
+                i, worker->placement.cpu, (unsigned long long)atomic_load_explicit(
+                    &runner->console_frames[i], memory_order_relaxed));
+        }
+    }
+}
+
+int runner_export_metrics(runner_t *runner, const char *path, uint32_t interval_ms) {
+    if (runner->exporter) {
+        return -1;
+    }
+    runner->exporter = metrics_export_start(path, interval_ms, _runner_write_metrics, runner);
+    return runner->exporter ? 0 : -1;
+}
+
+#else
+
+int runner_export_metrics(runner_t *runner, const char *path, uint32_t interval_ms) {
+    (void)runner;
+    (void)path;
+    (void)interval_ms;
+    return -1;
+}
+
+#endif // NES_CONF_METRICS_ENABLE
+
+#endif // NES_CONF_RUNNER_ENABLE
@@ -0,0 +1,272 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "stream.h"
+#include "metrics.h"
+
+#ifdef NES_CONF_STREAM_ENABLE
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * @brief Waits yield this many times before sleeping
+ */
+#define STREAM_WAIT_YIELDS 64U
+#define STREAM_WAIT_SLEEP_NS 50000L
+
+static uint64_t _stream_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * @brief Back off while waiting for the other thread, yielding first and
+ * sleeping once the wait gets long
+ */
+static void _stream_wait(unsigned *spins) {
+    struct timespec ts = { 0, STREAM_WAIT_SLEEP_NS };
+
+    if ((*spins)++ < STREAM_WAIT_YIELDS) {
+        sched_yield();
+    } else {
+        nanosleep(&ts, NULL);
+    }
+}
+
+static inline uint8_t *_stream_slot(stream_ring_t *ring, uint64_t index) {
+    return ring->slots + (index & ring->mask) * ring->stride;
+}
+
+stream_ring_t *stream_ring_create(size_t slot_size, size_t slots,
+        stream_policy_e policy) {
+    stream_ring_t *ring;
+    size_t count = 1;
+
+    while (count < slots) {
+        count <<= 1;
+    }
+
+    if (!slot_size || !(ring = aligned_alloc(STREAM_CACHE_LINE, sizeof(stream_ring_t)))) {
+        return NULL;
+    }
+
+    memset(ring, 0, sizeof(stream_ring_t));
+    ring->slot_size = slot_size;
+    ring->stride = (slot_size + STREAM_CACHE_LINE - 1) & ~(size_t)(STREAM_CACHE_LINE - 1);
+    ring->mask = count - 1;
+    ring->policy = policy;
+
+    if (!(ring->slots = aligned_alloc(STREAM_CACHE_LINE, ring->stride * count))) {
+        free(ring);
+        return NULL;
+    }
+
+    return ring;
+}
+
+void stream_ring_destroy(stream_ring_t *ring) {
+    if (ring) {
+        free(ring->slots);
+        free(ring);
+    }
+}
+
+void *stream_ring_acquire(stream_ring_t *ring) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    unsigned spins = 0;
+
+    while (head - tail > ring->mask) {
+        if (ring->policy == STREAM_POLICY_DROP_OLDEST) {
+            /* On failure the consumer freed the slot, tail is reloaded */
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &tail, tail + 1,
+                    memory_order_acq_rel, memory_order_acquire)) {
+                atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+                break;
+            }
+            continue;
+        }
+
+        if (!spins) {
+            atomic_fetch_add_explicit(&ring->stalls, 1, memory_order_relaxed);
+        }
+        if (atomic_load_explicit(&ring->closed, memory_order_acquire)) {
+            return NULL;
+        }
+        _stream_wait(&spins);
+        tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    }
+
+    return _stream_slot(ring, head);
+}
+
+void stream_ring_publish(stream_ring_t *ring) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    METRICS_SET(queue_depth,
+        head + 1 - atomic_load_explicit(&ring->tail, memory_order_relaxed));
+}
+
+int stream_ring_read(stream_ring_t *ring, void *data) {
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    while (tail != atomic_load_explicit(&ring->head, memory_order_acquire)) {
+        memcpy(data, _stream_slot(ring, tail), ring->slot_size);
+
+        /* A failed swap means the producer dropped the slot while it was
+         * copied, the copy may be torn and is read again from the new tail */
+        if (atomic_compare_exchange_strong_explicit(&ring->tail, &tail, tail + 1,
+                memory_order_acq_rel, memory_order_acquire)) {
+            atomic_fetch_add_explicit(&ring->consumed, 1, memory_order_relaxed);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void stream_ring_close(stream_ring_t *ring) {
+    atomic_store_explicit(&ring->closed, 1, memory_order_release);
+}
+
+void stream_ring_get_stats(stream_ring_t *ring, stream_ring_stats_t *stats) {
+    stats->produced = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    stats->consumed = atomic_load_explicit(&ring->consumed, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    stats->stalls = atomic_load_explicit(&ring->stalls, memory_order_relaxed);
+}
+
+/*
+ * @brief Emulation thread, runs and publishes frames until stopped
+ */
+static void *_stream_run(void *arg) {
+    stream_t *stream = arg;
+    uint64_t deadline = _stream_now();
+
+    while (atomic_load_explicit(&stream->running, memory_order_acquire)) {
+        stream_frame_t *frame;
+        stream_audio_t *audio;
+
+        for (uint8_t port = 0; port < CONTROLLER_PORTS; port++) {
+            nes_set_buttons(stream->nes, port, atomic_load_explicit(
+                &stream->buttons[port], memory_order_relaxed));
+        }
+        nes_step_frames(stream->nes, 1);
+        atomic_fetch_add_explicit(&stream->frames, 1, memory_order_relaxed);
+
+        if (stream->video) {
+            if (!(frame = stream_ring_acquire(stream->video))) {
+                break;
+            }
+            frame->frame = nes_get_frame(stream->nes);
+            frame->fingerprint = nes_fingerprint(stream->nes);
+            memcpy(frame->pixels, nes_get_framebuffer(stream->nes), sizeof(frame->pixels));
+            stream_ring_publish(stream->video);
+        }
+
+        if (stream->audio) {
+            size_t count;
+            const int16_t *samples = nes_get_audio(stream->nes, &count);
+
+            if (!(audio = stream_ring_acquire(stream->audio))) {
+                break;
+            }
+            audio->frame = nes_get_frame(stream->nes);
+            audio->count = count;
+            memcpy(audio->samples, samples, count * sizeof(int16_t));
+            stream_ring_publish(stream->audio);
+        }
+
+        if (stream->period_ns) {
+            uint64_t now = _stream_now();
+
+            deadline += stream->period_ns;
+            if (now > deadline) {
+                /* Start over from now rather than rushing to catch up */
+                atomic_fetch_add_explicit(&stream->late, 1, memory_order_relaxed);
+                deadline = now;
+            } else {
+                struct timespec ts = {
+                    deadline / 1000000000ULL, deadline % 1000000000ULL
+                };
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+stream_t *stream_start(nes_t *nes, const stream_config_t *config) {
+    stream_t *stream = calloc(1, sizeof(stream_t));
+
+    if (!stream) {
+        return NULL;
+    }
+
+    stream->nes = nes;
+    stream->period_ns = config->period_ns;
+    atomic_store(&stream->running, 1);
+
+    if ((config->video_slots && !(stream->video = stream_ring_create(
+            sizeof(stream_frame_t), config->video_slots, config->policy))) ||
+        (config->audio_slots && !(stream->audio = stream_ring_create(
+            sizeof(stream_audio_t), config->audio_slots, config->policy))) ||
+        pthread_create(&stream->thread, NULL, _stream_run, stream) != 0) {
+
+        stream_ring_destroy(stream->video);
+        stream_ring_destroy(stream->audio);
+        free(stream);
+        return NULL;
+    }
+
+    return stream;
+}
+
+void stream_stop(stream_t *stream) {
+    atomic_store_explicit(&stream->running, 0, memory_order_release);
+    if (stream->video) {
+        stream_ring_close(stream->video);
+    }
+    if (stream->audio) {
+        stream_ring_close(stream->audio);
+    }
+
+    pthread_join(stream->thread, NULL);
+
+    stream_ring_destroy(stream->video);
+    stream_ring_destroy(stream->audio);
+    free(stream);
+}
+
+stream_ring_t *stream_get_video(stream_t *stream) {
+    return stream->video;
+}
+
+stream_ring_t *stream_get_audio(stream_t *stream) {
+    return stream->audio;
+}
+
+void stream_set_buttons(stream_t *stream, uint8_t port, uint8_t buttons) {
+    atomic_store_explicit(&stream->buttons[port], buttons, memory_order_relaxed);
+}
+
+void stream_get_stats(stream_t *stream, stream_stats_t *stats) {
+    memset(stats, 0, sizeof(stream_stats_t));
+
+    stats->frames = atomic_load_explicit(&stream->frames, memory_order_relaxed);
+    stats->late = atomic_load_explicit(&stream->late, memory_order_relaxed);
+    if (stream->video) {
+        stream_ring_get_stats(stream->video, &stats->video);
+    }
+    if (stream->audio) {
+        stream_ring_get_stats(stream->audio, &stats->audio);
+    }
+}
+
+#endif // NES_CONF_STREAM_ENABLE
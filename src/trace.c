@@ -0,0 +1,591 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+
+#ifdef NES_CONF_TRACE_ENABLE
+
+#include "cartridge.h"
+#include "memory.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * @brief Tracer state
+ *
+ * The CPU fills blocks[tail % TRACE_QUEUE_BLOCKS] while the writer thread
+ * encodes the submitted blocks between head and tail, taking them off the
+ * queue as it starts each one.
+ *
+ * @attribute blocks Raw record blocks
+ * @attribute counts Record count of each submitted block
+ * @attribute current Block being filled, NULL when tracing is off, only
+ * touched by the traced console
+ * @attribute count Records in current
+ * @attribute head Next block to encode
+ * @attribute tail Next block to submit
+ * @attribute encoding The writer is encoding block head - 1
+ * @attribute running Writer thread keeps waiting for blocks
+ * @attribute lock Protects head, tail, encoding and running
+ * @attribute ready Signaled when a block is submitted
+ * @attribute free Signaled when a block is encoded
+ * @attribute thread Writer thread
+ * @attribute file Output file
+ * @attribute mode Output mode
+ * @attribute encoded Encode buffer
+ * @attribute ring Encoded blocks kept in TRACE_MODE_RING
+ * @attribute ring_sizes Size of each ring entry
+ * @attribute ring_blocks Number of ring entries
+ * @attribute ring_count Number of ring entries written so far
+ */
+typedef struct {
+    trace_record_t *blocks;
+    uint32_t counts[TRACE_QUEUE_BLOCKS];
+    trace_record_t *current;
+    uint32_t count;
+
+    size_t head;
+    size_t tail;
+    bool encoding;
+    bool running;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t free;
+    pthread_t thread;
+
+    FILE *file;
+    trace_mode_e mode;
+    uint8_t *encoded;
+    uint8_t **ring;
+    size_t *ring_sizes;
+    size_t ring_blocks;
+    size_t ring_count;
+} _trace_t;
+
+static _trace_t _trace;
+
+/*
+ * @brief CPU of the traced console, NULL when tracing is off. Consoles
+ * running on other threads check it before touching anything else.
+ */
+static _Atomic(const cpu_t *) _trace_cpu;
+
+/*
+ * @brief Read an operand byte without going through the bus, so tracing
+ * changes neither registers nor the bus counters. Operands are never in
+ * the I/O registers of a real program, those read as 0.
+ */
+static uint8_t _trace_peek(uint16_t address) {
+    if (address >= MEMORY_CARTRIDGE_BASE) {
+        return cartridge_read(address);
+    }
+    if (address < MEMORY_PPU_REG_BASE) {
+        return memory_get_ram()[address % MEMORY_RAM_SIZE];
+    }
+    return 0;
+}
+
+static void _trace_put_u32(uint8_t *out, uint32_t value) {
+    out[0] = value;
+    out[1] = value >> 8;
+    out[2] = value >> 16;
+    out[3] = value >> 24;
+}
+
+static uint32_t _trace_get_u32(const uint8_t *in) {
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+/*
+ * @brief Encode a block of records behind a block header
+ *
+ * @return Total encoded size, header included
+ */
+static size_t _trace_encode(const trace_record_t *records, uint32_t count,
+        uint8_t *out) {
+    trace_record_t prev;
+    uint8_t *p = out + TRACE_BLOCK_HEADER_SIZE;
+
+    memset(&prev, 0, sizeof(prev));
+
+    for (uint32_t i = 0; i < count; i++) {
+        const trace_record_t *r = &records[i];
+        uint8_t *mask = p++;
+        uint64_t delta = r->cycles - prev.cycles;
+
+        *mask = (r->size - 1) & TRACE_MASK_OPERANDS;
+        *p++ = r->opcode;
+        for (uint8_t j = 1; j < r->size; j++) {
+            *p++ = r->operands[j - 1];
+        }
+
+        if (r->pc != (uint16_t)(prev.pc + prev.size)) {
+            *mask |= TRACE_MASK_PC;
+            *p++ = r->pc;
+            *p++ = r->pc >> 8;
+        }
+        if (r->a != prev.a) {
+            *mask |= TRACE_MASK_A;
+            *p++ = r->a;
+        }
+        if (r->x != prev.x) {
+            *mask |= TRACE_MASK_X;
+            *p++ = r->x;
+        }
+        if (r->y != prev.y) {
+            *mask |= TRACE_MASK_Y;
+            *p++ = r->y;
+        }
+        if (r->flags != prev.flags) {
+            *mask |= TRACE_MASK_FLAGS;
+            *p++ = r->flags;
+        }
+        if (r->sp != prev.sp) {
+            *mask |= TRACE_MASK_SP;
+            *p++ = r->sp;
+        }
+
+        do {
+            *p++ = (delta & 0x7f) | (delta > 0x7f ? 0x80 : 0);
+            delta >>= 7;
+        } while (delta);
+
+        prev = *r;
+    }
+
+    _trace_put_u32(out, count);
+    _trace_put_u32(out + 4, p - out - TRACE_BLOCK_HEADER_SIZE);
+
+    return p - out;
+}
+
+static void _trace_write_header(FILE *file) {
+    uint8_t header[TRACE_HEADER_SIZE] = { 0 };
+
+    memcpy(header, TRACE_MAGIC, 4);
+    header[4] = TRACE_VERSION;
+    fwrite(header, 1, sizeof(header), file);
+}
+
+/*
+ * @brief Writer thread, encodes submitted blocks until the trace closes
+ */
+static void *_trace_writer(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&_trace.lock);
+    for (;;) {
+        while (_trace.head == _trace.tail && _trace.running) {
+            pthread_cond_wait(&_trace.ready, &_trace.lock);
+        }
+        if (_trace.head == _trace.tail) {
+            break;
+        }
+
+        size_t index = _trace.head++ % TRACE_QUEUE_BLOCKS;
+        uint32_t count = _trace.counts[index];
+        _trace.encoding = true;
+        pthread_mutex_unlock(&_trace.lock);
+
+        const trace_record_t *records =
+            &_trace.blocks[index * TRACE_BLOCK_RECORDS];
+
+        if (_trace.mode == TRACE_MODE_RING) {
+            size_t slot = _trace.ring_count++ % _trace.ring_blocks;
+            _trace.ring_sizes[slot] =
+                _trace_encode(records, count, _trace.ring[slot]);
+        } else {
+            size_t size = _trace_encode(records, count, _trace.encoded);
+            fwrite(_trace.encoded, 1, size, _trace.file);
+        }
+
+        pthread_mutex_lock(&_trace.lock);
+        _trace.encoding = false;
+        pthread_cond_signal(&_trace.free);
+    }
+    pthread_mutex_unlock(&_trace.lock);
+
+    return NULL;
+}
+
+/*
+ * @brief Hand the filled block to the writer and start the next one
+ *
+ * The next block must be neither queued nor being encoded. A file trace
+ * waits for the writer to free one, a ring trace drops the oldest queued
+ * block instead, so the CPU never waits on it.
+ */
+static void _trace_submit() {
+    pthread_mutex_lock(&_trace.lock);
+
+    _trace.counts[_trace.tail % TRACE_QUEUE_BLOCKS] = _trace.count;
+    _trace.tail++;
+    pthread_cond_signal(&_trace.ready);
+
+    while (_trace.encoding + (_trace.tail - _trace.head) + 1 > TRACE_QUEUE_BLOCKS) {
+        if (_trace.mode == TRACE_MODE_RING && _trace.head != _trace.tail) {
+            _trace.head++;
+        } else {
+            pthread_cond_wait(&_trace.free, &_trace.lock);
+        }
+    }
+
+    pthread_mutex_unlock(&_trace.lock);
+
+    _trace.current =
+        &_trace.blocks[(_trace.tail % TRACE_QUEUE_BLOCKS) * TRACE_BLOCK_RECORDS];
+    _trace.count = 0;
+}
+
+static void _trace_free() {
+    if (_trace.ring) {
+        for (size_t i = 0; i < _trace.ring_blocks; i++) {
+            free(_trace.ring[i]);
+        }
+    }
+    free(_trace.ring);
+    free(_trace.ring_sizes);
+    free(_trace.encoded);
+    free(_trace.blocks);
+    if (_trace.file) {
+        fclose(_trace.file);
+    }
+    memset(&_trace, 0, sizeof(_trace));
+}
+
+int trace_open(const char *path, trace_mode_e mode, size_t ring_blocks) {
+    const size_t block_size = TRACE_BLOCK_HEADER_SIZE +
+        TRACE_BLOCK_RECORDS * TRACE_RECORD_MAX_SIZE;
+
+    if (_trace.current || (mode == TRACE_MODE_RING && ring_blocks == 0)) {
+        return -1;
+    }
+
+    memset(&_trace, 0, sizeof(_trace));
+    _trace.mode = mode;
+    _trace.file = fopen(path, "wb");
+    _trace.blocks = malloc(sizeof(trace_record_t) *
+        TRACE_BLOCK_RECORDS * TRACE_QUEUE_BLOCKS);
+
+    if (mode == TRACE_MODE_RING) {
+        _trace.ring_blocks = ring_blocks;
+        _trace.ring = calloc(ring_blocks, sizeof(uint8_t *));
+        _trace.ring_sizes = calloc(ring_blocks, sizeof(size_t));
+        for (size_t i = 0; _trace.ring && i < ring_blocks; i++) {
+            if (!(_trace.ring[i] = malloc(block_size))) {
+                break;
+            }
+        }
+        if (!_trace.ring || !_trace.ring_sizes || !_trace.ring[ring_blocks - 1]) {
+            _trace_free();
+            return -1;
+        }
+    } else {
+        _trace.encoded = malloc(block_size);
+    }
+
+    if (!_trace.file || !_trace.blocks ||
+            (mode == TRACE_MODE_FILE && !_trace.encoded)) {
+        _trace_free();
+        return -1;
+    }
+
+    if (mode == TRACE_MODE_FILE) {
+        _trace_write_header(_trace.file);
+    }
+
+    pthread_mutex_init(&_trace.lock, NULL);
+    pthread_cond_init(&_trace.ready, NULL);
+    pthread_cond_init(&_trace.free, NULL);
+    _trace.running = true;
+
+    if (pthread_create(&_trace.thread, NULL, _trace_writer, NULL) != 0) {
+        pthread_cond_destroy(&_trace.free);
+        pthread_cond_destroy(&_trace.ready);
+        pthread_mutex_destroy(&_trace.lock);
+        _trace_free();
+        return -1;
+    }
+
+    _trace.current = _trace.blocks;
+    atomic_store_explicit(&_trace_cpu, cpu_get_bound(), memory_order_release);
+    return 0;
+}
+
+void trace_close() {
+    if (!_trace.current) {
+        return;
+    }
+
+    atomic_store_explicit(&_trace_cpu, NULL, memory_order_release);
+    if (_trace.count) {
+        _trace_submit();
+    }
+
+    pthread_mutex_lock(&_trace.lock);
+    _trace.running = false;
+    pthread_cond_signal(&_trace.ready);
+    pthread_mutex_unlock(&_trace.lock);
+    pthread_join(_trace.thread, NULL);
+
+    if (_trace.mode == TRACE_MODE_RING) {
+        size_t count = _trace.ring_count < _trace.ring_blocks ?
+            _trace.ring_count : _trace.ring_blocks;
+
+        _trace_write_header(_trace.file);
+        for (size_t i = _trace.ring_count - count; i < _trace.ring_count; i++) {
+            size_t slot = i % _trace.ring_blocks;
+            fwrite(_trace.ring[slot], 1, _trace.ring_sizes[slot], _trace.file);
+        }
+    }
+
+    pthread_cond_destroy(&_trace.free);
+    pthread_cond_destroy(&_trace.ready);
+    pthread_mutex_destroy(&_trace.lock);
+    _trace_free();
+}
+
+void trace_record(const cpu_t *cpu, uint8_t opcode, uint8_t size) {
+    if (atomic_load_explicit(&_trace_cpu, memory_order_acquire) != cpu) {
+        return;
+    }
+
+    trace_record_t *record = &_trace.current[_trace.count];
+
+    record->cycles = cpu->cycles;
+    record->pc = cpu->pc;
+    record->opcode = opcode;
+    record->size = size;
+    if (size > 1) {
+        size_t available = 0;
+        const uint8_t *code = cartridge_peek(cpu->pc + 1, &available);
+
+        /* Code runs from ROM, where the operands are one copy away */
+        if (code && available >= 2) {
+            memcpy(record->operands, code, 2);
+        } else {
+            for (uint8_t i = 1; i < size; i++) {
+                record->operands[i - 1] = _trace_peek(cpu->pc + i);
+            }
+        }
+    }
+    record->a = cpu->a;
+    record->x = cpu->x;
+    record->y = cpu->y;
+    record->flags = cpu->flags;
+    record->sp = cpu->sp;
+
+    if (++_trace.count == TRACE_BLOCK_RECORDS) {
+        _trace_submit();
+    }
+}
+
+int trace_reader_open(trace_reader_t *reader, const char *path) {
+    uint8_t header[TRACE_HEADER_SIZE];
+
+    memset(reader, 0, sizeof(trace_reader_t));
+    reader->file = fopen(path, "rb");
+    if (!reader->file) {
+        return -1;
+    }
+
+    if (fread(header, 1, sizeof(header), reader->file) != sizeof(header) ||
+            memcmp(header, TRACE_MAGIC, 4) != 0 ||
+            header[4] != TRACE_VERSION) {
+        trace_reader_close(reader);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * @brief Read the next block into the reader
+ *
+ * @return 1 on success, 0 at end of file, -1 on corruption
+ */
+static int _trace_reader_load(trace_reader_t *reader) {
+    uint8_t header[TRACE_BLOCK_HEADER_SIZE];
+    size_t read = fread(header, 1, sizeof(header), reader->file);
+
+    if (read == 0) {
+        return 0;
+    }
+    if (read != sizeof(header)) {
+        return -1;
+    }
+
+    reader->remaining = _trace_get_u32(header);
+    reader->size = _trace_get_u32(header + 4);
+    reader->pos = 0;
+    memset(&reader->prev, 0, sizeof(trace_record_t));
+
+    if (reader->remaining > TRACE_BLOCK_RECORDS ||
+            reader->size > (size_t)reader->remaining * TRACE_RECORD_MAX_SIZE) {
+        return -1;
+    }
+
+    if (reader->size > reader->capacity) {
+        uint8_t *block = realloc(reader->block, reader->size);
+        if (!block) {
+            return -1;
+        }
+        reader->block = block;
+        reader->capacity = reader->size;
+    }
+
+    if (fread(reader->block, 1, reader->size, reader->file) != reader->size) {
+        return -1;
+    }
+
+    return 1;
+}
+
+int trace_reader_next(trace_reader_t *reader, trace_record_t *record) {
+    while (reader->remaining == 0) {
+        int status = _trace_reader_load(reader);
+        if (status <= 0) {
+            return status;
+        }
+    }
+
+    const uint8_t *p = reader->block + reader->pos;
+    const uint8_t *end = reader->block + reader->size;
+    trace_record_t *prev = &reader->prev;
+    uint8_t mask;
+    uint64_t delta = 0;
+
+    /* At most two operands, a corrupted mask must not overflow them */
+    if (p == end || (*p & TRACE_MASK_OPERANDS) > sizeof(record->operands) ||
+            end - p < 2 + (*p & TRACE_MASK_OPERANDS)) {
+        return -1;
+    }
+
+    mask = *p++;
+    record->size = (mask & TRACE_MASK_OPERANDS) + 1;
+    record->opcode = *p++;
+    for (uint8_t i = 1; i < record->size; i++) {
+        record->operands[i - 1] = *p++;
+    }
+
+    record->pc = prev->pc + prev->size;
+    if (mask & TRACE_MASK_PC) {
+        if (end - p < 2) {
+            return -1;
+        }
+        record->pc = p[0] | (p[1] << 8);
+        p += 2;
+    }
+
+    uint8_t *registers[] = {
+        &record->a, &record->x, &record->y, &record->flags, &record->sp
+    };
+    const uint8_t *prev_registers[] = {
+        &prev->a, &prev->x, &prev->y, &prev->flags, &prev->sp
+    };
+    for (int i = 0; i < 5; i++) {
+        if (mask & (TRACE_MASK_A << i)) {
+            if (p == end) {
+                return -1;
+            }
+            *registers[i] = *p++;
+        } else {
+            *registers[i] = *prev_registers[i];
+        }
+    }
+
+    for (int shift = 0;; shift += 7) {
+        if (p == end || shift > 63) {
+            return -1;
+        }
+        delta |= (uint64_t)(*p & 0x7f) << shift;
+        if (!(*p++ & 0x80)) {
+            break;
+        }
+    }
+    record->cycles = prev->cycles + delta;
+
+    reader->pos = p - reader->block;
+    reader->remaining--;
+    *prev = *record;
+
+    return 1;
+}
+
+void trace_reader_close(trace_reader_t *reader) {
+    if (reader->file) {
+        fclose(reader->file);
+    }
+    free(reader->block);
+    memset(reader, 0, sizeof(trace_reader_t));
+}
+
+void trace_format(const trace_record_t *record, char *buffer, size_t size) {
+    const cpu_instruction_t *instr = cpu_get_instruction(record->opcode);
+    uint8_t lo = record->operands[0];
+    uint16_t word = lo | (record->operands[1] << 8);
+    char bytes[9];
+    char disasm[32];
+
+    snprintf(bytes, sizeof(bytes), "%02X", record->opcode);
+    for (uint8_t i = 1; i < record->size; i++) {
+        snprintf(bytes + 3 * i - 1, sizeof(bytes) - (3 * i - 1), " %02X",
+            record->operands[i - 1]);
+    }
+
+    const char *name = instr->handler ? instr->mnemonic : "???";
+
+    switch (instr->handler ? instr->mode : CPU_MODE_IMP) {
+    case CPU_MODE_ACC:
+        snprintf(disasm, sizeof(disasm), "%s A", name);
+        break;
+    case CPU_MODE_IMM:
+        snprintf(disasm, sizeof(disasm), "%s #$%02X", name, lo);
+        break;
+    case CPU_MODE_ZP:
+        snprintf(disasm, sizeof(disasm), "%s $%02X", name, lo);
+        break;
+    case CPU_MODE_ZPX:
+        snprintf(disasm, sizeof(disasm), "%s $%02X,X", name, lo);
+        break;
+    case CPU_MODE_ZPY:
+        snprintf(disasm, sizeof(disasm), "%s $%02X,Y", name, lo);
+        break;
+    case CPU_MODE_ABS:
+        snprintf(disasm, sizeof(disasm), "%s $%04X", name, word);
+        break;
+    case CPU_MODE_ABSX:
+        snprintf(disasm, sizeof(disasm), "%s $%04X,X", name, word);
+        break;
+    case CPU_MODE_ABSY:
+        snprintf(disasm, sizeof(disasm), "%s $%04X,Y", name, word);
+        break;
+    case CPU_MODE_IND:
+        snprintf(disasm, sizeof(disasm), "%s ($%04X)", name, word);
+        break;
+    case CPU_MODE_INDX:
+        snprintf(disasm, sizeof(disasm), "%s ($%02X,X)", name, lo);
+        break;
+    case CPU_MODE_INDY:
+        snprintf(disasm, sizeof(disasm), "%s ($%02X),Y", name, lo);
+        break;
+    case CPU_MODE_REL:
+        snprintf(disasm, sizeof(disasm), "%s $%04X", name,
+            (uint16_t)(record->pc + 2 + (int8_t)lo));
+        break;
+    default:
+        snprintf(disasm, sizeof(disasm), "%s", name);
+        break;
+    }
+
+    snprintf(buffer, size,
+        "%04X  %-8s  %-31s A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%" PRIu64,
+        record->pc, bytes, disasm, record->a, record->x, record->y,
+        record->flags, record->sp, record->cycles);
+}
+
+#endif // NES_CONF_TRACE_ENABLE
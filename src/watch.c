@@ -0,0 +1,167 @@
+#include "watch.h"
+
+#include "cartridge.h"
+#include "cpu.h"
+#include "memory.h"
+
+#ifdef NES_CONF_WATCH_ENABLE
+
+#include <string.h>
+
+/*
+ * @brief Watch state the calling thread operates on, see watch_bind()
+ */
+static watch_t _watch_default;
+static _Thread_local watch_t *_watch = &_watch_default;
+
+/*
+ * @brief Report a hit to the handler
+ *
+ * @return Non-zero if the CPU should stop
+ */
+static int _watch_hit(watch_hit_e type, uint16_t address, uint8_t value,
+        uint8_t old) {
+    cpu_t cpu;
+
+    cpu_get_state(&cpu);
+
+    _watch->hit.type = type;
+    _watch->hit.address = address;
+    _watch->hit.value = value;
+    _watch->hit.old = old;
+    _watch->hit.pc = cpu.pc;
+    _watch->hit.cycles = cpu.cycles;
+
+    return !_watch->handler || _watch->handler(_watch->user, &_watch->hit);
+}
+
+/*
+ * @brief Address whose bits hold the watch of an address, internal RAM
+ * mirrors share those of the RAM byte
+ */
+static inline uint16_t _watch_address(uint16_t address) {
+    return address < MEMORY_PPU_REG_BASE ? address % MEMORY_RAM_SIZE : address;
+}
+
+/*
+ * @brief Byte at a change watch address, read straight from RAM or
+ * cartridge memory so the bus sees no extra access
+ *
+ * @return The byte, 0 where nothing plain is mapped
+ */
+static uint8_t _watch_peek(uint16_t address) {
+    const uint8_t *byte;
+    size_t size;
+
+    if (address < MEMORY_PPU_REG_BASE) {
+        return memory_get_ram()[address % MEMORY_RAM_SIZE];
+    }
+    byte = cartridge_peek(address, &size);
+    return byte ? *byte : 0;
+}
+
+/*
+ * @brief Recompute the page flag of the page holding a watch address, and
+ * of its mirrors for internal RAM
+ */
+static void _watch_update_page(uint16_t address) {
+    size_t first = (address & ~(WATCH_PAGE_SIZE - 1)) >> 3;
+    uint8_t flag = 0;
+
+    for (size_t i = first; i < first + WATCH_PAGE_SIZE / 8; i++) {
+        flag |= _watch->writes[i] | _watch->changes[i];
+    }
+
+    if (address >= MEMORY_PPU_REG_BASE) {
+        _watch->pages[address >> 8] = flag != 0;
+        return;
+    }
+    for (uint32_t mirror = address; mirror < MEMORY_PPU_REG_BASE; mirror += MEMORY_RAM_SIZE) {
+        _watch->pages[mirror >> 8] = flag != 0;
+    }
+}
+
+void watch_bind(watch_t *watch) {
+    _watch = watch;
+    memory_set_traps(watch->pages);
+    cpu_set_breakpoints(watch->breakpoints);
+}
+
+void watch_init() {
+    memset(_watch, 0, sizeof(watch_t));
+}
+
+int watch_set(uint16_t address, watch_mode_e mode) {
+    uint8_t bit = 1U << (address & 7U);
+
+    if (mode == WATCH_MODE_CHANGE && address >= MEMORY_PPU_REG_BASE &&
+            address < MEMORY_CARTRIDGE_BASE) {
+        return -1;
+    }
+    address = _watch_address(address);
+
+    _watch->writes[address >> 3] &= ~bit;
+    _watch->changes[address >> 3] &= ~bit;
+
+    if (mode == WATCH_MODE_WRITE) {
+        _watch->writes[address >> 3] |= bit;
+    } else if (mode == WATCH_MODE_CHANGE) {
+        _watch->changes[address >> 3] |= bit;
+    }
+
+    _watch_update_page(address);
+    return 0;
+}
+
+void watch_set_breakpoint(uint16_t address, uint8_t enable) {
+    if (enable) {
+        _watch->breakpoints[address >> 3] |= 1U << (address & 7U);
+    } else {
+        _watch->breakpoints[address >> 3] &= ~(1U << (address & 7U));
+    }
+}
+
+void watch_set_handler(watch_handler_t handler, void *user) {
+    _watch->handler = handler;
+    _watch->user = user;
+}
+
+void watch_get_hit(watch_hit_t *hit) {
+    *hit = _watch->hit;
+}
+
+void watch_write(uint16_t address, uint8_t data) {
+    uint16_t watched = _watch_address(address);
+    uint8_t old;
+
+    /* The hit reports the address written, mirror or not */
+    if (WATCH_BIT(_watch->writes, watched)) {
+        if (_watch_hit(WATCH_HIT_WRITE, address, data, data)) {
+            cpu_stop();
+        }
+    } else if (WATCH_BIT(_watch->changes, watched) &&
+            (old = _watch_peek(address)) != data) {
+        if (_watch_hit(WATCH_HIT_WRITE, address, data, old)) {
+            cpu_stop();
+        }
+    }
+}
+
+int watch_break(uint16_t pc, uint64_t cycles) {
+    /* Resuming from this breakpoint, run the instruction this time */
+    if (_watch->resume && _watch->hit.pc == pc && _watch->hit.cycles == cycles) {
+        _watch->resume = 0;
+        return 0;
+    }
+
+    _watch->resume = 0;
+    if (!_watch_hit(WATCH_HIT_BREAK, pc, 0, 0)) {
+        return 0;
+    }
+
+    _watch->resume = 1;
+    cpu_stop();
+    return 1;
+}
+
+#endif // NES_CONF_WATCH_ENABLE
@@ -0,0 +1,520 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cartridge.h"
+#include "cpu.h"
+#include "memory.h"
+#include "nes.h"
+#include "ppu.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * @brief Synthetic NROM-256 image, code starts at $8000
+ */
+#define BENCH_ROM_SIZE (CARTRIDGE_INES_HEADER_SIZE + CARTRIDGE_NROM_ROM_SIZE)
+#define BENCH_CODE_START CARTRIDGE_NROM_ROM_START
+
+/*
+ * @brief Consoles advanced per nes_step_frames_many call
+ */
+#define BENCH_BATCH_SIZE 16U
+
+/*
+ * @brief A synthetic program: body is repeated to fill the bank, then
+ * jumps back to the start
+ *
+ * @attribute name Benchmark name
+ * @attribute body Instruction sequence, must keep the CPU in the bank
+ * @attribute size Size of body
+ */
+typedef struct {
+    const char *name;
+    const uint8_t *body;
+    size_t size;
+} bench_program_t;
+
+/*
+ * @brief A bus access pattern for memory_read / memory_write
+ *
+ * @attribute name Region name
+ * @attribute base First address
+ * @attribute span Number of addresses cycled through
+ */
+typedef struct {
+    const char *name;
+    uint16_t base;
+    uint16_t span;
+} bench_region_t;
+
+/*
+ * @brief Opcode class programs, avoiding handlers that desync the program
+ * counter today (ADC, indexed indirect, JSR / RTS)
+ */
+static const uint8_t _load_store[] = {
+    0xA9, 0x12,             // LDA #$12
+    0x85, 0x10,             // STA $10
+    0xA5, 0x10,             // LDA $10
+    0x8D, 0x00, 0x02,       // STA $0200
+    0xAD, 0x00, 0x02,       // LDA $0200
+    0xA2, 0x04,             // LDX #$04
+    0xB5, 0x10,             // LDA $10,X
+    0x9D, 0x00, 0x03,       // STA $0300,X
+};
+static const uint8_t _alu[] = {
+    0x29, 0x5A,             // AND #$5A
+    0x09, 0x81,             // ORA #$81
+    0x49, 0xFF,             // EOR #$FF
+    0xC9, 0x40,             // CMP #$40
+    0x25, 0x10,             // AND $10
+    0x05, 0x11,             // ORA $11
+    0x45, 0x12,             // EOR $12
+};
+static const uint8_t _rmw[] = {
+    0xE6, 0x10,             // INC $10
+    0x06, 0x11,             // ASL $11
+    0x66, 0x12,             // ROR $12
+    0xC6, 0x13,             // DEC $13
+    0xEE, 0x00, 0x02,       // INC $0200
+    0x4A,                   // LSR A
+};
+static const uint8_t _branch[] = {
+    0xD0, 0x00,             // BNE +0
+    0xF0, 0x00,             // BEQ +0
+    0x90, 0x00,             // BCC +0
+    0x10, 0x00,             // BPL +0
+};
+static const uint8_t _stack[] = {
+    0x48,                   // PHA
+    0x08,                   // PHP
+    0x68,                   // PLA
+    0x28,                   // PLP
+    0xBA,                   // TSX
+    0x9A,                   // TXS
+};
+static const uint8_t _implied[] = {
+    0xE8,                   // INX
+    0xC8,                   // INY
+    0xCA,                   // DEX
+    0xAA,                   // TAX
+    0x8A,                   // TXA
+    0x18,                   // CLC
+    0x38,                   // SEC
+    0xEA,                   // NOP
+};
+static const uint8_t _jump[] = {
+    0x4C, 0x03, 0x80,       // JMP $8003, patched to the next instruction
+};
+
+/*
+ * @brief Frame programs, closer to what a game main loop does
+ */
+static const uint8_t _clear_ram[] = {
+    0xA9, 0x00,             // LDA #$00
+    0x9D, 0x00, 0x02,       // STA $0200,X
+    0x9D, 0x00, 0x03,       // STA $0300,X
+    0xE8,                   // INX
+    0xD0, 0x00,             // BNE +0
+};
+static const uint8_t _game_loop[] = {
+    0xA5, 0x20,             // LDA $20
+    0x29, 0x0F,             // AND #$0F
+    0xAA,                   // TAX
+    0xBD, 0x00, 0x80,       // LDA $8000,X
+    0x85, 0x21,             // STA $21
+    0xE6, 0x20,             // INC $20
+    0xAD, 0x02, 0x20,       // LDA $2002
+    0x8D, 0x16, 0x40,       // STA $4016
+    0xAD, 0x00, 0x60,       // LDA $6000
+    0x48,                   // PHA
+    0x68,                   // PLA
+};
+
+static const bench_program_t _step_programs[] = {
+    { "load_store", _load_store, sizeof(_load_store) },
+    { "alu", _alu, sizeof(_alu) },
+    { "rmw", _rmw, sizeof(_rmw) },
+    { "branch", _branch, sizeof(_branch) },
+    { "stack", _stack, sizeof(_stack) },
+    { "implied", _implied, sizeof(_implied) },
+    { "jump", _jump, sizeof(_jump) },
+};
+
+static const bench_program_t _frame_programs[] = {
+    { "clear_ram", _clear_ram, sizeof(_clear_ram) },
+    { "game_loop", _game_loop, sizeof(_game_loop) },
+};
+
+static const bench_region_t _regions[] = {
+    { "ram", MEMORY_RAM_BASE, MEMORY_RAM_SIZE },
+    { "ram_mirror", MEMORY_RAM_BASE + MEMORY_RAM_SIZE, MEMORY_RAM_MIRROR_SIZE },
+    { "ppu", MEMORY_PPU_REG_BASE, MEMORY_PPU_REG_SIZE + MEMORY_PPU_REG_MIRROR_SIZE },
+    { "apu_io", MEMORY_APU_IO_REG_BASE, MEMORY_APU_IO_REG_SIZE },
+    { "cartridge_ram", CARTRIDGE_NROM_RAM_START, CARTRIDGE_NROM_RAM_SIZE },
+    { "cartridge_rom", CARTRIDGE_NROM_ROM_START, CARTRIDGE_NROM_ROM_SIZE },
+};
+
+static volatile uint8_t _sink;
+static nes_t *_nes;
+static FILE *_out;
+static int _results;
+
+static double _bench_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * @brief Build a ROM that loops over a program body forever
+ */
+static void _bench_rom(const bench_program_t *program, uint8_t *rom) {
+    uint8_t *prg = rom + CARTRIDGE_INES_HEADER_SIZE;
+    size_t pos = 0;
+    const size_t limit = CARTRIDGE_NROM_ROM_SIZE - 6 - 3;
+
+    memset(rom, 0, BENCH_ROM_SIZE);
+    memcpy(rom, CARTRIDGE_INES_MAGIC, 4);
+    rom[4] = CARTRIDGE_NROM_ROM_SIZE / CARTRIDGE_INES_PRG_BANK_SIZE;
+
+    while (pos + program->size <= limit) {
+        memcpy(prg + pos, program->body, program->size);
+        if (program->body == _jump) {
+            uint16_t next = BENCH_CODE_START + pos + program->size;
+            prg[pos + 1] = next & 0xFF;
+            prg[pos + 2] = next >> 8;
+        }
+        pos += program->size;
+    }
+
+    prg[pos] = 0x4C;
+    prg[pos + 1] = BENCH_CODE_START & 0xFF;
+    prg[pos + 2] = BENCH_CODE_START >> 8;
+
+    /* NMI, reset and IRQ vectors */
+    for (int i = 0; i < 3; i++) {
+        prg[CARTRIDGE_NROM_ROM_SIZE - 6 + 2 * i] = BENCH_CODE_START & 0xFF;
+        prg[CARTRIDGE_NROM_ROM_SIZE - 5 + 2 * i] = BENCH_CODE_START >> 8;
+    }
+}
+
+static void _bench_result(const char *group, const char *name,
+        double seconds, double ops, const char *unit) {
+    double ns = seconds * 1e9 / ops;
+
+    fprintf(_out, "%s\n    { \"group\": \"%s\", \"name\": \"%s\", "
+        "\"ns_per_op\": %.3f, \"%s_per_sec\": %.0f, \"ops\": %.0f }",
+        _results++ ? "," : "", group, name, ns, unit, ops / seconds, ops);
+    fprintf(stderr, "%-10s %-20s %12.3f ns/op %14.0f %s/s\n",
+        group, name, ns, ops / seconds, unit);
+}
+
+static void _bench_cpu_step(long steps) {
+    static uint8_t rom[BENCH_ROM_SIZE];
+
+    for (size_t i = 0; i < sizeof(_step_programs) / sizeof(_step_programs[0]); i++) {
+        _bench_rom(&_step_programs[i], rom);
+        nes_load_rom(_nes, rom, sizeof(rom));
+
+        double start = _bench_now();
+        for (long n = 0; n < steps; n++) {
+            cpu_step();
+        }
+        _bench_result("cpu_step", _step_programs[i].name,
+            _bench_now() - start, steps, "instructions");
+    }
+}
+
+static void _bench_memory(long accesses) {
+    char name[32];
+
+    for (size_t i = 0; i < sizeof(_regions) / sizeof(_regions[0]); i++) {
+        const bench_region_t *region = &_regions[i];
+        uint8_t sum = 0;
+
+        double start = _bench_now();
+        for (long n = 0; n < accesses; n++) {
+            sum += memory_read(region->base + n % region->span);
+        }
+        _sink = sum;
+        snprintf(name, sizeof(name), "read_%s", region->name);
+        _bench_result("memory", name, _bench_now() - start, accesses, "accesses");
+
+        start = _bench_now();
+        for (long n = 0; n < accesses; n++) {
+            memory_write(region->base + n % region->span, n);
+        }
+        snprintf(name, sizeof(name), "write_%s", region->name);
+        _bench_result("memory", name, _bench_now() - start, accesses, "accesses");
+    }
+}
+
+static void _bench_cartridge(long accesses) {
+    uint8_t sum = 0;
+
+    double start = _bench_now();
+    for (long n = 0; n < accesses; n++) {
+        sum += cartridge_read(CARTRIDGE_NROM_ROM_START + n % CARTRIDGE_NROM_ROM_SIZE);
+    }
+    _sink = sum;
+    _bench_result("cartridge", "nrom_read_rom", _bench_now() - start, accesses, "accesses");
+
+    start = _bench_now();
+    for (long n = 0; n < accesses; n++) {
+        sum += cartridge_read(CARTRIDGE_NROM_RAM_START + n % CARTRIDGE_NROM_RAM_SIZE);
+    }
+    _sink = sum;
+    _bench_result("cartridge", "nrom_read_ram", _bench_now() - start, accesses, "accesses");
+
+    start = _bench_now();
+    for (long n = 0; n < accesses; n++) {
+        cartridge_write(CARTRIDGE_NROM_RAM_START + n % CARTRIDGE_NROM_RAM_SIZE, n);
+    }
+    _bench_result("cartridge", "nrom_write_ram", _bench_now() - start, accesses, "accesses");
+}
+
+static void _bench_frames(long frames) {
+    static uint8_t rom[BENCH_ROM_SIZE];
+
+    for (size_t i = 0; i < sizeof(_frame_programs) / sizeof(_frame_programs[0]); i++) {
+        _bench_rom(&_frame_programs[i], rom);
+        nes_load_rom(_nes, rom, sizeof(rom));
+
+        double start = _bench_now();
+        for (long n = 0; n < frames; n++) {
+            nes_step_frames(_nes, 1);
+        }
+        _bench_result("frame", _frame_programs[i].name,
+            _bench_now() - start, frames, "frames");
+    }
+}
+
+/*
+ * @brief Frames with run-ahead, and the save and rollback part of their
+ * cost
+ */
+static void _bench_run_ahead(long frames) {
+    static uint8_t rom[BENCH_ROM_SIZE];
+    nes_run_ahead_stats_t stats;
+    char name[32];
+
+    _bench_rom(&_frame_programs[1], rom);
+
+    for (uint32_t ahead = 1; ahead <= 2; ahead++) {
+        nes_load_rom(_nes, rom, sizeof(rom));
+        if (nes_set_run_ahead(_nes, ahead) != 0) {
+            return;
+        }
+
+        double start = _bench_now();
+        for (long n = 0; n < frames; n++) {
+            nes_step_frames(_nes, 1);
+        }
+        snprintf(name, sizeof(name), "game_loop_ahead_%u", ahead);
+        _bench_result("frame", name, _bench_now() - start, frames, "frames");
+
+        nes_get_run_ahead_stats(_nes, &stats);
+        snprintf(name, sizeof(name), "save_load_ahead_%u", ahead);
+        _bench_result("run_ahead", name, (stats.save_ns + stats.load_ns) * 1e-9,
+            stats.frames, "frames");
+    }
+    nes_set_run_ahead(_nes, 0);
+}
+
+/*
+ * @brief One frame of every console per nes_step_frames_many call, as a
+ * host stepping a batch of environments would, with the consoles on the
+ * heap or in an arena
+ */
+static void _bench_batch(long frames, arena_t *arena) {
+    static uint8_t rom[BENCH_ROM_SIZE];
+    static uint8_t buttons[BENCH_BATCH_SIZE * CONTROLLER_PORTS];
+    nes_t *batch[BENCH_BATCH_SIZE];
+    size_t count = 0;
+
+    _bench_rom(&_frame_programs[1], rom);
+    while (count < BENCH_BATCH_SIZE &&
+            (batch[count] = arena ? nes_create_in(arena) : nes_create())) {
+        nes_load_rom(batch[count++], rom, sizeof(rom));
+    }
+
+    double start = _bench_now();
+    for (long n = 0; n < frames; n++) {
+        buttons[n % sizeof(buttons)] = n;
+        nes_step_frames_many(batch, count, 1, buttons);
+    }
+    _bench_result("frame", arena ? "game_loop_batch_arena" : "game_loop_batch",
+        _bench_now() - start, (double)frames * count, "frames");
+
+    while (count) {
+        nes_destroy(batch[--count]);
+    }
+}
+
+/*
+ * @brief Frames untraced, then traced in ring and in file mode, and the
+ * overhead of tracing. The file is /dev/null so the disk is left out.
+ */
+static void _bench_trace(long frames) {
+    static const char *names[] = { "game_loop_untraced", "game_loop_trace_ring",
+        "game_loop_trace_file" };
+    static uint8_t rom[BENCH_ROM_SIZE];
+    double seconds[3];
+
+    _bench_rom(&_frame_programs[1], rom);
+
+    for (uint32_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        nes_load_rom(_nes, rom, sizeof(rom));
+        if (i && trace_open("/dev/null", i == 1 ? TRACE_MODE_RING : TRACE_MODE_FILE,
+                TRACE_QUEUE_BLOCKS) != 0) {
+            return;
+        }
+
+        /* Closing waits for the writer, its share counts */
+        double start = _bench_now();
+        for (long n = 0; n < frames; n++) {
+            nes_step_frames(_nes, 1);
+        }
+        trace_close();
+        seconds[i] = _bench_now() - start;
+        _bench_result("trace", names[i], seconds[i], frames, "frames");
+    }
+
+    fprintf(stderr, "%-10s %-20s %11.1f%% ring %11.1f%% file\n", "trace", "overhead",
+        (seconds[1] / seconds[0] - 1) * 100, (seconds[2] / seconds[0] - 1) * 100);
+}
+
+/*
+ * @brief Fill PPU memory with a pattern through PPUADDR and PPUDATA
+ */
+static void _bench_ppu_fill(uint16_t address, uint32_t size, uint8_t step) {
+    memory_write(MEMORY_PPU_REG_BASE + PPU_REG_ADDR, address >> 8);
+    memory_write(MEMORY_PPU_REG_BASE + PPU_REG_ADDR, address & 0xFF);
+    for (uint32_t i = 0; i < size; i++) {
+        memory_write(MEMORY_PPU_REG_BASE + PPU_REG_DATA, i * step + (i >> 4));
+    }
+}
+
+/*
+ * @brief Drawing a frame of a full screen of tiles and 64 sprites: with
+ * nothing changed, with one nametable byte changed, and with the scroll
+ * changed so every line is drawn. Then whole frames with the scroll
+ * changed, drawn on the CPU thread and on a render thread.
+ */
+static void _bench_ppu(long frames) {
+    static const char *names[] = { "render_static", "render_one_row", "render_scroll" };
+    static uint8_t rom[BENCH_ROM_SIZE];
+    static uint8_t framebuffer[NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT];
+    uint8_t oam[PPU_OAM_SIZE];
+
+    _bench_rom(&_frame_programs[1], rom);
+    nes_load_rom(_nes, rom, sizeof(rom));
+
+    _bench_ppu_fill(0x0000, CHR_RAM_SIZE, 37);
+    _bench_ppu_fill(PPU_NAMETABLE_BASE, PPU_NAMETABLE_SIZE, 7);
+    _bench_ppu_fill(PPU_PALETTE_BASE, PPU_PALETTE_SIZE, 5);
+    for (uint32_t i = 0; i < PPU_OAM_SIZE; i++) {
+        oam[i] = i * 13;
+    }
+    ppu_dma(oam);
+    memory_write(MEMORY_PPU_REG_BASE + PPU_REG_MASK, PPU_MASK_BACKGROUND | PPU_MASK_SPRITES |
+        PPU_MASK_BACKGROUND_LEFT | PPU_MASK_SPRITES_LEFT);
+
+    for (uint32_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        double start = _bench_now();
+
+        for (long n = 0; n < frames; n++) {
+            if (i == 1) {
+                memory_write(MEMORY_PPU_REG_BASE + PPU_REG_ADDR, PPU_NAMETABLE_BASE >> 8);
+                memory_write(MEMORY_PPU_REG_BASE + PPU_REG_ADDR, n & 0xFF);
+                memory_write(MEMORY_PPU_REG_BASE + PPU_REG_DATA, n);
+
+                /* PPUADDR went through the scroll, put it back as games do */
+                memory_write(MEMORY_PPU_REG_BASE + PPU_REG_CTRL, 0);
+                memory_write(MEMORY_PPU_REG_BASE + PPU_REG_SCROLL, 0);
+                memory_write(MEMORY_PPU_REG_BASE + PPU_REG_SCROLL, 0);
+            } else if (i == 2) {
+                memory_write(MEMORY_PPU_REG_BASE + PPU_REG_SCROLL, n);
+                memory_write(MEMORY_PPU_REG_BASE + PPU_REG_SCROLL, 0);
+            }
+            ppu_prerender();
+            ppu_render(framebuffer);
+        }
+        _sink = framebuffer[frames % sizeof(framebuffer)];
+        _bench_result("ppu", names[i], _bench_now() - start, frames, "frames");
+    }
+
+    for (uint8_t thread = 0; thread <= 1; thread++) {
+        double start;
+
+        if (nes_set_render_thread(_nes, thread) != 0) {
+            break;
+        }
+        start = _bench_now();
+        for (long n = 0; n < frames; n++) {
+            memory_write(MEMORY_PPU_REG_BASE + PPU_REG_SCROLL, n);
+            memory_write(MEMORY_PPU_REG_BASE + PPU_REG_SCROLL, 0);
+            nes_step_frames(_nes, 1);
+        }
+        _sink = nes_get_framebuffer(_nes)[frames % sizeof(framebuffer)];
+        _bench_result("ppu", thread ? "frame_scroll_thread" : "frame_scroll",
+            _bench_now() - start, frames, "frames");
+    }
+    nes_set_render_thread(_nes, 0);
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    double scale = 1.0;
+    arena_t *arena;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            scale = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [-o output.json] [-s scale]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    _out = path ? fopen(path, "w") : stdout;
+    if (!_out || scale <= 0) {
+        fprintf(stderr, "%s: cannot open output\n", path ? path : "-");
+        return 1;
+    }
+
+    if (!(_nes = nes_create())) {
+        return 1;
+    }
+
+    fprintf(_out, "{\n  \"version\": 1,\n  \"compiler\": \"%s\",\n  \"results\": [",
+        __VERSION__);
+
+    _bench_cpu_step(5000000 * scale);
+    _bench_memory(20000000 * scale);
+    _bench_cartridge(20000000 * scale);
+    _bench_frames(600 * scale);
+    _bench_batch(600 / BENCH_BATCH_SIZE * scale, NULL);
+    if ((arena = nes_arena_create(BENCH_BATCH_SIZE))) {
+        _bench_batch(600 / BENCH_BATCH_SIZE * scale, arena);
+        nes_arena_destroy(arena);
+    }
+    _bench_run_ahead(300 * scale);
+    _bench_trace(300 * scale);
+    _bench_ppu(3000 * scale);
+
+    fprintf(_out, "\n  ]\n}\n");
+
+    if (path) {
+        fclose(_out);
+    }
+    nes_destroy(_nes);
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "codemap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * @brief Frames run to check a map
+ */
+#define _CODEMAP_FRAMES 600U
+
+static uint8_t *_codemap_read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    uint8_t *data = NULL;
+    long length;
+
+    if (!file) {
+        return NULL;
+    }
+
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) > 0 &&
+            fseek(file, 0, SEEK_SET) == 0 && (data = malloc(length))) {
+        if (fread(data, 1, length, file) == (size_t)length) {
+            *size = length;
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    fclose(file);
+    return data;
+}
+
+/*
+ * @brief Run a console for _CODEMAP_FRAMES frames from a state
+ *
+ * @return Seconds taken, the fingerprint in fingerprint
+ */
+static double _codemap_run(nes_t *nes, const nes_state_t *state, const codemap_t *map,
+        uint64_t *fingerprint) {
+    struct timespec start, end;
+
+    nes_load_state(nes, state);
+    nes_set_decoded(nes, NULL);
+    if (map) {
+        codemap_attach(map, nes);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    nes_step_frames(nes, _CODEMAP_FRAMES);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    *fingerprint = nes_fingerprint(nes);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+/*
+ * @brief Analyze a ROM and write its code map, or check a code map by
+ * running the ROM with and without it
+ */
+int main(int argc, char **argv) {
+    int check = argc == 4 && strcmp(argv[1], "-c") == 0;
+    const char *rom_path = argv[1 + check], *path = argv[2 + check];
+    codemap_t *map = malloc(sizeof(codemap_t));
+    nes_t *nes = nes_create();
+    nes_state_t *state = NULL;
+    uint8_t *rom = NULL, *data = NULL;
+    size_t rom_size, size;
+    int status = 0;
+
+    if (argc != 3 + check) {
+        fprintf(stderr, "usage: %s [-c] <rom> <code map>\n", argv[0]);
+        free(map);
+        nes_destroy(nes);
+        return 1;
+    }
+
+    if (!map || !nes || !(rom = _codemap_read_file(rom_path, &rom_size)) ||
+            nes_load_rom(nes, rom, rom_size) != 0) {
+        fprintf(stderr, "%s: cannot load\n", rom_path);
+        status = 2;
+    } else if (!check) {
+        codemap_analyze(map, nes);
+        if (codemap_save(map, path) != 0) {
+            fprintf(stderr, "%s: write failed\n", path);
+            status = 2;
+        }
+    } else if (!(data = _codemap_read_file(path, &size)) ||
+            codemap_load(map, nes, data, size) != 0) {
+        fprintf(stderr, "%s: invalid code map or wrong ROM\n", path);
+        status = 2;
+    }
+
+    if (status == 0) {
+        printf("%u code bytes, %u instructions, %u entries, %u jump tables, "
+            "%u table entries, %u bank switches\n", map->stats.code,
+            map->stats.instructions, map->stats.entries, map->stats.jump_tables,
+            map->stats.table_entries, map->stats.bank_switches);
+    }
+
+    if (status == 0 && check && (state = malloc(sizeof(nes_state_t)))) {
+        uint64_t plain, decoded;
+        double plain_seconds, decoded_seconds;
+
+        nes_save_state(nes, state);
+        plain_seconds = _codemap_run(nes, state, NULL, &plain);
+        decoded_seconds = _codemap_run(nes, state, map, &decoded);
+
+        printf("%.0f frames/s plain, %.0f frames/s pre-decoded, %s\n",
+            _CODEMAP_FRAMES / plain_seconds, _CODEMAP_FRAMES / decoded_seconds,
+            plain == decoded ? "same fingerprint" : "fingerprint differs");
+        status = plain == decoded ? 0 : 1;
+    }
+
+    free(state);
+    free(data);
+    free(rom);
+    free(map);
+    nes_destroy(nes);
+    return status;
+}
@@ -0,0 +1,451 @@
+#include "cartridge.h"
+#include "cpu.h"
+#include "hash.h"
+#include "memory.h"
+#include "nes.h"
+#include "trace.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * @brief nestest automation mode entry point and initial state
+ */
+#define CONFORM_NESTEST_PC 0xC000U
+#define CONFORM_NESTEST_SP 0xFDU
+#define CONFORM_NESTEST_FLAGS 0x24U
+#define CONFORM_NESTEST_CYCLES 7U
+
+/*
+ * @brief blargg test ROM status protocol, text output starts at $6004
+ */
+#define CONFORM_BLARGG_STATUS 0x6000U
+#define CONFORM_BLARGG_SIGNATURE 0x6001U
+#define CONFORM_BLARGG_TEXT 0x6004U
+#define CONFORM_BLARGG_RUNNING 0x80U
+#define CONFORM_BLARGG_RESET 0x81U
+#define CONFORM_BLARGG_TEXT_SIZE 0x1000U
+#define CONFORM_BLARGG_FRAMES 60U * 60U
+
+/*
+ * @brief Frames run by the self checks when none are given
+ */
+#define CONFORM_CHECK_FRAMES 300U
+
+/*
+ * @brief State from one golden log line
+ */
+typedef struct {
+    uint16_t pc;
+    unsigned a;
+    unsigned x;
+    unsigned y;
+    unsigned flags;
+    unsigned sp;
+    uint64_t cycles;
+    int has_cycles;
+} conform_state_t;
+
+static uint8_t *_conform_read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    uint8_t *data = NULL;
+    long length;
+
+    if (!file) {
+        return NULL;
+    }
+
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) > 0 &&
+            fseek(file, 0, SEEK_SET) == 0 && (data = malloc(length))) {
+        if (fread(data, 1, length, file) == (size_t)length) {
+            *size = length;
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    fclose(file);
+    return data;
+}
+
+static int _conform_load(nes_t *nes, const char *path) {
+    size_t size;
+    uint8_t *rom = _conform_read_file(path, &size);
+    int status;
+
+    if (!rom) {
+        fprintf(stderr, "%s: cannot read\n", path);
+        return -1;
+    }
+
+    status = nes_load_rom(nes, rom, size);
+    free(rom);
+
+    if (status != 0) {
+        fprintf(stderr, "%s: invalid image or unsupported mapper\n", path);
+    }
+    return status;
+}
+
+/*
+ * @brief Describe the instruction the CPU is about to execute
+ */
+static void _conform_record(trace_record_t *record) {
+    cpu_t cpu;
+
+    cpu_get_state(&cpu);
+
+    record->cycles = cpu.cycles;
+    record->pc = cpu.pc;
+    record->opcode = memory_read(cpu.pc);
+    record->size = cpu_get_instruction_size(record->opcode);
+    record->operands[0] = memory_read(cpu.pc + 1);
+    record->operands[1] = memory_read(cpu.pc + 2);
+    record->a = cpu.a;
+    record->x = cpu.x;
+    record->y = cpu.y;
+    record->flags = cpu.flags;
+    record->sp = cpu.sp;
+}
+
+static int _conform_parse(const char *line, conform_state_t *state) {
+    const char *regs = strstr(line, "A:");
+    const char *cycles = strstr(line, "CYC:");
+
+    if (!regs || sscanf(line, "%4" SCNx16, &state->pc) != 1 ||
+            sscanf(regs, "A:%2x X:%2x Y:%2x P:%2x SP:%2x", &state->a,
+                &state->x, &state->y, &state->flags, &state->sp) != 5) {
+        return -1;
+    }
+
+    state->has_cycles = cycles &&
+        sscanf(cycles, "CYC:%" SCNu64, &state->cycles) == 1;
+    return 0;
+}
+
+/*
+ * @brief Step through nestest.nes in automation mode and compare every
+ * instruction with the golden log
+ */
+static int _conform_nestest(nes_t *nes, const char *rom, const char *log) {
+    char line[256];
+    char actual[128];
+    char previous[256] = "";
+    conform_state_t expected;
+    trace_record_t record;
+    unsigned long steps = 0;
+    FILE *file;
+    cpu_t cpu;
+
+    if (_conform_load(nes, rom) != 0) {
+        return 2;
+    }
+
+    if (!(file = fopen(log, "r"))) {
+        fprintf(stderr, "%s: cannot read\n", log);
+        return 2;
+    }
+
+    cpu_get_state(&cpu);
+    cpu.pc = CONFORM_NESTEST_PC;
+    cpu.sp = CONFORM_NESTEST_SP;
+    cpu.flags = CONFORM_NESTEST_FLAGS;
+    cpu.cycles = CONFORM_NESTEST_CYCLES;
+    cpu_set_state(&cpu);
+
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (_conform_parse(line, &expected) != 0) {
+            continue;
+        }
+
+        _conform_record(&record);
+
+        if (record.pc != expected.pc || record.a != expected.a ||
+                record.x != expected.x || record.y != expected.y ||
+                record.flags != expected.flags || record.sp != expected.sp ||
+                (expected.has_cycles && record.cycles != expected.cycles)) {
+            trace_format(&record, actual, sizeof(actual));
+            printf("nestest: diverged at step %lu\n", steps);
+            printf("previous: %s\n", previous);
+            printf("expected: %s\n", line);
+            printf("actual:   %s\n", actual);
+            fclose(file);
+            return 1;
+        }
+
+        strcpy(previous, line);
+        cpu_step();
+        steps++;
+    }
+
+    fclose(file);
+    printf("nestest: %lu steps match\n", steps);
+    return 0;
+}
+
+/*
+ * @brief Run a blargg test ROM headlessly until it reports a result
+ */
+static int _conform_blargg(nes_t *nes, const char *rom, unsigned long frames) {
+    char text[CONFORM_BLARGG_TEXT_SIZE];
+    uint8_t status = CONFORM_BLARGG_RUNNING;
+    int started = 0;
+
+    if (_conform_load(nes, rom) != 0) {
+        return 2;
+    }
+
+    for (unsigned long frame = 0; frame < frames; frame++) {
+        nes_step_frames(nes, 1);
+
+        if (memory_read(CONFORM_BLARGG_SIGNATURE) != 0xDE ||
+                memory_read(CONFORM_BLARGG_SIGNATURE + 1) != 0xB0 ||
+                memory_read(CONFORM_BLARGG_SIGNATURE + 2) != 0x61) {
+            continue;
+        }
+
+        status = memory_read(CONFORM_BLARGG_STATUS);
+        if (status == CONFORM_BLARGG_RUNNING) {
+            started = 1;
+        } else if (status == CONFORM_BLARGG_RESET) {
+            nes_reset(nes);
+        } else if (started) {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(text) - 1; i++) {
+        text[i] = memory_read(CONFORM_BLARGG_TEXT + i);
+        if (!text[i]) {
+            break;
+        }
+    }
+    text[sizeof(text) - 1] = '\0';
+
+    if (!started || status >= CONFORM_BLARGG_RUNNING) {
+        printf("%s: no result after %lu frames\n", rom, frames);
+        return 1;
+    }
+
+    printf("%s: %s (status %u)\n%s\n", rom, status ? "failed" : "passed",
+        status, text);
+    return status ? 1 : 0;
+}
+
+/*
+ * @brief Run a ROM and check after every frame that the RAM hashes kept up
+ * to date on each write equal a full recompute
+ */
+static int _conform_hash(nes_t *nes, const char *rom, unsigned long frames) {
+    nes_state_t *state = malloc(sizeof(nes_state_t));
+    uint64_t ram_hash, cartridge_hash;
+    size_t size;
+    int result = 0;
+
+    if (!state) {
+        return 2;
+    }
+    if (_conform_load(nes, rom) != 0) {
+        free(state);
+        return 2;
+    }
+
+    for (unsigned long frame = 0; frame < frames; frame++) {
+        nes_step_frames(nes, 1);
+        nes_save_state(nes, state);
+        cartridge_get_ram(&size);
+
+        ram_hash = hash_memory(HASH_DOMAIN_RAM, state->memory.ram, MEMORY_RAM_SIZE);
+        cartridge_hash = hash_memory(HASH_DOMAIN_CARTRIDGE_RAM,
+            state->cartridge_ram, size);
+
+        if (state->memory.hash != ram_hash ||
+                state->cartridge_ram_hash != cartridge_hash) {
+            printf("hash: %s hash diverged at frame %lu: %016" PRIx64
+                " kept, %016" PRIx64 " recomputed\n",
+                state->memory.hash != ram_hash ? "RAM" : "cartridge RAM", frame,
+                state->memory.hash != ram_hash ? state->memory.hash :
+                    state->cartridge_ram_hash,
+                state->memory.hash != ram_hash ? ram_hash : cartridge_hash);
+            result = 1;
+            break;
+        }
+    }
+
+    if (!result) {
+        printf("hash: %lu frames match\n", frames);
+    }
+    free(state);
+    return result;
+}
+
+/*
+ * @brief Run a ROM on two consoles, one drawing on its render thread, and
+ * check after every frame that both pictures are the same
+ */
+static int _conform_render(nes_t *nes, const char *rom, unsigned long frames) {
+    const uint8_t *expected, *actual;
+    nes_t *threaded = nes_create();
+    size_t pixel;
+    int result = 0;
+
+    if (!threaded) {
+        return 2;
+    }
+    if (_conform_load(nes, rom) != 0 || _conform_load(threaded, rom) != 0) {
+        nes_destroy(threaded);
+        return 2;
+    }
+    if (nes_set_render_thread(threaded, 1) != 0) {
+        fprintf(stderr, "render: cannot start the render thread\n");
+        nes_destroy(threaded);
+        return 2;
+    }
+
+    for (unsigned long frame = 0; frame < frames; frame++) {
+        nes_step_frames(nes, 1);
+        nes_step_frames(threaded, 1);
+
+        expected = nes_get_framebuffer(nes);
+        actual = nes_get_framebuffer(threaded);
+        if (memcmp(expected, actual, NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT) != 0) {
+            for (pixel = 0; expected[pixel] == actual[pixel]; pixel++) {
+            }
+            printf("render: diverged at frame %lu, pixel (%zu, %zu): %02x "
+                "synchronous, %02x threaded\n", frame, pixel % NES_SCREEN_WIDTH,
+                pixel / NES_SCREEN_WIDTH, expected[pixel], actual[pixel]);
+            result = 1;
+            break;
+        }
+    }
+
+    if (!result) {
+        printf("render: %lu frames match\n", frames);
+    }
+    nes_destroy(threaded);
+    return result;
+}
+
+/*
+ * @brief Compare two execution traces, for instance from two cores or two
+ * builds, and report the first state where they diverge
+ */
+static int _conform_diff(const char *path_a, const char *path_b) {
+    trace_reader_t a, b;
+    trace_record_t ra, rb;
+    char line_a[128], line_b[128];
+    unsigned long steps = 0;
+    int status_a, status_b;
+    int result = 0;
+
+    if (trace_reader_open(&a, path_a) != 0) {
+        fprintf(stderr, "%s: not a trace file\n", path_a);
+        return 2;
+    }
+    if (trace_reader_open(&b, path_b) != 0) {
+        fprintf(stderr, "%s: not a trace file\n", path_b);
+        trace_reader_close(&a);
+        return 2;
+    }
+
+    for (;; steps++) {
+        status_a = trace_reader_next(&a, &ra);
+        status_b = trace_reader_next(&b, &rb);
+
+        if (status_a < 0 || status_b < 0) {
+            fprintf(stderr, "%s: corrupted trace\n", status_a < 0 ? path_a : path_b);
+            result = 2;
+            break;
+        }
+        if (status_a == 0 || status_b == 0) {
+            if (status_a != status_b) {
+                printf("diff: %s ends at step %lu\n",
+                    status_a ? path_b : path_a, steps);
+                result = 1;
+            } else {
+                printf("diff: %lu steps match\n", steps);
+            }
+            break;
+        }
+
+        if (ra.pc != rb.pc || ra.opcode != rb.opcode || ra.a != rb.a ||
+                ra.x != rb.x || ra.y != rb.y || ra.flags != rb.flags ||
+                ra.sp != rb.sp || ra.cycles != rb.cycles) {
+            trace_format(&ra, line_a, sizeof(line_a));
+            trace_format(&rb, line_b, sizeof(line_b));
+            printf("diff: diverged at step %lu\n%s\n%s\n", steps, line_a, line_b);
+            result = 1;
+            break;
+        }
+    }
+
+    trace_reader_close(&a);
+    trace_reader_close(&b);
+    return result;
+}
+
+static void _conform_usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [-t trace] nestest <nestest.nes> <nestest.log>\n"
+        "       %s [-t trace] blargg <rom> [frames]\n"
+        "       %s [-t trace] hash <rom> [frames]\n"
+        "       %s [-t trace] render <rom> [frames]\n"
+        "       %s diff <trace a> <trace b>\n", name, name, name, name, name);
+}
+
+int main(int argc, char **argv) {
+    const char *trace = NULL;
+    nes_t *nes = NULL;
+    int arg = 1;
+    int result;
+
+    if (argc > 2 && strcmp(argv[1], "-t") == 0) {
+        trace = argv[2];
+        arg = 3;
+    }
+
+    if (argc - arg < 2) {
+        _conform_usage(argv[0]);
+        return 2;
+    }
+
+    if (strcmp(argv[arg], "diff") != 0 && !(nes = nes_create())) {
+        return 2;
+    }
+
+    /* The trace follows the console bound when it is opened */
+    if (trace && nes) {
+        nes_bind(nes);
+        if (trace_open(trace, TRACE_MODE_FILE, 0) != 0) {
+            fprintf(stderr, "%s: cannot open trace\n", trace);
+            nes_destroy(nes);
+            return 2;
+        }
+    }
+
+    if (strcmp(argv[arg], "nestest") == 0 && argc - arg == 3) {
+        result = _conform_nestest(nes, argv[arg + 1], argv[arg + 2]);
+    } else if (strcmp(argv[arg], "blargg") == 0 && argc - arg <= 3) {
+        result = _conform_blargg(nes, argv[arg + 1], argc - arg == 3 ?
+            strtoul(argv[arg + 2], NULL, 0) : CONFORM_BLARGG_FRAMES);
+    } else if (strcmp(argv[arg], "hash") == 0 && argc - arg <= 3) {
+        result = _conform_hash(nes, argv[arg + 1], argc - arg == 3 ?
+            strtoul(argv[arg + 2], NULL, 0) : CONFORM_CHECK_FRAMES);
+    } else if (strcmp(argv[arg], "render") == 0 && argc - arg <= 3) {
+        result = _conform_render(nes, argv[arg + 1], argc - arg == 3 ?
+            strtoul(argv[arg + 2], NULL, 0) : CONFORM_CHECK_FRAMES);
+    } else if (strcmp(argv[arg], "diff") == 0 && argc - arg == 3 && !trace) {
+        result = _conform_diff(argv[arg + 1], argv[arg + 2]);
+    } else {
+        _conform_usage(argv[0]);
+        result = 2;
+    }
+
+    trace_close();
+    nes_destroy(nes);
+    return result;
+}
@@ -0,0 +1,302 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "control.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * @brief Commands per request in the batched runs
+ */
+#define CONTROL_TOOL_BATCH 256U
+
+/*
+ * @brief Time spent on each benchmark
+ */
+#define CONTROL_TOOL_SECONDS 1.0
+
+static uint8_t *_control_read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    uint8_t *data = NULL;
+    long length;
+
+    if (!file) {
+        return NULL;
+    }
+
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) > 0 &&
+            fseek(file, 0, SEEK_SET) == 0 && (data = malloc(length))) {
+        if (fread(data, 1, length, file) == (size_t)length) {
+            *size = length;
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    fclose(file);
+    return data;
+}
+
+static double _control_seconds(const struct timespec *start) {
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+/*
+ * @brief Request being built
+ *
+ * @attribute data The request, header first
+ * @attribute size Bytes used
+ * @attribute capacity Bytes allocated
+ */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} control_request_t;
+
+static void _control_begin(control_request_t *request) {
+    control_header_t header = { .magic = CONTROL_MAGIC };
+
+    memcpy(request->data, &header, sizeof(header));
+    request->size = sizeof(header);
+}
+
+/*
+ * @brief Append a command and its payload
+ *
+ * @return 0 on success, -1 if it does not fit
+ */
+static int _control_add(control_request_t *request, control_op_e op, uint32_t first,
+        uint32_t count, uint32_t arg0, uint32_t arg1, const void *payload, uint32_t size) {
+    control_command_t command = { op, first, count, arg0, arg1, size };
+    control_header_t header;
+
+    if (request->capacity - request->size < sizeof(command) + size) {
+        return -1;
+    }
+    memcpy(request->data + request->size, &command, sizeof(command));
+    if (size) {
+        memcpy(request->data + request->size + sizeof(command), payload, size);
+    }
+    request->size += sizeof(command) + size;
+
+    memcpy(&header, request->data, sizeof(header));
+    header.commands++;
+    header.size = request->size - sizeof(header);
+    memcpy(request->data, &header, sizeof(header));
+    return 0;
+}
+
+/*
+ * @brief Check that every command of a reply succeeded
+ *
+ * @return Sum of the reply values, -1 if a command failed
+ */
+static long _control_check(const uint8_t *reply, long size) {
+    control_header_t header;
+    control_reply_t command;
+    long offset = sizeof(header), value = 0;
+
+    memcpy(&header, reply, sizeof(header));
+    for (uint32_t i = 0; i < header.commands; i++) {
+        if (size - offset < (long)sizeof(command)) {
+            return -1;
+        }
+        memcpy(&command, reply + offset, sizeof(command));
+        if (command.status != 0) {
+            return -1;
+        }
+        value += command.value;
+        offset += sizeof(command) + command.size;
+    }
+    return offset == size ? value : -1;
+}
+
+/*
+ * @brief Send the same request until the time is up
+ *
+ * @return Requests per second, 0 on failure
+ */
+static double _control_repeat(int fd, const control_request_t *request, uint8_t *reply,
+        size_t capacity) {
+    struct timespec start;
+    uint64_t calls = 0;
+    double seconds;
+    long size;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        if ((size = control_call(fd, request->data, request->size, reply, capacity)) < 0 ||
+                _control_check(reply, size) < 0) {
+            return 0;
+        }
+        calls++;
+    } while ((seconds = _control_seconds(&start)) < CONTROL_TOOL_SECONDS);
+
+    return calls / seconds;
+}
+
+/*
+ * @brief Compare one round trip per command against batched requests, on
+ * a server of its own
+ */
+static int _control_bench(const char *rom_path, uint32_t count) {
+    char path[64];
+    size_t size;
+    uint8_t *rom = _control_read_file(rom_path, &size);
+    nes_t **consoles = calloc(count, sizeof(nes_t *));
+    uint8_t *buttons = calloc(count, CONTROLLER_PORTS);
+    control_request_t request = { .capacity = CONTROL_TOOL_BATCH *
+        (sizeof(control_command_t) + count * CONTROLLER_PORTS) + sizeof(control_header_t) };
+    size_t capacity = sizeof(control_header_t) +
+        CONTROL_TOOL_BATCH * (sizeof(control_reply_t) + 16) + count * nes_state_size() * 2;
+    uint8_t *reply = malloc(capacity), *grown;
+    control_t *control = NULL;
+    double single, batched;
+    int fd = -1, status = 2;
+
+    request.data = malloc(request.capacity);
+    if (!rom || !consoles || !buttons || !reply || !request.data) {
+        fprintf(stderr, "%s: cannot load\n", rom_path);
+        goto done;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (!(consoles[i] = nes_create()) || nes_load_rom(consoles[i], rom, size) != 0) {
+            fprintf(stderr, "%s: cannot load\n", rom_path);
+            goto done;
+        }
+    }
+
+    snprintf(path, sizeof(path), "/tmp/nes-control-%ld.sock", (long)getpid());
+    if (!(control = control_create(path, consoles, count)) || (fd = control_connect(path)) < 0) {
+        fprintf(stderr, "%s: cannot serve\n", path);
+        goto done;
+    }
+
+    /* Protocol cost alone: a 16 byte RAM read */
+    _control_begin(&request);
+    _control_add(&request, CONTROL_READ, 0, 1, 0, 16, NULL, 0);
+    single = _control_repeat(fd, &request, reply, capacity);
+
+    _control_begin(&request);
+    for (uint32_t i = 0; i < CONTROL_TOOL_BATCH; i++) {
+        _control_add(&request, CONTROL_READ, i % count, 1, 0, 16, NULL, 0);
+    }
+    batched = _control_repeat(fd, &request, reply, capacity) * CONTROL_TOOL_BATCH;
+    printf("read    %10.0f commands/s alone %10.0f commands/s batched by %u\n",
+        single, batched, CONTROL_TOOL_BATCH);
+
+    /* Stepping every console a frame at a time, with new input each frame */
+    _control_begin(&request);
+    _control_add(&request, CONTROL_STEP, 0, count, 1, 0, buttons, count * CONTROLLER_PORTS);
+    single = _control_repeat(fd, &request, reply, capacity);
+
+    _control_begin(&request);
+    for (uint32_t i = 0; i < CONTROL_TOOL_BATCH; i++) {
+        _control_add(&request, CONTROL_STEP, 0, count, 1, 0, buttons, count * CONTROLLER_PORTS);
+    }
+    batched = _control_repeat(fd, &request, reply, capacity) * CONTROL_TOOL_BATCH;
+    printf("step    %10.0f commands/s alone %10.0f commands/s batched by %u (%u consoles)\n",
+        single, batched, CONTROL_TOOL_BATCH, count);
+
+    /* Saving then restoring every console, states travel both ways */
+    _control_begin(&request);
+    _control_add(&request, CONTROL_SAVE, 0, count, 0, 0, NULL, 0);
+    single = _control_repeat(fd, &request, reply, capacity);
+    printf("save    %10.0f commands/s (%u consoles, %zu bytes each)\n",
+        single, count, nes_state_size());
+
+    request.capacity += count * nes_state_size();
+    if (!(grown = realloc(request.data, request.capacity))) {
+        goto done;
+    }
+    request.data = grown;
+    _control_begin(&request);
+    _control_add(&request, CONTROL_LOAD, 0, count, 0, 0,
+        reply + sizeof(control_header_t) + sizeof(control_reply_t), count * nes_state_size());
+    single = _control_repeat(fd, &request, reply, capacity);
+    printf("load    %10.0f commands/s (%u consoles)\n", single, count);
+
+    status = 0;
+
+done:
+    if (fd >= 0) {
+        close(fd);
+    }
+    control_destroy(control);
+    for (uint32_t i = 0; consoles && i < count; i++) {
+        nes_destroy(consoles[i]);
+    }
+    free(request.data);
+    free(reply);
+    free(buttons);
+    free(consoles);
+    free(rom);
+    return status;
+}
+
+/*
+ * @brief Serve consoles until stdin is closed or a line is read
+ */
+static int _control_serve(const char *rom_path, const char *path, uint32_t count) {
+    size_t size;
+    uint8_t *rom = _control_read_file(rom_path, &size);
+    nes_t **consoles = calloc(count, sizeof(nes_t *));
+    control_t *control = NULL;
+    uint32_t loaded = 0;
+    int status = 2, c;
+
+    while (rom && consoles && loaded < count && (consoles[loaded] = nes_create()) &&
+            nes_load_rom(consoles[loaded], rom, size) == 0) {
+        loaded++;
+    }
+
+    if (loaded < count || !(control = control_create(path, consoles, count))) {
+        fprintf(stderr, "%s: cannot serve %s\n", path, rom_path);
+    } else {
+        fprintf(stderr, "serving %u consoles on %s, press enter to stop\n", count, path);
+        while ((c = getchar()) != EOF && c != '\n') {
+            /* Until a line or the end of the input */
+        }
+        status = 0;
+    }
+
+    control_destroy(control);
+    for (uint32_t i = 0; consoles && i < count; i++) {
+        nes_destroy(consoles[i]);
+    }
+    free(consoles);
+    free(rom);
+    return status;
+}
+
+/*
+ * @brief Serve consoles on a Unix domain socket, or measure the protocol
+ */
+int main(int argc, char **argv) {
+    uint32_t count;
+
+    if (argc >= 4 && argc <= 5 && strcmp(argv[1], "serve") == 0) {
+        count = argc == 5 ? strtoul(argv[4], NULL, 10) : 1;
+        if (count) {
+            return _control_serve(argv[2], argv[3], count);
+        }
+    }
+    if (argc >= 3 && argc <= 4 && strcmp(argv[1], "bench") == 0) {
+        count = argc == 4 ? strtoul(argv[3], NULL, 10) : 1;
+        if (count) {
+            return _control_bench(argv[2], count);
+        }
+    }
+
+    fprintf(stderr, "usage: %s serve <rom> <path> [consoles]\n"
+        "       %s bench <rom> [consoles]\n", argv[0], argv[0]);
+    return 1;
+}
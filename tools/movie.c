@@ -0,0 +1,142 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "movie.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint8_t *_movie_read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    uint8_t *data = NULL;
+    long length;
+
+    if (!file) {
+        return NULL;
+    }
+
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) > 0 &&
+            fseek(file, 0, SEEK_SET) == 0 && (data = malloc(length))) {
+        if (fread(data, 1, length, file) == (size_t)length) {
+            *size = length;
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    fclose(file);
+    return data;
+}
+
+/*
+ * @brief Record a movie from per-frame input read on stdin, one line of
+ * hexadecimal button masks per frame ("port1 [port2]")
+ */
+static int _movie_record(const char *rom_path, const char *path,
+        uint16_t interval) {
+    movie_recorder_t recorder;
+    nes_t *nes = nes_create();
+    uint8_t buttons[CONTROLLER_PORTS];
+    unsigned port1, port2;
+    char line[64];
+    size_t size;
+    uint8_t *rom = _movie_read_file(rom_path, &size);
+
+    if (!nes || !rom ||
+            movie_record_open(&recorder, nes, path, rom, size, interval) != 0) {
+        fprintf(stderr, "%s: cannot record %s\n", path, rom_path);
+        nes_destroy(nes);
+        free(rom);
+        return 2;
+    }
+
+    while (fgets(line, sizeof(line), stdin)) {
+        port2 = 0;
+        if (sscanf(line, "%x %x", &port1, &port2) < 1) {
+            continue;
+        }
+        buttons[0] = port1;
+        buttons[1] = port2;
+        movie_record_frame(&recorder, buttons);
+    }
+
+    free(rom);
+    nes_destroy(nes);
+
+    if (movie_record_close(&recorder) != 0) {
+        fprintf(stderr, "%s: write failed\n", path);
+        return 2;
+    }
+    return 0;
+}
+
+/*
+ * @brief Replay movies and verify their checkpoints
+ */
+static int _movie_play(const char *rom_path, char **paths, int count) {
+    struct timespec start, end;
+    movie_result_t result;
+    uint64_t frames = 0;
+    int failed = 0;
+    size_t rom_size, size;
+    uint8_t *rom = _movie_read_file(rom_path, &rom_size);
+    nes_t *nes = nes_create();
+
+    if (!rom || !nes) {
+        fprintf(stderr, "%s: cannot read\n", rom_path);
+        nes_destroy(nes);
+        free(rom);
+        return 2;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < count; i++) {
+        uint8_t *movie = _movie_read_file(paths[i], &size);
+        int status = movie ? movie_play(nes, movie, size, rom, rom_size, &result) : -1;
+
+        free(movie);
+        frames += result.frames;
+
+        if (status < 0) {
+            printf("%s: invalid movie or wrong ROM\n", paths[i]);
+            failed++;
+        } else if (status == 2) {
+            printf("%s: stopped by a hit at frame %u\n", paths[i], result.frames);
+            failed++;
+        } else if (status > 0) {
+            printf("%s: desync at frame %u\n", paths[i], result.failed_frame);
+            failed++;
+        } else if (count == 1) {
+            printf("%s: %u frames, %u checkpoints ok\n", paths[i],
+                result.frames, result.checkpoints);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+    fprintf(stderr, "%d movies, %d failed, %.0f frames/s, %.0f movies/min\n",
+        count, failed, frames / seconds, count * 60.0 / seconds);
+
+    nes_destroy(nes);
+    free(rom);
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 4 && argc <= 5 && strcmp(argv[1], "record") == 0) {
+        return _movie_record(argv[2], argv[3], argc == 5 ?
+            strtoul(argv[4], NULL, 0) : MOVIE_DEFAULT_INTERVAL);
+    }
+    if (argc >= 4 && strcmp(argv[1], "play") == 0) {
+        return _movie_play(argv[2], &argv[3], argc - 3);
+    }
+
+    fprintf(stderr,
+        "usage: %s record <rom> <movie> [interval] < inputs\n"
+        "       %s play <rom> <movie>...\n", argv[0], argv[0]);
+    return 2;
+}
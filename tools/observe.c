@@ -0,0 +1,125 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "observe.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint8_t *_observe_read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    uint8_t *data = NULL;
+    long length;
+
+    if (!file) {
+        return NULL;
+    }
+
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) > 0 &&
+            fseek(file, 0, SEEK_SET) == 0 && (data = malloc(length))) {
+        if (fread(data, 1, length, file) == (size_t)length) {
+            *size = length;
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    fclose(file);
+    return data;
+}
+
+static double _observe_seconds(const struct timespec *start) {
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+/*
+ * @brief Run a console as fast as possible, publishing every frame
+ */
+static int _observe_serve(const char *rom_path, const char *name, uint32_t frames) {
+    struct timespec start;
+    size_t size;
+    uint8_t *rom = _observe_read_file(rom_path, &size);
+    nes_t *nes = nes_create();
+    observe_channel_t *channel = NULL;
+
+    if (!rom || !nes || nes_load_rom(nes, rom, size) != 0 || !(channel = observe_create(name))) {
+        fprintf(stderr, "%s: cannot serve %s\n", name, rom_path);
+        nes_destroy(nes);
+        free(rom);
+        return 2;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < frames; i++) {
+        nes_step_frames(nes, 1);
+        observe_publish(channel, nes);
+    }
+    fprintf(stderr, "%u frames published, %.0f frames/s\n", frames,
+        frames / _observe_seconds(&start));
+
+    observe_destroy(channel);
+    nes_destroy(nes);
+    free(rom);
+    return 0;
+}
+
+/*
+ * @brief Wait for observations and print them, until the producer stays
+ * quiet for a second
+ */
+static int _observe_watch(const char *name) {
+    struct timespec start;
+    observe_channel_t *channel = observe_open(name);
+    observe_read_t read = { 0 };
+    uint64_t observations = 0, retries = 0;
+
+    if (!channel) {
+        fprintf(stderr, "%s: no channel\n", name);
+        return 2;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (observe_wait(channel, read.published, 1000) == 0) {
+        uint64_t frame = 0, fingerprint = 0;
+
+        /* Read in place, start over if the producer lapped us meanwhile */
+        while (observe_read_begin(channel, &read) == 0) {
+            frame = read.observation->frame;
+            fingerprint = read.observation->fingerprint;
+            if (observe_read_end(channel, &read) == 0) {
+                break;
+            }
+            retries++;
+        }
+
+        printf("%llu %016llx\n", (unsigned long long)frame, (unsigned long long)fingerprint);
+        observations++;
+    }
+
+    fprintf(stderr, "%llu observations, %llu retried reads, %.0f observations/s\n",
+        (unsigned long long)observations, (unsigned long long)retries,
+        observations / _observe_seconds(&start));
+    observe_close(channel);
+    return 0;
+}
+
+/*
+ * @brief Publish a console over shared memory, or consume a channel
+ */
+int main(int argc, char **argv) {
+    if (argc >= 4 && argc <= 5 && strcmp(argv[1], "serve") == 0) {
+        return _observe_serve(argv[2], argv[3], argc == 5 ? strtoul(argv[4], NULL, 10) : 600);
+    }
+    if (argc == 3 && strcmp(argv[1], "watch") == 0) {
+        return _observe_watch(argv[2]);
+    }
+
+    fprintf(stderr, "usage: %s serve <rom> <name> [frames]\n"
+        "       %s watch <name>\n", argv[0], argv[0]);
+    return 1;
+}
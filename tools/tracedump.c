@@ -0,0 +1,37 @@
+#include "trace.h"
+
+#include <stdio.h>
+
+/*
+ * @brief Decode a binary trace file to nestest style text on stdout
+ */
+int main(int argc, char **argv) {
+    trace_reader_t reader;
+    trace_record_t record;
+    char line[128];
+    int status;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <trace file>\n", argv[0]);
+        return 1;
+    }
+
+    if (trace_reader_open(&reader, argv[1]) != 0) {
+        fprintf(stderr, "%s: not a trace file\n", argv[1]);
+        return 1;
+    }
+
+    while ((status = trace_reader_next(&reader, &record)) > 0) {
+        trace_format(&record, line, sizeof(line));
+        puts(line);
+    }
+
+    trace_reader_close(&reader);
+
+    if (status < 0) {
+        fprintf(stderr, "%s: corrupted trace\n", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}